@@ -41,6 +41,7 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 #include <linux/sched.h>
 #include <linux/vmalloc.h>
 #include <linux/wait.h>
+#include <linux/poll.h>
 #include <linux/tracepoint.h>
 #include <linux/cpu.h>
 #include <linux/jiffies.h>
@@ -108,6 +109,9 @@ static int ppm_open(struct inode *inode, struct file *filp);
 static int ppm_release(struct inode *inode, struct file *filp);
 static long ppm_ioctl(struct file *f, unsigned int cmd, unsigned long arg);
 static int ppm_mmap(struct file *filp, struct vm_area_struct *vma);
+#ifdef PPM_HAS_POLL
+static unsigned int ppm_poll(struct file *filp, poll_table *wait);
+#endif
 static int record_event_consumer(struct ppm_consumer_t *consumer,
 	enum ppm_event_type event_type,
 	enum syscall_flags drop_flags,
@@ -151,6 +155,9 @@ static const struct file_operations g_ppm_fops = {
 	.open = ppm_open,
 	.release = ppm_release,
 	.mmap = ppm_mmap,
+#ifdef PPM_HAS_POLL
+	.poll = ppm_poll,
+#endif
 	.unlocked_ioctl = ppm_ioctl,
 	.owner = THIS_MODULE,
 };
@@ -393,6 +400,7 @@ static int ppm_open(struct inode *inode, struct file *filp)
 	consumer->do_dynamic_snaplen = false;
 	consumer->need_to_insert_drop_e = 0;
 	consumer->need_to_insert_drop_x = 0;
+	consumer->poll_watermark = 1;
 	bitmap_fill(g_events_mask, PPM_EVENT_MAX); /* Enable all syscall to be passed to userspace */
 	ring->info->head = 0;
 	ring->info->tail = 0;
@@ -935,6 +943,28 @@ cleanup_ioctl_procinfo:
 		ret = 0;
 		goto cleanup_ioctl;
 	}
+#ifdef PPM_HAS_POLL
+	/*
+	 * Without poll() support this falls in the default case, so that the
+	 * reader knows that it has to sleep instead
+	 */
+	case PPM_IOCTL_SET_POLL_WATERMARK:
+	{
+		u32 new_watermark = (u32)arg;
+
+		vpr_info("PPM_IOCTL_SET_POLL_WATERMARK, consumer %p\n", consumer_id);
+
+		if (new_watermark == 0 || new_watermark >= RING_BUF_SIZE) {
+			pr_err("invalid poll watermark %u\n", new_watermark);
+			ret = -EINVAL;
+			goto cleanup_ioctl;
+		}
+
+		consumer->poll_watermark = new_watermark;
+		ret = 0;
+		goto cleanup_ioctl;
+	}
+#endif
 	default:
 		ret = -ENOTTY;
 		goto cleanup_ioctl;
@@ -946,6 +976,74 @@ cleanup_ioctl_nolock:
 	return ret;
 }
 
+#ifdef PPM_HAS_POLL
+static void ppm_wakeup_reader(struct irq_work *work)
+{
+	struct ppm_ring_buffer_context *ring = container_of(work, struct ppm_ring_buffer_context, wakeup_work);
+
+	wake_up_interruptible(&ring->read_queue);
+}
+
+/*
+ * Readable once the ring holds poll_watermark bytes. The producer only
+ * checks reader_waiting after publishing the head, without a full barrier,
+ * so a wakeup can be missed; the reader bounds that with its poll()
+ * timeout.
+ */
+static unsigned int ppm_poll(struct file *filp, poll_table *wait)
+{
+	struct task_struct *consumer_id = filp->private_data;
+	struct ppm_consumer_t *consumer = NULL;
+	struct ppm_ring_buffer_context *ring;
+	unsigned int ret = 0;
+	u32 head;
+	u32 ttail;
+	u32 usedspace;
+#if LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 20)
+	int ring_no = iminor(filp->f_path.dentry->d_inode);
+#else
+	int ring_no = iminor(filp->f_dentry->d_inode);
+#endif
+
+	/*
+	 * Like the other file operations, hold the consumer mutex while using
+	 * the consumer, so that it can't be freed under us
+	 */
+	mutex_lock(&g_consumer_mutex);
+
+	consumer = ppm_find_consumer(consumer_id);
+	if (!consumer) {
+		ret = POLLERR;
+		goto cleanup_poll;
+	}
+
+	ring = per_cpu_ptr(consumer->ring_buffers, ring_no);
+	if (!ring || !ring->open) {
+		ret = POLLERR;
+		goto cleanup_poll;
+	}
+
+	poll_wait(filp, &ring->read_queue, wait);
+
+	ring->reader_waiting = 1;
+	smp_mb();
+
+	head = ring->info->head;
+	ttail = ring->info->tail;
+	usedspace = (head >= ttail) ? head - ttail : RING_BUF_SIZE + head - ttail;
+
+	if (usedspace >= consumer->poll_watermark) {
+		ring->reader_waiting = 0;
+		ret = POLLIN | POLLRDNORM;
+	}
+
+cleanup_poll:
+	mutex_unlock(&g_consumer_mutex);
+
+	return ret;
+}
+#endif
+
 static int ppm_mmap(struct file *filp, struct vm_area_struct *vma)
 {
 	int ret;
@@ -1574,6 +1672,18 @@ static int record_event_consumer(struct ppm_consumer_t *consumer,
 		ring_info->head = next;
 
 		++ring->nevents;
+
+#ifdef PPM_HAS_POLL
+		/*
+		 * The reader can't be woken up from here, the tracepoints can
+		 * run with the scheduler locks held
+		 */
+		if (unlikely(ring->reader_waiting) &&
+			usedspace + event_size >= consumer->poll_watermark) {
+			ring->reader_waiting = 0;
+			irq_work_queue(&ring->wakeup_work);
+		}
+#endif
 	} else {
 		if (cbres == PPM_SUCCESS) {
 			ASSERT(freespace < sizeof(struct ppm_evt_hdr) + args.arg_data_offset);
@@ -1842,6 +1952,11 @@ static int init_ring_buffer(struct ppm_ring_buffer_context *ring)
 	ring->info->n_context_switches = 0;
 	atomic_set(&ring->preempt_count, 0);
 	getnstimeofday(&ring->last_print_time);
+#ifdef PPM_HAS_POLL
+	init_waitqueue_head(&ring->read_queue);
+	init_irq_work(&ring->wakeup_work, ppm_wakeup_reader);
+	ring->reader_waiting = 0;
+#endif
 
 	pr_info("CPU buffer initialized, size=%d\n", RING_BUF_SIZE);
 
@@ -1859,6 +1974,11 @@ err_str_storage:
 
 static void free_ring_buffer(struct ppm_ring_buffer_context *ring)
 {
+#ifdef PPM_HAS_POLL
+	if (ring->info)
+		irq_work_sync(&ring->wakeup_work);
+#endif
+
 	if (ring->info)
 		vfree(ring->info);
 
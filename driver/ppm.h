@@ -28,6 +28,16 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 #include <linux/time.h>
+#include <linux/wait.h>
+
+/*
+ * poll() on the devices needs irq_work to wake the reader from the
+ * tracepoints, where the scheduler locks can be held
+ */
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(2, 6, 37))
+#define PPM_HAS_POLL
+#include <linux/irq_work.h>
+#endif
 
 /*
  * Global defines
@@ -78,6 +88,11 @@ struct ppm_ring_buffer_context {
 	u32 nevents;
 	atomic_t preempt_count;
 	char *str_storage;	/* String storage. Size is one page. */
+#ifdef PPM_HAS_POLL
+	wait_queue_head_t read_queue;	/* The reader blocked in poll() */
+	struct irq_work wakeup_work;	/* Wakes up read_queue outside of the tracepoint */
+	int reader_waiting;	/* Set by poll(), cleared when the wakeup is queued */
+#endif
 };
 
 struct ppm_consumer_t {
@@ -93,6 +108,7 @@ struct ppm_consumer_t {
 	u32 sampling_interval;
 	int is_dropping;
 	int dropping_mode;
+	u32 poll_watermark;	/* Bytes in a ring that make poll() return */
 	volatile int need_to_insert_drop_e;
 	volatile int need_to_insert_drop_x;
 	struct list_head node;
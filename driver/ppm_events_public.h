@@ -1264,6 +1264,7 @@ struct ppm_evt_hdr {
 #define PPM_IOCTL_ENABLE_SIGNAL_DELIVER _IO(PPM_IOCTL_MAGIC, 15)
 #define PPM_IOCTL_GET_PROCLIST _IO(PPM_IOCTL_MAGIC, 16)
 #define PPM_IOCTL_SET_TRACERS_CAPTURE _IO(PPM_IOCTL_MAGIC, 17)
+#define PPM_IOCTL_SET_POLL_WATERMARK _IO(PPM_IOCTL_MAGIC, 18)
 
 
 extern const struct ppm_name_value socket_families[];
@@ -0,0 +1,225 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures how fast scap_next() and scap_next_batch() merge events coming from
+// a growing number of cpus. The per-cpu rings are synthetic and live in process
+// memory, so no driver is needed.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <scap.h>
+#include "../../../../driver/ppm_events_public.h"
+#include "../../../../driver/ppm_ringbuffer.h"
+
+#define RING_DATA_SIZE (1024 * 1024)
+#define EVT_SIZE (sizeof(struct ppm_evt_hdr) + 2 * sizeof(uint16_t) + 2 * sizeof(uint64_t))
+#define MIN_EVTS_PER_RUN 20000000
+#define BATCH_SIZE 256
+
+static uint64_t get_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//
+// Fill the rings with events whose timestamps interleave randomly across the
+// cpus, the way they do on a busy machine. Returns the number of events written.
+//
+static uint64_t fill_rings(uint32_t ncpus, char** buffers, struct ppm_ring_buffer_info** bufinfos)
+{
+	uint32_t j;
+	uint64_t ts = 1;
+	uint64_t nevts = 0;
+	uint32_t nfull = 0;
+	uint32_t seed = 12345;
+	bool* full = (bool*)calloc(ncpus, sizeof(bool));
+
+	for(j = 0; j < ncpus; j++)
+	{
+		bufinfos[j]->head = 0;
+	}
+
+	while(nfull < ncpus)
+	{
+		struct ppm_evt_hdr* hdr;
+		uint16_t* lens;
+
+		seed = seed * 1103515245 + 12345;
+		j = (seed >> 8) % ncpus;
+
+		if(full[j])
+		{
+			continue;
+		}
+
+		if(bufinfos[j]->head + EVT_SIZE > RING_DATA_SIZE)
+		{
+			full[j] = true;
+			nfull++;
+			continue;
+		}
+
+		hdr = (struct ppm_evt_hdr*)(buffers[j] + bufinfos[j]->head);
+		hdr->ts = ts++;
+		hdr->tid = j;
+		hdr->len = EVT_SIZE;
+		hdr->type = PPME_PROCINFO_E;
+		lens = (uint16_t*)(hdr + 1);
+		lens[0] = sizeof(uint64_t);
+		lens[1] = sizeof(uint64_t);
+
+		bufinfos[j]->head += EVT_SIZE;
+		nevts++;
+	}
+
+	free(full);
+	return nevts;
+}
+
+//
+// Consume the rings over and over until at least MIN_EVTS_PER_RUN events have
+// been read, and return the number of events per second. If batch_size is 0,
+// scap_next() is used, otherwise scap_next_batch().
+//
+static double run(uint32_t ncpus, char** buffers, struct ppm_ring_buffer_info** bufinfos, uint64_t nevts_per_run, uint32_t batch_size)
+{
+	char error[SCAP_LASTERR_SIZE];
+	scap_evt* evs[BATCH_SIZE];
+	uint16_t cpuids[BATCH_SIZE];
+	uint32_t flags[BATCH_SIZE];
+	uint64_t nevts = 0;
+	uint64_t duration = 0;
+	uint32_t j;
+
+	while(nevts < MIN_EVTS_PER_RUN)
+	{
+		uint64_t last_ts = 0;
+		uint64_t n = 0;
+		uint64_t start;
+		scap_t* h;
+
+		for(j = 0; j < ncpus; j++)
+		{
+			bufinfos[j]->tail = 0;
+		}
+
+		h = scap_open_ringbufs(ncpus, bufinfos, buffers, error);
+		if(h == NULL)
+		{
+			fprintf(stderr, "%s\n", error);
+			exit(-1);
+		}
+
+		start = get_time_ns();
+
+		while(n < nevts_per_run)
+		{
+			uint32_t nbatch = 1;
+			int32_t res;
+
+			if(batch_size == 0)
+			{
+				res = scap_next(h, &evs[0], &cpuids[0]);
+			}
+			else
+			{
+				res = scap_next_batch(h, batch_size, evs, cpuids, flags, &nbatch);
+			}
+
+			if(res == SCAP_TIMEOUT)
+			{
+				continue;
+			}
+			else if(res != SCAP_SUCCESS)
+			{
+				fprintf(stderr, "%s\n", scap_getlasterr(h));
+				exit(-1);
+			}
+
+			for(j = 0; j < nbatch; j++)
+			{
+				if(evs[j]->ts < last_ts)
+				{
+					fprintf(stderr, "events out of order: %" PRIu64 " after %" PRIu64 "\n", evs[j]->ts, last_ts);
+					exit(-1);
+				}
+
+				last_ts = evs[j]->ts;
+			}
+
+			n += nbatch;
+		}
+
+		duration += get_time_ns() - start;
+		nevts += n;
+
+		scap_close(h);
+	}
+
+	return (double)nevts * 1000000000 / duration;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t cpu_counts[] = {1, 2, 4, 8, 16, 32, 64, 96, 128};
+	uint32_t c;
+
+	printf("%8s %14s %14s\n", "cpus", "next evts/s", "batch evts/s");
+
+	for(c = 0; c < sizeof(cpu_counts) / sizeof(cpu_counts[0]); c++)
+	{
+		uint32_t ncpus = cpu_counts[c];
+		char** buffers = (char**)malloc(ncpus * sizeof(char*));
+		struct ppm_ring_buffer_info** bufinfos = (struct ppm_ring_buffer_info**)malloc(ncpus * sizeof(struct ppm_ring_buffer_info*));
+		uint64_t nevts_per_run;
+		double next_rate;
+		double batch_rate;
+		uint32_t j;
+
+		for(j = 0; j < ncpus; j++)
+		{
+			buffers[j] = (char*)calloc(1, RING_DATA_SIZE);
+			bufinfos[j] = (struct ppm_ring_buffer_info*)calloc(1, sizeof(struct ppm_ring_buffer_info));
+		}
+
+		nevts_per_run = fill_rings(ncpus, buffers, bufinfos);
+
+		next_rate = run(ncpus, buffers, bufinfos, nevts_per_run, 0);
+		batch_rate = run(ncpus, buffers, bufinfos, nevts_per_run, BATCH_SIZE);
+
+		printf("%8" PRIu32 " %14.0f %14.0f\n", ncpus, next_rate, batch_rate);
+
+		for(j = 0; j < ncpus; j++)
+		{
+			free(buffers[j]);
+			free(bufinfos[j]);
+		}
+
+		free(buffers);
+		free(bufinfos);
+	}
+
+	return 0;
+}
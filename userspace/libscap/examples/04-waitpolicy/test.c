@@ -0,0 +1,208 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Compares the wait policies of a live capture on a quiet system. A producer
+// thread writes events into an in-process ring at a steady, low rate, and the
+// consumer measures how long each event waited before scap_next() returned it,
+// together with the cpu time the consumer burned.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <scap.h>
+#include "../../../../driver/ppm_events_public.h"
+#include "../../../../driver/ppm_ringbuffer.h"
+
+#define RING_DATA_SIZE (1024 * 1024)
+#define EVT_SIZE (sizeof(struct ppm_evt_hdr) + 2 * sizeof(uint16_t) + 2 * sizeof(uint64_t))
+#define NEVTS 4000
+#define EVT_INTERVAL_US 250
+
+typedef struct producer_args
+{
+	char* buffer;
+	struct ppm_ring_buffer_info* bufinfo;
+}producer_args;
+
+static uint64_t get_time_ns(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//
+// Write NEVTS events, one every EVT_INTERVAL_US. The timestamp of each event is
+// the time it was produced, so the consumer can compute its latency. The ring
+// is big enough for all the events, so it never wraps.
+//
+static void* producer(void* arg)
+{
+	producer_args* pargs = (producer_args*)arg;
+	uint32_t j;
+
+	for(j = 0; j < NEVTS; j++)
+	{
+		struct ppm_evt_hdr* hdr = (struct ppm_evt_hdr*)(pargs->buffer + pargs->bufinfo->head);
+		uint16_t* lens = (uint16_t*)(hdr + 1);
+
+		hdr->ts = get_time_ns(CLOCK_MONOTONIC);
+		hdr->tid = 0;
+		hdr->len = EVT_SIZE;
+		hdr->type = PPME_PROCINFO_E;
+		lens[0] = sizeof(uint64_t);
+		lens[1] = sizeof(uint64_t);
+
+		__sync_synchronize();
+		pargs->bufinfo->head += EVT_SIZE;
+
+		usleep(EVT_INTERVAL_US);
+	}
+
+	return NULL;
+}
+
+static int run(const char* name, scap_wait_params* params)
+{
+	char error[SCAP_LASTERR_SIZE];
+	char* buffer = (char*)calloc(1, RING_DATA_SIZE);
+	struct ppm_ring_buffer_info* bufinfo = (struct ppm_ring_buffer_info*)calloc(1, sizeof(struct ppm_ring_buffer_info));
+	producer_args pargs;
+	pthread_t tid;
+	scap_stats stats;
+	uint64_t tot_latency = 0;
+	uint64_t max_latency = 0;
+	uint64_t cpu_start;
+	uint64_t cpu_time;
+	uint32_t n = 0;
+	scap_t* h;
+
+	h = scap_open_ringbufs(1, &bufinfo, &buffer, error);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s\n", error);
+		return -1;
+	}
+
+	if(scap_set_wait_params(h, params) != SCAP_SUCCESS)
+	{
+		fprintf(stderr, "%s\n", scap_getlasterr(h));
+		return -1;
+	}
+
+	pargs.buffer = buffer;
+	pargs.bufinfo = bufinfo;
+	pthread_create(&tid, NULL, producer, &pargs);
+
+	cpu_start = get_time_ns(CLOCK_THREAD_CPUTIME_ID);
+
+	while(n < NEVTS)
+	{
+		scap_evt* ev;
+		uint16_t cpuid;
+		uint64_t latency;
+		int32_t res = scap_next(h, &ev, &cpuid);
+
+		if(res == SCAP_TIMEOUT)
+		{
+			continue;
+		}
+		else if(res != SCAP_SUCCESS)
+		{
+			fprintf(stderr, "%s\n", scap_getlasterr(h));
+			return -1;
+		}
+
+		latency = get_time_ns(CLOCK_MONOTONIC) - ev->ts;
+		tot_latency += latency;
+		if(latency > max_latency)
+		{
+			max_latency = latency;
+		}
+
+		n++;
+	}
+
+	cpu_time = get_time_ns(CLOCK_THREAD_CPUTIME_ID) - cpu_start;
+
+	pthread_join(tid, NULL);
+
+	scap_get_stats(h, &stats);
+
+	printf("%-10s %12.1f %12.1f %10" PRIu64 " %12.1f %12.1f\n",
+		name,
+		(double)tot_latency / n / 1000,
+		(double)max_latency / 1000,
+		stats.n_waits,
+		(double)stats.wait_ns / 1000000,
+		(double)cpu_time / 1000000);
+
+	scap_close(h);
+	free(buffer);
+	free(bufinfo);
+
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	scap_wait_params params;
+
+	printf("%-10s %12s %12s %10s %12s %12s\n", "policy", "avg lat(us)", "max lat(us)", "waits", "wait(ms)", "cpu(ms)");
+
+	memset(&params, 0, sizeof(params));
+	params.policy = SCAP_WAIT_FIXED;
+	if(run("fixed", &params) != 0)
+	{
+		return -1;
+	}
+
+	memset(&params, 0, sizeof(params));
+	params.policy = SCAP_WAIT_BUSY_POLL;
+	if(run("busypoll", &params) != 0)
+	{
+		return -1;
+	}
+
+	memset(&params, 0, sizeof(params));
+	params.policy = SCAP_WAIT_BACKOFF;
+	params.min_wait_us = 50;
+	params.max_wait_us = 5000;
+	if(run("backoff", &params) != 0)
+	{
+		return -1;
+	}
+
+	memset(&params, 0, sizeof(params));
+	params.policy = SCAP_WAIT_WATERMARK;
+	params.min_wait_us = 500;
+	params.max_wait_us = 2000;
+	params.bytes_watermark = 4096;
+	if(run("watermark", &params) != 0)
+	{
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,354 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures how fast trace files are read with and without read-ahead. A
+// synthetic trace is written twice, compressed and uncompressed, and then
+// read back with scap_next(). The events that the two readers return must be
+// the same, and so must the way they end on truncated copies of the
+// compressed trace.
+//
+// Usage: scap-readahead [size in MB] [file prefix]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include <scap.h>
+#include "../../../../driver/ppm_events_public.h"
+#include "../../../../driver/ppm_ringbuffer.h"
+
+#define DEFAULT_TRACE_SIZE_MB 2048
+#define MAX_DATA_LEN 128
+#define NTRUNCATIONS 16
+
+static uint64_t get_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//
+// Write a trace made of read() exit events with payloads of varying length.
+// The payloads are text-like, so that they compress roughly like real data.
+//
+static int write_trace(const char* fname, compression_mode compress, uint64_t size)
+{
+	char error[SCAP_LASTERR_SIZE];
+	static const char text[] = "GET /index.html HTTP/1.1\r\nHost: www.example.com\r\nUser-Agent: curl/7.47.0\r\nAccept: */*\r\n\r\n"
+		"HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: 1270\r\nConnection: keep-alive\r\n\r\n"
+		"<html><head><title>Example Domain</title></head><body><div><h1>Example Domain</h1><p>This domain is for use in examples.</p></div></body></html>";
+	char evbuf[sizeof(struct ppm_evt_hdr) + 2 * sizeof(uint16_t) + sizeof(int64_t) + MAX_DATA_LEN];
+	struct ppm_evt_hdr* hdr = (struct ppm_evt_hdr*)evbuf;
+	uint16_t* lens = (uint16_t*)(hdr + 1);
+	char* vals = (char*)(lens + 2);
+	struct ppm_ring_buffer_info bufinfo;
+	struct ppm_ring_buffer_info* pbufinfo = &bufinfo;
+	char* buffer = NULL;
+	uint64_t written = 0;
+	uint32_t seed = 12345;
+	scap_dumper_t* d;
+	scap_t* h;
+
+	//
+	// The fake ring is never read, it's only used to get a handle to dump from
+	//
+	memset(&bufinfo, 0, sizeof(bufinfo));
+	h = scap_open_ringbufs(1, &pbufinfo, &buffer, error);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s\n", error);
+		return -1;
+	}
+
+	d = scap_dump_open(h, fname, compress);
+	if(d == NULL)
+	{
+		fprintf(stderr, "%s\n", scap_getlasterr(h));
+		scap_close(h);
+		return -1;
+	}
+
+	hdr->type = PPME_SYSCALL_READ_X;
+
+	while(written < size)
+	{
+		uint16_t datalen;
+		int64_t res;
+
+		seed = seed * 1103515245 + 12345;
+		datalen = (seed >> 8) % MAX_DATA_LEN;
+		res = datalen;
+
+		hdr->ts = written;
+		hdr->tid = (seed >> 16) % 1000;
+		hdr->len = sizeof(struct ppm_evt_hdr) + 2 * sizeof(uint16_t) + sizeof(int64_t) + datalen;
+		lens[0] = sizeof(int64_t);
+		lens[1] = datalen;
+		memcpy(vals, &res, sizeof(int64_t));
+		memcpy(vals + sizeof(int64_t), text + (seed >> 4) % (sizeof(text) - MAX_DATA_LEN), datalen);
+
+		if(scap_dump(h, d, hdr, (seed >> 12) % 8, 0) != SCAP_SUCCESS)
+		{
+			fprintf(stderr, "%s\n", scap_getlasterr(h));
+			scap_dump_close(d);
+			scap_close(h);
+			return -1;
+		}
+
+		written += hdr->len;
+	}
+
+	scap_dump_close(d);
+	scap_close(h);
+	return 0;
+}
+
+//
+// What a reader got from a file. The two readers must get the same events and
+// end the same way.
+//
+struct read_result
+{
+	uint64_t m_nevts;
+	uint64_t m_checksum;
+	int32_t m_res;
+	char m_lasterr[SCAP_LASTERR_SIZE];
+};
+
+static int read_trace(const char* name, const char* fname, bool readahead, OUT struct read_result* rr)
+{
+	char error[SCAP_LASTERR_SIZE];
+	scap_open_args oargs;
+	uint64_t nbytes = 0;
+	uint64_t start;
+	uint64_t duration;
+	int32_t res;
+	scap_t* h;
+
+	memset(&oargs, 0, sizeof(oargs));
+	oargs.fname = fname;
+	oargs.import_users = true;
+	oargs.readahead = readahead;
+
+	memset(rr, 0, sizeof(*rr));
+
+	start = get_time_ns();
+
+	h = scap_open(oargs, error);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s\n", error);
+		return -1;
+	}
+
+	while(true)
+	{
+		scap_evt* ev;
+		uint16_t cpuid;
+
+		res = scap_next(h, &ev, &cpuid);
+		if(res != SCAP_SUCCESS)
+		{
+			break;
+		}
+
+		rr->m_nevts++;
+		rr->m_checksum = rr->m_checksum * 31 + ev->ts + ev->len + cpuid;
+		nbytes += ev->len;
+	}
+
+	rr->m_res = res;
+	if(res != SCAP_EOF)
+	{
+		//
+		// The line of the check is not part of the error
+		//
+		snprintf(rr->m_lasterr, sizeof(rr->m_lasterr), "%s", scap_getlasterr(h));
+		if(strstr(rr->m_lasterr, " at ") != NULL)
+		{
+			*strstr(rr->m_lasterr, " at ") = 0;
+		}
+	}
+
+	scap_close(h);
+
+	duration = get_time_ns() - start;
+
+	if(name != NULL)
+	{
+		printf("%-14s %10s %14" PRIu64 " %12.1f %14.0f\n",
+			name,
+			readahead? "yes" : "no",
+			rr->m_nevts,
+			(double)nbytes * 1000000000 / duration / (1024 * 1024),
+			(double)rr->m_nevts * 1000000000 / duration);
+	}
+
+	return 0;
+}
+
+//
+// Read the file with and without read-ahead, and fail if the results differ
+//
+static int compare_readers(const char* name, const char* fname, bool quiet)
+{
+	struct read_result sync_rr;
+	struct read_result ra_rr;
+
+	if(read_trace(quiet? NULL : name, fname, false, &sync_rr) != 0 ||
+		read_trace(quiet? NULL : name, fname, true, &ra_rr) != 0)
+	{
+		return -1;
+	}
+
+	if(sync_rr.m_nevts != ra_rr.m_nevts ||
+		sync_rr.m_checksum != ra_rr.m_checksum ||
+		sync_rr.m_res != ra_rr.m_res ||
+		strcmp(sync_rr.m_lasterr, ra_rr.m_lasterr) != 0)
+	{
+		fprintf(stderr, "%s: the readers disagree. sync: %" PRIu64 " events, res %d (%s). read-ahead: %" PRIu64 " events, res %d (%s)\n",
+			name,
+			sync_rr.m_nevts,
+			sync_rr.m_res,
+			sync_rr.m_lasterr,
+			ra_rr.m_nevts,
+			ra_rr.m_res,
+			ra_rr.m_lasterr);
+		return -1;
+	}
+
+	if(sync_rr.m_res != SCAP_EOF && !quiet)
+	{
+		fprintf(stderr, "%s: %s\n", name, sync_rr.m_lasterr);
+		return -1;
+	}
+
+	return 0;
+}
+
+//
+// Check that the readers end a truncated copy of the file the same way
+//
+static int compare_truncated(const char* fname, const char* truncname, uint64_t size)
+{
+	char buf[65536];
+	uint64_t copied = 0;
+	size_t n;
+	FILE* in;
+	FILE* out;
+	int res;
+
+	in = fopen(fname, "rb");
+	out = fopen(truncname, "wb");
+	if(in == NULL || out == NULL)
+	{
+		fprintf(stderr, "can't create %s\n", truncname);
+		if(in != NULL)
+		{
+			fclose(in);
+		}
+		if(out != NULL)
+		{
+			fclose(out);
+		}
+		return -1;
+	}
+
+	while(copied < size && (n = fread(buf, 1, (size - copied < sizeof(buf))? (size_t)(size - copied) : sizeof(buf), in)) > 0)
+	{
+		fwrite(buf, 1, n, out);
+		copied += n;
+	}
+
+	fclose(in);
+	fclose(out);
+
+	res = compare_readers("truncated", truncname, true);
+	remove(truncname);
+	return res;
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t size = (uint64_t)DEFAULT_TRACE_SIZE_MB * 1024 * 1024;
+	const char* prefix = "/tmp/scap-readahead";
+	char gzname[SCAP_MAX_PATH_SIZE];
+	char rawname[SCAP_MAX_PATH_SIZE];
+	char truncname[SCAP_MAX_PATH_SIZE];
+	uint32_t j;
+	int res = 0;
+
+	if(argc > 1)
+	{
+		size = strtoull(argv[1], NULL, 10) * 1024 * 1024;
+	}
+
+	if(argc > 2)
+	{
+		prefix = argv[2];
+	}
+
+	snprintf(gzname, sizeof(gzname), "%s.gz.scap", prefix);
+	snprintf(rawname, sizeof(rawname), "%s.raw.scap", prefix);
+	snprintf(truncname, sizeof(truncname), "%s.trunc.scap", prefix);
+
+	fprintf(stderr, "writing %" PRIu64 " MB traces...\n", size / (1024 * 1024));
+
+	if(write_trace(gzname, SCAP_COMPRESSION_GZIP, size) != 0 ||
+		write_trace(rawname, SCAP_COMPRESSION_NONE, size) != 0)
+	{
+		res = -1;
+		goto cleanup;
+	}
+
+	printf("%-14s %10s %14s %12s %14s\n", "file", "readahead", "events", "MB/s", "events/s");
+
+	if(compare_readers("compressed", gzname, false) != 0 ||
+		compare_readers("uncompressed", rawname, false) != 0)
+	{
+		res = -1;
+		goto cleanup;
+	}
+
+	//
+	// Cut the compressed file at a few places, some of them close to the end
+	// of the read-ahead buffers
+	//
+	for(j = 1; j <= NTRUNCATIONS; j++)
+	{
+		struct stat st;
+
+		if(stat(gzname, &st) != 0 ||
+			compare_truncated(gzname, truncname, (uint64_t)st.st_size * j / (NTRUNCATIONS + 1) + j * 37) != 0)
+		{
+			res = -1;
+			break;
+		}
+	}
+
+cleanup:
+	remove(gzname);
+	remove(rawname);
+
+	return res;
+}
@@ -0,0 +1,274 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures how fast events are written to trace files. A set of synthetic
+// events is generated in memory and then written with scap_dump() in the
+// different compression modes, with synchronous and asynchronous dumpers.
+// The first rows write the same events with one gzwrite() per block field,
+// which is how scap_dump() used to work, as a baseline.
+//
+// Usage: scap-dumpbench [number of events] [file name]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <zlib.h>
+
+#include <scap.h>
+#include "../../../../driver/ppm_events_public.h"
+#include "../../../../driver/ppm_ringbuffer.h"
+
+#define DEFAULT_NEVTS 2000000
+#define MAX_DATA_LEN 128
+#define EV_BLOCK_TYPE 0x204
+
+static uint64_t get_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//
+// Fill buf with read() exit events with payloads of varying length. The
+// payloads are text-like, so that they compress roughly like real data.
+//
+static uint64_t generate_events(char* buf, uint64_t nevts)
+{
+	static const char text[] = "GET /index.html HTTP/1.1\r\nHost: www.example.com\r\nUser-Agent: curl/7.47.0\r\nAccept: */*\r\n\r\n"
+		"HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: 1270\r\nConnection: keep-alive\r\n\r\n"
+		"<html><head><title>Example Domain</title></head><body><div><h1>Example Domain</h1><p>This domain is for use in examples.</p></div></body></html>";
+	uint32_t seed = 12345;
+	uint64_t off = 0;
+	uint64_t j;
+
+	for(j = 0; j < nevts; j++)
+	{
+		struct ppm_evt_hdr* hdr = (struct ppm_evt_hdr*)(buf + off);
+		uint16_t* lens = (uint16_t*)(hdr + 1);
+		char* vals = (char*)(lens + 2);
+		uint16_t datalen;
+		int64_t res;
+
+		seed = seed * 1103515245 + 12345;
+		datalen = (seed >> 8) % MAX_DATA_LEN;
+		res = datalen;
+
+		hdr->ts = 1000 * j;
+		hdr->tid = (seed >> 16) % 1000;
+		hdr->type = PPME_SYSCALL_READ_X;
+		hdr->len = sizeof(struct ppm_evt_hdr) + 2 * sizeof(uint16_t) + sizeof(int64_t) + datalen;
+		lens[0] = sizeof(int64_t);
+		lens[1] = datalen;
+		memcpy(vals, &res, sizeof(int64_t));
+		memcpy(vals + sizeof(int64_t), text + (seed >> 4) % (sizeof(text) - MAX_DATA_LEN), datalen);
+
+		off += hdr->len;
+	}
+
+	return off;
+}
+
+static void print_result(const char* name, int level, const char* async, const char* stalls, uint64_t nevts, uint64_t nbytes, uint64_t duration, const char* fname)
+{
+	struct stat st;
+
+	if(stat(fname, &st) != 0)
+	{
+		st.st_size = 0;
+	}
+
+	printf("%-10s %6d %6s %8s %14.0f %10.1f %12.1f\n",
+		name,
+		level,
+		async,
+		stalls,
+		(double)nevts * 1000000000 / duration,
+		(double)nbytes * 1000000000 / duration / (1024 * 1024),
+		(double)st.st_size / (1024 * 1024));
+}
+
+//
+// Write the events with a gzwrite() per field of each block, like the
+// unbuffered scap_dump() did
+//
+static int write_unbuffered(const char* fname, const char* mode, int level, char* evts, uint64_t nevts, uint64_t nbytes)
+{
+	gzFile f;
+	uint64_t off = 0;
+	uint64_t start;
+	uint64_t j;
+
+	f = gzopen(fname, mode);
+	if(f == NULL)
+	{
+		fprintf(stderr, "can't open %s\n", fname);
+		return -1;
+	}
+
+	start = get_time_ns();
+
+	for(j = 0; j < nevts; j++)
+	{
+		struct ppm_evt_hdr* e = (struct ppm_evt_hdr*)(evts + off);
+		uint16_t cpuid = j % 8;
+		uint32_t bh[2];
+		uint32_t pad = 0;
+		uint32_t padlen = ((sizeof(cpuid) + e->len + 3) & ~3) - (sizeof(cpuid) + e->len);
+
+		bh[0] = EV_BLOCK_TYPE;
+		bh[1] = (sizeof(bh) + sizeof(cpuid) + e->len + 4 + 3) & ~3;
+
+		if(gzwrite(f, bh, sizeof(bh)) != sizeof(bh) ||
+			gzwrite(f, &cpuid, sizeof(cpuid)) != sizeof(cpuid) ||
+			gzwrite(f, e, e->len) != (int)e->len ||
+			gzwrite(f, &pad, padlen) != (int)padlen ||
+			gzwrite(f, &bh[1], sizeof(bh[1])) != sizeof(bh[1]))
+		{
+			fprintf(stderr, "error writing to %s\n", fname);
+			gzclose(f);
+			return -1;
+		}
+
+		off += e->len;
+	}
+
+	gzclose(f);
+
+	print_result(mode[2] == 'T'? "none" : "gzip", level, "-", "-", nevts, nbytes, get_time_ns() - start, fname);
+	return 0;
+}
+
+static int write_scap(scap_t* h, const char* fname, compression_mode compress, int level, bool async, char* evts, uint64_t nevts, uint64_t nbytes)
+{
+	static const char* names[] = {"none", "gzip", "chunked"};
+	scap_dump_params params;
+	scap_dumper_t* d;
+	char stalls[32];
+	uint64_t off = 0;
+	uint64_t start;
+	uint64_t j;
+
+	memset(&params, 0, sizeof(params));
+	params.compress = compress;
+	params.compression_level = level;
+	params.async = async;
+
+	start = get_time_ns();
+
+	d = scap_dump_open_ex(h, fname, &params);
+	if(d == NULL)
+	{
+		fprintf(stderr, "%s\n", scap_getlasterr(h));
+		return -1;
+	}
+
+	for(j = 0; j < nevts; j++)
+	{
+		struct ppm_evt_hdr* e = (struct ppm_evt_hdr*)(evts + off);
+
+		if(scap_dump(h, d, e, j % 8, 0) != SCAP_SUCCESS)
+		{
+			fprintf(stderr, "%s\n", scap_getlasterr(h));
+			scap_dump_close(d);
+			return -1;
+		}
+
+		off += e->len;
+	}
+
+	snprintf(stalls, sizeof(stalls), "%" PRIu64, scap_dump_get_stalls(d));
+	scap_dump_close(d);
+
+	print_result(names[compress], level, async? "yes" : "no", async? stalls : "-", nevts, nbytes, get_time_ns() - start, fname);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	char error[SCAP_LASTERR_SIZE];
+	uint64_t nevts = DEFAULT_NEVTS;
+	const char* fname = "/tmp/scap-dumpbench.scap";
+	struct ppm_ring_buffer_info bufinfo;
+	struct ppm_ring_buffer_info* pbufinfo = &bufinfo;
+	char* buffer = NULL;
+	uint64_t nbytes;
+	char* evts;
+	scap_t* h;
+	int res = 0;
+
+	if(argc > 1)
+	{
+		nevts = strtoull(argv[1], NULL, 10);
+	}
+
+	if(argc > 2)
+	{
+		fname = argv[2];
+	}
+
+	evts = (char*)malloc(nevts * (sizeof(struct ppm_evt_hdr) + 2 * sizeof(uint16_t) + sizeof(int64_t) + MAX_DATA_LEN));
+	if(evts == NULL)
+	{
+		fprintf(stderr, "error allocating the events\n");
+		return -1;
+	}
+
+	nbytes = generate_events(evts, nevts);
+
+	//
+	// The fake ring is never read, it's only used to get a handle to dump from
+	//
+	memset(&bufinfo, 0, sizeof(bufinfo));
+	h = scap_open_ringbufs(1, &pbufinfo, &buffer, error);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s\n", error);
+		free(evts);
+		return -1;
+	}
+
+	printf("%-10s %6s %6s %8s %14s %10s %12s\n", "mode", "level", "async", "stalls", "events/s", "MB/s", "file MB");
+
+	if(write_unbuffered(fname, "wbT", 0, evts, nevts, nbytes) != 0 ||
+		write_unbuffered(fname, "wb1", 1, evts, nevts, nbytes) != 0 ||
+		write_unbuffered(fname, "wb", 0, evts, nevts, nbytes) != 0 ||
+		write_scap(h, fname, SCAP_COMPRESSION_NONE, 0, false, evts, nevts, nbytes) != 0 ||
+		write_scap(h, fname, SCAP_COMPRESSION_NONE, 0, true, evts, nevts, nbytes) != 0 ||
+		write_scap(h, fname, SCAP_COMPRESSION_GZIP, 1, false, evts, nevts, nbytes) != 0 ||
+		write_scap(h, fname, SCAP_COMPRESSION_GZIP, 1, true, evts, nevts, nbytes) != 0 ||
+		write_scap(h, fname, SCAP_COMPRESSION_GZIP, 0, false, evts, nevts, nbytes) != 0 ||
+		write_scap(h, fname, SCAP_COMPRESSION_GZIP, 0, true, evts, nevts, nbytes) != 0 ||
+		write_scap(h, fname, SCAP_COMPRESSION_CHUNKED, 1, false, evts, nevts, nbytes) != 0 ||
+		write_scap(h, fname, SCAP_COMPRESSION_CHUNKED, 1, true, evts, nevts, nbytes) != 0 ||
+		write_scap(h, fname, SCAP_COMPRESSION_CHUNKED, 0, false, evts, nevts, nbytes) != 0 ||
+		write_scap(h, fname, SCAP_COMPRESSION_CHUNKED, 0, true, evts, nevts, nbytes) != 0)
+	{
+		res = -1;
+	}
+
+	remove(fname);
+	scap_close(h);
+	free(evts);
+
+	return res;
+}
@@ -0,0 +1,246 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Compares the ways an uncompressed trace file can be read: gzread() into the
+// handle buffer, the read-ahead thread, and a memory mapping of the file. A
+// compressed trace is also opened with the mapping enabled, to show that it
+// falls back to zlib. Every mode must return the same events.
+//
+// Usage: scap-mmapread [size in MB] [file prefix]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <scap.h>
+#include "../../../../driver/ppm_events_public.h"
+#include "../../../../driver/ppm_ringbuffer.h"
+
+#define DEFAULT_TRACE_SIZE_MB 2048
+#define MAX_DATA_LEN 128
+
+static uint64_t get_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//
+// Write a trace made of read() exit events with payloads of varying length.
+// The payloads are text-like, so that they compress roughly like real data.
+//
+static int write_trace(const char* fname, compression_mode compress, uint64_t size)
+{
+	char error[SCAP_LASTERR_SIZE];
+	static const char text[] = "GET /index.html HTTP/1.1\r\nHost: www.example.com\r\nUser-Agent: curl/7.47.0\r\nAccept: */*\r\n\r\n"
+		"HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: 1270\r\nConnection: keep-alive\r\n\r\n"
+		"<html><head><title>Example Domain</title></head><body><div><h1>Example Domain</h1><p>This domain is for use in examples.</p></div></body></html>";
+	char evbuf[sizeof(struct ppm_evt_hdr) + 2 * sizeof(uint16_t) + sizeof(int64_t) + MAX_DATA_LEN];
+	struct ppm_evt_hdr* hdr = (struct ppm_evt_hdr*)evbuf;
+	uint16_t* lens = (uint16_t*)(hdr + 1);
+	char* vals = (char*)(lens + 2);
+	struct ppm_ring_buffer_info bufinfo;
+	struct ppm_ring_buffer_info* pbufinfo = &bufinfo;
+	char* buffer = NULL;
+	uint64_t written = 0;
+	uint32_t seed = 12345;
+	scap_dumper_t* d;
+	scap_t* h;
+
+	//
+	// The fake ring is never read, it's only used to get a handle to dump from
+	//
+	memset(&bufinfo, 0, sizeof(bufinfo));
+	h = scap_open_ringbufs(1, &pbufinfo, &buffer, error);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s\n", error);
+		return -1;
+	}
+
+	d = scap_dump_open(h, fname, compress);
+	if(d == NULL)
+	{
+		fprintf(stderr, "%s\n", scap_getlasterr(h));
+		scap_close(h);
+		return -1;
+	}
+
+	hdr->type = PPME_SYSCALL_READ_X;
+
+	while(written < size)
+	{
+		uint16_t datalen;
+		int64_t res;
+
+		seed = seed * 1103515245 + 12345;
+		datalen = (seed >> 8) % MAX_DATA_LEN;
+		res = datalen;
+
+		hdr->ts = written;
+		hdr->tid = (seed >> 16) % 1000;
+		hdr->len = sizeof(struct ppm_evt_hdr) + 2 * sizeof(uint16_t) + sizeof(int64_t) + datalen;
+		lens[0] = sizeof(int64_t);
+		lens[1] = datalen;
+		memcpy(vals, &res, sizeof(int64_t));
+		memcpy(vals + sizeof(int64_t), text + (seed >> 4) % (sizeof(text) - MAX_DATA_LEN), datalen);
+
+		if(scap_dump(h, d, hdr, (seed >> 12) % 8, 0) != SCAP_SUCCESS)
+		{
+			fprintf(stderr, "%s\n", scap_getlasterr(h));
+			scap_dump_close(d);
+			scap_close(h);
+			return -1;
+		}
+
+		written += hdr->len;
+	}
+
+	scap_dump_close(d);
+	scap_close(h);
+	return 0;
+}
+
+static int read_trace(const char* name, const char* fname, bool readahead, bool mmap, uint64_t* checksum)
+{
+	char error[SCAP_LASTERR_SIZE];
+	scap_open_args oargs;
+	uint64_t nevts = 0;
+	uint64_t nbytes = 0;
+	uint64_t sum = 0;
+	uint64_t start;
+	uint64_t duration;
+	int32_t res;
+	scap_t* h;
+
+	memset(&oargs, 0, sizeof(oargs));
+	oargs.fname = fname;
+	oargs.import_users = true;
+	oargs.readahead = readahead;
+	oargs.mmap = mmap;
+
+	start = get_time_ns();
+
+	h = scap_open(oargs, error);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s\n", error);
+		return -1;
+	}
+
+	while(true)
+	{
+		scap_evt* ev;
+		uint16_t cpuid;
+
+		res = scap_next(h, &ev, &cpuid);
+		if(res != SCAP_SUCCESS)
+		{
+			break;
+		}
+
+		nevts++;
+		nbytes += ev->len;
+		sum = sum * 31 + ev->ts + ev->tid + ev->len + cpuid;
+	}
+
+	if(res != SCAP_EOF)
+	{
+		fprintf(stderr, "%s\n", scap_getlasterr(h));
+		scap_close(h);
+		return -1;
+	}
+
+	scap_close(h);
+
+	duration = get_time_ns() - start;
+
+	printf("%-14s %-10s %14" PRIu64 " %12.1f %14.0f\n",
+		name,
+		mmap? "mmap" : (readahead? "readahead" : "gzread"),
+		nevts,
+		(double)nbytes * 1000000000 / duration / (1024 * 1024),
+		(double)nevts * 1000000000 / duration);
+
+	//
+	// All the modes must see the same events
+	//
+	if(*checksum == 0)
+	{
+		*checksum = sum;
+	}
+	else if(*checksum != sum)
+	{
+		fprintf(stderr, "%s: events differ from the first read\n", name);
+		return -1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t size = (uint64_t)DEFAULT_TRACE_SIZE_MB * 1024 * 1024;
+	const char* prefix = "/tmp/scap-mmapread";
+	char gzname[SCAP_MAX_PATH_SIZE];
+	char rawname[SCAP_MAX_PATH_SIZE];
+	uint64_t checksum = 0;
+	int res = 0;
+
+	if(argc > 1)
+	{
+		size = strtoull(argv[1], NULL, 10) * 1024 * 1024;
+	}
+
+	if(argc > 2)
+	{
+		prefix = argv[2];
+	}
+
+	snprintf(gzname, sizeof(gzname), "%s.gz.scap", prefix);
+	snprintf(rawname, sizeof(rawname), "%s.raw.scap", prefix);
+
+	fprintf(stderr, "writing %" PRIu64 " MB traces...\n", size / (1024 * 1024));
+
+	if(write_trace(gzname, SCAP_COMPRESSION_GZIP, size) != 0 ||
+		write_trace(rawname, SCAP_COMPRESSION_NONE, size) != 0)
+	{
+		res = -1;
+		goto cleanup;
+	}
+
+	printf("%-14s %-10s %14s %12s %14s\n", "file", "mode", "events", "MB/s", "events/s");
+
+	if(read_trace("uncompressed", rawname, false, false, &checksum) != 0 ||
+		read_trace("uncompressed", rawname, true, false, &checksum) != 0 ||
+		read_trace("uncompressed", rawname, false, true, &checksum) != 0 ||
+		read_trace("compressed", gzname, false, true, &checksum) != 0)
+	{
+		res = -1;
+	}
+
+cleanup:
+	remove(gzname);
+	remove(rawname);
+
+	return res;
+}
@@ -0,0 +1,508 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures how long it takes to build the process table with different
+// numbers of /proc scan threads. The scan runs against a synthetic procfs tree,
+// which is found through SYSDIG_HOST_ROOT, so no driver is needed. Every run
+// must produce the same table, in the same order. The last run skips the fds,
+// and then reads each of them with scap_fd_lookup().
+//
+// Usage: scap-procscan [processes] [threads per process] [fds per process] [root dir]
+//
+
+#define _XOPEN_SOURCE 700
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <scap.h>
+#include "../../../../driver/ppm_ringbuffer.h"
+
+#define DEFAULT_NPROCS 2000
+#define DEFAULT_NTHREADS 4
+#define DEFAULT_NFDS 50
+#define NFILES 256
+
+static uint64_t get_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int write_file(const char* dir, const char* name, const char* content, size_t len)
+{
+	char path[SCAP_MAX_PATH_SIZE];
+	FILE* f;
+
+	if(snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path))
+	{
+		fprintf(stderr, "path too long: %s/%s\n", dir, name);
+		return -1;
+	}
+
+	f = fopen(path, "w");
+	if(f == NULL)
+	{
+		perror(path);
+		return -1;
+	}
+
+	fwrite(content, 1, len, f);
+	fclose(f);
+	return 0;
+}
+
+static int make_link(const char* dir, const char* name, const char* target)
+{
+	char path[SCAP_MAX_PATH_SIZE];
+
+	if(snprintf(path, sizeof(path), "%s/%s", dir, name) >= (int)sizeof(path))
+	{
+		fprintf(stderr, "path too long: %s/%s\n", dir, name);
+		return -1;
+	}
+
+	if(symlink(target, path) != 0)
+	{
+		perror(path);
+		return -1;
+	}
+
+	return 0;
+}
+
+//
+// Fill the directory of a thread with the files that libscap parses
+//
+static int make_thread_dir(const char* dir, const char* root, uint32_t pid, uint32_t tid, uint32_t nfds)
+{
+	static const char cmdline[] = "/usr/bin/server\0--config\0/etc/server.conf\0--workers\0" "16";
+	static const char environ[] = "PATH=/usr/local/sbin:/usr/local/bin:/usr/sbin:/usr/bin\0HOME=/root\0LANG=C.UTF-8\0HOSTNAME=node-1";
+	static const char cgroup[] = "11:memory:/kubepods/burstable/pod1234/abcdef\n4:cpu,cpuacct:/kubepods/burstable/pod1234/abcdef\n1:name=systemd:/kubepods\n";
+	char buf[1024];
+	char path[SCAP_MAX_PATH_SIZE];
+	uint32_t j;
+	int len;
+
+	if(mkdir(dir, 0755) != 0)
+	{
+		perror(dir);
+		return -1;
+	}
+
+	len = snprintf(buf, sizeof(buf), "Name:\tserver\nState:\tS (sleeping)\nPPid:\t1\nUid:\t1000\t1000\t1000\t1000\nGid:\t1000\t1000\t1000\t1000\n"
+		"VmSize:\t  123456 kB\nVmRSS:\t   23456 kB\nVmSwap:\t       0 kB\n");
+	if(write_file(dir, "status", buf, len) != 0)
+	{
+		return -1;
+	}
+
+	len = snprintf(buf, sizeof(buf), "%u (server) S 1 %u %u 0 -1 4194560 %u 0 %u 0 10 5 0 0 20 0 1 0 100 126418944 5864\n",
+		tid, pid, pid, tid * 7, tid % 13);
+	if(write_file(dir, "stat", buf, len) != 0 ||
+		write_file(dir, "cmdline", cmdline, sizeof(cmdline)) != 0 ||
+		write_file(dir, "environ", environ, sizeof(environ)) != 0 ||
+		write_file(dir, "cgroup", cgroup, sizeof(cgroup) - 1) != 0 ||
+		make_link(dir, "exe", "/usr/bin/server") != 0 ||
+		make_link(dir, "cwd", "/var/lib/server") != 0 ||
+		make_link(dir, "root", "/") != 0)
+	{
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), "%s/fd", dir);
+	if(mkdir(path, 0755) != 0)
+	{
+		perror(path);
+		return -1;
+	}
+
+	//
+	// The last fd is a socket, which makes the scan read the socket tables
+	//
+	for(j = 0; j < nfds; j++)
+	{
+		char name[32];
+		char target[SCAP_MAX_PATH_SIZE];
+
+		snprintf(name, sizeof(name), "%u", j);
+		if(j == nfds - 1)
+		{
+			snprintf(target, sizeof(target), "%s/sock", root);
+		}
+		else
+		{
+			snprintf(target, sizeof(target), "%s/files/%u", root, (pid + j) % NFILES);
+		}
+
+		if(make_link(path, name, target) != 0)
+		{
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int make_procfs(const char* root, uint32_t nprocs, uint32_t nthreads, uint32_t nfds)
+{
+	static const char inet_header[] = "  sl  local_address rem_address   st tx_queue rx_queue tr tm->when retrnsmt   uid  timeout inode\n";
+	static const char unix_header[] = "Num       RefCount Protocol Flags    Type St Inode Path\n";
+	struct sockaddr_un addr;
+	char path[SCAP_MAX_PATH_SIZE];
+	uint32_t j;
+	uint32_t k;
+	int sock;
+
+	if(mkdir(root, 0755) != 0)
+	{
+		perror(root);
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/sock", root);
+	sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(sock < 0 || bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		perror(addr.sun_path);
+		return -1;
+	}
+
+	close(sock);
+
+	snprintf(path, sizeof(path), "%s/files", root);
+	if(mkdir(path, 0755) != 0)
+	{
+		perror(path);
+		return -1;
+	}
+
+	for(j = 0; j < NFILES; j++)
+	{
+		char name[32];
+
+		snprintf(name, sizeof(name), "%u", j);
+		if(write_file(path, name, "", 0) != 0)
+		{
+			return -1;
+		}
+	}
+
+	snprintf(path, sizeof(path), "%s/proc", root);
+	if(mkdir(path, 0755) != 0)
+	{
+		perror(path);
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), "%s/proc/net", root);
+	if(mkdir(path, 0755) != 0 ||
+		write_file(path, "tcp", inet_header, sizeof(inet_header) - 1) != 0 ||
+		write_file(path, "udp", inet_header, sizeof(inet_header) - 1) != 0 ||
+		write_file(path, "raw", inet_header, sizeof(inet_header) - 1) != 0 ||
+		write_file(path, "unix", unix_header, sizeof(unix_header) - 1) != 0)
+	{
+		perror(path);
+		return -1;
+	}
+
+	for(j = 0; j < nprocs; j++)
+	{
+		uint32_t pid = 1000 + j * (nthreads + 1);
+		char procdir[SCAP_MAX_PATH_SIZE];
+		char taskdir[SCAP_MAX_PATH_SIZE];
+
+		snprintf(procdir, sizeof(procdir), "%s/proc/%u", root, pid);
+		if(make_thread_dir(procdir, root, pid, pid, nfds) != 0)
+		{
+			return -1;
+		}
+
+		if(snprintf(taskdir, sizeof(taskdir), "%s/task", procdir) >= (int)sizeof(taskdir))
+		{
+			fprintf(stderr, "path too long: %s/task\n", procdir);
+			return -1;
+		}
+
+		if(mkdir(taskdir, 0755) != 0)
+		{
+			perror(taskdir);
+			return -1;
+		}
+
+		//
+		// Like in the real /proc, the main thread is also under task
+		//
+		for(k = 0; k <= nthreads; k++)
+		{
+			if(snprintf(path, sizeof(path), "%s/%u", taskdir, pid + k) >= (int)sizeof(path))
+			{
+				fprintf(stderr, "path too long: %s/%u\n", taskdir, pid + k);
+				return -1;
+			}
+
+			if(make_thread_dir(path, root, pid, pid + k, k == 0? nfds : 0) != 0)
+			{
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static int remove_entry(const char* path, const struct stat* sb, int type, struct FTW* ftwbuf)
+{
+	return remove(path);
+}
+
+//
+// Read the fds of a process one at a time, in the order of its fd directory
+// like the full scan does
+//
+static int lookup_fds(scap_t* h, int64_t pid, uint64_t* pnfds, uint64_t* pchecksum)
+{
+	char dirname[1024];
+	DIR* dir;
+	struct dirent* entry;
+	scap_fdinfo fdinfo;
+	int32_t res;
+
+	snprintf(dirname, sizeof(dirname), "%s/proc/%" PRId64 "/fd", getenv("SYSDIG_HOST_ROOT"), pid);
+	dir = opendir(dirname);
+	if(dir == NULL)
+	{
+		return 0;
+	}
+
+	while((entry = readdir(dir)) != NULL)
+	{
+		if(entry->d_name[0] < '0' || entry->d_name[0] > '9')
+		{
+			continue;
+		}
+
+		res = scap_fd_lookup(h, pid, atoll(entry->d_name), &fdinfo);
+		if(res == SCAP_NOTFOUND)
+		{
+			continue;
+		}
+		else if(res != SCAP_SUCCESS)
+		{
+			fprintf(stderr, "%s\n", scap_getlasterr(h));
+			closedir(dir);
+			return -1;
+		}
+
+		(*pnfds)++;
+		*pchecksum = *pchecksum * 31 + fdinfo.fd + fdinfo.type;
+	}
+
+	closedir(dir);
+	return 0;
+}
+
+static int scan(uint32_t nthreads, bool lazy, uint64_t* pnprocs, uint64_t* pnfds, uint64_t* pchecksum)
+{
+	char error[SCAP_LASTERR_SIZE];
+	struct ppm_ring_buffer_info bufinfo;
+	struct ppm_ring_buffer_info* pbufinfo = &bufinfo;
+	char* buffer = NULL;
+	scap_threadinfo* tinfo;
+	scap_threadinfo* ttinfo;
+	scap_fdinfo* fdi;
+	scap_fdinfo* tfdi;
+	uint64_t nprocs = 0;
+	uint64_t nfds = 0;
+	uint64_t checksum = 0;
+	uint64_t start;
+	uint64_t duration;
+	uint64_t lookup_duration;
+	scap_t* h;
+
+	//
+	// A ring-backed handle scans /proc like a live one, without the driver
+	//
+	memset(&bufinfo, 0, sizeof(bufinfo));
+	h = scap_open_ringbufs(1, &pbufinfo, &buffer, error);
+	if(h == NULL)
+	{
+		fprintf(stderr, "%s\n", error);
+		return -1;
+	}
+
+	scap_set_proc_scan_threads(h, nthreads);
+	scap_set_lazy_fds(h, lazy);
+
+	start = get_time_ns();
+
+	if(scap_refresh_proc_table(h) != SCAP_SUCCESS)
+	{
+		fprintf(stderr, "%s\n", scap_getlasterr(h));
+		scap_close(h);
+		return -1;
+	}
+
+	duration = get_time_ns() - start;
+	start = get_time_ns();
+
+	HASH_ITER(hh, scap_get_proc_table(h), tinfo, ttinfo)
+	{
+		nprocs++;
+		checksum = checksum * 31 + tinfo->tid + tinfo->pid + tinfo->pfminor + tinfo->cgroups_len + tinfo->args_len;
+
+		if(lazy)
+		{
+			if(tinfo->tid == tinfo->pid && lookup_fds(h, tinfo->pid, &nfds, &checksum) != 0)
+			{
+				scap_close(h);
+				return -1;
+			}
+
+			continue;
+		}
+
+		HASH_ITER(hh, tinfo->fdlist, fdi, tfdi)
+		{
+			nfds++;
+			checksum = checksum * 31 + fdi->fd + fdi->type;
+		}
+	}
+
+	lookup_duration = get_time_ns() - start;
+
+	scap_close(h);
+
+	printf("%8u %5s %10" PRIu64 " %10" PRIu64 " %10.1f %14.0f",
+		nthreads,
+		lazy? "yes" : "no",
+		nprocs,
+		nfds,
+		(double)duration / 1000000,
+		(double)nprocs * 1000000000 / duration);
+
+	if(lazy)
+	{
+		printf("   %.1f ms to look up all the fds", (double)lookup_duration / 1000000);
+	}
+
+	printf("\n");
+
+	*pnprocs = nprocs;
+	*pnfds = nfds;
+	*pchecksum = checksum;
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t nprocs = DEFAULT_NPROCS;
+	uint32_t nthreads = DEFAULT_NTHREADS;
+	uint32_t nfds = DEFAULT_NFDS;
+	const char* root = "/tmp/scap-procscan";
+	static const uint32_t scan_threads[] = {1, 2, 4, 8};
+	uint32_t nruns = sizeof(scan_threads) / sizeof(scan_threads[0]);
+	uint64_t ref_nprocs = 0;
+	uint64_t ref_nfds = 0;
+	uint64_t ref_checksum = 0;
+	int res = 0;
+	uint32_t j;
+
+	if(argc > 1)
+	{
+		nprocs = atoi(argv[1]);
+	}
+
+	if(argc > 2)
+	{
+		nthreads = atoi(argv[2]);
+	}
+
+	if(argc > 3)
+	{
+		nfds = atoi(argv[3]);
+	}
+
+	if(argc > 4)
+	{
+		root = argv[4];
+	}
+
+	fprintf(stderr, "creating %u processes with %u threads and %u fds each under %s...\n", nprocs, nthreads, nfds, root);
+
+	if(make_procfs(root, nprocs, nthreads, nfds) != 0)
+	{
+		res = -1;
+		goto cleanup;
+	}
+
+	setenv("SYSDIG_HOST_ROOT", root, 1);
+
+	printf("%8s %5s %10s %10s %10s %14s\n", "threads", "lazy", "procs", "fds", "ms", "procs/s");
+
+	for(j = 0; j <= nruns; j++)
+	{
+		uint64_t n;
+		uint64_t nf;
+		uint64_t checksum;
+		bool lazy = (j == nruns);
+
+		if(scan(lazy? 1 : scan_threads[j], lazy, &n, &nf, &checksum) != 0)
+		{
+			res = -1;
+			break;
+		}
+
+		if(j == 0)
+		{
+			ref_nprocs = n;
+			ref_nfds = nf;
+			ref_checksum = checksum;
+		}
+		else if(n != ref_nprocs || nf != ref_nfds || checksum != ref_checksum)
+		{
+			if(lazy)
+			{
+				fprintf(stderr, "the fds looked up one at a time differ from the ones of the full scan\n");
+			}
+			else
+			{
+				fprintf(stderr, "the table built with %u threads differs from the serial one\n", scan_threads[j]);
+			}
+
+			res = -1;
+			break;
+		}
+	}
+
+cleanup:
+	nftw(root, remove_entry, 64, FTW_DEPTH | FTW_PHYS);
+
+	return res;
+}
@@ -32,6 +32,9 @@ extern "C" {
 #include <crtdbg.h>
 #endif
 #include <assert.h>
+#if defined(HAS_READAHEAD) || defined(HAS_ASYNC_DUMP) || defined(HAS_CAPTURE)
+#include <pthread.h>
+#endif
 #ifdef USE_ZLIB
 #include <zlib.h>
 #else
@@ -50,8 +53,22 @@ extern "C" {
 // Read buffer timeout constants
 //
 #define BUFFER_EMPTY_WAIT_TIME_MS 30
+#define BUFFER_EMPTY_THRESHOLD_B 20000
+#define BUFFER_MIN_WAIT_TIME_US 100
 #define MAX_N_CONSECUTIVE_WAITS 4
 
+//
+// Offline read-ahead constants
+//
+#define READAHEAD_BUF_SIZE (4 * 1024 * 1024)
+#define READAHEAD_NBUFS 4
+
+//
+// Memory mapped files: how far ahead of the reader the kernel is asked to
+// bring the file in memory
+//
+#define MMAP_WILLNEED_SIZE (32 * 1024 * 1024)
+
 //
 // Process flags
 //
@@ -71,6 +88,68 @@ typedef struct scap_device
 	uint32_t m_read_size; // Number of bytes currently ready to be read in this CPU's ring buffer
 }scap_device;
 
+//
+// Entry of the heap used by scap_next to merge the per-CPU rings
+//
+typedef struct scap_dev_heap_entry
+{
+	uint64_t m_ts; // Timestamp of the next event in the device buffer
+	uint16_t m_cpuid;
+}scap_dev_heap_entry;
+
+#ifdef HAS_MMAP_READ
+//
+// State of an uncompressed trace file that is read through a memory mapping
+//
+typedef struct scap_mmap_reader
+{
+	char* m_base;
+	uint64_t m_size;
+	uint64_t m_pos; // File offset of the next event block
+	uint64_t m_advised_end; // End of the range that the kernel has been asked to read in advance
+}scap_mmap_reader;
+#endif // HAS_MMAP_READ
+
+#ifdef HAS_READAHEAD
+//
+// A buffer of the offline read-ahead ring. It always contains whole event
+// blocks, so the consumer can hand out pointers into it.
+//
+typedef struct scap_readahead_buf
+{
+	char* m_buf;
+	uint32_t m_len; // Number of bytes of event blocks in m_buf
+	uint64_t m_off; // Uncompressed file offset of the first byte of m_buf
+	int64_t m_raw_off; // Compressed file offset after m_buf was filled
+	int32_t m_res; // What to return once m_buf has been consumed: SCAP_SUCCESS to move to the next buffer, SCAP_EOF or SCAP_FAILURE
+	char m_lasterr[SCAP_LASTERR_SIZE];
+}scap_readahead_buf;
+
+//
+// State of the offline read-ahead. A producer thread decompresses the file
+// into a ring of buffers, and scap_next() consumes them in order.
+//
+typedef struct scap_readahead
+{
+	pthread_t m_thread;
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_cond_full; // Signaled when the producer fills a buffer
+	pthread_cond_t m_cond_empty; // Signaled when the consumer releases a buffer
+	scap_readahead_buf m_bufs[READAHEAD_NBUFS];
+	uint32_t m_nfull; // Buffers filled by the producer and not yet released by the consumer
+	bool m_stop;
+	// Producer side
+	uint32_t m_prod_idx;
+	uint64_t m_prod_off;
+	// Consumer side
+	uint32_t m_cons_idx;
+	uint32_t m_cons_pos;
+	bool m_cons_holding; // True if the consumer is reading m_bufs[m_cons_idx]
+	uint64_t m_cons_off; // Uncompressed file offset of the next event
+	int64_t m_cons_raw_off;
+}scap_readahead;
+#endif // HAS_READAHEAD
+
 //
 // The open instance handle
 //
@@ -78,13 +157,24 @@ struct scap
 {
 	scap_device* m_devs;
 	uint32_t m_ndevs;
+	scap_dev_heap_entry* m_dev_heap; // Devices with data to consume, kept as a min-heap on the timestamp of their next event
+	uint32_t m_dev_heap_size; // Number of valid entries in m_dev_heap
 #ifdef USE_ZLIB
 	gzFile m_file;
 #else
 	FILE* m_file;
 #endif
 	char* m_file_evt_buf;
+	char* m_file_batch_buf; // Allocated on the first call to scap_next_batch() on a file
+#ifdef HAS_READAHEAD
+	scap_readahead* m_readahead; // NULL if the file is read synchronously
+#endif
+#ifdef HAS_MMAP_READ
+	scap_mmap_reader* m_mmap; // NULL if the file is read with gzread()
+#endif
+	struct scap_chunk_reader* m_chunk_reader; // NULL unless the file has been written with SCAP_COMPRESSION_CHUNKED
 	uint32_t m_last_evt_dump_flags;
+	int32_t m_batch_res; // Error of a partial batch, returned by the next scap_next_batch() call
 	char m_lasterr[SCAP_LASTERR_SIZE];
 	scap_threadinfo* m_proclist;
 	scap_threadinfo m_fake_kernel_proc;
@@ -93,8 +183,22 @@ struct scap
 	scap_machine_info m_machine_info;
 	scap_userlist* m_userlist;
 	uint32_t m_n_consecutive_waits;
+	scap_wait_params m_wait_params;
+	uint32_t m_cur_wait_us; // SCAP_WAIT_BACKOFF: duration of the last sleep
+	uint64_t m_data_pending_ns; // SCAP_WAIT_WATERMARK: when we first saw data waiting in the buffers, or 0
+	struct pollfd* m_pollfds; // SCAP_WAIT_WATERMARK: the devices to poll(), NULL if the driver can't poll them
+	uint64_t m_n_waits;
+	uint64_t m_wait_ns;
+	uint64_t m_max_wait_ns;
+	uint64_t m_n_drops_during_wait;
 	proc_entry_callback m_proc_callback;
 	void* m_proc_callback_context;
+	uint32_t m_proc_scan_threads; // Threads used to scan /proc, 0 to pick them based on the number of CPUs
+#ifdef HAS_CAPTURE
+	pthread_mutex_t* m_proc_scan_sockets_mutex; // Set on the handles of the /proc scan workers, which share the socket tables
+	struct scap_ns_socket_list* m_lazy_sockets_by_ns; // Socket tables used by scap_fd_lookup()
+#endif
+	bool m_lazy_fds; // Don't read the fds of the processes when scanning /proc
 	struct ppm_proclist_info* m_driver_procinfo;
 	bool refresh_proc_table_when_saving;
 };
@@ -103,6 +207,7 @@ struct scap_ns_socket_list
 {
 	int64_t net_ns;
 	scap_fdinfo* sockets;
+	uint64_t read_ts; // Monotonic time when the table was read
 	UT_hash_handle hh;
 };
 
@@ -111,6 +216,7 @@ struct scap_ns_socket_list
 //
 #define MEMBER_SIZE(type, member) sizeof(((type *)0)->member)
 #define FILE_READ_BUF_SIZE 65536
+#define FILE_BATCH_BUF_SIZE (16 * FILE_READ_BUF_SIZE)
 
 //
 // Internal library functions
@@ -118,6 +224,10 @@ struct scap_ns_socket_list
 
 // Read the full event buffer for the given processor
 int32_t scap_readbuf(scap_t* handle, uint32_t proc, bool blocking, OUT char** buf, OUT uint32_t* len);
+#if defined(HAS_CAPTURE)
+// Return the value of the monotonic clock in nanoseconds
+uint64_t scap_get_monotonic_time_ns();
+#endif
 // Scan a directory containing process information
 int32_t scap_proc_scan_proc_dir(scap_t* handle, char* procdirname, int parenttid, int tid_to_scan, struct scap_threadinfo** pi, char *error, bool scan_sockets);
 // Remove an entry from the process list by parsin a PPME_PROC_EXIT event
@@ -126,6 +236,8 @@ int32_t scap_proc_scan_proc_dir(scap_t* handle, char* procdirname, int parenttid
 // void scap_proc_remove_scheduled(scap_t* handle);
 // Free the process table
 void scap_proc_free_table(scap_t* handle);
+// Add a copy of the process table of src, including the fd tables, to the one of dst
+int32_t scap_proc_copy_table(scap_t* dst, scap_t* src);
 // Copy the fd table of a process into the one of another process
 // int32_t scap_proc_copy_fd_table(scap_t* handle, scap_threadinfo* dst, scap_threadinfo* src);
 // Internal helper function to output the process table to screen
@@ -161,8 +273,26 @@ int32_t scap_read_init(scap_t* handle, gzFile f);
 int32_t scap_add_fd_to_proc_table(scap_t* handle, scap_threadinfo* pi, scap_fdinfo* fdi);
 // Remove the given fd from the process table of the process pointed by pi
 void scap_fd_remove(scap_t* handle, scap_threadinfo* pi, int64_t fd);
+// Load the chunk index from the end of a SCAP_COMPRESSION_CHUNKED file
+void scap_read_chunk_index(scap_t* handle, const char* fname);
+// Free the read state of a SCAP_COMPRESSION_CHUNKED file
+void scap_chunk_reader_free(scap_t* handle);
 // Read an event from disk
 int32_t scap_next_offline(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid);
+// Read a batch of events from disk
+int32_t scap_next_offline_batch(scap_t* handle, uint32_t max_evts, OUT scap_evt** pevents, OUT uint16_t* pcpuids, OUT uint32_t* pflags, OUT uint32_t* pnevts);
+#ifdef HAS_MMAP_READ
+// Map an uncompressed trace file in memory, leaving m_mmap NULL if it can't be done
+void scap_mmap_start(scap_t* handle, const char* fname);
+// Unmap a trace file mapped with scap_mmap_start()
+void scap_mmap_stop(scap_t* handle);
+#endif
+#ifdef HAS_READAHEAD
+// Start the thread that reads the events of an offline capture ahead of the consumer
+int32_t scap_readahead_start(scap_t* handle);
+// Stop the read-ahead thread and free its buffers
+void scap_readahead_stop(scap_t* handle);
+#endif
 // read the filedescriptors for a given process directory
 int32_t scap_fd_scan_fd_dir(scap_t* handle, char * procdir, scap_threadinfo* pi, struct scap_ns_socket_list** sockets_by_ns, char *error);
 // read tcp or udp sockets from the proc filesystem
@@ -175,10 +305,14 @@ void scap_proc_print_proc_by_tid(scap_t* handle, uint64_t tid);
 int32_t scap_create_iflist(scap_t* handle);
 // Free a previously allocated list of interfaces
 void scap_free_iflist(scap_addrlist* ifhandle);
+// Make a copy of a list of interfaces, or return NULL if out of memory
+scap_addrlist* scap_dup_iflist(const scap_addrlist* ifhandle);
 // Allocate and return the list of interfaces on this system
 int32_t scap_create_userlist(scap_t* handle);
 // Free a previously allocated list of users
 void scap_free_userlist(scap_userlist* uhandle);
+// Make a copy of a list of users, or return NULL if out of memory
+scap_userlist* scap_dup_userlist(const scap_userlist* uhandle);
 
 int32_t scap_fd_post_process_unix_sockets(scap_t* handle, scap_fdinfo* sockets);
 
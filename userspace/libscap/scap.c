@@ -27,6 +27,7 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 #include <fcntl.h>
 #include <poll.h>
 #include <errno.h>
+#include <time.h>
 #endif // _WIN32
 
 #include "scap.h"
@@ -34,8 +35,8 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 #include "../../driver/driver_config.h"
 #endif // HAS_CAPTURE
 #include "../../driver/ppm_ringbuffer.h"
-#include "scap_savefile.h"
 #include "scap-int.h"
+#include "scap_savefile.h"
 
 //#define NDEBUG
 #include <assert.h>
@@ -67,7 +68,8 @@ char* scap_getlasterr(scap_t* handle)
 scap_t* scap_open_live_int(char *error, 
 						   proc_entry_callback proc_callback,
 						   void* proc_callback_context,
-						   bool import_users)
+						   bool import_users,
+						   bool lazy_fds)
 {
 #if !defined(HAS_CAPTURE)
 	snprintf(error, SCAP_LASTERR_SIZE, "live capture not supported on %s", PLATFORM_NAME);
@@ -96,6 +98,7 @@ scap_t* scap_open_live_int(char *error,
 	// Preliminary initializations
 	//
 	memset(handle, 0, sizeof(scap_t));
+	scap_set_wait_params(handle, NULL);
 
 	//
 	// Find out how many devices we have to open, which equals to the number of CPUs
@@ -116,6 +119,14 @@ scap_t* scap_open_live_int(char *error,
 		return NULL;
 	}
 
+	handle->m_dev_heap = (scap_dev_heap_entry*)malloc(ndevs * sizeof(scap_dev_heap_entry));
+	if(!handle->m_dev_heap)
+	{
+		scap_close(handle);
+		snprintf(error, SCAP_LASTERR_SIZE, "error allocating the device heap");
+		return NULL;
+	}
+
 	for(j = 0; j < ndevs; j++)
 	{
 		handle->m_devs[j].m_buffer = (char*)MAP_FAILED;
@@ -129,6 +140,7 @@ scap_t* scap_open_live_int(char *error,
 	//
 	handle->m_proc_callback = proc_callback;
 	handle->m_proc_callback_context = proc_callback_context;
+	handle->m_lazy_fds = lazy_fds;
 	handle->m_machine_info.num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
 	handle->m_machine_info.memory_size_bytes = (uint64_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
 	gethostname(handle->m_machine_info.hostname, sizeof(handle->m_machine_info.hostname) / sizeof(handle->m_machine_info.hostname[0]));
@@ -280,11 +292,97 @@ scap_t* scap_open_live_int(char *error,
 #endif // HAS_CAPTURE
 }
 
+scap_t* scap_open_ringbufs(uint32_t ndevs,
+						   struct ppm_ring_buffer_info** bufinfos,
+						   char** buffers,
+						   char *error)
+{
+#if !defined(HAS_CAPTURE)
+	snprintf(error, SCAP_LASTERR_SIZE, "live capture not supported on %s", PLATFORM_NAME);
+	return NULL;
+#else
+	uint32_t j;
+	scap_t* handle = NULL;
+
+	if(ndevs == 0 || ndevs > 65535)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "invalid number of ring buffers %" PRIu32, ndevs);
+		return NULL;
+	}
+
+	//
+	// Allocate the handle
+	//
+	handle = (scap_t*)malloc(sizeof(scap_t));
+	if(!handle)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "error allocating the scap_t structure");
+		return NULL;
+	}
+
+	memset(handle, 0, sizeof(scap_t));
+	scap_set_wait_params(handle, NULL);
+
+	handle->m_devs = (scap_device*)malloc(ndevs * sizeof(scap_device));
+	handle->m_dev_heap = (scap_dev_heap_entry*)malloc(ndevs * sizeof(scap_dev_heap_entry));
+	if(!handle->m_devs || !handle->m_dev_heap)
+	{
+		scap_close(handle);
+		snprintf(error, SCAP_LASTERR_SIZE, "error allocating the device handles");
+		return NULL;
+	}
+
+	handle->m_ndevs = ndevs;
+
+	//
+	// The rings are owned by the caller: a negative fd tells scap_close() not to
+	// unmap them, and there's no driver to send ioctls to.
+	//
+	for(j = 0; j < ndevs; j++)
+	{
+		handle->m_devs[j].m_fd = -1;
+		handle->m_devs[j].m_buffer = buffers[j];
+		handle->m_devs[j].m_bufinfo = bufinfos[j];
+		handle->m_devs[j].m_lastreadsize = 0;
+		handle->m_devs[j].m_sn_len = 0;
+	}
+
+	handle->m_machine_info.num_cpus = ndevs;
+	gethostname(handle->m_machine_info.hostname, sizeof(handle->m_machine_info.hostname) / sizeof(handle->m_machine_info.hostname[0]));
+
+	handle->m_fake_kernel_proc.tid = -1;
+	handle->m_fake_kernel_proc.pid = -1;
+	handle->m_fake_kernel_proc.flags = 0;
+	snprintf(handle->m_fake_kernel_proc.comm, SCAP_MAX_PATH_SIZE, "kernel");
+	snprintf(handle->m_fake_kernel_proc.exe, SCAP_MAX_PATH_SIZE, "kernel");
+	handle->m_fake_kernel_proc.args[0] = 0;
+
+	//
+	// Empty tables, so that the events can be dumped to a trace file. The
+	// rings don't come from this machine, so /proc is not rescanned.
+	//
+	handle->m_addrlist = (scap_addrlist*)calloc(1, sizeof(scap_addrlist));
+	handle->m_userlist = (scap_userlist*)calloc(1, sizeof(scap_userlist));
+	if(!handle->m_addrlist || !handle->m_userlist)
+	{
+		scap_close(handle);
+		snprintf(error, SCAP_LASTERR_SIZE, "error allocating the interface and user lists");
+		return NULL;
+	}
+
+	handle->refresh_proc_table_when_saving = false;
+
+	return handle;
+#endif // HAS_CAPTURE
+}
+
 scap_t* scap_open_offline_int(const char* fname, 
 							  char *error,
 							  proc_entry_callback proc_callback, 
 							  void* proc_callback_context,
-							  bool import_users)
+							  bool import_users,
+							  bool readahead,
+							  bool map_file)
 {
 	scap_t* handle = NULL;
 
@@ -305,6 +403,26 @@ scap_t* scap_open_offline_int(const char* fname,
 	handle->m_proc_callback_context = proc_callback_context;
 	handle->m_devs = NULL;
 	handle->m_ndevs = 0;
+	handle->m_dev_heap = NULL;
+	handle->m_dev_heap_size = 0;
+	handle->m_file_batch_buf = NULL;
+#ifdef HAS_READAHEAD
+	handle->m_readahead = NULL;
+#endif
+#ifdef HAS_MMAP_READ
+	handle->m_mmap = NULL;
+#endif
+	handle->m_chunk_reader = NULL;
+	handle->m_proc_scan_threads = 0;
+#ifdef HAS_CAPTURE
+	handle->m_proc_scan_sockets_mutex = NULL;
+	handle->m_lazy_sockets_by_ns = NULL;
+#endif
+	handle->m_lazy_fds = false;
+	handle->m_n_waits = 0;
+	handle->m_wait_ns = 0;
+	handle->m_max_wait_ns = 0;
+	handle->m_n_drops_during_wait = 0;
 	handle->m_proclist = NULL;
 	handle->m_evtcnt = 0;
 	handle->m_file = NULL;
@@ -312,6 +430,7 @@ scap_t* scap_open_offline_int(const char* fname,
 	handle->m_userlist = NULL;
 	handle->m_machine_info.num_cpus = (uint32_t)-1;
 	handle->m_last_evt_dump_flags = 0;
+	handle->m_batch_res = SCAP_SUCCESS;
 	handle->m_driver_procinfo = NULL;
 	handle->refresh_proc_table_when_saving = true;
 
@@ -344,6 +463,45 @@ scap_t* scap_open_offline_int(const char* fname,
 		return NULL;
 	}
 
+	//
+	// Chunked files can be seeked, so load the index of their chunks. Their
+	// events are read synchronously, since each chunk is inflated in one go.
+	//
+	if(handle->m_chunk_reader != NULL)
+	{
+		scap_read_chunk_index(handle, fname);
+	}
+
+#ifdef HAS_MMAP_READ
+	//
+	// Uncompressed files are mapped in memory and their events are returned
+	// without copying them
+	//
+	if(map_file)
+	{
+		scap_mmap_start(handle, fname);
+	}
+#endif
+
+#ifdef HAS_READAHEAD
+	//
+	// Start decompressing the events in the background
+	//
+	if(readahead && handle->m_chunk_reader == NULL
+#ifdef HAS_MMAP_READ
+		&& handle->m_mmap == NULL
+#endif
+		)
+	{
+		if(scap_readahead_start(handle) != SCAP_SUCCESS)
+		{
+			snprintf(error, SCAP_LASTERR_SIZE, "%s", scap_getlasterr(handle));
+			scap_close(handle);
+			return NULL;
+		}
+	}
+#endif
+
 	if(!import_users)
 	{
 		if(handle->m_userlist != NULL)
@@ -368,12 +526,12 @@ scap_t* scap_open_offline_int(const char* fname,
 
 scap_t* scap_open_offline(const char* fname, char *error)
 {
-	return scap_open_offline_int(fname, error, NULL, NULL, true);
+	return scap_open_offline_int(fname, error, NULL, NULL, true, false, false);
 }
 
 scap_t* scap_open_live(char *error)
 {
-	return scap_open_live_int(error, NULL, NULL, true);
+	return scap_open_live_int(error, NULL, NULL, true, false);
 }
 
 scap_t* scap_open(scap_open_args args, char *error)
@@ -382,13 +540,23 @@ scap_t* scap_open(scap_open_args args, char *error)
 	{
 		return scap_open_offline_int(args.fname, error, 
 			args.proc_callback, args.proc_callback_context,
-			args.import_users);
+			args.import_users, args.readahead, args.mmap);
 	}
 	else
 	{
-		return scap_open_live_int(error, args.proc_callback, 
+		scap_t* handle = scap_open_live_int(error, args.proc_callback,
 			args.proc_callback_context,
-			args.import_users);
+			args.import_users,
+			args.lazy_fds);
+
+		if(handle != NULL && scap_set_wait_params(handle, &args.wait_params) != SCAP_SUCCESS)
+		{
+			snprintf(error, SCAP_LASTERR_SIZE, "%s", scap_getlasterr(handle));
+			scap_close(handle);
+			return NULL;
+		}
+
+		return handle;
 	}
 }
 
@@ -396,6 +564,13 @@ void scap_close(scap_t* handle)
 {
 	if(handle->m_file)
 	{
+#ifdef HAS_READAHEAD
+		scap_readahead_stop(handle);
+#endif
+#ifdef HAS_MMAP_READ
+		scap_mmap_stop(handle);
+#endif
+		scap_chunk_reader_free(handle);
 		gzclose(handle->m_file);
 	}
 	else
@@ -410,7 +585,11 @@ void scap_close(scap_t* handle)
 		//
 		for(j = 0; j < handle->m_ndevs; j++)
 		{
-			if(handle->m_devs[j].m_buffer != MAP_FAILED)
+			//
+			// Devices with a negative fd are backed by rings provided through
+			// scap_open_ringbufs(), which are owned by the caller
+			//
+			if(handle->m_devs[j].m_buffer != MAP_FAILED && handle->m_devs[j].m_fd >= 0)
 			{
 				munmap(handle->m_devs[j].m_bufinfo, sizeof(struct ppm_ring_buffer_info));
 				munmap(handle->m_devs[j].m_buffer, RING_BUF_SIZE * 2);
@@ -425,6 +604,18 @@ void scap_close(scap_t* handle)
 		{
 			free(handle->m_devs);
 		}
+
+		if(handle->m_dev_heap != NULL)
+		{
+			free(handle->m_dev_heap);
+		}
+
+		if(handle->m_pollfds != NULL)
+		{
+			free(handle->m_pollfds);
+		}
+
+		scap_fd_free_ns_sockets_list(handle, &handle->m_lazy_sockets_by_ns);
 #endif // HAS_CAPTURE
 	}
 
@@ -433,6 +624,11 @@ void scap_close(scap_t* handle)
 		free(handle->m_file_evt_buf);
 	}
 
+	if(handle->m_file_batch_buf)
+	{
+		free(handle->m_file_batch_buf);
+	}
+
 	// Free the process table
 	if(handle->m_proclist != NULL)
 	{
@@ -556,10 +752,28 @@ int32_t scap_readbuf(scap_t* handle, uint32_t cpuid, bool blocking, OUT char** b
 	return SCAP_SUCCESS;
 }
 
-bool check_scap_next_wait(scap_t* handle)
+uint64_t scap_get_monotonic_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//
+// Decide, based on the wait policy, for how long the reader should sleep
+// before reading the buffers. 0 means that the buffers should be read right
+// away.
+//
+static uint32_t check_scap_next_wait(scap_t* handle)
 {
 	uint32_t j;
-	bool res = true;
+	uint32_t max_read_size = 0;
+	scap_wait_params* params = &handle->m_wait_params;
+
+	if(params->policy == SCAP_WAIT_BUSY_POLL)
+	{
+		return 0;
+	}
 
 	for(j = 0; j < handle->m_ndevs; j++)
 	{
@@ -569,26 +783,203 @@ bool check_scap_next_wait(scap_t* handle)
 
 		get_buf_pointers(dev->m_bufinfo, &thead, &ttail, &dev->m_read_size);
 
-		if(dev->m_read_size > 20000)
+		if(dev->m_read_size > max_read_size)
+		{
+			max_read_size = dev->m_read_size;
+		}
+	}
+
+	switch(params->policy)
+	{
+	case SCAP_WAIT_BACKOFF:
+		if(max_read_size != 0)
+		{
+			handle->m_cur_wait_us = 0;
+			return 0;
+		}
+
+		if(handle->m_cur_wait_us == 0)
+		{
+			handle->m_cur_wait_us = params->min_wait_us;
+		}
+		else if(handle->m_cur_wait_us < params->max_wait_us / 2)
+		{
+			handle->m_cur_wait_us *= 2;
+		}
+		else
+		{
+			handle->m_cur_wait_us = params->max_wait_us;
+		}
+
+		return handle->m_cur_wait_us;
+	case SCAP_WAIT_WATERMARK:
+	{
+		uint64_t pending_us = 0;
+
+		if(max_read_size >= params->bytes_watermark)
+		{
+			handle->m_data_pending_ns = 0;
+			return 0;
+		}
+
+		if(max_read_size != 0)
+		{
+			uint64_t now = scap_get_monotonic_time_ns();
+
+			if(handle->m_data_pending_ns == 0)
+			{
+				handle->m_data_pending_ns = now;
+			}
+
+			pending_us = (now - handle->m_data_pending_ns) / 1000;
+			if(pending_us >= params->max_wait_us)
+			{
+				handle->m_data_pending_ns = 0;
+				return 0;
+			}
+		}
+
+		//
+		// poll() returns when the watermark is reached, so it can wait
+		// for as long as the data that is already there allows
+		//
+		if(handle->m_pollfds != NULL)
+		{
+			return params->max_wait_us - (uint32_t)pending_us;
+		}
+
+		return params->min_wait_us;
+	}
+	default:
+		if(max_read_size > params->bytes_watermark)
+		{
+			handle->m_n_consecutive_waits = 0;
+			return 0;
+		}
+
+		if(handle->m_n_consecutive_waits >= MAX_N_CONSECUTIVE_WAITS)
 		{
 			handle->m_n_consecutive_waits = 0;
-			res = false;
+			return 0;
 		}
+
+		handle->m_n_consecutive_waits++;
+		return params->max_wait_us;
 	}
+}
+
+static uint64_t get_buffer_drops(scap_t* handle)
+{
+	uint32_t j;
+	uint64_t ndrops = 0;
 
-	if(res == false)
+	for(j = 0; j < handle->m_ndevs; j++)
 	{
-		return false;
+		ndrops += handle->m_devs[j].m_bufinfo->n_drops_buffer;
 	}
 
-	if(handle->m_n_consecutive_waits >= MAX_N_CONSECUTIVE_WAITS)
+	return ndrops;
+}
+
+//
+// Sleep and keep track of how long we slept and of how many events the
+// driver dropped in the meantime, so that the wait policy can be tuned
+//
+static void scap_wait(scap_t* handle, uint32_t wait_us)
+{
+	uint64_t ndrops = get_buffer_drops(handle);
+	uint64_t start = scap_get_monotonic_time_ns();
+	uint64_t duration;
+
+	if(handle->m_pollfds != NULL && handle->m_wait_params.policy == SCAP_WAIT_WATERMARK)
 	{
-		handle->m_n_consecutive_waits = 0;
-		return false;
+		//
+		// Errors, like EINTR, just end the wait early
+		//
+		poll(handle->m_pollfds, handle->m_ndevs, (wait_us + 999) / 1000);
 	}
 	else
 	{
-		return true;
+		usleep(wait_us);
+	}
+
+	duration = scap_get_monotonic_time_ns() - start;
+
+	handle->m_n_waits++;
+	handle->m_wait_ns += duration;
+	if(duration > handle->m_max_wait_ns)
+	{
+		handle->m_max_wait_ns = duration;
+	}
+
+	handle->m_n_drops_during_wait += get_buffer_drops(handle) - ndrops;
+}
+
+//
+// The devices that have data to consume are kept in a min-heap keyed on the
+// timestamp of their next event, so that scap_next_live() can find the oldest
+// event without scanning every ring. Ties are broken on the cpu id, which keeps
+// the order identical to the one of a linear scan of m_devs.
+//
+static inline bool dev_heap_less(const scap_dev_heap_entry* a, const scap_dev_heap_entry* b)
+{
+	return a->m_ts < b->m_ts || (a->m_ts == b->m_ts && a->m_cpuid < b->m_cpuid);
+}
+
+static inline void dev_heap_sift_down(scap_t* handle, uint32_t pos)
+{
+	scap_dev_heap_entry* heap = handle->m_dev_heap;
+	uint32_t size = handle->m_dev_heap_size;
+	scap_dev_heap_entry cur = heap[pos];
+
+	while(true)
+	{
+		uint32_t child = 2 * pos + 1;
+
+		if(child >= size)
+		{
+			break;
+		}
+
+		if(child + 1 < size && dev_heap_less(&heap[child + 1], &heap[child]))
+		{
+			child++;
+		}
+
+		if(!dev_heap_less(&heap[child], &cur))
+		{
+			break;
+		}
+
+		heap[pos] = heap[child];
+		pos = child;
+	}
+
+	heap[pos] = cur;
+}
+
+static void dev_heap_build(scap_t* handle)
+{
+	uint32_t j;
+
+	handle->m_dev_heap_size = 0;
+
+	for(j = 0; j < handle->m_ndevs; j++)
+	{
+		scap_device* dev = &(handle->m_devs[j]);
+
+		if(dev->m_sn_len != 0)
+		{
+			scap_dev_heap_entry* entry = &(handle->m_dev_heap[handle->m_dev_heap_size++]);
+
+			entry->m_ts = ((scap_evt*)dev->m_sn_next_event)->ts;
+			entry->m_cpuid = (uint16_t)j;
+		}
+	}
+
+	for(j = handle->m_dev_heap_size / 2; j > 0; j--)
+	{
+		dev_heap_sift_down(handle, j - 1);
 	}
 }
 
@@ -599,10 +990,27 @@ int32_t refill_read_buffers(scap_t* handle, bool wait)
 
 	if(wait)
 	{
-		if(check_scap_next_wait(handle))
+		uint32_t wait_us = check_scap_next_wait(handle);
+
+		if(wait_us != 0)
 		{
-			usleep(BUFFER_EMPTY_WAIT_TIME_MS * 1000);
-			handle->m_n_consecutive_waits++;
+			scap_wait(handle, wait_us);
+
+			//
+			// With the watermark policy, the buffers are read only when
+			// check_scap_next_wait() says that enough data is ready, or that
+			// it has been waiting for too long. poll() only returns in those
+			// cases, the sleep has to check again.
+			//
+			if(handle->m_wait_params.policy == SCAP_WAIT_WATERMARK)
+			{
+				if(handle->m_pollfds == NULL)
+				{
+					return SCAP_TIMEOUT;
+				}
+
+				handle->m_data_pending_ns = 0;
+			}
 		}
 	}
 
@@ -625,6 +1033,8 @@ int32_t refill_read_buffers(scap_t* handle, bool wait)
 		}
 	}
 
+	dev_heap_build(handle);
+
 	//
 	// Note: we might return a spurious timeout here in case the previous loop extracted valid data to parse.
 	//       It's ok, since this is rare and the caller will just call us again after receiving a 
@@ -648,79 +1058,65 @@ static int32_t scap_next_live(scap_t* handle, OUT scap_evt** pevent, OUT uint16_
 	ASSERT(false);
 	return SCAP_FAILURE;
 #else
-	uint32_t j;
-	uint64_t max_ts = 0xffffffffffffffffLL;
-	uint64_t max_buf_size = 0;
-	scap_evt* pe = NULL;
-	uint32_t ndevs = handle->m_ndevs;
+	scap_device* dev;
+	scap_evt* pe;
+	uint16_t cpuid;
 
 	*pcpuid = 65535;
 
-	for(j = 0; j < ndevs; j++)
+	if(handle->m_dev_heap_size == 0)
 	{
-		scap_device* dev = &(handle->m_devs[j]);
-
-		if(dev->m_sn_len == 0)
-		{
-			continue;
-		}
-
 		//
-		// Make sure that we have data from this ring
+		// All the buffers have been consumed. Check if there's enough data to keep going or
+		// if we should wait.
 		//
-		if(dev->m_sn_len != 0)
-		{
-			if(dev->m_sn_len > max_buf_size)
-			{
-				max_buf_size = dev->m_sn_len;
-			}
-
-			//
-			// We want to consume the event with the lowest timestamp
-			//
-			pe = (scap_evt*)dev->m_sn_next_event;
+		return refill_read_buffers(handle, true);
+	}
 
-			if(pe->ts < max_ts)
-			{
-				if(pe->len > dev->m_sn_len)
-				{
-					snprintf(handle->m_lasterr,	SCAP_LASTERR_SIZE, "scap_next buffer corruption");
+	//
+	// We want to consume the event with the lowest timestamp, which is the next
+	// event of the device at the top of the heap
+	//
+	cpuid = handle->m_dev_heap[0].m_cpuid;
+	dev = &(handle->m_devs[cpuid]);
+	pe = (scap_evt*)dev->m_sn_next_event;
 
-					//
-					// if you get the following assertion, first recompile the driver and libscap
-					//
-					ASSERT(false);
-					return SCAP_FAILURE;
-				}
+	if(pe->len > dev->m_sn_len)
+	{
+		snprintf(handle->m_lasterr,	SCAP_LASTERR_SIZE, "scap_next buffer corruption");
 
-				*pevent = pe;
-				*pcpuid = j;
-				max_ts = pe->ts;
-			}
-		}
+		//
+		// if you get the following assertion, first recompile the driver and libscap
+		//
+		ASSERT(false);
+		return SCAP_FAILURE;
 	}
 
+	*pevent = pe;
+	*pcpuid = cpuid;
+
 	//
-	// Check which buffer has been picked
+	// Update the pointers and the position of this device in the heap. If the
+	// device has no more data, it leaves the heap until the next refill.
 	//
-	if(*pcpuid != 65535)
+	dev->m_sn_len -= pe->len;
+	dev->m_sn_next_event += pe->len;
+
+	if(dev->m_sn_len != 0)
 	{
-		//
-		// Update the pointers.
-		//
-		ASSERT(handle->m_devs[*pcpuid].m_sn_len >= (*pevent)->len);
-		handle->m_devs[*pcpuid].m_sn_len -= (*pevent)->len;
-		handle->m_devs[*pcpuid].m_sn_next_event += (*pevent)->len;
-		return SCAP_SUCCESS;
+		handle->m_dev_heap[0].m_ts = ((scap_evt*)dev->m_sn_next_event)->ts;
 	}
 	else
 	{
-		//
-		// All the buffers have been consumed. Check if there's enough data to keep going or
-		// if we should wait.
-		//
-		return refill_read_buffers(handle, true);
+		handle->m_dev_heap[0] = handle->m_dev_heap[--handle->m_dev_heap_size];
+	}
+
+	if(handle->m_dev_heap_size > 1)
+	{
+		dev_heap_sift_down(handle, 0);
 	}
+
+	return SCAP_SUCCESS;
 #endif
 }
 
@@ -745,6 +1141,89 @@ int32_t scap_next(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid)
 	return res;
 }
 
+#if defined(HAS_CAPTURE)
+static int32_t scap_next_live_batch(scap_t* handle, uint32_t max_evts, OUT scap_evt** pevents, OUT uint16_t* pcpuids, OUT uint32_t* pflags, OUT uint32_t* pnevts)
+{
+	uint32_t n = 0;
+
+	if(handle->m_dev_heap_size == 0)
+	{
+		return refill_read_buffers(handle, true);
+	}
+
+	//
+	// Only consume what was read by the last refill: the ring tails don't move
+	// until the next refill, so all the returned events stay valid until the
+	// next call.
+	//
+	while(n < max_evts && handle->m_dev_heap_size != 0)
+	{
+		int32_t res = scap_next_live(handle, &pevents[n], &pcpuids[n]);
+
+		if(res != SCAP_SUCCESS)
+		{
+			return res;
+		}
+
+		pflags[n] = 0;
+		n++;
+		*pnevts = n;
+	}
+
+	return SCAP_SUCCESS;
+}
+#endif // HAS_CAPTURE
+
+int32_t scap_next_batch(scap_t* handle, uint32_t max_evts, OUT scap_evt** pevents, OUT uint16_t* pcpuids, OUT uint32_t* pflags, OUT uint32_t* pnevts)
+{
+	int32_t res;
+
+	*pnevts = 0;
+
+	//
+	// The error that ended the previous batch
+	//
+	if(handle->m_batch_res != SCAP_SUCCESS)
+	{
+		res = handle->m_batch_res;
+		handle->m_batch_res = SCAP_SUCCESS;
+		return res;
+	}
+
+	if(handle->m_file)
+	{
+		res = scap_next_offline_batch(handle, max_evts, pevents, pcpuids, pflags, pnevts);
+	}
+	else
+	{
+#if !defined(HAS_CAPTURE)
+		ASSERT(false);
+		res = SCAP_FAILURE;
+#else
+		res = scap_next_live_batch(handle, max_evts, pevents, pcpuids, pflags, pnevts);
+#endif
+	}
+
+	handle->m_evtcnt += *pnevts;
+
+	//
+	// An error or the end of the file in the middle of a batch doesn't
+	// discard the events read before it: they are returned now, and the
+	// error with the next call, like scap_next() would do
+	//
+	if(res != SCAP_SUCCESS && *pnevts != 0)
+	{
+		if(res != SCAP_TIMEOUT)
+		{
+			handle->m_batch_res = res;
+		}
+
+		res = SCAP_SUCCESS;
+	}
+
+	return res;
+}
+
 //
 // Return the process list for the given handle
 //
@@ -763,6 +1242,10 @@ int32_t scap_get_stats(scap_t* handle, OUT scap_stats* stats)
 	stats->n_evts = 0;
 	stats->n_drops = 0;
 	stats->n_preemptions = 0;
+	stats->n_waits = handle->m_n_waits;
+	stats->wait_ns = handle->m_wait_ns;
+	stats->max_wait_ns = handle->m_max_wait_ns;
+	stats->n_drops_during_wait = handle->m_n_drops_during_wait;
 
 	for(j = 0; j < handle->m_ndevs; j++)
 	{
@@ -775,6 +1258,93 @@ int32_t scap_get_stats(scap_t* handle, OUT scap_stats* stats)
 	return SCAP_SUCCESS;
 }
 
+int32_t scap_set_wait_params(scap_t* handle, const scap_wait_params* params)
+{
+	//
+	// Not supported for files
+	//
+	if(handle->m_file)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "the wait policy cannot be set on offline captures");
+		return SCAP_FAILURE;
+	}
+
+	if(params == NULL)
+	{
+		memset(&handle->m_wait_params, 0, sizeof(handle->m_wait_params));
+	}
+	else if(params->policy > SCAP_WAIT_WATERMARK)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid wait policy %d", (int)params->policy);
+		return SCAP_FAILURE;
+	}
+	else
+	{
+		handle->m_wait_params = *params;
+	}
+
+	if(handle->m_wait_params.max_wait_us == 0)
+	{
+		handle->m_wait_params.max_wait_us = BUFFER_EMPTY_WAIT_TIME_MS * 1000;
+	}
+
+	if(handle->m_wait_params.min_wait_us == 0)
+	{
+		handle->m_wait_params.min_wait_us = BUFFER_MIN_WAIT_TIME_US;
+
+		if(handle->m_wait_params.min_wait_us > handle->m_wait_params.max_wait_us)
+		{
+			handle->m_wait_params.min_wait_us = handle->m_wait_params.max_wait_us;
+		}
+	}
+
+	if(handle->m_wait_params.bytes_watermark == 0)
+	{
+		handle->m_wait_params.bytes_watermark = BUFFER_EMPTY_THRESHOLD_B;
+	}
+
+	if(handle->m_wait_params.min_wait_us > handle->m_wait_params.max_wait_us)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "min_wait_us can't be bigger than max_wait_us");
+		return SCAP_FAILURE;
+	}
+
+	handle->m_n_consecutive_waits = 0;
+	handle->m_cur_wait_us = 0;
+	handle->m_data_pending_ns = 0;
+
+#if defined(HAS_CAPTURE)
+	free(handle->m_pollfds);
+	handle->m_pollfds = NULL;
+
+	//
+	// The watermark policy blocks in poll() if the driver tells it when a
+	// buffer reaches the watermark. Drivers without poll() support reject
+	// the ioctl, and the policy sleeps instead.
+	//
+	if(handle->m_wait_params.policy == SCAP_WAIT_WATERMARK &&
+		handle->m_ndevs != 0 &&
+		handle->m_devs[0].m_fd >= 0 &&
+		ioctl(handle->m_devs[0].m_fd, PPM_IOCTL_SET_POLL_WATERMARK, handle->m_wait_params.bytes_watermark) == 0)
+	{
+		uint32_t j;
+
+		handle->m_pollfds = (struct pollfd*)malloc(handle->m_ndevs * sizeof(struct pollfd));
+		if(handle->m_pollfds != NULL)
+		{
+			for(j = 0; j < handle->m_ndevs; j++)
+			{
+				handle->m_pollfds[j].fd = handle->m_devs[j].m_fd;
+				handle->m_pollfds[j].events = POLLIN;
+				handle->m_pollfds[j].revents = 0;
+			}
+		}
+	}
+#endif
+
+	return SCAP_SUCCESS;
+}
+
 //
 // Stop capturing the events
 //
@@ -1000,6 +1570,8 @@ int32_t scap_set_snaplen(scap_t* handle, uint32_t snaplen)
 
 			handle->m_devs[j].m_sn_len = 0;
 		}
+
+		handle->m_dev_heap_size = 0;
 	}
 
 	return SCAP_SUCCESS;
@@ -1014,28 +1586,26 @@ int64_t scap_get_readfile_offset(scap_t* handle)
 		return -1;
 	}
 
-	return gzoffset(handle->m_file);
-}
+#ifdef HAS_READAHEAD
+	if(handle->m_readahead)
+	{
+		return handle->m_readahead->m_cons_raw_off;
+	}
+#endif
 
-static int32_t scap_handle_eventmask(scap_t* handle, uint32_t op, uint32_t event_id)
-{
-	//
-	// Not supported on files
-	//
-	if(handle->m_file)
+#ifdef HAS_MMAP_READ
+	if(handle->m_mmap)
 	{
-		snprintf(handle->m_lasterr,	SCAP_LASTERR_SIZE, "manipulating eventmasks not supported on offline captures");
-		return SCAP_FAILURE;
+		return handle->m_mmap->m_pos;
 	}
+#endif
 
-#if !defined(HAS_CAPTURE)
-	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "eventmask not supported on %s", PLATFORM_NAME);
-	return SCAP_FAILURE;
-#else
-	//
-	// Tell the driver to change the snaplen
-	//
+	return gzoffset(handle->m_file);
+}
 
+#if defined(HAS_CAPTURE)
+static int32_t scap_eventmask_ioctl(scap_t* handle, uint32_t op, uint32_t event_id)
+{
 	switch(op) {
 	case PPM_IOCTL_MASK_ZERO_EVENTS:
 	case PPM_IOCTL_MASK_SET_EVENT:
@@ -1056,24 +1626,53 @@ static int32_t scap_handle_eventmask(scap_t* handle, uint32_t op, uint32_t event
 		return SCAP_FAILURE;
 	}
 
+	return SCAP_SUCCESS;
+}
+
+//
+// Force a flush of the read buffers, so we don't capture events with the old mask
+//
+static void scap_flush_after_eventmask(scap_t* handle)
+{
+	uint32_t j;
+
+	for(j = 0; j < handle->m_ndevs; j++)
 	{
-		uint32_t j;
+		scap_readbuf(handle,
+			j,
+			false,
+			&handle->m_devs[j].m_sn_next_event,
+			&handle->m_devs[j].m_sn_len);
 
-		//
-		// Force a flush of the read buffers, so we don't capture events with the old snaplen
-		//
-		for(j = 0; j < handle->m_ndevs; j++)
-		{
-			scap_readbuf(handle,
-				j,
-				false,
-				&handle->m_devs[j].m_sn_next_event,
-				&handle->m_devs[j].m_sn_len);
+		handle->m_devs[j].m_sn_len = 0;
+	}
 
-			handle->m_devs[j].m_sn_len = 0;
-		}
+	handle->m_dev_heap_size = 0;
+}
+#endif
+
+static int32_t scap_handle_eventmask(scap_t* handle, uint32_t op, uint32_t event_id)
+{
+	//
+	// Not supported on files
+	//
+	if(handle->m_file)
+	{
+		snprintf(handle->m_lasterr,	SCAP_LASTERR_SIZE, "manipulating eventmasks not supported on offline captures");
+		return SCAP_FAILURE;
+	}
+
+#if !defined(HAS_CAPTURE)
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "eventmask not supported on %s", PLATFORM_NAME);
+	return SCAP_FAILURE;
+#else
+	if(scap_eventmask_ioctl(handle, op, event_id) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
 	}
 
+	scap_flush_after_eventmask(handle);
+
 	return SCAP_SUCCESS;
 #endif
 }
@@ -1105,6 +1704,44 @@ int32_t scap_unset_eventmask(scap_t* handle, uint32_t event_id) {
 #endif
 }
 
+int32_t scap_set_eventmask_all(scap_t* handle, const uint8_t* events)
+{
+	//
+	// Not supported on files
+	//
+	if(handle->m_file)
+	{
+		snprintf(handle->m_lasterr,	SCAP_LASTERR_SIZE, "manipulating eventmasks not supported on offline captures");
+		return SCAP_FAILURE;
+	}
+
+#if !defined(HAS_CAPTURE)
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "eventmask not supported on %s", PLATFORM_NAME);
+	return SCAP_FAILURE;
+#else
+	uint32_t j;
+	int32_t res;
+
+	//
+	// The buffers are flushed once for the whole mask, even if the mask
+	// was only partially applied
+	//
+	res = scap_eventmask_ioctl(handle, PPM_IOCTL_MASK_ZERO_EVENTS, 0);
+
+	for(j = 0; j < PPM_EVENT_MAX && res == SCAP_SUCCESS; j++)
+	{
+		if(events[j])
+		{
+			res = scap_eventmask_ioctl(handle, PPM_IOCTL_MASK_SET_EVENT, j);
+		}
+	}
+
+	scap_flush_after_eventmask(handle);
+
+	return res;
+#endif
+}
+
 uint32_t scap_event_get_dump_flags(scap_t* handle)
 {
 	return handle->m_last_evt_dump_flags;
@@ -1264,3 +1901,33 @@ void scap_set_refresh_proc_table_when_saving(scap_t* handle, bool refresh)
 {
 	handle->refresh_proc_table_when_saving = refresh;
 }
+
+void scap_set_proc_scan_threads(scap_t* handle, uint32_t nthreads)
+{
+	handle->m_proc_scan_threads = nthreads;
+}
+
+void scap_set_lazy_fds(scap_t* handle, bool lazy)
+{
+	handle->m_lazy_fds = lazy;
+}
+
+int32_t scap_refresh_proc_table(scap_t* handle)
+{
+#if !defined(HAS_CAPTURE)
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "live capture not supported on %s", PLATFORM_NAME);
+	return SCAP_FAILURE;
+#else
+	char filename[SCAP_MAX_PATH_SIZE];
+
+	if(handle->m_file)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_refresh_proc_table not supported on offline captures");
+		return SCAP_FAILURE;
+	}
+
+	scap_proc_free_table(handle);
+	snprintf(filename, sizeof(filename), "%s/proc", scap_get_host_root());
+	return scap_proc_scan_proc_dir(handle, filename, -1, -1, NULL, handle->m_lasterr, true);
+#endif
+}
@@ -83,6 +83,10 @@ typedef struct scap_stats
 	uint64_t n_evts; ///< Total number of events that were received by the driver.
 	uint64_t n_drops; ///< Number of dropped events.
 	uint64_t n_preemptions; ///< Number of preemptions.
+	uint64_t n_waits; ///< Number of times the reader slept waiting for the buffers to fill up.
+	uint64_t wait_ns; ///< Total time the reader spent sleeping, in nanoseconds.
+	uint64_t max_wait_ns; ///< Longest single sleep of the reader, in nanoseconds.
+	uint64_t n_drops_during_wait; ///< Number of events dropped by the driver while the reader was sleeping.
 }scap_stats;
 
 /*!
@@ -227,6 +231,28 @@ typedef void (*proc_entry_callback)(void* context,
 									scap_fdinfo* fdinfo,
 									scap_t* newhandle);
 
+/*!
+  \brief Policies that a live capture can use to wait for the buffers to fill up
+*/
+typedef enum scap_wait_policy
+{
+	SCAP_WAIT_FIXED = 0, ///< Sleep max_wait_us when every buffer holds less than bytes_watermark bytes, but never more than 4 times in a row. This is the default.
+	SCAP_WAIT_BUSY_POLL = 1, ///< Never sleep. Gives the lowest latency, but keeps a CPU busy.
+	SCAP_WAIT_BACKOFF = 2, ///< Sleep only when the buffers are empty, starting from min_wait_us and doubling at every consecutive empty read, up to max_wait_us.
+	SCAP_WAIT_WATERMARK = 3, ///< Block in poll() on the devices until one of the buffers holds bytes_watermark bytes or data has been waiting for max_wait_us. With drivers that can't be polled, check the buffers every min_wait_us instead.
+}scap_wait_policy;
+
+/*!
+  \brief Parameters of the wait policy. Fields that are set to 0 get the default value.
+*/
+typedef struct scap_wait_params
+{
+	scap_wait_policy policy; ///< The policy to use.
+	uint32_t min_wait_us; ///< SCAP_WAIT_BACKOFF: first sleep. SCAP_WAIT_WATERMARK: interval between checks if the driver can't be polled. Default 100.
+	uint32_t max_wait_us; ///< SCAP_WAIT_FIXED: sleep time. SCAP_WAIT_BACKOFF: longest sleep. SCAP_WAIT_WATERMARK: maximum latency. Default 30000.
+	uint32_t bytes_watermark; ///< SCAP_WAIT_FIXED and SCAP_WAIT_WATERMARK: amount of data in a buffer that ends the wait. Default 20000.
+}scap_wait_params;
+
 /*!
   \brief Arguments for scap_open
 */
@@ -236,6 +262,10 @@ typedef struct scap_open_args
 	proc_entry_callback proc_callback; ///< Callback to be invoked for each thread/fd that is extracted from /proc, or NULL if no callback is needed.
 	void* proc_callback_context; ///< Opaque pointer that will be included in the calls to proc_callback. Ignored if proc_callback is NULL.
 	bool import_users; ///< true if the user list should be created when opening the capture.
+	scap_wait_params wait_params; ///< How a live capture waits for data when the buffers are empty. Ignored for offline captures.
+	bool readahead; ///< true to decompress the events of an offline capture in a background thread. Ignored for live captures.
+	bool mmap; ///< true to map uncompressed trace files in memory and return their events without copying them. Compressed files are read normally. Ignored for live captures.
+	bool lazy_fds; ///< true to skip the fds when the process table is read from /proc. They can then be read one at a time with \ref scap_fd_lookup(). Ignored for offline captures.
 }scap_open_args;
 
 
@@ -421,7 +451,9 @@ typedef enum event_direction
 typedef enum compression_mode
 {
 	SCAP_COMPRESSION_NONE = 0,
-	SCAP_COMPRESSION_GZIP = 1
+	SCAP_COMPRESSION_GZIP = 1,
+	SCAP_COMPRESSION_CHUNKED = 2 ///< Events are compressed in independent chunks and the file ends with an index of
+								 ///< the chunks, so that it can be seeked with scap_seek_to_time() and scap_seek_to_evtnum()
 }compression_mode;
 
 /*!
@@ -437,6 +469,17 @@ typedef enum scap_dump_flags
 
 typedef struct scap_dumper scap_dumper_t;
 
+/*!
+  \brief Options for scap_dump_open_ex()
+*/
+typedef struct scap_dump_params
+{
+	compression_mode compress;
+	int32_t compression_level; ///< zlib compression level, from 1 (fastest) to 9 (smallest). 0 means the zlib default. Ignored with SCAP_COMPRESSION_NONE.
+	uint32_t buffer_size; ///< Size of the buffer where the events are assembled before being written, 0 for the default. Ignored with SCAP_COMPRESSION_CHUNKED, where the buffer holds a chunk.
+	bool async; ///< If true, the compression and the writes are done by a background thread, and scap_dump() only waits if the thread is several buffers behind. Write errors are returned by the following scap_dump() calls.
+}scap_dump_params;
+
 /*!
   \brief System call description struct.
 */
@@ -481,6 +524,10 @@ scap_t* scap_open_live(char *error);
     function fails. The buffer must have size SCAP_LASTERR_SIZE.
 
   \return The capture instance handle in case of success. NULL in case of failure.
+
+  \note The file is read and decompressed by the thread that reads the
+   events. Use \ref scap_open() to read it ahead in a background thread, or
+   to map it in memory.
 */
 scap_t* scap_open_offline(const char* fname, char *error);
 
@@ -535,6 +582,41 @@ char* scap_getlasterr(scap_t* handle);
 */
 int32_t scap_next(scap_t* handle, OUT scap_evt** pevent, OUT uint16_t* pcpuid);
 
+/*!
+  \brief Get a batch of events from the given capture instance
+
+  \param handle Handle to the capture instance.
+  \param max_evts Maximum number of events to return. pevents, pcpuids and pflags
+    must have room for at least max_evts entries.
+  \param pevents User-provided array that will be filled with the addresses of the events.
+  \param pcpuids User-provided array that will be filled with the ID of the CPU
+    where each event was captured.
+  \param pflags User-provided array that will be filled with the dump flags of each
+    event (see \ref scap_event_get_dump_flags).
+  \param pnevts Pointer to the number of events that have been returned.
+
+  \return SCAP_SUCCESS if the call is succesful and at least one event was returned.
+   SCAP_TIMEOUT, SCAP_EOF and SCAP_FAILURE have the same meaning as in \ref scap_next.
+
+  \note The returned events are valid until the next call to \ref scap_next or
+   \ref scap_next_batch. For live captures, a batch never spans more than one read
+   of the ring buffers, so it can contain less than max_evts events even when
+   more data is available.
+*/
+int32_t scap_next_batch(scap_t* handle, uint32_t max_evts, OUT scap_evt** pevents, OUT uint16_t* pcpuids, OUT uint32_t* pflags, OUT uint32_t* pnevts);
+
+/*!
+  \brief Change the policy that a live capture uses to wait for data when the
+   buffers are empty.
+
+  \param handle Handle to the capture instance.
+  \param params the new policy. NULL restores the default one.
+
+  \return SCAP_SUCCESS if the call is succesful. On Failure, SCAP_FAILURE is
+   returned and scap_getlasterr() can be used to obtain the cause of the error.
+*/
+int32_t scap_set_wait_params(scap_t* handle, const scap_wait_params* params);
+
 /*!
   \brief Get the length of an event
 
@@ -589,6 +671,37 @@ uint32_t scap_event_get_dump_flags(scap_t* handle);
 */
 int64_t scap_get_readfile_offset(scap_t* handle);
 
+/*!
+  \brief Move the read position of a trace file to the beginning of the chunk
+  that contains the first event with a timestamp equal or greater than ts.
+  Only works on files written with SCAP_COMPRESSION_CHUNKED.
+
+  \param handle Handle to the capture instance.
+  \param ts The timestamp to look for, in nanoseconds.
+  \param chunk_evtnum Receives the number of events in the file before the
+  chunk. The events of the chunk that come before ts are returned by the
+  following calls to scap_next(), and it's up to the caller to skip them.
+
+  \return SCAP_SUCCESS, SCAP_EOF if no event is at or after ts, or
+  SCAP_FAILURE. In case of failure, the read position is undefined.
+*/
+int32_t scap_seek_to_time(scap_t* handle, uint64_t ts, OUT uint64_t* chunk_evtnum);
+
+/*!
+  \brief Move the read position of a trace file to the beginning of the chunk
+  that contains the given event. Only works on files written with
+  SCAP_COMPRESSION_CHUNKED.
+
+  \param handle Handle to the capture instance.
+  \param evtnum The number of events in the file before the one to look for.
+  \param chunk_evtnum Receives the number of events in the file before the
+  chunk, which is less or equal than evtnum.
+
+  \return SCAP_SUCCESS, SCAP_EOF if the file has less than evtnum + 1 events,
+  or SCAP_FAILURE. In case of failure, the read position is undefined.
+*/
+int32_t scap_seek_to_evtnum(scap_t* handle, uint64_t evtnum, OUT uint64_t* chunk_evtnum);
+
 /*!
   \brief Open a tracefile for writing
 
@@ -599,6 +712,41 @@ int64_t scap_get_readfile_offset(scap_t* handle);
 */
 scap_dumper_t* scap_dump_open(scap_t *handle, const char *fname, compression_mode compress);
 
+/*!
+  \brief Open a tracefile for writing, with more control on how it's written
+   than \ref scap_dump_open
+
+  \param handle Handle to the capture instance.
+  \param fname The name of the tracefile.
+  \param params The compression mode and the buffering options.
+
+  \return Dump handle that can be used to identify this specific dump instance.
+*/
+scap_dumper_t* scap_dump_open_ex(scap_t *handle, const char *fname, const scap_dump_params* params);
+
+/*!
+  \brief Copy the tables that are saved at the beginning of tracefiles into
+   a new handle, that can only be used to open dumps and write events to them.
+
+  \param handle Handle to the capture instance.
+  \param error Pointer to a buffer that will contain the error string in case the
+    function fails. The buffer must have size SCAP_LASTERR_SIZE.
+
+  \return The snapshot handle, or NULL if the copy failed. It must be released
+   with \ref scap_dump_snapshot_free.
+
+  \note The snapshot doesn't depend on the capture handle, so it can be passed to
+   \ref scap_dump_open_ex and \ref scap_dump from another thread while the capture
+   goes on. For live captures, the process table is not copied: it's read from
+   /proc when the dump is opened.
+*/
+scap_t* scap_dump_snapshot(scap_t* handle, char *error);
+
+/*!
+  \brief Free a handle returned by \ref scap_dump_snapshot.
+*/
+void scap_dump_snapshot_free(scap_t* snap);
+
 /*!
   \brief Close a tracefile.
 
@@ -610,10 +758,20 @@ void scap_dump_close(scap_dumper_t *d);
   \brief Return the current size of a tracefile.
 
   \param d The dump handle, returned by \ref scap_dump_open
-  \return The current size of the dump file pointed by d.
+  \return The current size of the dump file pointed by d. The events that are
+   waiting to be written are counted with their uncompressed size.
 */
 int64_t scap_dump_get_offset(scap_dumper_t *d);
 
+/*!
+  \brief Return how many times \ref scap_dump had to wait for the writer
+   thread of an asynchronous dumper to free a buffer.
+
+  \param d The dump handle, returned by \ref scap_dump_open_ex
+  \return The number of waits. Always 0 for synchronous dumpers.
+*/
+uint64_t scap_dump_get_stalls(scap_dumper_t *d);
+
 /*!
   \brief Flush all pending output into the file.
 
@@ -816,6 +974,17 @@ int32_t scap_set_eventmask(scap_t* handle, uint32_t event_id);
 */
 int32_t scap_unset_eventmask(scap_t* handle, uint32_t event_id);
 
+/*!
+  \brief Replace the eventmask: only the events whose entry in events is
+  nonzero will be passed to sysdig. The read buffers are flushed once, instead
+  of once per event like \ref scap_set_eventmask does.
+
+  \param handle Handle to the capture instance.
+  \param events PPM_EVENT_MAX entries, indexed by event id.
+  \note This function can only be called for live captures.
+*/
+int32_t scap_set_eventmask_all(scap_t* handle, const uint8_t* events);
+
 
 /*!
   \brief Get the root directory of the system. This usually changes
@@ -845,6 +1014,13 @@ uint32_t scap_get_ndevs(scap_t* handle);
 // Retrieve a buffer of events from one of the cpus
 extern int32_t scap_readbuf(scap_t* handle, uint32_t cpuid, bool blocking, OUT char** buf, OUT uint32_t* len);
 
+// Open a live-like capture that consumes events from caller-owned ring buffers
+// instead of the driver devices. The buffers follow the driver layout, where head
+// and tail index a RING_BUF_SIZE ring that is mapped twice back to back. Used to
+// exercise the live event path without loading the kernel module.
+struct ppm_ring_buffer_info;
+scap_t* scap_open_ringbufs(uint32_t ndevs, struct ppm_ring_buffer_info** bufinfos, char** buffers, char *error);
+
 #ifdef PPM_ENABLE_SENTINEL
 // Get the sentinel at the beginning of the event
 uint32_t scap_event_get_sentinel_begin(scap_evt* e);
@@ -868,6 +1044,17 @@ int32_t scap_disable_dynamic_snaplen(scap_t* handle);
 void scap_proc_free_table(scap_t* handle);
 void scap_refresh_iflist(scap_t* handle);
 void scap_set_refresh_proc_table_when_saving(scap_t* handle, bool refresh);
+// Set how many threads scan /proc when the process table is built. 0, the
+// default, uses one thread per CPU up to a fixed maximum.
+void scap_set_proc_scan_threads(scap_t* handle, uint32_t nthreads);
+// Set if the next scans of /proc skip the fds of the processes, like the ones
+// of a handle opened with the lazy_fds option
+void scap_set_lazy_fds(scap_t* handle, bool lazy);
+// Rebuild the process table of a live capture from /proc
+int32_t scap_refresh_proc_table(scap_t* handle);
+// Read the info of the fd of a live process from /proc. Returns SCAP_NOTFOUND
+// if the fd doesn't exist or is of a type that is not tracked.
+int32_t scap_fd_lookup(scap_t* handle, int64_t pid, int64_t fd, OUT scap_fdinfo* fdinfo);
 uint64_t scap_ftell(scap_t *handle);
 void scap_fseek(scap_t *handle, uint64_t off);
 int32_t scap_enable_tracers_capture(scap_t* handle);
@@ -565,7 +565,11 @@ int32_t scap_add_fd_to_proc_table(scap_t *handle, scap_threadinfo *tinfo, scap_f
 
 #if defined(HAS_CAPTURE)
 
-int32_t scap_fd_handle_pipe(scap_t *handle, char *fname, scap_threadinfo *tinfo, scap_fdinfo *fdi, char *error)
+//
+// The scap_fd_handle_* functions fill fdi from the entry fname of a /proc fd
+// directory. They return SCAP_NOTFOUND if the fd is not to be tracked.
+//
+int32_t scap_fd_handle_pipe(scap_t *handle, char *fname, scap_fdinfo *fdi, char *error)
 {
 	char link_name[1024];
 	ssize_t r;
@@ -584,17 +588,17 @@ int32_t scap_fd_handle_pipe(scap_t *handle, char *fname, scap_threadinfo *tinfo,
 		// and we've got to call stat on the link name
 		if(-1 == stat(link_name, &sb))
 		{
-			return SCAP_SUCCESS;
+			return SCAP_NOTFOUND;
 		}
 		ino = sb.st_ino;
 	}
 	strncpy(fdi->info.fname, link_name, SCAP_MAX_PATH_SIZE);
 
 	fdi->ino = ino;
-	return scap_add_fd_to_proc_table(handle, tinfo, fdi);
+	return SCAP_SUCCESS;
 }
 
-int32_t scap_fd_handle_regular_file(scap_t *handle, char *fname, scap_threadinfo *tinfo, scap_fdinfo *fdi, char *error)
+int32_t scap_fd_handle_regular_file(scap_t *handle, char *fname, scap_fdinfo *fdi, char *error)
 {
 	char link_name[1024];
 	ssize_t r;
@@ -602,7 +606,7 @@ int32_t scap_fd_handle_regular_file(scap_t *handle, char *fname, scap_threadinfo
 	r = readlink(fname, link_name, 1024);
 	if (r <= 0)
 	{
-		return SCAP_SUCCESS;
+		return SCAP_NOTFOUND;
 	}
 
 	link_name[r] = '\0';
@@ -642,10 +646,10 @@ int32_t scap_fd_handle_regular_file(scap_t *handle, char *fname, scap_threadinfo
 		strncpy(fdi->info.fname, link_name, SCAP_MAX_PATH_SIZE);
 	}
 
-	return scap_add_fd_to_proc_table(handle, tinfo, fdi);
+	return SCAP_SUCCESS;
 }
 
-int32_t scap_fd_handle_socket(scap_t *handle, char *fname, scap_threadinfo *tinfo, scap_fdinfo *fdi, char* procdir, uint64_t net_ns, struct scap_ns_socket_list **sockets_by_ns, char *error)
+int32_t scap_fd_handle_socket(scap_t *handle, char *fname, scap_fdinfo *fdi, char* procdir, uint64_t net_ns, struct scap_ns_socket_list **sockets_by_ns, char *error)
 {
 	char link_name[1024];
 	ssize_t r;
@@ -653,10 +657,21 @@ int32_t scap_fd_handle_socket(scap_t *handle, char *fname, scap_threadinfo *tinf
 	uint64_t ino;
 	struct scap_ns_socket_list* sockets = NULL;
 	int32_t uth_status = SCAP_SUCCESS;
+	int32_t res = SCAP_SUCCESS;
+
+	//
+	// When /proc is scanned in parallel, the socket tables are shared by the
+	// workers. A table is read only once, and it's complete before it's added
+	// to the list.
+	//
+	if(handle->m_proc_scan_sockets_mutex != NULL)
+	{
+		pthread_mutex_lock(handle->m_proc_scan_sockets_mutex);
+	}
 
 	if(*sockets_by_ns == (void*)-1)
 	{
-		return SCAP_SUCCESS;
+		res = SCAP_NOTFOUND;
 	}
 	else 
 	{
@@ -664,28 +679,58 @@ int32_t scap_fd_handle_socket(scap_t *handle, char *fname, scap_threadinfo *tinf
 		if(sockets == NULL)
 		{
 			sockets = malloc(sizeof(struct scap_ns_socket_list));
-			sockets->net_ns = net_ns;
-			sockets->sockets = NULL;
-
-			HASH_ADD_INT64(*sockets_by_ns, net_ns, sockets);
-			if(uth_status != SCAP_SUCCESS)
+			if(sockets == NULL)
 			{
 				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "socket list allocation error");
-				return SCAP_FAILURE;				
+				res = SCAP_FAILURE;
 			}
-
-			if(scap_fd_read_sockets(handle, procdir, sockets) == SCAP_FAILURE)
+			else
 			{
+				sockets->net_ns = net_ns;
 				sockets->sockets = NULL;
-				return SCAP_FAILURE;
+				sockets->read_ts = scap_get_monotonic_time_ns();
+
+				if(scap_fd_read_sockets(handle, procdir, sockets) == SCAP_FAILURE)
+				{
+					free(sockets);
+					res = SCAP_FAILURE;
+				}
+				else
+				{
+					HASH_ADD_INT64(*sockets_by_ns, net_ns, sockets);
+					if(uth_status != SCAP_SUCCESS)
+					{
+						snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "socket list allocation error");
+						scap_fd_free_table(handle, &sockets->sockets);
+						free(sockets);
+						res = SCAP_FAILURE;
+					}
+				}
 			}
 		}
 	}
 
+	if(handle->m_proc_scan_sockets_mutex != NULL)
+	{
+		pthread_mutex_unlock(handle->m_proc_scan_sockets_mutex);
+	}
+
+	if(res == SCAP_NOTFOUND)
+	{
+		//
+		// Sockets are not being scanned
+		//
+		return SCAP_NOTFOUND;
+	}
+	else if(res != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
+
 	r = readlink(fname, link_name, 1024);
 	if(r <= 0)
 	{
-		return SCAP_SUCCESS;
+		return SCAP_NOTFOUND;
 	}
 
 	link_name[r] = '\0';
@@ -697,7 +742,7 @@ int32_t scap_fd_handle_socket(scap_t *handle, char *fname, scap_threadinfo *tinf
 	{
 		// it's a kind of socket, but we don't support it right now
 		fdi->type = SCAP_FD_UNSUPPORTED;
-		return scap_add_fd_to_proc_table(handle, tinfo, fdi);
+		return SCAP_SUCCESS;
 	}
 
 	//
@@ -709,11 +754,11 @@ int32_t scap_fd_handle_socket(scap_t *handle, char *fname, scap_threadinfo *tinf
 		memcpy(&(fdi->info), &(tfdi->info), sizeof(fdi->info));
 		fdi->ino = ino;
 		fdi->type = tfdi->type;
-		return scap_add_fd_to_proc_table(handle, tinfo, fdi);
+		return SCAP_SUCCESS;
 	}
 	else
 	{
-		return SCAP_SUCCESS;
+		return SCAP_NOTFOUND;
 	}
 }
 
@@ -724,6 +769,7 @@ int32_t scap_fd_read_unix_sockets_from_proc_fs(scap_t *handle, const char* filen
 	int first_line = false;
 	char *delimiters = " \t";
 	char *token;
+	char *scan_pos;
 	int32_t uth_status = SCAP_SUCCESS;
 
 	f = fopen(filename, "r");
@@ -748,7 +794,7 @@ int32_t scap_fd_read_unix_sockets_from_proc_fs(scap_t *handle, const char* filen
 		// parse the fields
 		//
 		// 1. Num
-		token = strtok(line, delimiters);
+		token = strtok_r(line, delimiters, &scan_pos);
 		if(token == NULL)
 		{
 			ASSERT(false);
@@ -760,7 +806,7 @@ int32_t scap_fd_read_unix_sockets_from_proc_fs(scap_t *handle, const char* filen
 		fdinfo->info.unix_socket_info.destination = 0;
 
 		// 2. RefCount
-		token = strtok(NULL, delimiters);
+		token = strtok_r(NULL, delimiters, &scan_pos);
 		if(token == NULL)
 		{
 			ASSERT(false);
@@ -769,7 +815,7 @@ int32_t scap_fd_read_unix_sockets_from_proc_fs(scap_t *handle, const char* filen
 		}
 
 		// 3. Protocol
-		token = strtok(NULL, delimiters);
+		token = strtok_r(NULL, delimiters, &scan_pos);
 		if(token == NULL)
 		{
 			ASSERT(false);
@@ -778,7 +824,7 @@ int32_t scap_fd_read_unix_sockets_from_proc_fs(scap_t *handle, const char* filen
 		}
 
 		// 4. Flags
-		token = strtok(NULL, delimiters);
+		token = strtok_r(NULL, delimiters, &scan_pos);
 		if(token == NULL)
 		{
 			ASSERT(false);
@@ -787,7 +833,7 @@ int32_t scap_fd_read_unix_sockets_from_proc_fs(scap_t *handle, const char* filen
 		}
 
 		// 5. Type
-		token = strtok(NULL, delimiters);
+		token = strtok_r(NULL, delimiters, &scan_pos);
 		if(token == NULL)
 		{
 			ASSERT(false);
@@ -796,7 +842,7 @@ int32_t scap_fd_read_unix_sockets_from_proc_fs(scap_t *handle, const char* filen
 		}
 
 		// 6. St
-		token = strtok(NULL, delimiters);
+		token = strtok_r(NULL, delimiters, &scan_pos);
 		if(token == NULL)
 		{
 			ASSERT(false);
@@ -805,7 +851,7 @@ int32_t scap_fd_read_unix_sockets_from_proc_fs(scap_t *handle, const char* filen
 		}
 		
 		// 7. Inode
-		token = strtok(NULL, delimiters);
+		token = strtok_r(NULL, delimiters, &scan_pos);
 		if(token == NULL)
 		{
 			ASSERT(false);
@@ -816,7 +862,7 @@ int32_t scap_fd_read_unix_sockets_from_proc_fs(scap_t *handle, const char* filen
 		sscanf(token, "%"PRIu64, &(fdinfo->ino));
 
 		// 8. Path
-		token = strtok(NULL, delimiters);
+		token = strtok_r(NULL, delimiters, &scan_pos);
 		if(NULL != token)
 		{
 			strncpy(fdinfo->info.unix_socket_info.fname, token, SCAP_MAX_PATH_SIZE);
@@ -1357,6 +1403,115 @@ char * decode_st_mode(struct stat* sb)
     	break;
     }
 }
+//
+// Get the network namespace of the process, or 0 if it's not available
+//
+static uint64_t scap_fd_get_net_ns(char *procdir)
+{
+	//
+	// procdir is at most SCAP_MAX_PATH_SIZE long, without the terminator
+	//
+	char f_name[SCAP_MAX_PATH_SIZE + sizeof("ns/net")];
+	char link_name[1024];
+	uint64_t net_ns = 0;
+	ssize_t r;
+
+	snprintf(f_name, sizeof(f_name), "%sns/net", procdir);
+	r = readlink(f_name, link_name, sizeof(link_name) - 1);
+	if(r <= 0)
+	{
+		//
+		// No network namespace available. Assume global
+		//
+		return 0;
+	}
+
+	link_name[r] = '\0';
+	sscanf(link_name, "net:[%"PRIi64"]", &net_ns);
+	return net_ns;
+}
+
+//
+// Build the fd info of the entry f_name of a /proc/x/fd directory. Returns
+// SCAP_NOTFOUND, and no fdinfo, if the fd is gone or is not tracked.
+//
+static int32_t scap_fd_read_from_proc(scap_t *handle, char *f_name, uint64_t fd, char *procdir, uint64_t net_ns, struct scap_ns_socket_list **sockets_by_ns, scap_fdinfo **pfdi, char *error)
+{
+	struct stat sb;
+	scap_fdinfo *fdi = NULL;
+	int32_t res;
+
+	*pfdi = NULL;
+
+	if(-1 == stat(f_name, &sb))
+	{
+		return SCAP_NOTFOUND;
+	}
+
+	switch(sb.st_mode & S_IFMT)
+	{
+	case S_IFIFO:
+		res = scap_fd_allocate_fdinfo(handle, &fdi, fd, SCAP_FD_FIFO);
+		if(SCAP_FAILURE == res)
+		{
+			break;
+		}
+		res = scap_fd_handle_pipe(handle, f_name, fdi, error);
+		break;
+	case S_IFREG:
+	case S_IFBLK:
+	case S_IFCHR:
+	case S_IFLNK:
+		res = scap_fd_allocate_fdinfo(handle, &fdi, fd, SCAP_FD_FILE);
+		if(SCAP_FAILURE == res)
+		{
+			break;
+		}
+		fdi->ino = sb.st_ino;
+		res = scap_fd_handle_regular_file(handle, f_name, fdi, error);
+		break;
+	case S_IFDIR:
+		res = scap_fd_allocate_fdinfo(handle, &fdi, fd, SCAP_FD_DIRECTORY);
+		if(SCAP_FAILURE == res)
+		{
+			break;
+		}
+		fdi->ino = sb.st_ino;
+		res = scap_fd_handle_regular_file(handle, f_name, fdi, error);
+		break;
+	case S_IFSOCK:
+		res = scap_fd_allocate_fdinfo(handle, &fdi, fd, SCAP_FD_UNKNOWN);
+		if(SCAP_FAILURE == res)
+		{
+			break;
+		}
+		res = scap_fd_handle_socket(handle, f_name, fdi, procdir, net_ns, sockets_by_ns, error);
+		break;
+	default:
+		res = scap_fd_allocate_fdinfo(handle, &fdi, fd, SCAP_FD_UNSUPPORTED);
+		if(SCAP_FAILURE == res)
+		{
+			break;
+		}
+		fdi->ino = sb.st_ino;
+		res = scap_fd_handle_regular_file(handle, f_name, fdi, error);
+		break;
+	}
+
+	if(res != SCAP_SUCCESS)
+	{
+		if(fdi != NULL)
+		{
+			scap_fd_free_fdinfo(&fdi);
+		}
+
+		return res;
+	}
+
+	*pfdi = fdi;
+	return SCAP_SUCCESS;
+}
+
 //
 // Scan the directory containing the fd's of a proc /proc/x/fd
 //
@@ -1367,12 +1522,9 @@ int32_t scap_fd_scan_fd_dir(scap_t *handle, char *procdir, scap_threadinfo *tinf
 	int32_t res = SCAP_SUCCESS;
 	char fd_dir_name[1024];
 	char f_name[1024];
-	char link_name[1024];
-	struct stat sb;
 	uint64_t fd;
 	scap_fdinfo *fdi = NULL;
 	uint64_t net_ns;
-	ssize_t r;
 
 	snprintf(fd_dir_name, 1024, "%sfd", procdir);
 	dir_p = opendir(fd_dir_name);
@@ -1382,97 +1534,33 @@ int32_t scap_fd_scan_fd_dir(scap_t *handle, char *procdir, scap_threadinfo *tinf
 		return SCAP_NOTFOUND;
 	}
 
-	//
-	// Get the network namespace of the process
-	//
-	snprintf(f_name, sizeof(f_name), "%sns/net", procdir);
-	r = readlink(f_name, link_name, sizeof(link_name));
-	if(r <= 0)
-	{
-		//
-		// No network namespace available. Assume global
-		//
-		net_ns = 0;
-	}
-	else
-	{
-		link_name[r] = '\0';
-		sscanf(link_name, "net:[%"PRIi64"]", &net_ns);
-	}
+	net_ns = scap_fd_get_net_ns(procdir);
 
 	while((dir_entry_p = readdir(dir_p)) != NULL)
 	{
-		fdi = NULL;
+		if(1 != sscanf(dir_entry_p->d_name, "%"PRIu64, &fd))
+		{
+			continue;
+		}
+
 		snprintf(f_name, 1024, "%s/%s", fd_dir_name, dir_entry_p->d_name);
 
-		if(-1 == stat(f_name, &sb) || 1 != sscanf(dir_entry_p->d_name, "%"PRIu64, &fd))
+		res = scap_fd_read_from_proc(handle, f_name, fd, procdir, net_ns, sockets_by_ns, &fdi, error);
+		if(res == SCAP_NOTFOUND)
 		{
+			res = SCAP_SUCCESS;
 			continue;
 		}
-		switch(sb.st_mode & S_IFMT)
+		else if(res != SCAP_SUCCESS)
 		{
-		case S_IFIFO:
-			res = scap_fd_allocate_fdinfo(handle, &fdi, fd, SCAP_FD_FIFO);
-			if(SCAP_FAILURE == res)
-			{
-				break;
-            }
-			res = scap_fd_handle_pipe(handle, f_name, tinfo, fdi, error);
-			break;
-		case S_IFREG:
-		case S_IFBLK:
-		case S_IFCHR:
-		case S_IFLNK:
-			res = scap_fd_allocate_fdinfo(handle, &fdi, fd, SCAP_FD_FILE);
-			if(SCAP_FAILURE == res)
-			{
-				break;
-			}
-			fdi->ino = sb.st_ino;
-			res = scap_fd_handle_regular_file(handle, f_name, tinfo, fdi, error);
-			break;
-		case S_IFDIR:
-			res = scap_fd_allocate_fdinfo(handle, &fdi, fd, SCAP_FD_DIRECTORY);
-			if(SCAP_FAILURE == res)
-			{
-				break;
-			}
-			fdi->ino = sb.st_ino;
-			res = scap_fd_handle_regular_file(handle, f_name, tinfo, fdi, error);
-			break;
-		case S_IFSOCK:
-			res = scap_fd_allocate_fdinfo(handle, &fdi, fd, SCAP_FD_UNKNOWN);
-			if(SCAP_FAILURE == res)
-			{
-				break;
-			}
-			res = scap_fd_handle_socket(handle, f_name, tinfo, fdi, procdir, net_ns, sockets_by_ns, error);
-			if(handle->m_proc_callback == NULL)
-			{
-				// we can land here if we've got a netlink socket
-				if(fdi->type == SCAP_FD_UNKNOWN)
-				{
-					scap_fd_free_fdinfo(&fdi);
-				}
-			} 
-			break;
-		default:
-			res = scap_fd_allocate_fdinfo(handle, &fdi, fd, SCAP_FD_UNSUPPORTED);
-			if(SCAP_FAILURE == res)
-			{
-				break;
-			}
-			fdi->ino = sb.st_ino;
-			res = scap_fd_handle_regular_file(handle, f_name, tinfo, fdi, error);
 			break;
 		}
 
+		res = scap_add_fd_to_proc_table(handle, tinfo, fdi);
+
 		if(handle->m_proc_callback != NULL)
 		{
-			if(fdi)
-			{
-				scap_fd_free_fdinfo(&fdi);
-			}
+			scap_fd_free_fdinfo(&fdi);
 		}
 
 		if(SCAP_SUCCESS != res)
@@ -1485,6 +1573,62 @@ int32_t scap_fd_scan_fd_dir(scap_t *handle, char *procdir, scap_threadinfo *tinf
 	return res;
 }
 
+//
+// Resolve a single fd of a live process from /proc. The socket tables are
+// read once per network namespace and kept in the handle. A socket that is
+// not in a table was probably created after the table was read: in that
+// case the table is read again, but not more than once every
+// LAZY_FD_SOCKET_TABLE_TTL_NS.
+//
+static int32_t scap_fd_lookup_int(scap_t *handle, int64_t pid, int64_t fd, scap_fdinfo *fdinfo)
+{
+	char procdir[SCAP_MAX_PATH_SIZE];
+	//
+	// Room for procdir, "fd/" and the 20 characters of the longest fd
+	//
+	char f_name[SCAP_MAX_PATH_SIZE + sizeof("fd/") + 20];
+	char error[SCAP_LASTERR_SIZE];
+	scap_fdinfo *fdi;
+	struct scap_ns_socket_list *sockets;
+	uint64_t net_ns;
+	int32_t res;
+
+	snprintf(procdir, sizeof(procdir), "%s/proc/%"PRId64"/", scap_get_host_root(), pid);
+	snprintf(f_name, sizeof(f_name), "%sfd/%"PRId64, procdir, fd);
+
+	net_ns = scap_fd_get_net_ns(procdir);
+
+	error[0] = '\0';
+	res = scap_fd_read_from_proc(handle, f_name, fd, procdir, net_ns, &handle->m_lazy_sockets_by_ns, &fdi, error);
+	if(res == SCAP_NOTFOUND)
+	{
+		HASH_FIND_INT64(handle->m_lazy_sockets_by_ns, &net_ns, sockets);
+		if(sockets == NULL || scap_get_monotonic_time_ns() - sockets->read_ts < LAZY_FD_SOCKET_TABLE_TTL_NS)
+		{
+			return SCAP_NOTFOUND;
+		}
+
+		HASH_DEL(handle->m_lazy_sockets_by_ns, sockets);
+		scap_fd_free_table(handle, &sockets->sockets);
+		free(sockets);
+
+		res = scap_fd_read_from_proc(handle, f_name, fd, procdir, net_ns, &handle->m_lazy_sockets_by_ns, &fdi, error);
+	}
+
+	if(res != SCAP_SUCCESS)
+	{
+		if(res == SCAP_FAILURE && error[0] != '\0')
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "%s", error);
+		}
+
+		return res;
+	}
+
+	*fdinfo = *fdi;
+	scap_fd_free_fdinfo(&fdi);
+	return SCAP_SUCCESS;
+}
 
 #endif // HAS_CAPTURE
 
@@ -1513,3 +1657,18 @@ void scap_fd_print_fd_table(scap_fdinfo *fds)
 	}
 }
 
+int32_t scap_fd_lookup(scap_t *handle, int64_t pid, int64_t fd, OUT scap_fdinfo *fdinfo)
+{
+#if !defined(HAS_CAPTURE)
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "live capture not supported on %s", PLATFORM_NAME);
+	return SCAP_FAILURE;
+#else
+	if(handle->m_file)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "fds can't be looked up on offline captures");
+		return SCAP_FAILURE;
+	}
+
+	return scap_fd_lookup_int(handle, pid, fd, fdinfo);
+#endif // HAS_CAPTURE
+}
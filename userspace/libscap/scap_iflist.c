@@ -17,6 +17,8 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "scap.h"
 #include "scap-int.h"
@@ -254,3 +256,47 @@ void scap_free_iflist(scap_addrlist* ifhandle)
 		free(ifhandle);
 	}
 }
+
+//
+// Make a copy of a list of interfaces
+//
+scap_addrlist* scap_dup_iflist(const scap_addrlist* ifhandle)
+{
+	scap_addrlist* res;
+
+	res = (scap_addrlist*)calloc(1, sizeof(scap_addrlist));
+	if(res == NULL)
+	{
+		return NULL;
+	}
+
+	res->n_v4_addrs = ifhandle->n_v4_addrs;
+	res->n_v6_addrs = ifhandle->n_v6_addrs;
+	res->totlen = ifhandle->totlen;
+
+	if(ifhandle->n_v4_addrs != 0)
+	{
+		res->v4list = (scap_ifinfo_ipv4*)malloc(ifhandle->n_v4_addrs * sizeof(scap_ifinfo_ipv4));
+		if(res->v4list == NULL)
+		{
+			scap_free_iflist(res);
+			return NULL;
+		}
+
+		memcpy(res->v4list, ifhandle->v4list, ifhandle->n_v4_addrs * sizeof(scap_ifinfo_ipv4));
+	}
+
+	if(ifhandle->n_v6_addrs != 0)
+	{
+		res->v6list = (scap_ifinfo_ipv6*)malloc(ifhandle->n_v6_addrs * sizeof(scap_ifinfo_ipv6));
+		if(res->v6list == NULL)
+		{
+			scap_free_iflist(res);
+			return NULL;
+		}
+
+		memcpy(res->v6list, ifhandle->v6list, ifhandle->n_v6_addrs * sizeof(scap_ifinfo_ipv6));
+	}
+
+	return res;
+}
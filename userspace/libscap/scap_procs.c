@@ -25,6 +25,7 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 #include <sys/resource.h>
 #include <sys/syscall.h>
 #include <sys/ioctl.h>
+#include <fcntl.h>
 #endif
 
 #include "scap.h"
@@ -280,9 +281,11 @@ int32_t scap_proc_fill_cgroups(struct scap_threadinfo* tinfo, const char* procdi
 		char* token;
 		char* subsys_list;
 		char* cgroup;
+		char* scan_pos;
+		char* subsys_pos;
 
 		// id
-		token = strtok(line, ":");
+		token = strtok_r(line, ":", &scan_pos);
 		if(token == NULL)
 		{
 			ASSERT(false);
@@ -291,7 +294,7 @@ int32_t scap_proc_fill_cgroups(struct scap_threadinfo* tinfo, const char* procdi
 		}
 
 		// subsys
-		subsys_list = strtok(NULL, ":");
+		subsys_list = strtok_r(NULL, ":", &scan_pos);
 		if(subsys_list == NULL)
 		{
 			ASSERT(false);
@@ -306,7 +309,7 @@ int32_t scap_proc_fill_cgroups(struct scap_threadinfo* tinfo, const char* procdi
 		}
 
 		// cgroup
-		cgroup = strtok(NULL, ":");
+		cgroup = strtok_r(NULL, ":", &scan_pos);
 		if(cgroup == NULL)
 		{
 			ASSERT(false);
@@ -317,7 +320,7 @@ int32_t scap_proc_fill_cgroups(struct scap_threadinfo* tinfo, const char* procdi
 		// remove the \n
 		cgroup[strlen(cgroup) - 1] = 0;
 
-		while((token = strtok(subsys_list, ",")) != NULL)
+		while((token = strtok_r(subsys_list, ",", &subsys_pos)) != NULL)
 		{
 			subsys_list = NULL;
 			if(strlen(cgroup) + 1 + strlen(token) + 1 > SCAP_MAX_CGROUPS_SIZE - tinfo->cgroups_len)
@@ -424,6 +427,35 @@ int32_t scap_proc_fill_root(struct scap_threadinfo* tinfo, const char* procdirna
 	}
 }
 
+//
+// Read up to size bytes of a file into buf with plain read() calls, which
+// avoids the stdio buffer that fopen() allocates for every file. Returns the
+// number of bytes read, or -1 if the file can't be opened.
+//
+static ssize_t scap_proc_read_file(const char* filename, char* buf, size_t size)
+{
+	size_t len = 0;
+	ssize_t r;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if(fd < 0)
+	{
+		return -1;
+	}
+
+	//
+	// Files like cmdline can be returned in more than one read
+	//
+	while(len < size && (r = read(fd, buf + len, size - len)) > 0)
+	{
+		len += r;
+	}
+
+	close(fd);
+	return len;
+}
+
 //
 // Add a process to the list by parsing its entry under /proc
 //
@@ -437,7 +469,7 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, int parentt
 	struct scap_threadinfo* tinfo;
 	int32_t uth_status = SCAP_SUCCESS;
 	FILE* f;
-	size_t filesize;
+	ssize_t filesize;
 	size_t exe_len;
 	bool free_tinfo = false;
 	int32_t res = SCAP_SUCCESS;
@@ -551,8 +583,10 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, int parentt
 	//
 	snprintf(filename, sizeof(filename), "%scmdline", dir_name);
 
-	f = fopen(filename, "r");
-	if(f == NULL)
+	ASSERT(sizeof(line) >= SCAP_MAX_ARGS_SIZE);
+
+	filesize = scap_proc_read_file(filename, line, SCAP_MAX_ARGS_SIZE - 1);
+	if(filesize < 0)
 	{
 		snprintf(error, SCAP_LASTERR_SIZE, "can't open %s", filename);
 		free(tinfo);
@@ -560,15 +594,12 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, int parentt
 	}
 	else
 	{
-		ASSERT(sizeof(line) >= SCAP_MAX_ARGS_SIZE);
-
-		filesize = fread(line, 1, SCAP_MAX_ARGS_SIZE - 1, f);
 		if(filesize > 0)
 		{
 			line[filesize] = 0;
 
 			exe_len = strlen(line);
-			if(exe_len < filesize)
+			if(exe_len < (size_t)filesize)
 			{
 				++exe_len;
 			}
@@ -585,8 +616,6 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, int parentt
 			tinfo->args[0] = 0;
 			tinfo->exe[0] = 0;
 		}
-
-		fclose(f);
 	}
 
 	//
@@ -594,8 +623,10 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, int parentt
 	//
 	snprintf(filename, sizeof(filename), "%senviron", dir_name);
 
-	f = fopen(filename, "r");
-	if(f == NULL)
+	ASSERT(sizeof(line) >= SCAP_MAX_ENV_SIZE);
+
+	filesize = scap_proc_read_file(filename, line, SCAP_MAX_ENV_SIZE);
+	if(filesize < 0)
 	{
 		snprintf(error, SCAP_LASTERR_SIZE, "can't open %s", filename);
 		free(tinfo);
@@ -603,10 +634,6 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, int parentt
 	}
 	else
 	{
-		ASSERT(sizeof(line) >= SCAP_MAX_ENV_SIZE);
-
-		filesize = fread(line, 1, SCAP_MAX_ENV_SIZE, f);
-
 		if(filesize > 0)
 		{
 			line[filesize - 1] = 0;
@@ -620,8 +647,6 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, int parentt
 		{
 			tinfo->env[0] = 0;
 		}
-
-		fclose(f);
 	}
 
 	//
@@ -711,9 +736,10 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, int parentt
 	}
 
 	//
-	// Only add fds for processes, not threads
+	// Only add fds for processes, not threads. With lazy fds, they are read
+	// when they are needed with scap_fd_lookup().
 	//
-	if(parenttid == -1)
+	if(parenttid == -1 && !handle->m_lazy_fds)
 	{
 		res = scap_fd_scan_fd_dir(handle, dir_name, tinfo, sockets_by_ns, error);
 	}
@@ -726,6 +752,352 @@ static int32_t scap_proc_add_from_proc(scap_t* handle, uint32_t tid, int parentt
 	return res;
 }
 
+//
+// A process of the parallel /proc scan. The worker that scans it builds a
+// private table with the process and its threads, which is then merged into
+// the handle in the order of the /proc directory.
+//
+typedef struct scap_proc_scan_slot
+{
+	uint64_t m_tid;
+	scap_threadinfo* m_proclist;
+	int32_t m_res;
+	bool m_done;
+	char m_error[SCAP_LASTERR_SIZE];
+}scap_proc_scan_slot;
+
+struct scap_proc_scan;
+
+typedef struct scap_proc_scan_worker
+{
+	struct scap_proc_scan* m_scan;
+	scap_t* m_handle; // Copy of the handle without the callback, so that the threads and fds go to a private table
+	pthread_t m_thread;
+}scap_proc_scan_worker;
+
+typedef struct scap_proc_scan
+{
+	char* m_procdirname;
+	bool m_scan_sockets;
+	scap_proc_scan_slot* m_slots;
+	uint32_t m_nslots;
+	uint32_t m_next; // Next slot to be scanned
+	uint32_t m_merged; // Next slot to be merged
+	bool m_stop;
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_cond_done; // Signaled when a slot is done
+	pthread_cond_t m_cond_room; // Signaled when a slot is merged
+	struct scap_ns_socket_list* m_sockets_by_ns;
+	pthread_mutex_t m_sockets_mutex;
+}scap_proc_scan;
+
+static void scap_proc_free_list(scap_t* handle, scap_threadinfo** proclist)
+{
+	struct scap_threadinfo* tinfo;
+	struct scap_threadinfo* ttinfo;
+
+	HASH_ITER(hh, *proclist, tinfo, ttinfo)
+	{
+		HASH_DEL(*proclist, tinfo);
+		scap_fd_free_proc_fd_table(handle, tinfo);
+		free(tinfo);
+	}
+}
+
+static void* scap_proc_scan_thread(void* arg)
+{
+	scap_proc_scan_worker* worker = (scap_proc_scan_worker*)arg;
+	scap_proc_scan* scan = worker->m_scan;
+	scap_t* wh = worker->m_handle;
+	char childdir[SCAP_MAX_PATH_SIZE];
+
+	pthread_mutex_lock(&scan->m_mutex);
+
+	while(true)
+	{
+		scap_proc_scan_slot* slot;
+		int32_t res;
+
+		while(!scan->m_stop &&
+			scan->m_next < scan->m_nslots &&
+			scan->m_next >= scan->m_merged + PROC_SCAN_WINDOW)
+		{
+			pthread_cond_wait(&scan->m_cond_room, &scan->m_mutex);
+		}
+
+		if(scan->m_stop || scan->m_next == scan->m_nslots)
+		{
+			break;
+		}
+
+		slot = &scan->m_slots[scan->m_next++];
+		pthread_mutex_unlock(&scan->m_mutex);
+
+		res = scap_proc_add_from_proc(wh, slot->m_tid, -1, -1, scan->m_procdirname, &scan->m_sockets_by_ns, NULL, slot->m_error);
+		if(res != SCAP_SUCCESS)
+		{
+			snprintf(slot->m_error, SCAP_LASTERR_SIZE, "cannot add procs tid = %"PRIu64", parenttid = %"PRIi32", dirname = %s", slot->m_tid, -1, scan->m_procdirname);
+		}
+		else
+		{
+			snprintf(childdir, sizeof(childdir), "%s/%u/task", scan->m_procdirname, (int)slot->m_tid);
+			if(scap_proc_scan_proc_dir(wh, childdir, slot->m_tid, -1, NULL, slot->m_error, scan->m_scan_sockets) == SCAP_FAILURE)
+			{
+				res = SCAP_FAILURE;
+			}
+		}
+
+		pthread_mutex_lock(&scan->m_mutex);
+		slot->m_proclist = wh->m_proclist;
+		slot->m_res = res;
+		slot->m_done = true;
+		wh->m_proclist = NULL;
+		pthread_cond_broadcast(&scan->m_cond_done);
+	}
+
+	pthread_mutex_unlock(&scan->m_mutex);
+	return NULL;
+}
+
+//
+// Move the threads scanned by a worker into the process table, or pass them to
+// the callback together with their fds, like the serial scan does
+//
+static int32_t scap_proc_scan_merge(scap_t* handle, scap_threadinfo** proclist, char* error)
+{
+	struct scap_threadinfo* tinfo;
+	struct scap_threadinfo* ttinfo;
+	struct scap_threadinfo* dup;
+	scap_fdinfo* fdlist;
+	scap_fdinfo* fdi;
+	scap_fdinfo* tfdi;
+	int32_t uth_status = SCAP_SUCCESS;
+
+	HASH_ITER(hh, *proclist, tinfo, ttinfo)
+	{
+		HASH_DEL(*proclist, tinfo);
+
+		if(handle->m_proc_callback == NULL)
+		{
+			HASH_FIND_INT64(handle->m_proclist, &tinfo->tid, dup);
+			if(dup != NULL)
+			{
+				ASSERT(false);
+				snprintf(error, SCAP_LASTERR_SIZE, "duplicate process %"PRIu64, tinfo->tid);
+				scap_fd_free_proc_fd_table(handle, tinfo);
+				free(tinfo);
+				return SCAP_FAILURE;
+			}
+
+			HASH_ADD_INT64(handle->m_proclist, tid, tinfo);
+			if(uth_status != SCAP_SUCCESS)
+			{
+				snprintf(error, SCAP_LASTERR_SIZE, "process table allocation error (2)");
+				return SCAP_FAILURE;
+			}
+		}
+		else
+		{
+			//
+			// The callback gets the thread without fds, and then the fds one by one
+			//
+			fdlist = tinfo->fdlist;
+			tinfo->fdlist = NULL;
+
+			handle->m_proc_callback(handle->m_proc_callback_context, tinfo->tid, tinfo, NULL, handle);
+
+			HASH_ITER(hh, fdlist, fdi, tfdi)
+			{
+				handle->m_proc_callback(handle->m_proc_callback_context, tinfo->tid, tinfo, fdi, handle);
+			}
+
+			scap_fd_free_table(handle, &fdlist);
+			free(tinfo);
+		}
+	}
+
+	return SCAP_SUCCESS;
+}
+
+//
+// Scan the processes under /proc with a pool of worker threads, one process at
+// a time. The order in which they are added to the table, or passed to the
+// callback, is the same as in the serial scan.
+//
+static int32_t scap_proc_scan_proc_dir_parallel(scap_t* handle, char* procdirname, uint32_t nthreads, char *error, bool scan_sockets)
+{
+	DIR *dir_p;
+	struct dirent *dir_entry_p;
+	scap_proc_scan scan;
+	scap_proc_scan_worker workers[PROC_SCAN_MAX_THREADS];
+	uint32_t nstarted = 0;
+	uint32_t maxslots = 1024;
+	int32_t res = SCAP_SUCCESS;
+	uint32_t j;
+
+	memset(&scan, 0, sizeof(scan));
+	scan.m_procdirname = procdirname;
+	scan.m_scan_sockets = scan_sockets;
+	scan.m_sockets_by_ns = scan_sockets? NULL : (void*)-1;
+
+	//
+	// Listing the directory is fast, so do it upfront
+	//
+	dir_p = opendir(procdirname);
+	if(dir_p == NULL)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "error opening the %s directory", procdirname);
+		return SCAP_NOTFOUND;
+	}
+
+	scan.m_slots = (scap_proc_scan_slot*)malloc(maxslots * sizeof(scap_proc_scan_slot));
+
+	while(scan.m_slots != NULL && (dir_entry_p = readdir(dir_p)) != NULL)
+	{
+		if(strspn(dir_entry_p->d_name, "0123456789") != strlen(dir_entry_p->d_name))
+		{
+			continue;
+		}
+
+		if(scan.m_nslots == maxslots)
+		{
+			scap_proc_scan_slot* slots;
+
+			maxslots *= 2;
+			slots = (scap_proc_scan_slot*)realloc(scan.m_slots, maxslots * sizeof(scap_proc_scan_slot));
+			if(slots == NULL)
+			{
+				free(scan.m_slots);
+				scan.m_slots = NULL;
+				break;
+			}
+
+			scan.m_slots = slots;
+		}
+
+		scan.m_slots[scan.m_nslots].m_tid = atoi(dir_entry_p->d_name);
+		scan.m_slots[scan.m_nslots].m_proclist = NULL;
+		scan.m_slots[scan.m_nslots].m_res = SCAP_SUCCESS;
+		scan.m_slots[scan.m_nslots].m_done = false;
+		scan.m_nslots++;
+	}
+
+	closedir(dir_p);
+
+	if(scan.m_slots == NULL)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "process table allocation error (4)");
+		return SCAP_FAILURE;
+	}
+
+	pthread_mutex_init(&scan.m_mutex, NULL);
+	pthread_cond_init(&scan.m_cond_done, NULL);
+	pthread_cond_init(&scan.m_cond_room, NULL);
+	pthread_mutex_init(&scan.m_sockets_mutex, NULL);
+
+	for(j = 0; j < nthreads; j++)
+	{
+		scap_proc_scan_worker* worker = &workers[nstarted];
+
+		worker->m_scan = &scan;
+		worker->m_handle = (scap_t*)malloc(sizeof(scap_t));
+		if(worker->m_handle == NULL)
+		{
+			break;
+		}
+
+		memcpy(worker->m_handle, handle, sizeof(scap_t));
+		worker->m_handle->m_proclist = NULL;
+		worker->m_handle->m_proc_callback = NULL;
+		worker->m_handle->m_proc_scan_sockets_mutex = &scan.m_sockets_mutex;
+
+		if(pthread_create(&worker->m_thread, NULL, scap_proc_scan_thread, worker) != 0)
+		{
+			free(worker->m_handle);
+			break;
+		}
+
+		nstarted++;
+	}
+
+	//
+	// Merge the processes in order as soon as they are done
+	//
+	pthread_mutex_lock(&scan.m_mutex);
+
+	while(scan.m_merged < scan.m_nslots && nstarted != 0)
+	{
+		scap_proc_scan_slot* slot = &scan.m_slots[scan.m_merged];
+
+		while(!slot->m_done)
+		{
+			pthread_cond_wait(&scan.m_cond_done, &scan.m_mutex);
+		}
+
+		pthread_mutex_unlock(&scan.m_mutex);
+
+		res = slot->m_res;
+		if(res == SCAP_SUCCESS)
+		{
+			res = scap_proc_scan_merge(handle, &slot->m_proclist, error);
+		}
+		else
+		{
+			snprintf(error, SCAP_LASTERR_SIZE, "%s", slot->m_error);
+		}
+
+		pthread_mutex_lock(&scan.m_mutex);
+		scan.m_merged++;
+
+		if(res != SCAP_SUCCESS)
+		{
+			scan.m_stop = true;
+		}
+
+		pthread_cond_broadcast(&scan.m_cond_room);
+
+		if(res != SCAP_SUCCESS)
+		{
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&scan.m_mutex);
+
+	for(j = 0; j < nstarted; j++)
+	{
+		pthread_join(workers[j].m_thread, NULL);
+		free(workers[j].m_handle);
+	}
+
+	if(nstarted == 0)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "error starting the /proc scan threads");
+		res = SCAP_FAILURE;
+	}
+
+	//
+	// Free what's left after a failure
+	//
+	for(j = 0; j < scan.m_nslots; j++)
+	{
+		scap_proc_free_list(handle, &scan.m_slots[j].m_proclist);
+	}
+
+	if(scan.m_sockets_by_ns != NULL && scan.m_sockets_by_ns != (void*)-1)
+	{
+		scap_fd_free_ns_sockets_list(handle, &scan.m_sockets_by_ns);
+	}
+
+	pthread_mutex_destroy(&scan.m_mutex);
+	pthread_cond_destroy(&scan.m_cond_done);
+	pthread_cond_destroy(&scan.m_cond_room);
+	pthread_mutex_destroy(&scan.m_sockets_mutex);
+	free(scan.m_slots);
+
+	return res;
+}
+
 //
 // Scan a directory containing multiple processes under /proc
 //
@@ -737,9 +1109,30 @@ int32_t scap_proc_scan_proc_dir(scap_t* handle, char* procdirname, int parenttid
 	uint64_t tid;
 	int32_t res = SCAP_SUCCESS;
 	char childdir[SCAP_MAX_PATH_SIZE];
+	uint32_t nthreads;
 
 	struct scap_ns_socket_list* sockets_by_ns = NULL;
 
+	//
+	// Full scans are done by a pool of threads
+	//
+	if(parenttid == -1 && tid_to_scan == -1)
+	{
+		nthreads = handle->m_proc_scan_threads;
+		if(nthreads == 0)
+		{
+			long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+			nthreads = (ncpus > 0)? ncpus : 1;
+		}
+
+		nthreads = MIN(nthreads, PROC_SCAN_MAX_THREADS);
+
+		if(nthreads > 1)
+		{
+			return scap_proc_scan_proc_dir_parallel(handle, procdirname, nthreads, error, scan_sockets);
+		}
+	}
+
 	tid = 0;
 	dir_p = opendir(procdirname);
 
@@ -886,6 +1279,57 @@ void scap_proc_free_table(scap_t* handle)
 	}
 }
 
+//
+// Copy the process table of src, including the fd tables, into the one of dst
+//
+int32_t scap_proc_copy_table(scap_t* dst, scap_t* src)
+{
+	struct scap_threadinfo* tinfo;
+	struct scap_threadinfo* ttinfo;
+	scap_fdinfo* fdi;
+	scap_fdinfo* tfdi;
+	int32_t uth_status = SCAP_SUCCESS;
+
+	HASH_ITER(hh, src->m_proclist, tinfo, ttinfo)
+	{
+		struct scap_threadinfo* ntinfo = (struct scap_threadinfo*)malloc(sizeof(struct scap_threadinfo));
+		if(ntinfo == NULL)
+		{
+			snprintf(dst->m_lasterr, SCAP_LASTERR_SIZE, "process table allocation error (3)");
+			return SCAP_FAILURE;
+		}
+
+		memcpy(ntinfo, tinfo, sizeof(struct scap_threadinfo));
+		ntinfo->fdlist = NULL;
+		HASH_ADD_INT64(dst->m_proclist, tid, ntinfo);
+		if(uth_status != SCAP_SUCCESS)
+		{
+			snprintf(dst->m_lasterr, SCAP_LASTERR_SIZE, "process table allocation error (3)");
+			return SCAP_FAILURE;
+		}
+
+		HASH_ITER(hh, tinfo->fdlist, fdi, tfdi)
+		{
+			scap_fdinfo* nfdi = (scap_fdinfo*)malloc(sizeof(scap_fdinfo));
+			if(nfdi == NULL)
+			{
+				snprintf(dst->m_lasterr, SCAP_LASTERR_SIZE, "fd table allocation error (3)");
+				return SCAP_FAILURE;
+			}
+
+			memcpy(nfdi, fdi, sizeof(scap_fdinfo));
+			HASH_ADD_INT64(ntinfo->fdlist, fd, nfdi);
+			if(uth_status != SCAP_SUCCESS)
+			{
+				snprintf(dst->m_lasterr, SCAP_LASTERR_SIZE, "fd table allocation error (3)");
+				return SCAP_FAILURE;
+			}
+		}
+	}
+
+	return SCAP_SUCCESS;
+}
+
 struct scap_threadinfo* scap_proc_get(scap_t* handle, int64_t tid, bool scan_sockets)
 {
 #if !defined(HAS_CAPTURE)
@@ -27,6 +27,12 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 #include "scap-int.h"
 #include "scap_savefile.h"
 
+#ifdef HAS_MMAP_READ
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 // WRITE FUNCTIONS
@@ -540,7 +546,7 @@ static int32_t scap_write_userlist(scap_t *handle, gzFile f)
 //
 // Create the dump file headers and add the tables
 //
-static scap_dumper_t *scap_setup_dump(scap_t *handle, gzFile f, const char *fname)
+static int32_t scap_setup_dump(scap_t *handle, gzFile f, const char *fname)
 {
 	block_header bh;
 	section_header_block sh;
@@ -564,19 +570,22 @@ static scap_dumper_t *scap_setup_dump(scap_t *handle, gzFile f, const char *fnam
 	        gzwrite(f, &bt, sizeof(bt)) != sizeof(bt))
 	{
 		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error writing to file %s  (5)", fname);
-		return NULL;
+		return SCAP_FAILURE;
 	}
 
 	//
 	// If we're dumping in live mode, refresh the process tables list
 	// so we don't lose information about processes created in the interval
-	// between opening the handle and starting the dump
+	// between opening the handle and starting the dump. The file always gets
+	// the fds, even if the handle reads them lazily.
 	//
 #if defined(HAS_CAPTURE)
 	if(handle->m_file == NULL && handle->refresh_proc_table_when_saving)
 	{
 		proc_entry_callback tcb = handle->m_proc_callback;
+		bool lazy_fds = handle->m_lazy_fds;
 		handle->m_proc_callback = NULL;
+		handle->m_lazy_fds = false;
 
 		scap_proc_free_table(handle);
 		char filename[SCAP_MAX_PATH_SIZE];
@@ -584,10 +593,12 @@ static scap_dumper_t *scap_setup_dump(scap_t *handle, gzFile f, const char *fnam
 		if(scap_proc_scan_proc_dir(handle, filename, -1, -1, NULL, handle->m_lasterr, true) != SCAP_SUCCESS)
 		{
 			handle->m_proc_callback = tcb;
-			return NULL;
+			handle->m_lazy_fds = lazy_fds;
+			return SCAP_FAILURE;
 		}
 
 		handle->m_proc_callback = tcb;
+		handle->m_lazy_fds = lazy_fds;
 	}
 #endif
 
@@ -596,7 +607,7 @@ static scap_dumper_t *scap_setup_dump(scap_t *handle, gzFile f, const char *fnam
 	//
 	if(scap_write_machine_info(handle, f) != SCAP_SUCCESS)
 	{
-		return NULL;
+		return SCAP_FAILURE;
 	}
 
 	//
@@ -604,7 +615,7 @@ static scap_dumper_t *scap_setup_dump(scap_t *handle, gzFile f, const char *fnam
 	//
 	if(scap_write_iflist(handle, f) != SCAP_SUCCESS)
 	{
-		return NULL;
+		return SCAP_FAILURE;
 	}
 
 	//
@@ -612,7 +623,7 @@ static scap_dumper_t *scap_setup_dump(scap_t *handle, gzFile f, const char *fnam
 	//
 	if(scap_write_userlist(handle, f) != SCAP_SUCCESS)
 	{
-		return NULL;
+		return SCAP_FAILURE;
 	}
 
 	//
@@ -620,7 +631,7 @@ static scap_dumper_t *scap_setup_dump(scap_t *handle, gzFile f, const char *fnam
 	//
 	if(scap_write_proclist(handle, f) != SCAP_SUCCESS)
 	{
-		return NULL;
+		return SCAP_FAILURE;
 	}
 
 	//
@@ -628,7 +639,7 @@ static scap_dumper_t *scap_setup_dump(scap_t *handle, gzFile f, const char *fnam
 	//
 	if(scap_write_fdlist(handle, f) != SCAP_SUCCESS)
 	{
-		return NULL;
+		return SCAP_FAILURE;
 	}
 
 	//
@@ -639,564 +650,1897 @@ static scap_dumper_t *scap_setup_dump(scap_t *handle, gzFile f, const char *fnam
 		scap_proc_free_table(handle);
 	}
 
-	//
-	// Done, return the file
-	//
-	return (scap_dumper_t *)f;
+	return SCAP_SUCCESS;
 }
 
 //
-// Open a "savefile" for writing.
+// Free a dumper, without closing its file
 //
-scap_dumper_t *scap_dump_open(scap_t *handle, const char *fname, compression_mode compress)
+static void scap_dump_free(scap_dumper_t *d)
 {
-	gzFile f = NULL;
-	int fd = -1;
-	const char* mode;
-
-	switch(compress)
-	{
-	case SCAP_COMPRESSION_GZIP:
-		mode = "wb";
-		break;
-	case SCAP_COMPRESSION_NONE:
-		mode = "wbT";
-		break;
-	default:
-		ASSERT(false);
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid compression mode");
-		return NULL;
-	}
-
-	if(fname[0] == '-' && fname[1] == '\0')
-	{
-#ifndef	_WIN32
-		fd = dup(STDOUT_FILENO);
-#else
-		fd = 1;
-#endif
-		if(fd != -1)
-		{
-			f = gzdopen(fd, mode);
-			fname = "standard output";
-		}
-	}
-	else
-	{
-		f = gzopen(fname, mode);
-	}
+	uint32_t j;
 
-	if(f == NULL)
+	if(d->m_bufs != NULL)
 	{
-#ifndef	_WIN32
-		if(fd != -1)
+		for(j = 0; j < d->m_nbufs; j++)
 		{
-			close(fd);
+			free(d->m_bufs[j].m_buf);
 		}
-#endif
 
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "can't open %s", fname);
-		return NULL;
+		free(d->m_bufs);
 	}
 
-	return scap_setup_dump(handle, f, fname);
-}
-
-//
-// Close a "savefile" opened with scap_dump_open
-//
-void scap_dump_close(scap_dumper_t *d)
-{
-	gzclose((gzFile)d);
-}
-
-//
-// Return the current size of a tracefile
-//
-int64_t scap_dump_get_offset(scap_dumper_t *d)
-{
-	return gzoffset((gzFile)d);
-}
-
-void scap_dump_flush(scap_dumper_t *d)
-{
-	gzflush((gzFile)d, Z_FULL_FLUSH);
+	free(d->m_zbuf);
+	free(d->m_index);
+	free(d);
 }
 
-//
-// Tell me how many bytes we will have written if we did.
-//
-int32_t scap_number_of_bytes_to_write(scap_evt *e, uint16_t cpuid, int32_t *bytes)
+static inline void scap_dump_reset_buf(scap_dump_buf* b)
 {
-	*bytes = scap_normalize_block_len(sizeof(block_header) + sizeof(cpuid) + e->len + 4);
-
-	return SCAP_SUCCESS;
+	b->m_len = 0;
+	memset(&b->m_chunk_hdr, 0, sizeof(b->m_chunk_hdr));
 }
 
+#ifdef USE_ZLIB
 //
-// Write an event to a dump file
+// Compress a staging buffer and write it to the file as a chunk block
 //
-int32_t scap_dump(scap_t *handle, scap_dumper_t *d, scap_evt *e, uint16_t cpuid, uint32_t flags)
+static int32_t scap_dump_write_chunk(scap_dumper_t *d, scap_dump_buf* b)
 {
 	block_header bh;
 	uint32_t bt;
-	gzFile f = (gzFile)d;
+	uLongf zlen = d->m_zbuf_size;
+	chunk_index_entry* entry;
 
-	if(flags == 0)
+	if(compress2((Bytef*)d->m_zbuf, &zlen, (Bytef*)b->m_buf, b->m_len, d->m_level) != Z_OK)
 	{
-		//
-		// Write the section header
-		//
-		bh.block_type = EV_BLOCK_TYPE;
-		bh.block_total_length = scap_normalize_block_len(sizeof(block_header) + sizeof(cpuid) + e->len + 4);
-		bt = bh.block_total_length;
+		snprintf(d->m_lasterr, SCAP_LASTERR_SIZE, "error compressing a chunk");
+		return SCAP_FAILURE;
+	}
+
+	//
+	// Make room for the index entry
+	//
+	if(d->m_index_len == d->m_index_size)
+	{
+		uint32_t newsize = (d->m_index_size == 0)? 64 : d->m_index_size * 2;
+		chunk_index_entry* newindex = (chunk_index_entry*)realloc(d->m_index, newsize * sizeof(chunk_index_entry));
 
-		if(gzwrite(f, &bh, sizeof(bh)) != sizeof(bh) ||
-				gzwrite(f, &cpuid, sizeof(cpuid)) != sizeof(cpuid) ||
-				gzwrite(f, e, e->len) != e->len ||
-				scap_write_padding(f, sizeof(cpuid) + e->len) != SCAP_SUCCESS ||
-				gzwrite(f, &bt, sizeof(bt)) != sizeof(bt))
+		if(newindex == NULL)
 		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error writing to file (6)");
+			snprintf(d->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the chunk index");
 			return SCAP_FAILURE;
 		}
+
+		d->m_index = newindex;
+		d->m_index_size = newsize;
 	}
-	else
+
+	entry = &d->m_index[d->m_index_len];
+	entry->offset = gztell(d->m_f);
+	entry->first_evtnum = b->m_chunk_hdr.first_evtnum;
+	entry->first_ts = b->m_chunk_hdr.first_ts;
+	entry->last_ts = b->m_chunk_hdr.last_ts;
+	entry->nevts = b->m_chunk_hdr.nevts;
+	entry->uncompressed_len = b->m_len;
+
+	b->m_chunk_hdr.uncompressed_len = b->m_len;
+	b->m_chunk_hdr.compressed_len = (uint32_t)zlen;
+
+	bh.block_type = CK_BLOCK_TYPE;
+	bh.block_total_length = scap_normalize_block_len(sizeof(block_header) + sizeof(chunk_block_header) + (uint32_t)zlen + 4);
+	bt = bh.block_total_length;
+
+	if(gzwrite(d->m_f, &bh, sizeof(bh)) != sizeof(bh) ||
+			gzwrite(d->m_f, &b->m_chunk_hdr, sizeof(chunk_block_header)) != sizeof(chunk_block_header) ||
+			gzwrite(d->m_f, d->m_zbuf, (uint32_t)zlen) != (int)zlen ||
+			scap_write_padding(d->m_f, (uint32_t)zlen) != SCAP_SUCCESS ||
+			gzwrite(d->m_f, &bt, sizeof(bt)) != sizeof(bt))
 	{
-		//
-		// Write the section header
-		//
-		bh.block_type = EVF_BLOCK_TYPE;
-		bh.block_total_length = scap_normalize_block_len(sizeof(block_header) + sizeof(cpuid) + sizeof(flags) + e->len + 4);
-		bt = bh.block_total_length;
-
-		if(gzwrite(f, &bh, sizeof(bh)) != sizeof(bh) ||
-				gzwrite(f, &cpuid, sizeof(cpuid)) != sizeof(cpuid) ||
-				gzwrite(f, &flags, sizeof(flags)) != sizeof(flags) ||
-				gzwrite(f, e, e->len) != e->len ||
-				scap_write_padding(f, sizeof(cpuid) + e->len) != SCAP_SUCCESS ||
-				gzwrite(f, &bt, sizeof(bt)) != sizeof(bt))
-		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error writing to file (7)");
-			return SCAP_FAILURE;
-		}
+		snprintf(d->m_lasterr, SCAP_LASTERR_SIZE, "error writing to file (8)");
+		return SCAP_FAILURE;
 	}
 
-	//
-	// Enable this to make sure that everything is saved to disk during the tests
-	//
-#if 0
-	fflush(f);
-#endif
+	d->m_index_len++;
 
 	return SCAP_SUCCESS;
 }
 
-///////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////
-// READ FUNCTIONS
-///////////////////////////////////////////////////////////////////////////////
-///////////////////////////////////////////////////////////////////////////////
-
 //
-// Load the machine info block
+// Write the chunk index at the end of the file
 //
-static int32_t scap_read_machine_info(scap_t *handle, gzFile f, uint32_t block_length)
+static int32_t scap_dump_write_chunk_index(scap_dumper_t *d)
 {
-	//
-	// Read the section header block
-	//
-	if(gzread(f, &handle->m_machine_info, sizeof(handle->m_machine_info)) !=
-		sizeof(handle->m_machine_info))
+	block_header bh;
+	uint32_t bt;
+	uint32_t len = d->m_index_len * sizeof(chunk_index_entry);
+
+	bh.block_type = CKI_BLOCK_TYPE;
+	bh.block_total_length = scap_normalize_block_len(sizeof(block_header) + len + 4);
+	bt = bh.block_total_length;
+
+	if(gzwrite(d->m_f, &bh, sizeof(bh)) != sizeof(bh) ||
+			(len != 0 && gzwrite(d->m_f, d->m_index, len) != (int)len) ||
+			scap_write_padding(d->m_f, len) != SCAP_SUCCESS ||
+			gzwrite(d->m_f, &bt, sizeof(bt)) != sizeof(bt))
 	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error reading from file (1)");
 		return SCAP_FAILURE;
 	}
 
 	return SCAP_SUCCESS;
 }
+#endif // USE_ZLIB
 
 //
-// Parse a process list block
+// Write a staging buffer to the file, with a single write unless the file is
+// chunked
 //
-static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_length, uint32_t block_type)
+static int32_t scap_dump_write_buf(scap_dumper_t *d, scap_dump_buf* b)
 {
-	size_t readsize;
-	size_t totreadsize = 0;
-	size_t padding_len;
-	struct scap_threadinfo tinfo;
-	uint16_t stlen;
-	uint32_t padding;
-	int32_t uth_status = SCAP_SUCCESS;
-	struct scap_threadinfo *ntinfo;
-
-	tinfo.fdlist = NULL;
-	tinfo.flags = 0;
-	tinfo.vmsize_kb = 0;
-	tinfo.vmrss_kb = 0;
-	tinfo.vmswap_kb = 0;
-	tinfo.pfmajor = 0;
-	tinfo.pfminor = 0;
-	tinfo.env_len = 0;
-	tinfo.vtid = -1;
-	tinfo.vpid = -1;
-	tinfo.cgroups_len = 0;
-	tinfo.filtered_out = 0;
-	tinfo.root[0] = 0;
-	tinfo.sid = -1;
-
-	while(((int32_t)block_length - (int32_t)totreadsize) >= 4)
+	if(b->m_len == 0)
 	{
-		//
-		// tid
-		//
-		readsize = gzread(f, &(tinfo.tid), sizeof(uint64_t));
-		CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+		return SCAP_SUCCESS;
+	}
 
-		totreadsize += readsize;
+#ifdef USE_ZLIB
+	if(d->m_compress == SCAP_COMPRESSION_CHUNKED)
+	{
+		return scap_dump_write_chunk(d, b);
+	}
+#endif
 
-		//
-		// pid
-		//
-		readsize = gzread(f, &(tinfo.pid), sizeof(uint64_t));
-		CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+	if(gzwrite(d->m_f, b->m_buf, b->m_len) != (int)b->m_len)
+	{
+		snprintf(d->m_lasterr, SCAP_LASTERR_SIZE, "error writing to file (6)");
+		return SCAP_FAILURE;
+	}
 
-		totreadsize += readsize;
+	return SCAP_SUCCESS;
+}
 
-		//
-		// ptid
-		//
-		readsize = gzread(f, &(tinfo.ptid), sizeof(uint64_t));
-		CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+#ifdef HAS_ASYNC_DUMP
+//
+// Body of the writer thread of asynchronous dumpers. It writes the queued
+// buffers in order. After an error, the buffers are dropped, and scap_dump()
+// reports the error.
+//
+static void* scap_dump_thread(void* arg)
+{
+	scap_dumper_t* d = (scap_dumper_t*)arg;
+	int32_t res = SCAP_SUCCESS;
 
-		totreadsize += readsize;
+	while(true)
+	{
+		scap_dump_buf* b;
+		int64_t off;
 
-		switch(block_type)
+		pthread_mutex_lock(&d->m_mutex);
+		while(d->m_nfull == 0 && !d->m_stop)
 		{
-		case PL_BLOCK_TYPE_V1:
-		case PL_BLOCK_TYPE_V1_INT:
-		case PL_BLOCK_TYPE_V2:
-		case PL_BLOCK_TYPE_V2_INT:
-		case PL_BLOCK_TYPE_V3:
-		case PL_BLOCK_TYPE_V3_INT:
-		case PL_BLOCK_TYPE_V4:
-		case PL_BLOCK_TYPE_V5:
-			break;
-		case PL_BLOCK_TYPE_V6:
-			readsize = gzread(f, &(tinfo.sid), sizeof(uint64_t));
-			CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+			pthread_cond_wait(&d->m_cond_full, &d->m_mutex);
+		}
 
-			totreadsize += readsize;
+		if(d->m_nfull == 0)
+		{
+			pthread_mutex_unlock(&d->m_mutex);
 			break;
-
-		default:
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted process block type (fd1)");
-			ASSERT(false);
-			return SCAP_FAILURE;
 		}
+		pthread_mutex_unlock(&d->m_mutex);
 
-		//
-		// comm
-		//
-		readsize = gzread(f, &(stlen), sizeof(uint16_t));
-		CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+		b = &d->m_bufs[d->m_cons_idx];
 
-		if(stlen > SCAP_MAX_PATH_SIZE)
+		if(res == SCAP_SUCCESS)
 		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid commlen %d", stlen);
-			return SCAP_FAILURE;
+			res = scap_dump_write_buf(d, b);
 		}
 
-		totreadsize += readsize;
-
-		readsize = gzread(f, tinfo.comm, stlen);
-		CHECK_READ_SIZE(readsize, stlen);
+		off = gzoffset(d->m_f);
 
-		// the string is not null-terminated on file
-		tinfo.comm[stlen] = 0;
+		pthread_mutex_lock(&d->m_mutex);
+		d->m_res = res;
+		d->m_written_off = off;
+		d->m_queued_bytes -= b->m_len;
+		d->m_cons_idx = (d->m_cons_idx + 1) % d->m_nbufs;
+		d->m_nfull--;
+		pthread_cond_signal(&d->m_cond_empty);
+		pthread_mutex_unlock(&d->m_mutex);
+	}
 
-		totreadsize += readsize;
+	return NULL;
+}
+#endif // HAS_ASYNC_DUMP
 
-		//
-		// exe
-		//
-		readsize = gzread(f, &(stlen), sizeof(uint16_t));
-		CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+//
+// Hand the staging buffer to the writer and move to the next one
+//
+static int32_t scap_dump_submit(scap_dumper_t *d)
+{
+	scap_dump_buf* b = &d->m_bufs[d->m_prod_idx];
+	int32_t res;
 
-		if(stlen > SCAP_MAX_PATH_SIZE)
+#ifdef HAS_ASYNC_DUMP
+	if(d->m_async)
+	{
+		pthread_mutex_lock(&d->m_mutex);
+		if(b->m_len != 0)
 		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid exelen %d", stlen);
-			return SCAP_FAILURE;
+			d->m_queued_bytes += b->m_len;
+			d->m_prod_idx = (d->m_prod_idx + 1) % d->m_nbufs;
+			d->m_nfull++;
+			pthread_cond_signal(&d->m_cond_full);
 		}
 
-		totreadsize += readsize;
+		if(d->m_nfull == d->m_nbufs)
+		{
+			d->m_n_stalls++;
 
-		readsize = gzread(f, tinfo.exe, stlen);
-		CHECK_READ_SIZE(readsize, stlen);
+			do
+			{
+				pthread_cond_wait(&d->m_cond_empty, &d->m_mutex);
+			}
+			while(d->m_nfull == d->m_nbufs);
+		}
 
-		// the string is not null-terminated on file
-		tinfo.exe[stlen] = 0;
+		res = d->m_res;
+		pthread_mutex_unlock(&d->m_mutex);
 
-		totreadsize += readsize;
+		scap_dump_reset_buf(&d->m_bufs[d->m_prod_idx]);
+		return res;
+	}
+#endif
 
-		//
-		// args
-		//
-		readsize = gzread(f, &(stlen), sizeof(uint16_t));
+	res = scap_dump_write_buf(d, b);
+	scap_dump_reset_buf(b);
+	return res;
+}
+
+//
+// Open a "savefile" for writing.
+//
+scap_dumper_t *scap_dump_open(scap_t *handle, const char *fname, compression_mode compress)
+{
+	scap_dump_params params;
+
+	memset(&params, 0, sizeof(params));
+	params.compress = compress;
+
+	return scap_dump_open_ex(handle, fname, &params);
+}
+
+scap_dumper_t *scap_dump_open_ex(scap_t *handle, const char *fname, const scap_dump_params* params)
+{
+	gzFile f = NULL;
+	int fd = -1;
+	char mode[8];
+	scap_dumper_t* d;
+	uint32_t j;
+
+	if(params->compression_level < 0 || params->compression_level > 9)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid compression level %d", params->compression_level);
+		return NULL;
+	}
+
+	switch(params->compress)
+	{
+	case SCAP_COMPRESSION_GZIP:
+		if(params->compression_level == 0)
+		{
+			snprintf(mode, sizeof(mode), "wb");
+		}
+		else
+		{
+			snprintf(mode, sizeof(mode), "wb%d", params->compression_level);
+		}
+		break;
+	case SCAP_COMPRESSION_NONE:
+		snprintf(mode, sizeof(mode), "wbT");
+		break;
+	case SCAP_COMPRESSION_CHUNKED:
+#ifdef USE_ZLIB
+		//
+		// The chunks are compressed by us, the rest of the file is not
+		//
+		snprintf(mode, sizeof(mode), "wbT");
+		break;
+#else
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "chunked trace files require zlib");
+		return NULL;
+#endif
+	default:
+		ASSERT(false);
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid compression mode");
+		return NULL;
+	}
+
+#ifndef HAS_ASYNC_DUMP
+	if(params->async)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "asynchronous dumps are not supported on this platform");
+		return NULL;
+	}
+#endif
+
+	d = (scap_dumper_t*)calloc(1, sizeof(scap_dumper_t));
+	if(d == NULL)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the dumper");
+		return NULL;
+	}
+
+	d->m_compress = params->compress;
+	d->m_res = SCAP_SUCCESS;
+	d->m_nbufs = 1;
+
+	//
+	// A staging buffer must be able to hold any event block that the
+	// readers accept
+	//
+	if(params->compress == SCAP_COMPRESSION_CHUNKED)
+	{
+		d->m_buf_size = CHUNK_SIZE;
+	}
+	else if(params->buffer_size != 0)
+	{
+		d->m_buf_size = MAX(params->buffer_size, sizeof(block_header) + FILE_READ_BUF_SIZE);
+	}
+	else
+	{
+		d->m_buf_size = DUMP_BUF_SIZE;
+	}
+
+#ifdef HAS_ASYNC_DUMP
+	if(params->async)
+	{
+		d->m_async = true;
+		d->m_nbufs = DUMP_ASYNC_NBUFS;
+	}
+#endif
+
+	d->m_bufs = (scap_dump_buf*)calloc(d->m_nbufs, sizeof(scap_dump_buf));
+	if(d->m_bufs == NULL)
+	{
+		scap_dump_free(d);
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the dump buffers");
+		return NULL;
+	}
+
+	for(j = 0; j < d->m_nbufs; j++)
+	{
+		d->m_bufs[j].m_buf = (char*)malloc(d->m_buf_size);
+		if(d->m_bufs[j].m_buf == NULL)
+		{
+			scap_dump_free(d);
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the dump buffers");
+			return NULL;
+		}
+	}
+
+#ifdef USE_ZLIB
+	if(params->compress == SCAP_COMPRESSION_CHUNKED)
+	{
+		d->m_level = (params->compression_level == 0)? Z_DEFAULT_COMPRESSION : params->compression_level;
+		d->m_zbuf_size = compressBound(CHUNK_SIZE);
+		d->m_zbuf = (char*)malloc(d->m_zbuf_size);
+		if(d->m_zbuf == NULL)
+		{
+			scap_dump_free(d);
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the chunk buffers");
+			return NULL;
+		}
+	}
+#endif
+
+	if(fname[0] == '-' && fname[1] == '\0')
+	{
+#ifndef	_WIN32
+		fd = dup(STDOUT_FILENO);
+#else
+		fd = 1;
+#endif
+		if(fd != -1)
+		{
+			f = gzdopen(fd, mode);
+			fname = "standard output";
+		}
+	}
+	else
+	{
+		f = gzopen(fname, mode);
+	}
+
+	if(f == NULL)
+	{
+#ifndef	_WIN32
+		if(fd != -1)
+		{
+			close(fd);
+		}
+#endif
+
+		scap_dump_free(d);
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "can't open %s", fname);
+		return NULL;
+	}
+
+	d->m_f = f;
+
+	if(scap_setup_dump(handle, f, fname) != SCAP_SUCCESS)
+	{
+		gzclose(f);
+		scap_dump_free(d);
+		return NULL;
+	}
+
+#ifdef HAS_ASYNC_DUMP
+	if(d->m_async)
+	{
+		d->m_written_off = gzoffset(f);
+
+		pthread_mutex_init(&d->m_mutex, NULL);
+		pthread_cond_init(&d->m_cond_full, NULL);
+		pthread_cond_init(&d->m_cond_empty, NULL);
+
+		if(pthread_create(&d->m_thread, NULL, scap_dump_thread, d) != 0)
+		{
+			pthread_cond_destroy(&d->m_cond_empty);
+			pthread_cond_destroy(&d->m_cond_full);
+			pthread_mutex_destroy(&d->m_mutex);
+			gzclose(f);
+			scap_dump_free(d);
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error starting the dump thread");
+			return NULL;
+		}
+	}
+#endif
+
+	return d;
+}
+
+//
+// Copy into a new handle everything that scap_setup_dump() needs. The /proc
+// scan that refreshes the process table of live captures is left to
+// scap_dump_open(), which then can be called from another thread.
+//
+scap_t *scap_dump_snapshot(scap_t *handle, char *error)
+{
+	scap_t* snap;
+
+	snap = (scap_t*)calloc(1, sizeof(scap_t));
+	if(snap == NULL)
+	{
+		snprintf(error, SCAP_LASTERR_SIZE, "error allocating the snapshot");
+		return NULL;
+	}
+
+	snap->m_machine_info = handle->m_machine_info;
+	snap->m_proc_scan_threads = handle->m_proc_scan_threads;
+	snap->refresh_proc_table_when_saving = (handle->m_file == NULL && handle->refresh_proc_table_when_saving);
+
+#if defined(HAS_CAPTURE)
+	//
+	// The /proc scan asks the driver for the namespace ids of the threads,
+	// through a private descriptor so that the capture can be closed first
+	//
+	if(snap->refresh_proc_table_when_saving && handle->m_ndevs != 0)
+	{
+		snap->m_devs = (scap_device*)calloc(1, sizeof(scap_device));
+		if(snap->m_devs == NULL)
+		{
+			scap_dump_snapshot_free(snap);
+			snprintf(error, SCAP_LASTERR_SIZE, "error allocating the snapshot");
+			return NULL;
+		}
+
+		snap->m_ndevs = 1;
+		snap->m_devs[0].m_fd = -1;
+
+		if(handle->m_devs[0].m_fd >= 0)
+		{
+			snap->m_devs[0].m_fd = dup(handle->m_devs[0].m_fd);
+			if(snap->m_devs[0].m_fd < 0)
+			{
+				scap_dump_snapshot_free(snap);
+				snprintf(error, SCAP_LASTERR_SIZE, "error duplicating the device descriptor");
+				return NULL;
+			}
+		}
+	}
+#endif
+
+	if(handle->m_addrlist != NULL)
+	{
+		snap->m_addrlist = scap_dup_iflist(handle->m_addrlist);
+		if(snap->m_addrlist == NULL)
+		{
+			scap_dump_snapshot_free(snap);
+			snprintf(error, SCAP_LASTERR_SIZE, "error copying the interface list");
+			return NULL;
+		}
+	}
+
+	if(handle->m_userlist != NULL)
+	{
+		snap->m_userlist = scap_dup_userlist(handle->m_userlist);
+		if(snap->m_userlist == NULL)
+		{
+			scap_dump_snapshot_free(snap);
+			snprintf(error, SCAP_LASTERR_SIZE, "error copying the user list");
+			return NULL;
+		}
+	}
+
+	//
+	// A table that will be replaced by the /proc scan isn't worth copying
+	//
+	if(!snap->refresh_proc_table_when_saving)
+	{
+		if(scap_proc_copy_table(snap, handle) != SCAP_SUCCESS)
+		{
+			snprintf(error, SCAP_LASTERR_SIZE, "%s", snap->m_lasterr);
+			scap_dump_snapshot_free(snap);
+			return NULL;
+		}
+	}
+
+	return snap;
+}
+
+void scap_dump_snapshot_free(scap_t *snap)
+{
+#if defined(HAS_CAPTURE)
+	if(snap->m_devs != NULL)
+	{
+		if(snap->m_devs[0].m_fd >= 0)
+		{
+			close(snap->m_devs[0].m_fd);
+		}
+
+		free(snap->m_devs);
+	}
+#endif
+
+	scap_proc_free_table(snap);
+	scap_free_iflist(snap->m_addrlist);
+	scap_free_userlist(snap->m_userlist);
+	free(snap);
+}
+
+//
+// Close a "savefile" opened with scap_dump_open
+//
+void scap_dump_close(scap_dumper_t *d)
+{
+	//
+	// There's no way to report errors from here. A chunked file without index
+	// can still be read, and its chunks are located by scanning it.
+	//
+	scap_dump_submit(d);
+
+#ifdef HAS_ASYNC_DUMP
+	if(d->m_async)
+	{
+		pthread_mutex_lock(&d->m_mutex);
+		d->m_stop = true;
+		pthread_cond_signal(&d->m_cond_full);
+		pthread_mutex_unlock(&d->m_mutex);
+
+		pthread_join(d->m_thread, NULL);
+
+		pthread_cond_destroy(&d->m_cond_empty);
+		pthread_cond_destroy(&d->m_cond_full);
+		pthread_mutex_destroy(&d->m_mutex);
+	}
+#endif
+
+#ifdef USE_ZLIB
+	if(d->m_compress == SCAP_COMPRESSION_CHUNKED)
+	{
+		scap_dump_write_chunk_index(d);
+	}
+#endif
+
+	gzclose(d->m_f);
+	scap_dump_free(d);
+}
+
+//
+// Return the current size of a tracefile, including the events that are
+// still in the staging buffers
+//
+int64_t scap_dump_get_offset(scap_dumper_t *d)
+{
+	int64_t off;
+
+#ifdef HAS_ASYNC_DUMP
+	if(d->m_async)
+	{
+		pthread_mutex_lock(&d->m_mutex);
+		off = d->m_written_off + d->m_queued_bytes;
+		pthread_mutex_unlock(&d->m_mutex);
+
+		return off + d->m_bufs[d->m_prod_idx].m_len;
+	}
+#endif
+
+	off = gzoffset(d->m_f);
+
+	return off + d->m_bufs[d->m_prod_idx].m_len;
+}
+
+uint64_t scap_dump_get_stalls(scap_dumper_t *d)
+{
+	uint64_t n_stalls = 0;
+
+#ifdef HAS_ASYNC_DUMP
+	if(d->m_async)
+	{
+		pthread_mutex_lock(&d->m_mutex);
+		n_stalls = d->m_n_stalls;
+		pthread_mutex_unlock(&d->m_mutex);
+	}
+#endif
+
+	return n_stalls;
+}
+
+void scap_dump_flush(scap_dumper_t *d)
+{
+	scap_dump_submit(d);
+
+#ifdef HAS_ASYNC_DUMP
+	//
+	// Wait for the writer to be idle, after which it doesn't touch the file
+	//
+	if(d->m_async)
+	{
+		pthread_mutex_lock(&d->m_mutex);
+		while(d->m_nfull != 0)
+		{
+			pthread_cond_wait(&d->m_cond_empty, &d->m_mutex);
+		}
+		pthread_mutex_unlock(&d->m_mutex);
+	}
+#endif
+
+	gzflush(d->m_f, Z_FULL_FLUSH);
+}
+
+//
+// Tell me how many bytes we will have written if we did.
+//
+int32_t scap_number_of_bytes_to_write(scap_evt *e, uint16_t cpuid, int32_t *bytes)
+{
+	*bytes = scap_normalize_block_len(sizeof(block_header) + sizeof(cpuid) + e->len + 4);
+
+	return SCAP_SUCCESS;
+}
+
+//
+// Write an event to a dump file. The event block is assembled in the staging
+// buffer, which is written once it's full.
+//
+int32_t scap_dump(scap_t *handle, scap_dumper_t *d, scap_evt *e, uint16_t cpuid, uint32_t flags)
+{
+	scap_dump_buf* b = &d->m_bufs[d->m_prod_idx];
+	block_header* bh;
+	uint32_t blocklen;
+	char* p;
+
+	if(flags == 0)
+	{
+		blocklen = scap_normalize_block_len(sizeof(block_header) + sizeof(cpuid) + e->len + 4);
+	}
+	else
+	{
+		blocklen = scap_normalize_block_len(sizeof(block_header) + sizeof(cpuid) + sizeof(flags) + e->len + 4);
+	}
+
+	if(blocklen > d->m_buf_size)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "event too large to be saved (%u bytes)", blocklen);
+		return SCAP_FAILURE;
+	}
+
+	if(b->m_len + blocklen > d->m_buf_size)
+	{
+		if(scap_dump_submit(d) != SCAP_SUCCESS)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "%s", d->m_lasterr);
+			return SCAP_FAILURE;
+		}
+
+		b = &d->m_bufs[d->m_prod_idx];
+	}
+
+	//
+	// Write the section header. EVF_BLOCK_TYPE has 32 bits of flags.
+	//
+	p = b->m_buf + b->m_len;
+	bh = (block_header*)p;
+	bh->block_type = (flags == 0)? EV_BLOCK_TYPE : EVF_BLOCK_TYPE;
+	bh->block_total_length = blocklen;
+	p += sizeof(block_header);
+
+	memcpy(p, &cpuid, sizeof(cpuid));
+	p += sizeof(cpuid);
+
+	if(flags != 0)
+	{
+		memcpy(p, &flags, sizeof(flags));
+		p += sizeof(flags);
+	}
+
+	memcpy(p, e, e->len);
+	p += e->len;
+
+	//
+	// Padding and trailer
+	//
+	memset(p, 0, b->m_buf + b->m_len + blocklen - sizeof(blocklen) - p);
+	memcpy(b->m_buf + b->m_len + blocklen - sizeof(blocklen), &blocklen, sizeof(blocklen));
+
+	if(d->m_compress == SCAP_COMPRESSION_CHUNKED)
+	{
+		if(b->m_chunk_hdr.nevts == 0)
+		{
+			b->m_chunk_hdr.first_evtnum = d->m_nevts;
+			b->m_chunk_hdr.first_ts = e->ts;
+		}
+
+		if(e->ts > b->m_chunk_hdr.last_ts)
+		{
+			b->m_chunk_hdr.last_ts = e->ts;
+		}
+
+		b->m_chunk_hdr.nevts++;
+	}
+
+	b->m_len += blocklen;
+	d->m_nevts++;
+
+	return SCAP_SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// READ FUNCTIONS
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+
+//
+// Allocate the read state of a chunked file. first_off is the file offset of
+// the first chunk block.
+//
+static int32_t scap_chunk_reader_init(scap_t *handle, uint64_t first_off)
+{
+	scap_chunk_reader* cr;
+
+	ASSERT(handle->m_chunk_reader == NULL);
+
+	cr = (scap_chunk_reader*)calloc(1, sizeof(scap_chunk_reader));
+	if(cr == NULL)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the chunk reader");
+		return SCAP_FAILURE;
+	}
+
+	cr->m_first_off = first_off;
+	handle->m_chunk_reader = cr;
+
+	return SCAP_SUCCESS;
+}
+
+void scap_chunk_reader_free(scap_t *handle)
+{
+	scap_chunk_reader* cr = handle->m_chunk_reader;
+
+	if(cr == NULL)
+	{
+		return;
+	}
+
+	free(cr->m_buf);
+	free(cr->m_zbuf);
+	free(cr->m_index);
+	free(cr);
+	handle->m_chunk_reader = NULL;
+}
+
+//
+// Load the index block at the end of a chunked file. The file is opened
+// again, because gzseek() can't seek from the end. If the index is missing,
+// for example because the writer didn't close the file, it will be rebuilt
+// when it's first needed.
+//
+void scap_read_chunk_index(scap_t *handle, const char *fname)
+{
+	scap_chunk_reader* cr = handle->m_chunk_reader;
+	block_header bh;
+	uint32_t bt;
+	uint32_t nentries;
+	chunk_index_entry* index;
+	FILE* f;
+
+	ASSERT(cr != NULL);
+
+	f = fopen(fname, "rb");
+	if(f == NULL)
+	{
+		return;
+	}
+
+	if(fseek(f, (long)0 - sizeof(bt), SEEK_END) != 0 ||
+		fread(&bt, sizeof(bt), 1, f) != 1 ||
+		bt < sizeof(block_header) + sizeof(chunk_index_entry) + 4 ||
+		(bt - sizeof(block_header) - 4) % sizeof(chunk_index_entry) != 0 ||
+		fseek(f, (long)0 - bt, SEEK_END) != 0 ||
+		fread(&bh, sizeof(bh), 1, f) != 1 ||
+		bh.block_type != CKI_BLOCK_TYPE ||
+		bh.block_total_length != bt)
+	{
+		fclose(f);
+		return;
+	}
+
+	nentries = (bt - sizeof(block_header) - 4) / sizeof(chunk_index_entry);
+
+	index = (chunk_index_entry*)malloc(nentries * sizeof(chunk_index_entry));
+	if(index == NULL)
+	{
+		fclose(f);
+		return;
+	}
+
+	if(fread(index, sizeof(chunk_index_entry), nentries, f) != nentries)
+	{
+		free(index);
+		fclose(f);
+		return;
+	}
+
+	cr->m_index = index;
+	cr->m_index_len = nentries;
+
+	fclose(f);
+}
+
+
+//
+// Load the machine info block
+//
+static int32_t scap_read_machine_info(scap_t *handle, gzFile f, uint32_t block_length)
+{
+	//
+	// Read the section header block
+	//
+	if(gzread(f, &handle->m_machine_info, sizeof(handle->m_machine_info)) !=
+		sizeof(handle->m_machine_info))
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error reading from file (1)");
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
+
+//
+// Parse a process list block
+//
+static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_length, uint32_t block_type)
+{
+	size_t readsize;
+	size_t totreadsize = 0;
+	size_t padding_len;
+	struct scap_threadinfo tinfo;
+	uint16_t stlen;
+	uint32_t padding;
+	int32_t uth_status = SCAP_SUCCESS;
+	struct scap_threadinfo *ntinfo;
+
+	tinfo.fdlist = NULL;
+	tinfo.flags = 0;
+	tinfo.vmsize_kb = 0;
+	tinfo.vmrss_kb = 0;
+	tinfo.vmswap_kb = 0;
+	tinfo.pfmajor = 0;
+	tinfo.pfminor = 0;
+	tinfo.env_len = 0;
+	tinfo.vtid = -1;
+	tinfo.vpid = -1;
+	tinfo.cgroups_len = 0;
+	tinfo.filtered_out = 0;
+	tinfo.root[0] = 0;
+	tinfo.sid = -1;
+
+	while(((int32_t)block_length - (int32_t)totreadsize) >= 4)
+	{
+		//
+		// tid
+		//
+		readsize = gzread(f, &(tinfo.tid), sizeof(uint64_t));
+		CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+
+		totreadsize += readsize;
+
+		//
+		// pid
+		//
+		readsize = gzread(f, &(tinfo.pid), sizeof(uint64_t));
+		CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+
+		totreadsize += readsize;
+
+		//
+		// ptid
+		//
+		readsize = gzread(f, &(tinfo.ptid), sizeof(uint64_t));
+		CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+
+		totreadsize += readsize;
+
+		switch(block_type)
+		{
+		case PL_BLOCK_TYPE_V1:
+		case PL_BLOCK_TYPE_V1_INT:
+		case PL_BLOCK_TYPE_V2:
+		case PL_BLOCK_TYPE_V2_INT:
+		case PL_BLOCK_TYPE_V3:
+		case PL_BLOCK_TYPE_V3_INT:
+		case PL_BLOCK_TYPE_V4:
+		case PL_BLOCK_TYPE_V5:
+			break;
+		case PL_BLOCK_TYPE_V6:
+			readsize = gzread(f, &(tinfo.sid), sizeof(uint64_t));
+			CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+
+			totreadsize += readsize;
+			break;
+
+		default:
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted process block type (fd1)");
+			ASSERT(false);
+			return SCAP_FAILURE;
+		}
+
+		//
+		// comm
+		//
+		readsize = gzread(f, &(stlen), sizeof(uint16_t));
+		CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+
+		if(stlen > SCAP_MAX_PATH_SIZE)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid commlen %d", stlen);
+			return SCAP_FAILURE;
+		}
+
+		totreadsize += readsize;
+
+		readsize = gzread(f, tinfo.comm, stlen);
+		CHECK_READ_SIZE(readsize, stlen);
+
+		// the string is not null-terminated on file
+		tinfo.comm[stlen] = 0;
+
+		totreadsize += readsize;
+
+		//
+		// exe
+		//
+		readsize = gzread(f, &(stlen), sizeof(uint16_t));
+		CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+
+		if(stlen > SCAP_MAX_PATH_SIZE)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid exelen %d", stlen);
+			return SCAP_FAILURE;
+		}
+
+		totreadsize += readsize;
+
+		readsize = gzread(f, tinfo.exe, stlen);
+		CHECK_READ_SIZE(readsize, stlen);
+
+		// the string is not null-terminated on file
+		tinfo.exe[stlen] = 0;
+
+		totreadsize += readsize;
+
+		//
+		// args
+		//
+		readsize = gzread(f, &(stlen), sizeof(uint16_t));
+		CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+
+		if(stlen > SCAP_MAX_ARGS_SIZE)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid argslen %d", stlen);
+			return SCAP_FAILURE;
+		}
+
+		totreadsize += readsize;
+
+		readsize = gzread(f, tinfo.args, stlen);
+		CHECK_READ_SIZE(readsize, stlen);
+
+		// the string is not null-terminated on file
+		tinfo.args[stlen] = 0;
+		tinfo.args_len = stlen;
+
+		totreadsize += readsize;
+
+		//
+		// cwd
+		//
+		readsize = gzread(f, &(stlen), sizeof(uint16_t));
 		CHECK_READ_SIZE(readsize, sizeof(uint16_t));
 
-		if(stlen > SCAP_MAX_ARGS_SIZE)
+		if(stlen > SCAP_MAX_PATH_SIZE)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid cwdlen %d", stlen);
+			return SCAP_FAILURE;
+		}
+
+		totreadsize += readsize;
+
+		readsize = gzread(f, tinfo.cwd, stlen);
+		CHECK_READ_SIZE(readsize, stlen);
+
+		// the string is not null-terminated on file
+		tinfo.cwd[stlen] = 0;
+
+		totreadsize += readsize;
+
+		//
+		// fdlimit
+		//
+		readsize = gzread(f, &(tinfo.fdlimit), sizeof(uint64_t));
+		CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+
+		totreadsize += readsize;
+
+		//
+		// flags
+		//
+		readsize = gzread(f, &(tinfo.flags), sizeof(uint32_t));
+		CHECK_READ_SIZE(readsize, sizeof(uint32_t));
+
+		totreadsize += readsize;
+
+		//
+		// uid
+		//
+		readsize = gzread(f, &(tinfo.uid), sizeof(uint32_t));
+		CHECK_READ_SIZE(readsize, sizeof(uint32_t));
+
+		totreadsize += readsize;
+
+		//
+		// gid
+		//
+		readsize = gzread(f, &(tinfo.gid), sizeof(uint32_t));
+		CHECK_READ_SIZE(readsize, sizeof(uint32_t));
+
+		totreadsize += readsize;
+
+		switch(block_type)
+		{
+		case PL_BLOCK_TYPE_V1:
+		case PL_BLOCK_TYPE_V1_INT:
+			break;
+		case PL_BLOCK_TYPE_V2:
+		case PL_BLOCK_TYPE_V2_INT:
+		case PL_BLOCK_TYPE_V3:
+		case PL_BLOCK_TYPE_V3_INT:
+		case PL_BLOCK_TYPE_V4:
+		case PL_BLOCK_TYPE_V5:
+		case PL_BLOCK_TYPE_V6:
+			//
+			// vmsize_kb
+			//
+			readsize = gzread(f, &(tinfo.vmsize_kb), sizeof(uint32_t));
+			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
+
+			totreadsize += readsize;
+
+			//
+			// vmrss_kb
+			//
+			readsize = gzread(f, &(tinfo.vmrss_kb), sizeof(uint32_t));
+			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
+
+			totreadsize += readsize;
+
+			//
+			// vmswap_kb
+			//
+			readsize = gzread(f, &(tinfo.vmswap_kb), sizeof(uint32_t));
+			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
+
+			totreadsize += readsize;
+
+			//
+			// pfmajor
+			//
+			readsize = gzread(f, &(tinfo.pfmajor), sizeof(uint64_t));
+			CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+
+			totreadsize += readsize;
+
+			//
+			// pfminor
+			//
+			readsize = gzread(f, &(tinfo.pfminor), sizeof(uint64_t));
+			CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+
+			totreadsize += readsize;
+
+			if(block_type == PL_BLOCK_TYPE_V3 ||
+				block_type == PL_BLOCK_TYPE_V3_INT ||
+				block_type == PL_BLOCK_TYPE_V4 ||
+				block_type == PL_BLOCK_TYPE_V5 ||
+				block_type == PL_BLOCK_TYPE_V6)
+			{
+				//
+				// env
+				//
+				readsize = gzread(f, &(stlen), sizeof(uint16_t));
+				CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+
+				if(stlen > SCAP_MAX_ENV_SIZE)
+				{
+					snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid envlen %d", stlen);
+					return SCAP_FAILURE;
+				}
+
+				totreadsize += readsize;
+
+				readsize = gzread(f, tinfo.env, stlen);
+				CHECK_READ_SIZE(readsize, stlen);
+
+				// the string is not null-terminated on file
+				tinfo.env[stlen] = 0;
+				tinfo.env_len = stlen;
+
+				totreadsize += readsize;
+			}
+
+			if(block_type == PL_BLOCK_TYPE_V4 ||
+			   block_type == PL_BLOCK_TYPE_V5 ||
+			   block_type == PL_BLOCK_TYPE_V6)
+			{
+				//
+				// vtid
+				//
+				readsize = gzread(f, &(tinfo.vtid), sizeof(int64_t));
+				CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+
+				totreadsize += readsize;
+
+				//
+				// vpid
+				//
+				readsize = gzread(f, &(tinfo.vpid), sizeof(int64_t));
+				CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+
+				totreadsize += readsize;
+
+				//
+				// cgroups
+				//
+				readsize = gzread(f, &(stlen), sizeof(uint16_t));
+				CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+
+				if(stlen > SCAP_MAX_CGROUPS_SIZE)
+				{
+					snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid cgroupslen %d", stlen);
+					return SCAP_FAILURE;
+				}
+				tinfo.cgroups_len = stlen;
+
+				totreadsize += readsize;
+
+				readsize = gzread(f, tinfo.cgroups, stlen);
+				CHECK_READ_SIZE(readsize, stlen);
+
+				totreadsize += readsize;
+
+				if(block_type == PL_BLOCK_TYPE_V5 ||
+				   block_type == PL_BLOCK_TYPE_V6)
+				{
+					readsize = gzread(f, &(stlen), sizeof(uint16_t));
+					CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+
+					if(stlen > SCAP_MAX_PATH_SIZE)
+					{
+						snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid rootlen %d", stlen);
+						return SCAP_FAILURE;
+					}
+
+					totreadsize += readsize;
+
+					readsize = gzread(f, tinfo.root, stlen);
+					CHECK_READ_SIZE(readsize, stlen);
+
+					// the string is not null-terminated on file
+					tinfo.root[stlen] = 0;
+
+					totreadsize += readsize;
+				}
+			}
+			break;
+		default:
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted process block type (fd1)");
+			ASSERT(false);
+			return SCAP_FAILURE;
+		}
+
+		//
+		// All parsed. Add the entry to the table, or fire the notification callback
+		//
+		if(handle->m_proc_callback == NULL)
+		{
+			//
+			// All parsed. Allocate the new entry and copy the temp one into into it.
+			//
+			ntinfo = (scap_threadinfo *)malloc(sizeof(scap_threadinfo));
+			if(ntinfo == NULL)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "process table allocation error (fd1)");
+				return SCAP_FAILURE;
+			}
+
+			// Structure copy
+			*ntinfo = tinfo;
+
+			HASH_ADD_INT64(handle->m_proclist, tid, ntinfo);
+			if(uth_status != SCAP_SUCCESS)
+			{
+				free(ntinfo);
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "process table allocation error (fd2)");
+				return SCAP_FAILURE;
+			}
+		}
+		else
+		{
+			handle->m_proc_callback(handle->m_proc_callback_context, tinfo.tid, &tinfo, NULL, handle);
+		}
+	}
+
+	//
+	// Read the padding bytes so we properly align to the end of the data
+	//
+	if(totreadsize > block_length)
+	{
+		ASSERT(false);
+		return SCAP_FAILURE;
+	}
+	padding_len = block_length - totreadsize;
+
+	readsize = (size_t)gzread(f, &padding, (unsigned int)padding_len);
+	CHECK_READ_SIZE(readsize, padding_len);
+
+	return SCAP_SUCCESS;
+}
+
+//
+// Parse an interface list block
+//
+static int32_t scap_read_iflist(scap_t *handle, gzFile f, uint32_t block_length)
+{
+	int32_t res = SCAP_SUCCESS;
+	size_t readsize;
+	size_t totreadsize;
+	char *readbuf = NULL;
+	char *pif;
+	uint16_t iftype;
+	uint16_t ifnamlen;
+	uint32_t toread;
+	uint32_t entrysize;
+	uint32_t ifcnt4 = 0;
+	uint32_t ifcnt6 = 0;
+
+	//
+	// If the list of interfaces was already allocated for this handle (for example because this is
+	// not the first interface list block), free it
+	//
+	if(handle->m_addrlist != NULL)
+	{
+		scap_free_iflist(handle->m_addrlist);
+		handle->m_addrlist = NULL;
+	}
+
+	//
+	// Bring the block to memory
+	// We assume that this block is always small enough that we can read it in a single shot
+	//
+	readbuf = (char *)malloc(block_length);
+	if(!readbuf)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "memory allocation error in scap_read_iflist");
+		return SCAP_FAILURE;
+	}
+
+	readsize = gzread(f, readbuf, block_length);
+	CHECK_READ_SIZE(readsize, block_length);
+
+	//
+	// First pass, count the number of addresses
+	//
+	pif = readbuf;
+	totreadsize = 0;
+
+	while(true)
+	{
+		toread = (int32_t)block_length - (int32_t)totreadsize;
+
+		if(toread < 4)
+		{
+			break;
+		}
+
+		iftype = *(uint16_t *)pif;
+		ifnamlen = *(uint16_t *)(pif + 2);
+
+		if(iftype == SCAP_II_IPV4)
+		{
+			entrysize = sizeof(scap_ifinfo_ipv4) + ifnamlen - SCAP_MAX_PATH_SIZE;
+		}
+		else if(iftype == SCAP_II_IPV6)
+		{
+			entrysize = sizeof(scap_ifinfo_ipv6) + ifnamlen - SCAP_MAX_PATH_SIZE;
+		}
+		else if(iftype == SCAP_II_IPV4_NOLINKSPEED)
+		{
+			entrysize = sizeof(scap_ifinfo_ipv4_nolinkspeed) + ifnamlen - SCAP_MAX_PATH_SIZE;
+		}
+		else if(iftype == SCAP_II_IPV6_NOLINKSPEED)
+		{
+			entrysize = sizeof(scap_ifinfo_ipv6_nolinkspeed) + ifnamlen - SCAP_MAX_PATH_SIZE;
+		}
+		else
+		{
+			ASSERT(false);
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "trace file has corrupted interface list(1)");
+			res = SCAP_FAILURE;
+			goto scap_read_iflist_error;
+		}
+
+		if(toread < entrysize)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "trace file has corrupted interface list(2)");
+			res = SCAP_FAILURE;
+			goto scap_read_iflist_error;
+		}
+
+		pif += entrysize;
+		totreadsize += entrysize;
+
+		if(iftype == SCAP_II_IPV4 || iftype == SCAP_II_IPV4_NOLINKSPEED)
+		{
+			ifcnt4++;
+		}
+		else if(iftype == SCAP_II_IPV6 || iftype == SCAP_II_IPV6_NOLINKSPEED)
+		{
+			ifcnt6++;
+		}
+		else
+		{
+			ASSERT(false);
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "unknown interface type %d", (int)iftype);
+			res = SCAP_FAILURE;
+			goto scap_read_iflist_error;
+		}
+	}
+
+	//
+	// Allocate the handle and the arrays
+	//
+	handle->m_addrlist = (scap_addrlist *)malloc(sizeof(scap_addrlist));
+	if(!handle->m_addrlist)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_read_iflist allocation failed(1)");
+		res = SCAP_FAILURE;
+		goto scap_read_iflist_error;
+	}
+
+	handle->m_addrlist->n_v4_addrs = 0;
+	handle->m_addrlist->n_v6_addrs = 0;
+	handle->m_addrlist->v4list = NULL;
+	handle->m_addrlist->v6list = NULL;
+	handle->m_addrlist->totlen = block_length;
+
+	if(ifcnt4 != 0)
+	{
+		handle->m_addrlist->v4list = (scap_ifinfo_ipv4 *)malloc(ifcnt4 * sizeof(scap_ifinfo_ipv4));
+		if(!handle->m_addrlist->v4list)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_read_iflist allocation failed(2)");
+			res = SCAP_FAILURE;
+			goto scap_read_iflist_error;
+		}
+	}
+	else
+	{
+		handle->m_addrlist->v4list = NULL;
+	}
+
+	if(ifcnt6 != 0)
+	{
+		handle->m_addrlist->v6list = (scap_ifinfo_ipv6 *)malloc(ifcnt6 * sizeof(scap_ifinfo_ipv6));
+		if(!handle->m_addrlist->v6list)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "getifaddrs allocation failed(3)");
+			res = SCAP_FAILURE;
+			goto scap_read_iflist_error;
+		}
+	}
+	else
+	{
+		handle->m_addrlist->v6list = NULL;
+	}
+
+	handle->m_addrlist->n_v4_addrs = ifcnt4;
+	handle->m_addrlist->n_v6_addrs = ifcnt6;
+
+	//
+	// Second pass: populate the arrays
+	//
+	ifcnt4 = 0;
+	ifcnt6 = 0;
+	pif = readbuf;
+	totreadsize = 0;
+
+	while(true)
+	{
+		toread = (int32_t)block_length - (int32_t)totreadsize;
+
+		if(toread < 4)
 		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid argslen %d", stlen);
-			return SCAP_FAILURE;
+			break;
 		}
 
-		totreadsize += readsize;
+		iftype = *(uint16_t *)pif;
+		ifnamlen = *(uint16_t *)(pif + 2);
 
-		readsize = gzread(f, tinfo.args, stlen);
-		CHECK_READ_SIZE(readsize, stlen);
+		if(ifnamlen >= SCAP_MAX_PATH_SIZE)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "trace file has corrupted interface list(0)");
+			res = SCAP_FAILURE;
+			goto scap_read_iflist_error;
+		}
 
-		// the string is not null-terminated on file
-		tinfo.args[stlen] = 0;
-		tinfo.args_len = stlen;
+		if(iftype == SCAP_II_IPV4)
+		{
+			entrysize = sizeof(scap_ifinfo_ipv4) + ifnamlen - SCAP_MAX_PATH_SIZE;
 
-		totreadsize += readsize;
+			if(toread < entrysize)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "trace file has corrupted interface list(1)");
+				res = SCAP_FAILURE;
+				goto scap_read_iflist_error;
+			}
 
-		//
-		// cwd
-		//
-		readsize = gzread(f, &(stlen), sizeof(uint16_t));
-		CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+			// Copy the entry
+			memcpy(handle->m_addrlist->v4list + ifcnt4, pif, entrysize);
 
-		if(stlen > SCAP_MAX_PATH_SIZE)
+			// Make sure the name string is NULL-terminated
+			*((char *)(handle->m_addrlist->v4list + ifcnt4) + entrysize) = 0;
+
+			pif += entrysize;
+			totreadsize += entrysize;
+
+			ifcnt4++;
+		}
+		else if(iftype == SCAP_II_IPV4_NOLINKSPEED)
 		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid cwdlen %d", stlen);
-			return SCAP_FAILURE;
+			scap_ifinfo_ipv4_nolinkspeed* src;
+			scap_ifinfo_ipv4* dst;
+
+			entrysize = sizeof(scap_ifinfo_ipv4_nolinkspeed) + ifnamlen - SCAP_MAX_PATH_SIZE;
+
+			if(toread < entrysize)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "trace file has corrupted interface list(1)");
+				res = SCAP_FAILURE;
+				goto scap_read_iflist_error;
+			}
+
+			// Copy the entry
+			src = (scap_ifinfo_ipv4_nolinkspeed*)pif;
+			dst = handle->m_addrlist->v4list + ifcnt4;
+
+			dst->type = src->type;
+			dst->ifnamelen = src->ifnamelen;
+			dst->addr = src->addr;
+			dst->netmask = src->netmask;
+			dst->bcast = src->bcast;
+			dst->linkspeed = 0;
+			memcpy(dst->ifname, src->ifname, MIN(dst->ifnamelen, SCAP_MAX_PATH_SIZE - 1));
+
+			// Make sure the name string is NULL-terminated
+			*((char *)(dst->ifname + MIN(dst->ifnamelen, SCAP_MAX_PATH_SIZE - 1))) = 0;
+
+			pif += entrysize;
+			totreadsize += entrysize;
+
+			ifcnt4++;
 		}
+		else if(iftype == SCAP_II_IPV6)
+		{
+			entrysize = sizeof(scap_ifinfo_ipv6) + ifnamlen - SCAP_MAX_PATH_SIZE;
 
-		totreadsize += readsize;
+			if(toread < entrysize)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "trace file has corrupted interface list(1)");
+				res = SCAP_FAILURE;
+				goto scap_read_iflist_error;
+			}
 
-		readsize = gzread(f, tinfo.cwd, stlen);
-		CHECK_READ_SIZE(readsize, stlen);
+			// Copy the entry
+			memcpy(handle->m_addrlist->v6list + ifcnt6, pif, entrysize);
 
-		// the string is not null-terminated on file
-		tinfo.cwd[stlen] = 0;
+			// Make sure the name string is NULL-terminated
+			*((char *)(handle->m_addrlist->v6list + ifcnt6) + entrysize) = 0;
 
-		totreadsize += readsize;
+			pif += entrysize;
+			totreadsize += entrysize;
 
-		//
-		// fdlimit
-		//
-		readsize = gzread(f, &(tinfo.fdlimit), sizeof(uint64_t));
-		CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+			ifcnt6++;
+		}
+		else if(iftype == SCAP_II_IPV6_NOLINKSPEED)
+		{
+			scap_ifinfo_ipv6_nolinkspeed* src;
+			scap_ifinfo_ipv6* dst;
+			entrysize = sizeof(scap_ifinfo_ipv6_nolinkspeed) + ifnamlen - SCAP_MAX_PATH_SIZE;
 
-		totreadsize += readsize;
+			if(toread < entrysize)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "trace file has corrupted interface list(1)");
+				res = SCAP_FAILURE;
+				goto scap_read_iflist_error;
+			}
 
-		//
-		// flags
-		//
-		readsize = gzread(f, &(tinfo.flags), sizeof(uint32_t));
-		CHECK_READ_SIZE(readsize, sizeof(uint32_t));
+			// Copy the entry
+			src = (scap_ifinfo_ipv6_nolinkspeed*)pif;
+			dst = handle->m_addrlist->v6list + ifcnt6;
 
-		totreadsize += readsize;
+			dst->type = src->type;
+			dst->ifnamelen = src->ifnamelen;
+			memcpy(dst->addr, src->addr, SCAP_IPV6_ADDR_LEN);
+			memcpy(dst->netmask, src->netmask, SCAP_IPV6_ADDR_LEN);
+			memcpy(dst->bcast, src->bcast, SCAP_IPV6_ADDR_LEN);
+			dst->linkspeed = 0;
+			memcpy(dst->ifname, src->ifname, MIN(dst->ifnamelen, SCAP_MAX_PATH_SIZE - 1));
+
+			// Make sure the name string is NULL-terminated
+			*((char *)(dst->ifname + MIN(dst->ifnamelen, SCAP_MAX_PATH_SIZE - 1))) = 0;
+
+			pif += entrysize;
+			totreadsize += entrysize;
+
+			ifcnt6++;
+		}
+		else
+		{
+			ASSERT(false);
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "unknown interface type %d", (int)iftype);
+			res = SCAP_FAILURE;
+			goto scap_read_iflist_error;
+		}
+	}
+
+	//
+	// Release the read storage
+	//
+	free(readbuf);
+
+	return res;
+
+scap_read_iflist_error:
+	scap_free_iflist(handle->m_addrlist);
+	handle->m_addrlist = NULL;
+
+	if(readbuf)
+	{
+		free(readbuf);
+	}
+
+	return res;
+}
+
+//
+// Parse a user list block
+//
+static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_length)
+{
+	size_t readsize;
+	size_t totreadsize = 0;
+	size_t padding_len;
+	uint32_t padding;
+	uint8_t type;
+	uint16_t stlen;
+
+	//
+	// If the list of users was already allocated for this handle (for example because this is
+	// not the first interface list block), free it
+	//
+	if(handle->m_userlist != NULL)
+	{
+		scap_free_userlist(handle->m_userlist);
+		handle->m_userlist = NULL;
+	}
+
+	//
+	// Allocate and initialize the handle info
+	//
+	handle->m_userlist = (scap_userlist*)malloc(sizeof(scap_userlist));
+	if(handle->m_userlist == NULL)
+	{
+		snprintf(handle->m_lasterr,	SCAP_LASTERR_SIZE, "userlist allocation failed(2)");
+		return SCAP_FAILURE;
+	}
+
+	handle->m_userlist->nusers = 0;
+	handle->m_userlist->ngroups = 0;
+	handle->m_userlist->totsavelen = 0;
+	handle->m_userlist->users = NULL;
+	handle->m_userlist->groups = NULL;
 
+	//
+	// Import the blocks
+	//
+	while(((int32_t)block_length - (int32_t)totreadsize) >= 4)
+	{
 		//
-		// uid
+		// type
 		//
-		readsize = gzread(f, &(tinfo.uid), sizeof(uint32_t));
-		CHECK_READ_SIZE(readsize, sizeof(uint32_t));
+		readsize = gzread(f, &(type), sizeof(type));
+		CHECK_READ_SIZE(readsize, sizeof(type));
 
 		totreadsize += readsize;
 
-		//
-		// gid
-		//
-		readsize = gzread(f, &(tinfo.gid), sizeof(uint32_t));
-		CHECK_READ_SIZE(readsize, sizeof(uint32_t));
+		if(type == USERBLOCK_TYPE_USER)
+		{
+			scap_userinfo* puser;
+
+			handle->m_userlist->nusers++;
+			handle->m_userlist->users = (scap_userinfo*)realloc(handle->m_userlist->users, handle->m_userlist->nusers * sizeof(scap_userinfo));
+			if(handle->m_userlist->users == NULL)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "memory allocation error in scap_read_userlist(1)");
+				return SCAP_FAILURE;
+			}
 
-		totreadsize += readsize;
+			puser = &handle->m_userlist->users[handle->m_userlist->nusers -1];
 
-		switch(block_type)
-		{
-		case PL_BLOCK_TYPE_V1:
-		case PL_BLOCK_TYPE_V1_INT:
-			break;
-		case PL_BLOCK_TYPE_V2:
-		case PL_BLOCK_TYPE_V2_INT:
-		case PL_BLOCK_TYPE_V3:
-		case PL_BLOCK_TYPE_V3_INT:
-		case PL_BLOCK_TYPE_V4:
-		case PL_BLOCK_TYPE_V5:
-		case PL_BLOCK_TYPE_V6:
 			//
-			// vmsize_kb
+			// uid
 			//
-			readsize = gzread(f, &(tinfo.vmsize_kb), sizeof(uint32_t));
+			readsize = gzread(f, &(puser->uid), sizeof(uint32_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
 
 			totreadsize += readsize;
 
 			//
-			// vmrss_kb
+			// gid
 			//
-			readsize = gzread(f, &(tinfo.vmrss_kb), sizeof(uint32_t));
+			readsize = gzread(f, &(puser->gid), sizeof(uint32_t));
 			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
 
 			totreadsize += readsize;
 
 			//
-			// vmswap_kb
+			// name
 			//
-			readsize = gzread(f, &(tinfo.vmswap_kb), sizeof(uint32_t));
-			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
+			readsize = gzread(f, &(stlen), sizeof(uint16_t));
+			CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+
+			if(stlen >= MAX_CREDENTIALS_STR_LEN)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid user name len %d", stlen);
+				return SCAP_FAILURE;
+			}
 
 			totreadsize += readsize;
 
-			//
-			// pfmajor
-			//
-			readsize = gzread(f, &(tinfo.pfmajor), sizeof(uint64_t));
-			CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+			readsize = gzread(f, puser->name, stlen);
+			CHECK_READ_SIZE(readsize, stlen);
+
+			// the string is not null-terminated on file
+			puser->name[stlen] = 0;
 
 			totreadsize += readsize;
 
 			//
-			// pfminor
+			// homedir
 			//
-			readsize = gzread(f, &(tinfo.pfminor), sizeof(uint64_t));
-			CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+			readsize = gzread(f, &(stlen), sizeof(uint16_t));
+			CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+
+			if(stlen >= MAX_CREDENTIALS_STR_LEN)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid user homedir len %d", stlen);
+				return SCAP_FAILURE;
+			}
 
 			totreadsize += readsize;
 
-			if(block_type == PL_BLOCK_TYPE_V3 ||
-				block_type == PL_BLOCK_TYPE_V3_INT ||
-				block_type == PL_BLOCK_TYPE_V4 ||
-				block_type == PL_BLOCK_TYPE_V5 ||
-				block_type == PL_BLOCK_TYPE_V6)
+			readsize = gzread(f, puser->homedir, stlen);
+			CHECK_READ_SIZE(readsize, stlen);
+
+			// the string is not null-terminated on file
+			puser->homedir[stlen] = 0;
+
+			totreadsize += readsize;
+
+			//
+			// shell
+			//
+			readsize = gzread(f, &(stlen), sizeof(uint16_t));
+			CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+
+			if(stlen >= MAX_CREDENTIALS_STR_LEN)
 			{
-				//
-				// env
-				//
-				readsize = gzread(f, &(stlen), sizeof(uint16_t));
-				CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid user shell len %d", stlen);
+				return SCAP_FAILURE;
+			}
 
-				if(stlen > SCAP_MAX_ENV_SIZE)
-				{
-					snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid envlen %d", stlen);
-					return SCAP_FAILURE;
-				}
+			totreadsize += readsize;
 
-				totreadsize += readsize;
+			readsize = gzread(f, puser->shell, stlen);
+			CHECK_READ_SIZE(readsize, stlen);
 
-				readsize = gzread(f, tinfo.env, stlen);
-				CHECK_READ_SIZE(readsize, stlen);
+			// the string is not null-terminated on file
+			puser->shell[stlen] = 0;
 
-				// the string is not null-terminated on file
-				tinfo.env[stlen] = 0;
-				tinfo.env_len = stlen;
+			totreadsize += readsize;
+		}
+		else
+		{
+			scap_groupinfo* pgroup;
 
-				totreadsize += readsize;
+			handle->m_userlist->ngroups++;
+			handle->m_userlist->groups = (scap_groupinfo*)realloc(handle->m_userlist->groups, handle->m_userlist->ngroups * sizeof(scap_groupinfo));
+			if(handle->m_userlist->groups == NULL)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "memory allocation error in scap_read_userlist(2)");
+				return SCAP_FAILURE;
 			}
 
-			if(block_type == PL_BLOCK_TYPE_V4 ||
-			   block_type == PL_BLOCK_TYPE_V5 ||
-			   block_type == PL_BLOCK_TYPE_V6)
-			{
-				//
-				// vtid
-				//
-				readsize = gzread(f, &(tinfo.vtid), sizeof(int64_t));
-				CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+			pgroup = &handle->m_userlist->groups[handle->m_userlist->ngroups -1];
 
-				totreadsize += readsize;
+			//
+			// gid
+			//
+			readsize = gzread(f, &(pgroup->gid), sizeof(uint32_t));
+			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
 
-				//
-				// vpid
-				//
-				readsize = gzread(f, &(tinfo.vpid), sizeof(int64_t));
-				CHECK_READ_SIZE(readsize, sizeof(uint64_t));
+			totreadsize += readsize;
 
-				totreadsize += readsize;
+			//
+			// name
+			//
+			readsize = gzread(f, &(stlen), sizeof(uint16_t));
+			CHECK_READ_SIZE(readsize, sizeof(uint16_t));
 
-				//
-				// cgroups
-				//
-				readsize = gzread(f, &(stlen), sizeof(uint16_t));
-				CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+			if(stlen >= MAX_CREDENTIALS_STR_LEN)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid group name len %d", stlen);
+				return SCAP_FAILURE;
+			}
 
-				if(stlen > SCAP_MAX_CGROUPS_SIZE)
-				{
-					snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid cgroupslen %d", stlen);
-					return SCAP_FAILURE;
-				}
-				tinfo.cgroups_len = stlen;
+			totreadsize += readsize;
 
-				totreadsize += readsize;
+			readsize = gzread(f, pgroup->name, stlen);
+			CHECK_READ_SIZE(readsize, stlen);
 
-				readsize = gzread(f, tinfo.cgroups, stlen);
-				CHECK_READ_SIZE(readsize, stlen);
+			// the string is not null-terminated on file
+			pgroup->name[stlen] = 0;
 
-				totreadsize += readsize;
+			totreadsize += readsize;
+		}
+	}
 
-				if(block_type == PL_BLOCK_TYPE_V5 ||
-				   block_type == PL_BLOCK_TYPE_V6)
-				{
-					readsize = gzread(f, &(stlen), sizeof(uint16_t));
-					CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+	//
+	// Read the padding bytes so we properly align to the end of the data
+	//
+	if(totreadsize > block_length)
+	{
+		ASSERT(false);
+		return SCAP_FAILURE;
+	}
+	padding_len = block_length - totreadsize;
 
-					if(stlen > SCAP_MAX_PATH_SIZE)
-					{
-						snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid rootlen %d", stlen);
-						return SCAP_FAILURE;
-					}
+	readsize = gzread(f, &padding, (unsigned int)padding_len);
+	CHECK_READ_SIZE(readsize, padding_len);
 
-					totreadsize += readsize;
+	return SCAP_SUCCESS;
+}
 
-					readsize = gzread(f, tinfo.root, stlen);
-					CHECK_READ_SIZE(readsize, stlen);
+//
+// Parse a process list block
+//
+static int32_t scap_read_fdlist(scap_t *handle, gzFile f, uint32_t block_length)
+{
+	size_t readsize;
+	size_t totreadsize = 0;
+	size_t padding_len;
+	struct scap_threadinfo *tinfo;
+	scap_fdinfo fdi;
+	scap_fdinfo *nfdi;
+	//  uint16_t stlen;
+	uint64_t tid;
+	int32_t uth_status = SCAP_SUCCESS;
+	uint32_t padding;
 
-					// the string is not null-terminated on file
-					tinfo.root[stlen] = 0;
+	//
+	// Read the tid
+	//
+	readsize = gzread(f, &tid, sizeof(tid));
+	CHECK_READ_SIZE(readsize, sizeof(tid));
+	totreadsize += readsize;
 
-					totreadsize += readsize;
-				}
-			}
-			break;
-		default:
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted process block type (fd1)");
-			ASSERT(false);
+	if(handle->m_proc_callback == NULL)
+	{
+		//
+		// Identify the process descriptor
+		//
+		HASH_FIND_INT64(handle->m_proclist, &tid, tinfo);
+		if(tinfo == NULL)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted trace file. FD block references TID %"PRIu64", which doesn't exist.",
+					 tid);
+			return SCAP_FAILURE;
+		}
+	}
+	else
+	{
+		tinfo = NULL;
+	}
+
+	while(((int32_t)block_length - (int32_t)totreadsize) >= 4)
+	{
+		if(scap_fd_read_from_disk(handle, &fdi, &readsize, f) != SCAP_SUCCESS)
+		{
 			return SCAP_FAILURE;
 		}
+		totreadsize += readsize;
 
 		//
-		// All parsed. Add the entry to the table, or fire the notification callback
+		// Add the entry to the table, or fire the notification callback
 		//
 		if(handle->m_proc_callback == NULL)
 		{
 			//
-			// All parsed. Allocate the new entry and copy the temp one into into it.
-			//
-			ntinfo = (scap_threadinfo *)malloc(sizeof(scap_threadinfo));
-			if(ntinfo == NULL)
+			// Parsed successfully. Allocate the new entry and copy the temp one into into it.
+			//
+			nfdi = (scap_fdinfo *)malloc(sizeof(scap_fdinfo));
+			if(nfdi == NULL)
 			{
 				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "process table allocation error (fd1)");
 				return SCAP_FAILURE;
 			}
 
 			// Structure copy
-			*ntinfo = tinfo;
+			*nfdi = fdi;
 
-			HASH_ADD_INT64(handle->m_proclist, tid, ntinfo);
+			ASSERT(tinfo != NULL);
+
+			HASH_ADD_INT64(tinfo->fdlist, fd, nfdi);
 			if(uth_status != SCAP_SUCCESS)
 			{
-				free(ntinfo);
+				free(nfdi);
 				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "process table allocation error (fd2)");
 				return SCAP_FAILURE;
 			}
 		}
 		else
 		{
-			handle->m_proc_callback(handle->m_proc_callback_context, tinfo.tid, &tinfo, NULL, handle);
+			ASSERT(tinfo == NULL);
+
+			handle->m_proc_callback(handle->m_proc_callback_context, tid, NULL, &fdi, handle);
 		}
 	}
 
@@ -1210,923 +2554,1281 @@ static int32_t scap_read_proclist(scap_t *handle, gzFile f, uint32_t block_lengt
 	}
 	padding_len = block_length - totreadsize;
 
-	readsize = (size_t)gzread(f, &padding, (unsigned int)padding_len);
+	readsize = gzread(f, &padding, (unsigned int)padding_len);
 	CHECK_READ_SIZE(readsize, padding_len);
 
 	return SCAP_SUCCESS;
 }
 
 //
-// Parse an interface list block
+// Parse the headers of a trace file and load the tables
 //
-static int32_t scap_read_iflist(scap_t *handle, gzFile f, uint32_t block_length)
+int32_t scap_read_init(scap_t *handle, gzFile f)
 {
-	int32_t res = SCAP_SUCCESS;
+	block_header bh;
+	section_header_block sh;
+	uint32_t bt;
 	size_t readsize;
-	size_t totreadsize;
-	char *readbuf = NULL;
-	char *pif;
-	uint16_t iftype;
-	uint16_t ifnamlen;
-	uint32_t toread;
-	uint32_t entrysize;
-	uint32_t ifcnt4 = 0;
-	uint32_t ifcnt6 = 0;
-
-	//
-	// If the list of interfaces was already allocated for this handle (for example because this is
-	// not the first interface list block), free it
-	//
-	if(handle->m_addrlist != NULL)
-	{
-		scap_free_iflist(handle->m_addrlist);
-		handle->m_addrlist = NULL;
-	}
+	size_t toread;
+	int fseekres;
+	int8_t found_mi = 0;
+	int8_t found_pl = 0;
+	int8_t found_fdl = 0;
+	int8_t found_il = 0;
+	int8_t found_ul = 0;
+	int8_t found_ev = 0;
 
 	//
-	// Bring the block to memory
-	// We assume that this block is always small enough that we can read it in a single shot
+	// Read the section header block
 	//
-	readbuf = (char *)malloc(block_length);
-	if(!readbuf)
+	if(gzread(f, &bh, sizeof(bh)) != sizeof(bh) ||
+	        gzread(f, &sh, sizeof(sh)) != sizeof(sh) ||
+	        gzread(f, &bt, sizeof(bt)) != sizeof(bt))
 	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "memory allocation error in scap_read_iflist");
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error reading from file (1)");
 		return SCAP_FAILURE;
 	}
 
-	readsize = gzread(f, readbuf, block_length);
-	CHECK_READ_SIZE(readsize, block_length);
-
-	//
-	// First pass, count the number of addresses
-	//
-	pif = readbuf;
-	totreadsize = 0;
-
-	while(true)
-	{
-		toread = (int32_t)block_length - (int32_t)totreadsize;
-
-		if(toread < 4)
-		{
-			break;
-		}
-
-		iftype = *(uint16_t *)pif;
-		ifnamlen = *(uint16_t *)(pif + 2);
-
-		if(iftype == SCAP_II_IPV4)
-		{
-			entrysize = sizeof(scap_ifinfo_ipv4) + ifnamlen - SCAP_MAX_PATH_SIZE;
-		}
-		else if(iftype == SCAP_II_IPV6)
-		{
-			entrysize = sizeof(scap_ifinfo_ipv6) + ifnamlen - SCAP_MAX_PATH_SIZE;
-		}
-		else if(iftype == SCAP_II_IPV4_NOLINKSPEED)
-		{
-			entrysize = sizeof(scap_ifinfo_ipv4_nolinkspeed) + ifnamlen - SCAP_MAX_PATH_SIZE;
-		}
-		else if(iftype == SCAP_II_IPV6_NOLINKSPEED)
-		{
-			entrysize = sizeof(scap_ifinfo_ipv6_nolinkspeed) + ifnamlen - SCAP_MAX_PATH_SIZE;
-		}
-		else
-		{
-			ASSERT(false);
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "trace file has corrupted interface list(1)");
-			res = SCAP_FAILURE;
-			goto scap_read_iflist_error;
-		}
-
-		if(toread < entrysize)
-		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "trace file has corrupted interface list(2)");
-			res = SCAP_FAILURE;
-			goto scap_read_iflist_error;
-		}
-
-		pif += entrysize;
-		totreadsize += entrysize;
-
-		if(iftype == SCAP_II_IPV4 || iftype == SCAP_II_IPV4_NOLINKSPEED)
-		{
-			ifcnt4++;
-		}
-		else if(iftype == SCAP_II_IPV6 || iftype == SCAP_II_IPV6_NOLINKSPEED)
-		{
-			ifcnt6++;
-		}
-		else
-		{
-			ASSERT(false);
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "unknown interface type %d", (int)iftype);
-			res = SCAP_FAILURE;
-			goto scap_read_iflist_error;
-		}
-	}
-
-	//
-	// Allocate the handle and the arrays
-	//
-	handle->m_addrlist = (scap_addrlist *)malloc(sizeof(scap_addrlist));
-	if(!handle->m_addrlist)
-	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_read_iflist allocation failed(1)");
-		res = SCAP_FAILURE;
-		goto scap_read_iflist_error;
-	}
-
-	handle->m_addrlist->n_v4_addrs = 0;
-	handle->m_addrlist->n_v6_addrs = 0;
-	handle->m_addrlist->v4list = NULL;
-	handle->m_addrlist->v6list = NULL;
-	handle->m_addrlist->totlen = block_length;
-
-	if(ifcnt4 != 0)
-	{
-		handle->m_addrlist->v4list = (scap_ifinfo_ipv4 *)malloc(ifcnt4 * sizeof(scap_ifinfo_ipv4));
-		if(!handle->m_addrlist->v4list)
-		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "scap_read_iflist allocation failed(2)");
-			res = SCAP_FAILURE;
-			goto scap_read_iflist_error;
-		}
-	}
-	else
+	if(bh.block_type != SHB_BLOCK_TYPE)
 	{
-		handle->m_addrlist->v4list = NULL;
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid block type");
+		return SCAP_FAILURE;
 	}
 
-	if(ifcnt6 != 0)
-	{
-		handle->m_addrlist->v6list = (scap_ifinfo_ipv6 *)malloc(ifcnt6 * sizeof(scap_ifinfo_ipv6));
-		if(!handle->m_addrlist->v6list)
-		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "getifaddrs allocation failed(3)");
-			res = SCAP_FAILURE;
-			goto scap_read_iflist_error;
-		}
-	}
-	else
+	if(sh.byte_order_magic != 0x1a2b3c4d)
 	{
-		handle->m_addrlist->v6list = NULL;
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid magic number");
+		return SCAP_FAILURE;
 	}
 
-	handle->m_addrlist->n_v4_addrs = ifcnt4;
-	handle->m_addrlist->n_v6_addrs = ifcnt6;
-
 	//
-	// Second pass: populate the arrays
+	// Read the metadata blocks (processes, FDs, etc.)
 	//
-	ifcnt4 = 0;
-	ifcnt6 = 0;
-	pif = readbuf;
-	totreadsize = 0;
-
 	while(true)
-	{
-		toread = (int32_t)block_length - (int32_t)totreadsize;
-
-		if(toread < 4)
-		{
-			break;
-		}
-
-		iftype = *(uint16_t *)pif;
-		ifnamlen = *(uint16_t *)(pif + 2);
-
-		if(ifnamlen >= SCAP_MAX_PATH_SIZE)
-		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "trace file has corrupted interface list(0)");
-			res = SCAP_FAILURE;
-			goto scap_read_iflist_error;
-		}
-
-		if(iftype == SCAP_II_IPV4)
-		{
-			entrysize = sizeof(scap_ifinfo_ipv4) + ifnamlen - SCAP_MAX_PATH_SIZE;
-
-			if(toread < entrysize)
-			{
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "trace file has corrupted interface list(1)");
-				res = SCAP_FAILURE;
-				goto scap_read_iflist_error;
-			}
-
-			// Copy the entry
-			memcpy(handle->m_addrlist->v4list + ifcnt4, pif, entrysize);
-
-			// Make sure the name string is NULL-terminated
-			*((char *)(handle->m_addrlist->v4list + ifcnt4) + entrysize) = 0;
-
-			pif += entrysize;
-			totreadsize += entrysize;
-
-			ifcnt4++;
-		}
-		else if(iftype == SCAP_II_IPV4_NOLINKSPEED)
-		{
-			scap_ifinfo_ipv4_nolinkspeed* src;
-			scap_ifinfo_ipv4* dst;
-
-			entrysize = sizeof(scap_ifinfo_ipv4_nolinkspeed) + ifnamlen - SCAP_MAX_PATH_SIZE;
-
-			if(toread < entrysize)
-			{
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "trace file has corrupted interface list(1)");
-				res = SCAP_FAILURE;
-				goto scap_read_iflist_error;
-			}
-
-			// Copy the entry
-			src = (scap_ifinfo_ipv4_nolinkspeed*)pif;
-			dst = handle->m_addrlist->v4list + ifcnt4;
-
-			dst->type = src->type;
-			dst->ifnamelen = src->ifnamelen;
-			dst->addr = src->addr;
-			dst->netmask = src->netmask;
-			dst->bcast = src->bcast;
-			dst->linkspeed = 0;
-			memcpy(dst->ifname, src->ifname, MIN(dst->ifnamelen, SCAP_MAX_PATH_SIZE - 1));
+	{
+		readsize = gzread(f, &bh, sizeof(bh));
 
-			// Make sure the name string is NULL-terminated
-			*((char *)(dst->ifname + MIN(dst->ifnamelen, SCAP_MAX_PATH_SIZE - 1))) = 0;
+		//
+		// If we don't find the event block header,
+		// it means there is no event in the file.
+		//
+		if (readsize == 0 && !found_ev && found_mi && found_pl &&
+			found_il && found_fdl && found_ul)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "no events in file");
+			return SCAP_FAILURE;
+		}
 
-			pif += entrysize;
-			totreadsize += entrysize;
+		CHECK_READ_SIZE(readsize, sizeof(bh));
 
-			ifcnt4++;
-		}
-		else if(iftype == SCAP_II_IPV6)
+		switch(bh.block_type)
 		{
-			entrysize = sizeof(scap_ifinfo_ipv6) + ifnamlen - SCAP_MAX_PATH_SIZE;
+		case MI_BLOCK_TYPE:
+		case MI_BLOCK_TYPE_INT:
+			found_mi = 1;
 
-			if(toread < entrysize)
+			if(scap_read_machine_info(handle, f, bh.block_total_length - sizeof(block_header) - 4) != SCAP_SUCCESS)
 			{
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "trace file has corrupted interface list(1)");
-				res = SCAP_FAILURE;
-				goto scap_read_iflist_error;
+				return SCAP_FAILURE;
 			}
+			break;
+		case PL_BLOCK_TYPE_V1:
+		case PL_BLOCK_TYPE_V2:
+		case PL_BLOCK_TYPE_V3:
+		case PL_BLOCK_TYPE_V4:
+		case PL_BLOCK_TYPE_V5:
+		case PL_BLOCK_TYPE_V6:
+		case PL_BLOCK_TYPE_V1_INT:
+		case PL_BLOCK_TYPE_V2_INT:
+		case PL_BLOCK_TYPE_V3_INT:
+			found_pl = 1;
 
-			// Copy the entry
-			memcpy(handle->m_addrlist->v6list + ifcnt6, pif, entrysize);
+			if(scap_read_proclist(handle, f, bh.block_total_length - sizeof(block_header) - 4, bh.block_type) != SCAP_SUCCESS)
+			{
+				return SCAP_FAILURE;
+			}
+			break;
+		case FDL_BLOCK_TYPE:
+		case FDL_BLOCK_TYPE_INT:
+			found_fdl = 1;
 
-			// Make sure the name string is NULL-terminated
-			*((char *)(handle->m_addrlist->v6list + ifcnt6) + entrysize) = 0;
+			if(scap_read_fdlist(handle, f, bh.block_total_length - sizeof(block_header) - 4) != SCAP_SUCCESS)
+			{
+				return SCAP_FAILURE;
+			}
+			break;
+		case EV_BLOCK_TYPE:
+		case EV_BLOCK_TYPE_INT:
+		case EVF_BLOCK_TYPE:
+			found_ev = 1;
 
-			pif += entrysize;
-			totreadsize += entrysize;
+			//
+			// We're done with the metadata headers. Rewind the file position so we are aligned to start reading the events.
+			//
+			fseekres = gzseek(f, (long)0 - sizeof(bh), SEEK_CUR);
+			if(fseekres != -1)
+			{
+				break;
+			}
+			else
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error seeking in file");
+				return SCAP_FAILURE;
+			}
+		case CK_BLOCK_TYPE:
+			found_ev = 1;
 
-			ifcnt6++;
-		}
-		else if(iftype == SCAP_II_IPV6_NOLINKSPEED)
-		{
-			scap_ifinfo_ipv6_nolinkspeed* src;
-			scap_ifinfo_ipv6* dst;
-			entrysize = sizeof(scap_ifinfo_ipv6_nolinkspeed) + ifnamlen - SCAP_MAX_PATH_SIZE;
+			//
+			// Same as above, and the events will be read through the chunk reader
+			//
+			fseekres = gzseek(f, (long)0 - sizeof(bh), SEEK_CUR);
+			if(fseekres == -1)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error seeking in file");
+				return SCAP_FAILURE;
+			}
 
-			if(toread < entrysize)
+			if(scap_chunk_reader_init(handle, fseekres) != SCAP_SUCCESS)
 			{
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "trace file has corrupted interface list(1)");
-				res = SCAP_FAILURE;
-				goto scap_read_iflist_error;
+				return SCAP_FAILURE;
 			}
+			break;
+		case IL_BLOCK_TYPE:
+		case IL_BLOCK_TYPE_INT:
+			found_il = 1;
 
-			// Copy the entry
-			src = (scap_ifinfo_ipv6_nolinkspeed*)pif;
-			dst = handle->m_addrlist->v6list + ifcnt6;
+			if(scap_read_iflist(handle, f, bh.block_total_length - sizeof(block_header) - 4) != SCAP_SUCCESS)
+			{
+				return SCAP_FAILURE;
+			}
+			break;
+		case UL_BLOCK_TYPE:
+		case UL_BLOCK_TYPE_INT:
+			found_ul = 1;
 
-			dst->type = src->type;
-			dst->ifnamelen = src->ifnamelen;
-			memcpy(dst->addr, src->addr, SCAP_IPV6_ADDR_LEN);
-			memcpy(dst->netmask, src->netmask, SCAP_IPV6_ADDR_LEN);
-			memcpy(dst->bcast, src->bcast, SCAP_IPV6_ADDR_LEN);
-			dst->linkspeed = 0;
-			memcpy(dst->ifname, src->ifname, MIN(dst->ifnamelen, SCAP_MAX_PATH_SIZE - 1));
+			if(scap_read_userlist(handle, f, bh.block_total_length - sizeof(block_header) - 4) != SCAP_SUCCESS)
+			{
+				return SCAP_FAILURE;
+			}
+			break;
+		default:
+			//
+			// Unknwon block type. Skip the block.
+			//
+			toread = bh.block_total_length - sizeof(block_header) - 4;
+			fseekres = (int)gzseek(f, (long)toread, SEEK_CUR);
+			if(fseekres == -1)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted input file. Can't skip block of type %x and size %u.",
+				         (int)bh.block_type,
+				         (unsigned int)toread);
+				return SCAP_FAILURE;
+			}
+			break;
+		}
 
-			// Make sure the name string is NULL-terminated
-			*((char *)(dst->ifname + MIN(dst->ifnamelen, SCAP_MAX_PATH_SIZE - 1))) = 0;
+		if(found_ev)
+		{
+			break;
+		}
 
-			pif += entrysize;
-			totreadsize += entrysize;
+		//
+		// Read and validate the trailer
+		//
+		readsize = gzread(f, &bt, sizeof(bt));
+		CHECK_READ_SIZE(readsize, sizeof(bt));
 
-			ifcnt6++;
-		}
-		else
+		if(bt != bh.block_total_length)
 		{
-			ASSERT(false);
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "unknown interface type %d", (int)iftype);
-			res = SCAP_FAILURE;
-			goto scap_read_iflist_error;
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "wrong block total length, header=%u, trailer=%u",
+			         bh.block_total_length,
+			         bt);
+			return SCAP_FAILURE;
 		}
 	}
 
-	//
-	// Release the read storage
-	//
-	free(readbuf);
-
-	return res;
+	if(!found_mi)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted input file. Can't find machine info block.");
+		return SCAP_FAILURE;
+	}
 
-scap_read_iflist_error:
-	scap_free_iflist(handle->m_addrlist);
-	handle->m_addrlist = NULL;
+	if(!found_ul)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted input file. Can't find user list block.");
+		return SCAP_FAILURE;
+	}
 
-	if(readbuf)
+	if(!found_il)
 	{
-		free(readbuf);
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted input file. Can't find interface list block.");
+		return SCAP_FAILURE;
 	}
 
-	return res;
+	return SCAP_SUCCESS;
 }
 
 //
-// Parse a user list block
+// Validate the header of an event block
 //
-static int32_t scap_read_userlist(scap_t *handle, gzFile f, uint32_t block_length)
+static int32_t scap_check_evt_block_header(scap_t *handle, block_header* bh)
 {
-	size_t readsize;
-	size_t totreadsize = 0;
-	size_t padding_len;
-	uint32_t padding;
-	uint8_t type;
-	uint16_t stlen;
+	if(bh->block_type != EV_BLOCK_TYPE &&
+		bh->block_type != EV_BLOCK_TYPE_INT &&
+		bh->block_type != EVF_BLOCK_TYPE)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "unexpected block type %u", (uint32_t)bh->block_type);
+		return SCAP_FAILURE;
+	}
 
-	//
-	// If the list of users was already allocated for this handle (for example because this is
-	// not the first interface list block), free it
-	//
-	if(handle->m_userlist != NULL)
+	if(bh->block_total_length < sizeof(block_header) + sizeof(struct ppm_evt_hdr) + 4)
 	{
-		scap_free_userlist(handle->m_userlist);
-		handle->m_userlist = NULL;
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "block length too short %u", (uint32_t)bh->block_total_length);
+		return SCAP_FAILURE;
 	}
 
-	//
-	// Allocate and initialize the handle info
-	//
-	handle->m_userlist = (scap_userlist*)malloc(sizeof(scap_userlist));
-	if(handle->m_userlist == NULL)
+	if(bh->block_total_length - sizeof(block_header) > FILE_READ_BUF_SIZE)
 	{
-		snprintf(handle->m_lasterr,	SCAP_LASTERR_SIZE, "userlist allocation failed(2)");
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "event block length %u greater than read buffer size %u",
+			 (uint32_t)(bh->block_total_length - sizeof(block_header)),
+			 FILE_READ_BUF_SIZE);
 		return SCAP_FAILURE;
 	}
 
-	handle->m_userlist->nusers = 0;
-	handle->m_userlist->ngroups = 0;
-	handle->m_userlist->totsavelen = 0;
-	handle->m_userlist->users = NULL;
-	handle->m_userlist->groups = NULL;
+	return SCAP_SUCCESS;
+}
 
+//
+// Extract the event, cpu id and flags from the body of an event block
+//
+static inline void scap_parse_evt_block(uint32_t block_type, char* buf, OUT scap_evt **pevent, OUT uint16_t *pcpuid, OUT uint32_t *pflags)
+{
 	//
-	// Import the blocks
+	// EVF_BLOCK_TYPE has 32 bits of flags
 	//
-	while(((int32_t)block_length - (int32_t)totreadsize) >= 4)
-	{
-		//
-		// type
-		//
-		readsize = gzread(f, &(type), sizeof(type));
-		CHECK_READ_SIZE(readsize, sizeof(type));
-
-		totreadsize += readsize;
+	*pcpuid = *(uint16_t *)buf;
 
-		if(type == USERBLOCK_TYPE_USER)
-		{
-			scap_userinfo* puser;
+	if(block_type == EVF_BLOCK_TYPE)
+	{
+		*pflags = *(uint32_t*)(buf + sizeof(uint16_t));
+		*pevent = (struct ppm_evt_hdr *)(buf + sizeof(uint16_t) + sizeof(uint32_t));
+	}
+	else
+	{
+		*pflags = 0;
+		*pevent = (struct ppm_evt_hdr *)(buf + sizeof(uint16_t));
+	}
+}
 
-			handle->m_userlist->nusers++;
-			handle->m_userlist->users = (scap_userinfo*)realloc(handle->m_userlist->users, handle->m_userlist->nusers * sizeof(scap_userinfo));
-			if(handle->m_userlist->users == NULL)
-			{
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "memory allocation error in scap_read_userlist(1)");
-				return SCAP_FAILURE;
-			}
+//
+// Read an event block from disk into buf, which must be able to hold
+// FILE_READ_BUF_SIZE bytes. On success, *pblocklen is set to the number of
+// bytes of buf that have been used.
+//
+static int32_t scap_read_evt_block(scap_t *handle, char* buf, OUT scap_evt **pevent, OUT uint16_t *pcpuid, OUT uint32_t *pflags, OUT uint32_t *pblocklen)
+{
+	block_header bh;
+	size_t readsize;
+	uint32_t readlen;
+	gzFile f = handle->m_file;
 
-			puser = &handle->m_userlist->users[handle->m_userlist->nusers -1];
+	ASSERT(f != NULL);
 
-			//
-			// uid
-			//
-			readsize = gzread(f, &(puser->uid), sizeof(uint32_t));
-			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
+	//
+	// Read the block header
+	//
+	readsize = gzread(f, &bh, sizeof(bh));
 
-			totreadsize += readsize;
+	if(readsize != sizeof(bh))
+	{
+		int err_no = 0;
+		const char* err_str = gzerror(f, &err_no);
+		if(err_no)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error reading file: %s, ernum=%d", err_str, err_no);
+			return SCAP_FAILURE;
+		}
 
+		if(readsize == 0)
+		{
 			//
-			// gid
+			// We read exactly 0 bytes. This indicates a correct end of file.
 			//
-			readsize = gzread(f, &(puser->gid), sizeof(uint32_t));
-			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
+			return SCAP_EOF;
+		}
+		else
+		{
+			CHECK_READ_SIZE(readsize, sizeof(bh));
+		}
+	}
 
-			totreadsize += readsize;
+	if(scap_check_evt_block_header(handle, &bh) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
 
-			//
-			// name
-			//
-			readsize = gzread(f, &(stlen), sizeof(uint16_t));
-			CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+	//
+	// Read the event
+	//
+	readlen = bh.block_total_length - sizeof(bh);
+	readsize = gzread(f, buf, readlen);
+	CHECK_READ_SIZE(readsize, readlen);
 
-			if(stlen >= MAX_CREDENTIALS_STR_LEN)
-			{
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid user name len %d", stlen);
-				return SCAP_FAILURE;
-			}
+	scap_parse_evt_block(bh.block_type, buf, pevent, pcpuid, pflags);
 
-			totreadsize += readsize;
+	*pblocklen = readlen;
 
-			readsize = gzread(f, puser->name, stlen);
-			CHECK_READ_SIZE(readsize, stlen);
+	return SCAP_SUCCESS;
+}
 
-			// the string is not null-terminated on file
-			puser->name[stlen] = 0;
+//
+// Make sure that a chunk reader buffer can hold size bytes
+//
+static int32_t scap_chunk_grow_buf(scap_t *handle, char** buf, uint32_t* bufsize, uint32_t size)
+{
+	char* newbuf;
 
-			totreadsize += readsize;
+	if(*bufsize >= size)
+	{
+		return SCAP_SUCCESS;
+	}
 
-			//
-			// homedir
-			//
-			readsize = gzread(f, &(stlen), sizeof(uint16_t));
-			CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+	newbuf = (char*)realloc(*buf, size);
+	if(newbuf == NULL)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the chunk buffers");
+		return SCAP_FAILURE;
+	}
 
-			if(stlen >= MAX_CREDENTIALS_STR_LEN)
-			{
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid user homedir len %d", stlen);
-				return SCAP_FAILURE;
-			}
+	*buf = newbuf;
+	*bufsize = size;
 
-			totreadsize += readsize;
+	return SCAP_SUCCESS;
+}
 
-			readsize = gzread(f, puser->homedir, stlen);
-			CHECK_READ_SIZE(readsize, stlen);
+//
+// Read the chunk block at the current file position and inflate it
+//
+static int32_t scap_chunk_load(scap_t *handle)
+{
+	scap_chunk_reader* cr = handle->m_chunk_reader;
+	gzFile f = handle->m_file;
+	block_header bh;
+	chunk_block_header ch;
+	uint32_t bt;
+	uint32_t readlen;
+	size_t readsize;
+	uint64_t off = gztell(f);
 
-			// the string is not null-terminated on file
-			puser->homedir[stlen] = 0;
+	readsize = gzread(f, &bh, sizeof(bh));
 
-			totreadsize += readsize;
+	if(readsize != sizeof(bh))
+	{
+		int err_no = 0;
+		const char* err_str = gzerror(f, &err_no);
+		if(err_no)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error reading file: %s, ernum=%d", err_str, err_no);
+			return SCAP_FAILURE;
+		}
 
+		if(readsize == 0)
+		{
 			//
-			// shell
+			// The writer didn't get to write the index
 			//
-			readsize = gzread(f, &(stlen), sizeof(uint16_t));
-			CHECK_READ_SIZE(readsize, sizeof(uint16_t));
-
-			if(stlen >= MAX_CREDENTIALS_STR_LEN)
-			{
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid user shell len %d", stlen);
-				return SCAP_FAILURE;
-			}
-
-			totreadsize += readsize;
-
-			readsize = gzread(f, puser->shell, stlen);
-			CHECK_READ_SIZE(readsize, stlen);
-
-			// the string is not null-terminated on file
-			puser->shell[stlen] = 0;
-
-			totreadsize += readsize;
+			return SCAP_EOF;
 		}
 		else
 		{
-			scap_groupinfo* pgroup;
-
-			handle->m_userlist->ngroups++;
-			handle->m_userlist->groups = (scap_groupinfo*)realloc(handle->m_userlist->groups, handle->m_userlist->ngroups * sizeof(scap_groupinfo));
-			if(handle->m_userlist->groups == NULL)
-			{
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "memory allocation error in scap_read_userlist(2)");
-				return SCAP_FAILURE;
-			}
+			CHECK_READ_SIZE(readsize, sizeof(bh));
+		}
+	}
 
-			pgroup = &handle->m_userlist->groups[handle->m_userlist->ngroups -1];
+	//
+	// The index is the last block of the file. Stay in front of it, so that
+	// the next calls return SCAP_EOF as well.
+	//
+	if(bh.block_type == CKI_BLOCK_TYPE)
+	{
+		gzseek(f, off, SEEK_SET);
+		return SCAP_EOF;
+	}
 
-			//
-			// gid
-			//
-			readsize = gzread(f, &(pgroup->gid), sizeof(uint32_t));
-			CHECK_READ_SIZE(readsize, sizeof(uint32_t));
+	if(bh.block_type != CK_BLOCK_TYPE)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "unexpected block type %u", (uint32_t)bh.block_type);
+		return SCAP_FAILURE;
+	}
 
-			totreadsize += readsize;
+	if(bh.block_total_length < sizeof(block_header) + sizeof(chunk_block_header) + 4)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "block length too short %u", (uint32_t)bh.block_total_length);
+		return SCAP_FAILURE;
+	}
 
-			//
-			// name
-			//
-			readsize = gzread(f, &(stlen), sizeof(uint16_t));
-			CHECK_READ_SIZE(readsize, sizeof(uint16_t));
+	readsize = gzread(f, &ch, sizeof(ch));
+	CHECK_READ_SIZE(readsize, sizeof(ch));
 
-			if(stlen >= MAX_CREDENTIALS_STR_LEN)
-			{
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid group name len %d", stlen);
-				return SCAP_FAILURE;
-			}
+	//
+	// Read the compressed data together with the padding and the trailer
+	//
+	readlen = bh.block_total_length - sizeof(block_header) - sizeof(chunk_block_header);
 
-			totreadsize += readsize;
+	if(ch.uncompressed_len == 0 ||
+		ch.uncompressed_len > CHUNK_MAX_SIZE ||
+		ch.compressed_len > readlen - 4)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted chunk at offset %" PRIu64, off);
+		return SCAP_FAILURE;
+	}
 
-			readsize = gzread(f, pgroup->name, stlen);
-			CHECK_READ_SIZE(readsize, stlen);
+	if(scap_chunk_grow_buf(handle, &cr->m_zbuf, &cr->m_zbuf_size, readlen) != SCAP_SUCCESS ||
+		scap_chunk_grow_buf(handle, &cr->m_buf, &cr->m_buf_size, ch.uncompressed_len) != SCAP_SUCCESS)
+	{
+		return SCAP_FAILURE;
+	}
 
-			// the string is not null-terminated on file
-			pgroup->name[stlen] = 0;
+	readsize = gzread(f, cr->m_zbuf, readlen);
+	CHECK_READ_SIZE(readsize, readlen);
 
-			totreadsize += readsize;
-		}
+	memcpy(&bt, cr->m_zbuf + readlen - sizeof(bt), sizeof(bt));
+	if(bt != bh.block_total_length)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "wrong block total length, header=%u, trailer=%u",
+		         bh.block_total_length,
+		         bt);
+		return SCAP_FAILURE;
 	}
 
-	//
-	// Read the padding bytes so we properly align to the end of the data
-	//
-	if(totreadsize > block_length)
+#ifdef USE_ZLIB
 	{
-		ASSERT(false);
-		return SCAP_FAILURE;
+		uLongf destlen = ch.uncompressed_len;
+
+		if(uncompress((Bytef*)cr->m_buf, &destlen, (Bytef*)cr->m_zbuf, ch.compressed_len) != Z_OK ||
+			destlen != ch.uncompressed_len)
+		{
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error decompressing the chunk at offset %" PRIu64, off);
+			return SCAP_FAILURE;
+		}
 	}
-	padding_len = block_length - totreadsize;
+#else
+	snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "chunked trace files require zlib");
+	return SCAP_FAILURE;
+#endif
 
-	readsize = gzread(f, &padding, (unsigned int)padding_len);
-	CHECK_READ_SIZE(readsize, padding_len);
+	cr->m_off = off;
+	cr->m_len = ch.uncompressed_len;
+	cr->m_pos = 0;
 
 	return SCAP_SUCCESS;
 }
 
 //
-// Parse a process list block
+// Return the next event of a chunked file. The event points into the current
+// chunk, which is replaced only when the consumer moves past it. If same_chunk
+// is true and the current chunk is over, SCAP_TIMEOUT is returned instead of
+// loading the next one.
 //
-static int32_t scap_read_fdlist(scap_t *handle, gzFile f, uint32_t block_length)
+static int32_t scap_chunk_next(scap_t *handle, OUT scap_evt **pevent, OUT uint16_t *pcpuid, OUT uint32_t *pflags, bool same_chunk)
 {
-	size_t readsize;
-	size_t totreadsize = 0;
-	size_t padding_len;
-	struct scap_threadinfo *tinfo;
-	scap_fdinfo fdi;
-	scap_fdinfo *nfdi;
-	//  uint16_t stlen;
-	uint64_t tid;
-	int32_t uth_status = SCAP_SUCCESS;
-	uint32_t padding;
-
-	//
-	// Read the tid
-	//
-	readsize = gzread(f, &tid, sizeof(tid));
-	CHECK_READ_SIZE(readsize, sizeof(tid));
-	totreadsize += readsize;
+	scap_chunk_reader* cr = handle->m_chunk_reader;
+	block_header* bh;
+	int32_t res;
 
-	if(handle->m_proc_callback == NULL)
+	if(cr->m_pos == cr->m_len)
 	{
-		//
-		// Identify the process descriptor
-		//
-		HASH_FIND_INT64(handle->m_proclist, &tid, tinfo);
-		if(tinfo == NULL)
+		if(same_chunk)
 		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted trace file. FD block references TID %"PRIu64", which doesn't exist.",
-					 tid);
-			return SCAP_FAILURE;
+			return SCAP_TIMEOUT;
+		}
+
+		res = scap_chunk_load(handle);
+		if(res != SCAP_SUCCESS)
+		{
+			return res;
 		}
 	}
-	else
+
+	bh = (block_header*)(cr->m_buf + cr->m_pos);
+	CHECK_READ_SIZE(MIN(cr->m_len - cr->m_pos, sizeof(block_header)), sizeof(block_header));
+
+	if(scap_check_evt_block_header(handle, bh) != SCAP_SUCCESS)
 	{
-		tinfo = NULL;
+		return SCAP_FAILURE;
 	}
 
-	while(((int32_t)block_length - (int32_t)totreadsize) >= 4)
+	CHECK_READ_SIZE(MIN(cr->m_len - cr->m_pos, bh->block_total_length), bh->block_total_length);
+
+	scap_parse_evt_block(bh->block_type, (char*)(bh + 1), pevent, pcpuid, pflags);
+
+	cr->m_pos += bh->block_total_length;
+
+	return SCAP_SUCCESS;
+}
+
+//
+// Rebuild the index of a chunked file that doesn't have one, by walking the
+// chunk headers. Nothing is decompressed.
+//
+static int32_t scap_chunk_scan_index(scap_t *handle)
+{
+	scap_chunk_reader* cr = handle->m_chunk_reader;
+	gzFile f = handle->m_file;
+	uint64_t off = cr->m_first_off;
+	chunk_index_entry* index = NULL;
+	uint32_t len = 0;
+	uint32_t size = 0;
+
+	cr->m_len = 0;
+	cr->m_pos = 0;
+
+	while(gzseek(f, off, SEEK_SET) != -1)
 	{
-		if(scap_fd_read_from_disk(handle, &fdi, &readsize, f) != SCAP_SUCCESS)
+		block_header bh;
+		chunk_block_header ch;
+
+		if(gzread(f, &bh, sizeof(bh)) != sizeof(bh) ||
+			bh.block_type != CK_BLOCK_TYPE ||
+			bh.block_total_length < sizeof(block_header) + sizeof(chunk_block_header) + 4 ||
+			gzread(f, &ch, sizeof(ch)) != sizeof(ch))
 		{
-			return SCAP_FAILURE;
+			break;
 		}
-		totreadsize += readsize;
 
-		//
-		// Add the entry to the table, or fire the notification callback
-		//
-		if(handle->m_proc_callback == NULL)
+		if(len == size)
 		{
-			//
-			// Parsed successfully. Allocate the new entry and copy the temp one into into it.
-			//
-			nfdi = (scap_fdinfo *)malloc(sizeof(scap_fdinfo));
-			if(nfdi == NULL)
+			uint32_t newsize = (size == 0)? 64 : size * 2;
+			chunk_index_entry* newindex = (chunk_index_entry*)realloc(index, newsize * sizeof(chunk_index_entry));
+
+			if(newindex == NULL)
 			{
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "process table allocation error (fd1)");
+				free(index);
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the chunk index");
 				return SCAP_FAILURE;
 			}
 
-			// Structure copy
-			*nfdi = fdi;
+			index = newindex;
+			size = newsize;
+		}
 
-			ASSERT(tinfo != NULL);
+		index[len].offset = off;
+		index[len].first_evtnum = ch.first_evtnum;
+		index[len].first_ts = ch.first_ts;
+		index[len].last_ts = ch.last_ts;
+		index[len].nevts = ch.nevts;
+		index[len].uncompressed_len = ch.uncompressed_len;
+		len++;
 
-			HASH_ADD_INT64(tinfo->fdlist, fd, nfdi);
-			if(uth_status != SCAP_SUCCESS)
-			{
-				free(nfdi);
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "process table allocation error (fd2)");
-				return SCAP_FAILURE;
-			}
-		}
-		else
-		{
-			ASSERT(tinfo == NULL);
+		off += bh.block_total_length;
+	}
 
-			handle->m_proc_callback(handle->m_proc_callback_context, tid, NULL, &fdi, handle);
-		}
+	if(len == 0)
+	{
+		free(index);
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "can't find the chunks of the file");
+		return SCAP_FAILURE;
 	}
 
-	//
-	// Read the padding bytes so we properly align to the end of the data
-	//
-	if(totreadsize > block_length)
+	cr->m_index = index;
+	cr->m_index_len = len;
+
+	return SCAP_SUCCESS;
+}
+
+//
+// Make sure that the file can be seeked and that its index is loaded
+//
+static int32_t scap_chunk_check_index(scap_t *handle)
+{
+	if(handle->m_file == NULL || handle->m_chunk_reader == NULL)
 	{
-		ASSERT(false);
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "seeking is only supported on trace files written in chunked mode");
 		return SCAP_FAILURE;
 	}
-	padding_len = block_length - totreadsize;
 
-	readsize = gzread(f, &padding, (unsigned int)padding_len);
-	CHECK_READ_SIZE(readsize, padding_len);
+	if(handle->m_chunk_reader->m_index == NULL)
+	{
+		return scap_chunk_scan_index(handle);
+	}
 
 	return SCAP_SUCCESS;
 }
 
 //
-// Parse the headers of a trace file and load the tables
+// Move the read position to the beginning of the given chunk
 //
-int32_t scap_read_init(scap_t *handle, gzFile f)
+static int32_t scap_chunk_seek(scap_t *handle, uint32_t idx, OUT uint64_t* chunk_evtnum)
 {
-	block_header bh;
-	section_header_block sh;
-	uint32_t bt;
-	size_t readsize;
-	size_t toread;
-	int fseekres;
-	int8_t found_mi = 0;
-	int8_t found_pl = 0;
-	int8_t found_fdl = 0;
-	int8_t found_il = 0;
-	int8_t found_ul = 0;
-	int8_t found_ev = 0;
+	scap_chunk_reader* cr = handle->m_chunk_reader;
 
-	//
-	// Read the section header block
-	//
-	if(gzread(f, &bh, sizeof(bh)) != sizeof(bh) ||
-	        gzread(f, &sh, sizeof(sh)) != sizeof(sh) ||
-	        gzread(f, &bt, sizeof(bt)) != sizeof(bt))
+	if(gzseek(handle->m_file, cr->m_index[idx].offset, SEEK_SET) == -1)
 	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error reading from file (1)");
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error seeking in file");
 		return SCAP_FAILURE;
 	}
 
-	if(bh.block_type != SHB_BLOCK_TYPE)
+	cr->m_len = 0;
+	cr->m_pos = 0;
+
+	handle->m_evtcnt = cr->m_index[idx].first_evtnum;
+	*chunk_evtnum = cr->m_index[idx].first_evtnum;
+
+	return SCAP_SUCCESS;
+}
+
+int32_t scap_seek_to_time(scap_t *handle, uint64_t ts, OUT uint64_t* chunk_evtnum)
+{
+	scap_chunk_reader* cr;
+	uint32_t j;
+
+	if(scap_chunk_check_index(handle) != SCAP_SUCCESS)
 	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid block type");
 		return SCAP_FAILURE;
 	}
 
-	if(sh.byte_order_magic != 0x1a2b3c4d)
+	cr = handle->m_chunk_reader;
+
+	//
+	// The timestamps of consecutive chunks can overlap a bit, so look for the
+	// first chunk that has an event at or after ts. The index is small enough
+	// for a linear scan.
+	//
+	for(j = 0; j < cr->m_index_len; j++)
+	{
+		if(cr->m_index[j].last_ts >= ts)
+		{
+			return scap_chunk_seek(handle, j, chunk_evtnum);
+		}
+	}
+
+	return SCAP_EOF;
+}
+
+int32_t scap_seek_to_evtnum(scap_t *handle, uint64_t evtnum, OUT uint64_t* chunk_evtnum)
+{
+	scap_chunk_reader* cr;
+	uint32_t lo = 0;
+	uint32_t hi;
+
+	if(scap_chunk_check_index(handle) != SCAP_SUCCESS)
 	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "invalid magic number");
 		return SCAP_FAILURE;
 	}
 
+	cr = handle->m_chunk_reader;
+	hi = cr->m_index_len;
+
 	//
-	// Read the metadata blocks (processes, FDs, etc.)
+	// Find the last chunk that starts at or before evtnum
 	//
-	while(true)
+	while(hi - lo > 1)
 	{
-		readsize = gzread(f, &bh, sizeof(bh));
+		uint32_t mid = lo + (hi - lo) / 2;
+
+		if(cr->m_index[mid].first_evtnum <= evtnum)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	if(evtnum < cr->m_index[lo].first_evtnum ||
+		evtnum >= cr->m_index[lo].first_evtnum + cr->m_index[lo].nevts)
+	{
+		return SCAP_EOF;
+	}
+
+	return scap_chunk_seek(handle, lo, chunk_evtnum);
+}
+
+#ifdef HAS_READAHEAD
+//
+// Body of the read-ahead thread. It decompresses the file into the ring
+// buffers and moves any partial event block at the end of a buffer to the
+// beginning of the next one, so that the consumer only sees whole blocks.
+//
+static void* scap_readahead_thread(void* arg)
+{
+	scap_t* handle = (scap_t*)arg;
+	scap_readahead* ra = handle->m_readahead;
+	gzFile f = handle->m_file;
+	scap_readahead_buf* prev = NULL;
+	uint32_t carry = 0;
+	bool done = false;
+
+	while(!done)
+	{
+		scap_readahead_buf* buf;
+		uint32_t filled;
+		uint32_t pos = 0;
+		int readsize;
+
+		pthread_mutex_lock(&ra->m_mutex);
+		while(ra->m_nfull == READAHEAD_NBUFS && !ra->m_stop)
+		{
+			pthread_cond_wait(&ra->m_cond_empty, &ra->m_mutex);
+		}
+
+		if(ra->m_stop)
+		{
+			pthread_mutex_unlock(&ra->m_mutex);
+			break;
+		}
+		pthread_mutex_unlock(&ra->m_mutex);
 
 		//
-		// If we don't find the event block header,
-		// it means there is no event in the file.
+		// The consumer never reads past m_len, so the partial block at the end
+		// of the previous buffer can be copied without holding the lock
 		//
-		if (readsize == 0 && !found_ev && found_mi && found_pl &&
-			found_il && found_fdl && found_ul)
+		buf = &ra->m_bufs[ra->m_prod_idx];
+		if(carry != 0)
 		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "no events in file");
-			return SCAP_FAILURE;
+			memcpy(buf->m_buf, prev->m_buf + prev->m_len, carry);
 		}
 
-		CHECK_READ_SIZE(readsize, sizeof(bh));
+		buf->m_off = ra->m_prod_off;
+		buf->m_res = SCAP_SUCCESS;
 
-		switch(bh.block_type)
+		readsize = gzread(f, buf->m_buf + carry, READAHEAD_BUF_SIZE - carry);
+		if(readsize < 0)
 		{
-		case MI_BLOCK_TYPE:
-		case MI_BLOCK_TYPE_INT:
-			found_mi = 1;
+			readsize = 0;
+		}
 
-			if(scap_read_machine_info(handle, f, bh.block_total_length - sizeof(block_header) - 4) != SCAP_SUCCESS)
-			{
-				return SCAP_FAILURE;
-			}
-			break;
-		case PL_BLOCK_TYPE_V1:
-		case PL_BLOCK_TYPE_V2:
-		case PL_BLOCK_TYPE_V3:
-		case PL_BLOCK_TYPE_V4:
-		case PL_BLOCK_TYPE_V5:
-		case PL_BLOCK_TYPE_V6:
-		case PL_BLOCK_TYPE_V1_INT:
-		case PL_BLOCK_TYPE_V2_INT:
-		case PL_BLOCK_TYPE_V3_INT:
-			found_pl = 1;
+		filled = carry + readsize;
 
-			if(scap_read_proclist(handle, f, bh.block_total_length - sizeof(block_header) - 4, bh.block_type) != SCAP_SUCCESS)
+		//
+		// Find the end of the last whole block. A corrupted length stops the
+		// framing, and the consumer will report the error when it gets there.
+		//
+		while(filled - pos >= sizeof(block_header))
+		{
+			uint32_t blen = ((block_header*)(buf->m_buf + pos))->block_total_length;
+
+			if(blen < sizeof(block_header) + sizeof(struct ppm_evt_hdr) + 4 ||
+				blen - sizeof(block_header) > FILE_READ_BUF_SIZE)
 			{
-				return SCAP_FAILURE;
+				pos = filled;
+				done = true;
+				break;
 			}
-			break;
-		case FDL_BLOCK_TYPE:
-		case FDL_BLOCK_TYPE_INT:
-			found_fdl = 1;
 
-			if(scap_read_fdlist(handle, f, bh.block_total_length - sizeof(block_header) - 4) != SCAP_SUCCESS)
+			if(blen > filled - pos)
 			{
-				return SCAP_FAILURE;
+				break;
 			}
-			break;
-		case EV_BLOCK_TYPE:
-		case EV_BLOCK_TYPE_INT:
-		case EVF_BLOCK_TYPE:
-			found_ev = 1;
 
-			//
-			// We're done with the metadata headers. Rewind the file position so we are aligned to start reading the events.
-			//
-			fseekres = gzseek(f, (long)0 - sizeof(bh), SEEK_CUR);
-			if(fseekres != -1)
+			pos += blen;
+		}
+
+		if(readsize == 0)
+		{
+			int err_no = 0;
+			const char* err_str = gzerror(f, &err_no);
+
+			if(err_no)
 			{
-				break;
+				snprintf(buf->m_lasterr, SCAP_LASTERR_SIZE, "error reading file: %s, ernum=%d", err_str, err_no);
+				buf->m_res = SCAP_FAILURE;
 			}
 			else
 			{
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error seeking in file");
-				return SCAP_FAILURE;
+				buf->m_res = SCAP_EOF;
 			}
-		case IL_BLOCK_TYPE:
-		case IL_BLOCK_TYPE_INT:
-			found_il = 1;
 
-			if(scap_read_iflist(handle, f, bh.block_total_length - sizeof(block_header) - 4) != SCAP_SUCCESS)
+			//
+			// A leftover partial block means that the file is truncated, and
+			// the consumer will report it
+			//
+			pos = filled;
+
+			done = true;
+		}
+
+		buf->m_len = pos;
+		carry = filled - pos;
+
+		buf->m_raw_off = gzoffset(f);
+		ra->m_prod_off += buf->m_len;
+		prev = buf;
+
+		pthread_mutex_lock(&ra->m_mutex);
+		ra->m_prod_idx = (ra->m_prod_idx + 1) % READAHEAD_NBUFS;
+		ra->m_nfull++;
+		pthread_cond_signal(&ra->m_cond_full);
+		pthread_mutex_unlock(&ra->m_mutex);
+	}
+
+	return NULL;
+}
+
+int32_t scap_readahead_start(scap_t* handle)
+{
+	uint32_t j;
+	scap_readahead* ra;
+
+	ASSERT(handle->m_readahead == NULL);
+
+	ra = (scap_readahead*)calloc(1, sizeof(scap_readahead));
+	if(ra == NULL)
+	{
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the read-ahead state");
+		return SCAP_FAILURE;
+	}
+
+	for(j = 0; j < READAHEAD_NBUFS; j++)
+	{
+		ra->m_bufs[j].m_buf = (char*)malloc(READAHEAD_BUF_SIZE);
+		if(ra->m_bufs[j].m_buf == NULL)
+		{
+			for(; j > 0; j--)
 			{
-				return SCAP_FAILURE;
+				free(ra->m_bufs[j - 1].m_buf);
 			}
-			break;
-		case UL_BLOCK_TYPE:
-		case UL_BLOCK_TYPE_INT:
-			found_ul = 1;
 
-			if(scap_read_userlist(handle, f, bh.block_total_length - sizeof(block_header) - 4) != SCAP_SUCCESS)
+			free(ra);
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the read-ahead buffers");
+			return SCAP_FAILURE;
+		}
+	}
+
+	ra->m_prod_off = gztell(handle->m_file);
+	ra->m_cons_off = ra->m_prod_off;
+	ra->m_cons_raw_off = gzoffset(handle->m_file);
+
+	pthread_mutex_init(&ra->m_mutex, NULL);
+	pthread_cond_init(&ra->m_cond_full, NULL);
+	pthread_cond_init(&ra->m_cond_empty, NULL);
+
+	handle->m_readahead = ra;
+
+	if(pthread_create(&ra->m_thread, NULL, scap_readahead_thread, handle) != 0)
+	{
+		handle->m_readahead = NULL;
+		pthread_cond_destroy(&ra->m_cond_empty);
+		pthread_cond_destroy(&ra->m_cond_full);
+		pthread_mutex_destroy(&ra->m_mutex);
+
+		for(j = 0; j < READAHEAD_NBUFS; j++)
+		{
+			free(ra->m_bufs[j].m_buf);
+		}
+
+		free(ra);
+		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error starting the read-ahead thread");
+		return SCAP_FAILURE;
+	}
+
+	return SCAP_SUCCESS;
+}
+
+void scap_readahead_stop(scap_t* handle)
+{
+	uint32_t j;
+	scap_readahead* ra = handle->m_readahead;
+
+	if(ra == NULL)
+	{
+		return;
+	}
+
+	pthread_mutex_lock(&ra->m_mutex);
+	ra->m_stop = true;
+	pthread_cond_signal(&ra->m_cond_empty);
+	pthread_mutex_unlock(&ra->m_mutex);
+
+	pthread_join(ra->m_thread, NULL);
+
+	pthread_cond_destroy(&ra->m_cond_empty);
+	pthread_cond_destroy(&ra->m_cond_full);
+	pthread_mutex_destroy(&ra->m_mutex);
+
+	for(j = 0; j < READAHEAD_NBUFS; j++)
+	{
+		free(ra->m_bufs[j].m_buf);
+	}
+
+	free(ra);
+	handle->m_readahead = NULL;
+}
+
+//
+// Return the next event from the read-ahead buffers. The event points into the
+// buffer, which is released only when the consumer moves past it. If
+// same_buf is true and the current buffer is over, SCAP_TIMEOUT is returned
+// instead of releasing it.
+//
+static int32_t scap_readahead_next(scap_t* handle, OUT scap_evt **pevent, OUT uint16_t *pcpuid, OUT uint32_t *pflags, bool same_buf)
+{
+	scap_readahead* ra = handle->m_readahead;
+	scap_readahead_buf* buf = &ra->m_bufs[ra->m_cons_idx];
+	block_header* bh;
+	uint32_t avail;
+	uint32_t bodylen;
+	uint32_t readlen;
+
+	//
+	// Move to the next buffer when the current one is over. A buffer can be
+	// empty if it only got the start of a block that continues in the next
+	// one.
+	//
+	while(!ra->m_cons_holding || ra->m_cons_pos == buf->m_len)
+	{
+		if(ra->m_cons_holding)
+		{
+			if(buf->m_res != SCAP_SUCCESS)
 			{
-				return SCAP_FAILURE;
+				if(buf->m_res == SCAP_FAILURE)
+				{
+					snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "%s", buf->m_lasterr);
+				}
+
+				return buf->m_res;
 			}
-			break;
-		default:
-			//
-			// Unknwon block type. Skip the block.
-			//
-			toread = bh.block_total_length - sizeof(block_header) - 4;
-			fseekres = (int)gzseek(f, (long)toread, SEEK_CUR);
-			if(fseekres == -1)
+
+			if(same_buf)
 			{
-				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted input file. Can't skip block of type %x and size %u.",
-				         (int)bh.block_type,
-				         (unsigned int)toread);
-				return SCAP_FAILURE;
+				return SCAP_TIMEOUT;
 			}
-			break;
+
+			pthread_mutex_lock(&ra->m_mutex);
+			ra->m_nfull--;
+			ra->m_cons_idx = (ra->m_cons_idx + 1) % READAHEAD_NBUFS;
+			ra->m_cons_holding = false;
+			pthread_cond_signal(&ra->m_cond_empty);
+			pthread_mutex_unlock(&ra->m_mutex);
 		}
 
-		if(found_ev)
+		pthread_mutex_lock(&ra->m_mutex);
+		while(ra->m_nfull == 0)
 		{
-			break;
+			pthread_cond_wait(&ra->m_cond_full, &ra->m_mutex);
 		}
+		pthread_mutex_unlock(&ra->m_mutex);
 
-		//
-		// Read and validate the trailer
-		//
-		readsize = gzread(f, &bt, sizeof(bt));
-		CHECK_READ_SIZE(readsize, sizeof(bt));
+		buf = &ra->m_bufs[ra->m_cons_idx];
+		ra->m_cons_holding = true;
+		ra->m_cons_pos = 0;
+		ra->m_cons_raw_off = buf->m_raw_off;
+	}
 
-		if(bt != bh.block_total_length)
+	//
+	// The producer only frames whole blocks, unless the file is truncated. The
+	// errors are the ones of the synchronous path: a read error if the header
+	// is cut, and the lengths of the body if the body is.
+	//
+	avail = buf->m_len - ra->m_cons_pos;
+	bh = (block_header*)(buf->m_buf + ra->m_cons_pos);
+
+	if(avail < sizeof(block_header))
+	{
+		if(buf->m_res == SCAP_FAILURE)
 		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "wrong block total length, header=%u, trailer=%u",
-			         bh.block_total_length,
-			         bt);
+			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "%s", buf->m_lasterr);
 			return SCAP_FAILURE;
 		}
+
+		CHECK_READ_SIZE(avail, sizeof(block_header));
 	}
 
-	if(!found_mi)
+	if(scap_check_evt_block_header(handle, bh) != SCAP_SUCCESS)
 	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted input file. Can't find machine info block.");
 		return SCAP_FAILURE;
 	}
 
-	if(!found_ul)
+	bodylen = bh->block_total_length - sizeof(block_header);
+	readlen = MIN(avail, bh->block_total_length) - sizeof(block_header);
+	CHECK_READ_SIZE(readlen, bodylen);
+
+	scap_parse_evt_block(bh->block_type, (char*)(bh + 1), pevent, pcpuid, pflags);
+
+	ra->m_cons_pos += bh->block_total_length;
+	ra->m_cons_off = buf->m_off + ra->m_cons_pos;
+
+	return SCAP_SUCCESS;
+}
+#endif // HAS_READAHEAD
+
+#ifdef HAS_MMAP_READ
+void scap_mmap_start(scap_t* handle, const char* fname)
+{
+	scap_mmap_reader* mr;
+	struct stat st;
+	void* base;
+	int fd;
+
+	ASSERT(handle->m_mmap == NULL);
+
+	//
+	// Compressed files go through zlib, and the chunks of chunked files are
+	// inflated anyway
+	//
+	if(handle->m_chunk_reader != NULL)
 	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted input file. Can't find user list block.");
-		return SCAP_FAILURE;
+		return;
 	}
 
-	if(!found_il)
+#ifdef USE_ZLIB
+	if(!gzdirect(handle->m_file))
+	{
+		return;
+	}
+#endif
+
+	fd = open(fname, O_RDONLY);
+	if(fd < 0)
+	{
+		return;
+	}
+
+	//
+	// Pipes and character devices can't be mapped
+	//
+	if(fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+	{
+		close(fd);
+		return;
+	}
+
+	//
+	// The mapping is private and writable because the consumers of scap_next()
+	// are allowed to modify the events in place. The pages they touch are
+	// copied, and the file is never written.
+	//
+	base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(base == MAP_FAILED)
+	{
+		return;
+	}
+
+	mr = (scap_mmap_reader*)malloc(sizeof(scap_mmap_reader));
+	if(mr == NULL)
+	{
+		munmap(base, st.st_size);
+		return;
+	}
+
+	madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+	mr->m_base = (char*)base;
+	mr->m_size = st.st_size;
+	mr->m_pos = gztell(handle->m_file);
+	mr->m_advised_end = mr->m_pos;
+
+	handle->m_mmap = mr;
+}
+
+void scap_mmap_stop(scap_t* handle)
+{
+	scap_mmap_reader* mr = handle->m_mmap;
+
+	if(mr == NULL)
+	{
+		return;
+	}
+
+	munmap(mr->m_base, mr->m_size);
+	free(mr);
+	handle->m_mmap = NULL;
+}
+
+//
+// Return the next event of a mapped file. The event points into the mapping,
+// so it stays valid until the file is closed.
+//
+static int32_t scap_mmap_next(scap_t* handle, OUT scap_evt **pevent, OUT uint16_t *pcpuid, OUT uint32_t *pflags)
+{
+	scap_mmap_reader* mr = handle->m_mmap;
+	block_header* bh;
+
+	if(mr->m_pos >= mr->m_size)
+	{
+		return SCAP_EOF;
+	}
+
+	//
+	// Ask the kernel to bring in the next window of the file before we get
+	// there, so that we don't block on page faults
+	//
+	if(mr->m_pos + MMAP_WILLNEED_SIZE / 2 > mr->m_advised_end && mr->m_advised_end < mr->m_size)
+	{
+		uint64_t page_size = getpagesize();
+		uint64_t start = mr->m_advised_end & ~(page_size - 1);
+		uint64_t end = MIN(mr->m_pos + MMAP_WILLNEED_SIZE, mr->m_size);
+
+		madvise(mr->m_base + start, end - start, MADV_WILLNEED);
+		mr->m_advised_end = end;
+	}
+
+	bh = (block_header*)(mr->m_base + mr->m_pos);
+	CHECK_READ_SIZE(MIN(mr->m_size - mr->m_pos, sizeof(block_header)), sizeof(block_header));
+
+	if(scap_check_evt_block_header(handle, bh) != SCAP_SUCCESS)
 	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "corrupted input file. Can't find interface list block.");
 		return SCAP_FAILURE;
 	}
 
+	CHECK_READ_SIZE(MIN(mr->m_size - mr->m_pos, bh->block_total_length), bh->block_total_length);
+
+	scap_parse_evt_block(bh->block_type, (char*)(bh + 1), pevent, pcpuid, pflags);
+
+	mr->m_pos += bh->block_total_length;
+
 	return SCAP_SUCCESS;
 }
+#endif // HAS_MMAP_READ
 
 //
 // Read an event from disk
 //
 int32_t scap_next_offline(scap_t *handle, OUT scap_evt **pevent, OUT uint16_t *pcpuid)
 {
-	block_header bh;
-	size_t readsize;
-	uint32_t readlen;
-	gzFile f = handle->m_file;
+	uint32_t blocklen;
 
-	ASSERT(f != NULL);
+	if(handle->m_chunk_reader)
+	{
+		return scap_chunk_next(handle, pevent, pcpuid, &handle->m_last_evt_dump_flags, false);
+	}
 
-	//
-	// Read the block header
-	//
-	readsize = gzread(f, &bh, sizeof(bh));
+#ifdef HAS_MMAP_READ
+	if(handle->m_mmap)
+	{
+		return scap_mmap_next(handle, pevent, pcpuid, &handle->m_last_evt_dump_flags);
+	}
+#endif
 
-	if(readsize != sizeof(bh))
+#ifdef HAS_READAHEAD
+	if(handle->m_readahead)
 	{
-		int err_no = 0;
-		const char* err_str = gzerror(f, &err_no);
-		if(err_no)
+		return scap_readahead_next(handle, pevent, pcpuid, &handle->m_last_evt_dump_flags, false);
+	}
+#endif
+
+	return scap_read_evt_block(handle,
+		handle->m_file_evt_buf,
+		pevent,
+		pcpuid,
+		&handle->m_last_evt_dump_flags,
+		&blocklen);
+}
+
+//
+// Read a batch of events from disk. The events are copied one after the other
+// in m_file_batch_buf, so that all of them stay valid until the next call.
+// With read-ahead, the events of a batch all come from the same read-ahead
+// buffer and are not copied, and the same goes for the chunks of chunked files
+// and for mapped files.
+//
+int32_t scap_next_offline_batch(scap_t *handle, uint32_t max_evts, OUT scap_evt **pevents, OUT uint16_t *pcpuids, OUT uint32_t *pflags, OUT uint32_t *pnevts)
+{
+	uint32_t offset = 0;
+	uint32_t n = 0;
+	int32_t res = SCAP_SUCCESS;
+
+	if(handle->m_chunk_reader)
+	{
+		while(n < max_evts)
 		{
-			snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error reading file: %s, ernum=%d", err_str, err_no);
-			return SCAP_FAILURE;
+			res = scap_chunk_next(handle, &pevents[n], &pcpuids[n], &pflags[n], n != 0);
+
+			if(res != SCAP_SUCCESS)
+			{
+				break;
+			}
+
+			n++;
 		}
 
-		if(readsize == 0)
+		if(res == SCAP_TIMEOUT)
 		{
-			//
-			// We read exactly 0 bytes. This indicates a correct end of file.
-			//
-			return SCAP_EOF;
+			res = SCAP_SUCCESS;
 		}
-		else
+	}
+	else
+#ifdef HAS_MMAP_READ
+	if(handle->m_mmap)
+	{
+		while(n < max_evts)
 		{
-			CHECK_READ_SIZE(readsize, sizeof(bh));
+			res = scap_mmap_next(handle, &pevents[n], &pcpuids[n], &pflags[n]);
+
+			if(res != SCAP_SUCCESS)
+			{
+				break;
+			}
+
+			n++;
 		}
 	}
-
-	if(bh.block_type != EV_BLOCK_TYPE &&
-		bh.block_type != EV_BLOCK_TYPE_INT &&
-		bh.block_type != EVF_BLOCK_TYPE)
+	else
+#endif
+#ifdef HAS_READAHEAD
+	if(handle->m_readahead)
 	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "unexpected block type %u", (uint32_t)bh.block_type);
-		return SCAP_FAILURE;
-	}
+		while(n < max_evts)
+		{
+			res = scap_readahead_next(handle, &pevents[n], &pcpuids[n], &pflags[n], n != 0);
 
-	if(bh.block_total_length < sizeof(bh) + sizeof(struct ppm_evt_hdr) + 4)
-	{
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "block length too short %u", (uint32_t)bh.block_total_length);
-		return SCAP_FAILURE;
-	}
+			if(res != SCAP_SUCCESS)
+			{
+				break;
+			}
 
-	//
-	// Read the event
-	//
-	readlen = bh.block_total_length - sizeof(bh);
-	if (readlen > FILE_READ_BUF_SIZE) {
-		snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "event block length %u greater than read buffer size %u",
-			 readlen,
-			 FILE_READ_BUF_SIZE);
-		return SCAP_FAILURE;
+			n++;
+		}
+
+		if(res == SCAP_TIMEOUT)
+		{
+			res = SCAP_SUCCESS;
+		}
 	}
+	else
+#endif
+	{
+		if(handle->m_file_batch_buf == NULL)
+		{
+			handle->m_file_batch_buf = (char*)malloc(FILE_BATCH_BUF_SIZE);
+			if(handle->m_file_batch_buf == NULL)
+			{
+				snprintf(handle->m_lasterr, SCAP_LASTERR_SIZE, "error allocating the batch read buffer");
+				return SCAP_FAILURE;
+			}
+		}
 
-	readsize = gzread(f, handle->m_file_evt_buf, readlen);
-	CHECK_READ_SIZE(readsize, readlen);
+		while(n < max_evts && FILE_BATCH_BUF_SIZE - offset >= FILE_READ_BUF_SIZE)
+		{
+			uint32_t blocklen;
 
-	//
-	// EVF_BLOCK_TYPE has 32 bits of flags
-	//
-	*pcpuid = *(uint16_t *)handle->m_file_evt_buf;
+			res = scap_read_evt_block(handle,
+				handle->m_file_batch_buf + offset,
+				&pevents[n],
+				&pcpuids[n],
+				&pflags[n],
+				&blocklen);
 
-	if(bh.block_type == EVF_BLOCK_TYPE)
-	{
-		handle->m_last_evt_dump_flags = *(uint32_t*)(handle->m_file_evt_buf + sizeof(uint16_t));
-		*pevent = (struct ppm_evt_hdr *)(handle->m_file_evt_buf + sizeof(uint16_t) + sizeof(uint32_t));
+			if(res != SCAP_SUCCESS)
+			{
+				break;
+			}
+
+			offset += blocklen;
+			n++;
+		}
 	}
-	else
+
+	*pnevts = n;
+
+	if(n != 0)
 	{
-		handle->m_last_evt_dump_flags = 0;
-		*pevent = (struct ppm_evt_hdr *)(handle->m_file_evt_buf + sizeof(uint16_t));
+		handle->m_last_evt_dump_flags = pflags[n - 1];
 	}
 
-	return SCAP_SUCCESS;
+	return res;
 }
 
 uint64_t scap_ftell(scap_t *handle)
@@ -2134,6 +3836,32 @@ uint64_t scap_ftell(scap_t *handle)
 	gzFile f = handle->m_file;
 	ASSERT(f != NULL);
 
+	if(handle->m_chunk_reader)
+	{
+		scap_chunk_reader* cr = handle->m_chunk_reader;
+
+		if(cr->m_len == 0)
+		{
+			return (uint64_t)gztell(f) << CHUNK_POS_BITS;
+		}
+
+		return (cr->m_off << CHUNK_POS_BITS) | cr->m_pos;
+	}
+
+#ifdef HAS_MMAP_READ
+	if(handle->m_mmap)
+	{
+		return handle->m_mmap->m_pos;
+	}
+#endif
+
+#ifdef HAS_READAHEAD
+	if(handle->m_readahead)
+	{
+		return handle->m_readahead->m_cons_off;
+	}
+#endif
+
 	return gztell(f);
 }
 
@@ -2142,5 +3870,60 @@ void scap_fseek(scap_t *handle, uint64_t off)
 	gzFile f = handle->m_file;
 	ASSERT(f != NULL);
 
+	//
+	// The error held from the last batch was at the old position
+	//
+	handle->m_batch_res = SCAP_SUCCESS;
+
+	//
+	// Reload the chunk and move to the position of the event in it
+	//
+	if(handle->m_chunk_reader)
+	{
+		scap_chunk_reader* cr = handle->m_chunk_reader;
+		uint32_t pos = off & CHUNK_MAX_SIZE;
+
+		gzseek(f, off >> CHUNK_POS_BITS, SEEK_SET);
+		cr->m_len = 0;
+		cr->m_pos = 0;
+
+		if(pos != 0 && scap_chunk_load(handle) == SCAP_SUCCESS)
+		{
+			ASSERT(pos <= cr->m_len);
+			cr->m_pos = MIN(pos, cr->m_len);
+		}
+
+		return;
+	}
+
+#ifdef HAS_MMAP_READ
+	if(handle->m_mmap)
+	{
+		handle->m_mmap->m_pos = off;
+		handle->m_mmap->m_advised_end = off;
+		return;
+	}
+#endif
+
+#ifdef HAS_READAHEAD
+	//
+	// Restart the read-ahead from the new position
+	//
+	if(handle->m_readahead)
+	{
+		scap_readahead_stop(handle);
+		gzseek(f, off, SEEK_SET);
+		if(scap_readahead_start(handle) != SCAP_SUCCESS)
+		{
+			//
+			// Fall back to synchronous reads
+			//
+			ASSERT(false);
+		}
+
+		return;
+	}
+#endif
+
 	gzseek(f, off, SEEK_SET);
 }
@@ -125,8 +125,135 @@ typedef struct _section_header_block
 ///////////////////////////////////////////////////////////////////////////////
 #define EVF_BLOCK_TYPE	0x208
 
+///////////////////////////////////////////////////////////////////////////////
+// CHUNK BLOCK
+///////////////////////////////////////////////////////////////////////////////
+//
+// Used by SCAP_COMPRESSION_CHUNKED files. A chunk is a sequence of EV/EVF
+// blocks deflated together, so that it can be decompressed without reading
+// what comes before it. The compressed data follows the chunk header.
+//
+#define CK_BLOCK_TYPE	0x220
+
+// Uncompressed size at which the writer closes a chunk
+#define CHUNK_SIZE (2 * 1024 * 1024)
+// scap_ftell() positions in chunked files combine the file offset of a chunk
+// and an offset in the chunk, which takes the lower CHUNK_POS_BITS bits
+#define CHUNK_POS_BITS 24
+// Larger chunks are rejected by the reader
+#define CHUNK_MAX_SIZE ((1 << CHUNK_POS_BITS) - 1)
+
+typedef struct _chunk_block_header
+{
+	uint32_t uncompressed_len;
+	uint32_t compressed_len;
+	uint32_t nevts;
+	uint32_t reserved;
+	uint64_t first_evtnum; // Number of events in the file before this chunk
+	uint64_t first_ts; // Timestamp of the first event of the chunk
+	uint64_t last_ts; // Highest timestamp in the chunk
+}chunk_block_header;
+
+///////////////////////////////////////////////////////////////////////////////
+// CHUNK INDEX BLOCK
+///////////////////////////////////////////////////////////////////////////////
+//
+// The last block of a SCAP_COMPRESSION_CHUNKED file, with one entry per chunk.
+// Since the block trailer contains the block length, it can be located by
+// reading the end of the file.
+//
+#define CKI_BLOCK_TYPE	0x221
+
+typedef struct _chunk_index_entry
+{
+	uint64_t offset; // File offset of the chunk block
+	uint64_t first_evtnum;
+	uint64_t first_ts;
+	uint64_t last_ts;
+	uint32_t nevts;
+	uint32_t uncompressed_len;
+}chunk_index_entry;
+
 #if defined __sun
 #pragma pack()
 #else
 #pragma pack(pop)
 #endif
+
+// Default size of the buffer where the event blocks are staged before being
+// written, for the modes other than SCAP_COMPRESSION_CHUNKED
+#define DUMP_BUF_SIZE (1024 * 1024)
+// Number of staging buffers used by asynchronous dumpers
+#define DUMP_ASYNC_NBUFS 8
+
+//
+// A staging buffer of a dumper. With SCAP_COMPRESSION_CHUNKED, it contains a
+// whole chunk.
+//
+typedef struct scap_dump_buf
+{
+	char* m_buf;
+	uint32_t m_len;
+	chunk_block_header m_chunk_hdr; // SCAP_COMPRESSION_CHUNKED only
+}scap_dump_buf;
+
+//
+// State of a trace file that is being written. scap_dump() fills the staging
+// buffer m_bufs[m_prod_idx], which is written when it's full, either right
+// away or, for asynchronous dumpers, by a background thread that takes the
+// full buffers in order.
+//
+struct scap_dumper
+{
+	gzFile m_f;
+	compression_mode m_compress;
+	int32_t m_level; // zlib level for SCAP_COMPRESSION_CHUNKED
+	uint32_t m_buf_size;
+	scap_dump_buf* m_bufs;
+	uint32_t m_nbufs;
+	uint32_t m_prod_idx;
+	uint64_t m_nevts;
+	//
+	// Used by the writer, which is the background thread for asynchronous dumpers
+	//
+	char* m_zbuf; // Compressed chunk
+	uint32_t m_zbuf_size;
+	chunk_index_entry* m_index;
+	uint32_t m_index_len;
+	uint32_t m_index_size;
+	int32_t m_res; // SCAP_FAILURE after a write error
+	char m_lasterr[SCAP_LASTERR_SIZE];
+#ifdef HAS_ASYNC_DUMP
+	//
+	// Asynchronous dumpers only
+	//
+	bool m_async;
+	pthread_t m_thread;
+	pthread_mutex_t m_mutex;
+	pthread_cond_t m_cond_full; // Signaled when scap_dump() queues a buffer
+	pthread_cond_t m_cond_empty; // Signaled when the writer is done with a buffer
+	uint32_t m_nfull; // Buffers queued and not yet written
+	uint32_t m_cons_idx;
+	bool m_stop;
+	uint64_t m_queued_bytes;
+	int64_t m_written_off; // gzoffset() after the last write
+	uint64_t m_n_stalls; // Times scap_dump() had to wait for a free buffer
+#endif
+};
+
+//
+// Read state of a SCAP_COMPRESSION_CHUNKED file
+//
+typedef struct scap_chunk_reader
+{
+	char* m_buf; // Uncompressed event blocks of the current chunk
+	uint32_t m_buf_size;
+	char* m_zbuf; // Compressed data of the current chunk
+	uint32_t m_zbuf_size;
+	uint32_t m_len; // Number of valid bytes in m_buf, 0 if no chunk is loaded
+	uint32_t m_pos; // Offset of the next event block in m_buf
+	uint64_t m_off; // File offset of the current chunk block
+	uint64_t m_first_off; // File offset of the first chunk block
+	chunk_index_entry* m_index; // NULL until the index has been loaded
+	uint32_t m_index_len;
+}scap_chunk_reader;
@@ -17,6 +17,8 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include "scap.h"
 #include "scap-int.h"
 
@@ -177,3 +179,47 @@ void scap_free_userlist(scap_userlist* uhandle)
 		free(uhandle);
 	}
 }
+
+//
+// Make a copy of a list of users
+//
+scap_userlist* scap_dup_userlist(const scap_userlist* uhandle)
+{
+	scap_userlist* res;
+
+	res = (scap_userlist*)calloc(1, sizeof(scap_userlist));
+	if(res == NULL)
+	{
+		return NULL;
+	}
+
+	res->nusers = uhandle->nusers;
+	res->ngroups = uhandle->ngroups;
+	res->totsavelen = uhandle->totsavelen;
+
+	if(uhandle->nusers != 0)
+	{
+		res->users = (scap_userinfo*)malloc(uhandle->nusers * sizeof(scap_userinfo));
+		if(res->users == NULL)
+		{
+			scap_free_userlist(res);
+			return NULL;
+		}
+
+		memcpy(res->users, uhandle->users, uhandle->nusers * sizeof(scap_userinfo));
+	}
+
+	if(uhandle->ngroups != 0)
+	{
+		res->groups = (scap_groupinfo*)malloc(uhandle->ngroups * sizeof(scap_groupinfo));
+		if(res->groups == NULL)
+		{
+			scap_free_userlist(res);
+			return NULL;
+		}
+
+		memcpy(res->groups, uhandle->groups, uhandle->ngroups * sizeof(scap_groupinfo));
+	}
+
+	return res;
+}
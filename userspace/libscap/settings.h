@@ -5,3 +5,41 @@
 #define INCLUDE_UNKNOWN_SOCKET_FDS
 
 #define USE_ZLIB
+
+//
+// If defined, events of offline captures can be decompressed and framed by a
+// background thread. Not available on Windows, where we don't use pthreads.
+//
+#ifndef _WIN32
+#define HAS_READAHEAD
+#endif
+
+//
+// If defined, uncompressed trace files can be mapped in memory, and the events
+// returned by scap_next() point directly into the mapping.
+//
+#ifndef _WIN32
+#define HAS_MMAP_READ
+#endif
+
+//
+// Maximum number of threads that scan /proc to build the process table, and
+// how many processes they can get ahead of the one that is being added to the
+// table
+//
+#define PROC_SCAN_MAX_THREADS 8
+#define PROC_SCAN_WINDOW 1024
+
+//
+// When fds are resolved lazily, minimum age of a socket table before a
+// socket that is not in it causes it to be read again
+//
+#define LAZY_FD_SOCKET_TABLE_TTL_NS 1000000000
+
+//
+// If defined, scap_dump_open_ex() can hand the compression and the writes of
+// a trace file to a background thread.
+//
+#ifndef _WIN32
+#define HAS_ASYNC_DUMP
+#endif
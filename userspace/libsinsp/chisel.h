@@ -115,6 +115,11 @@ public:
 	uint32_t get_n_required_args();
 	void set_args(string args);
 	void set_args(vector<pair<string, string>> args);
+	//
+	// Chisels don't read events themselves: the capture loop that owns the
+	// inspector pushes them one by one, after reading them in batches with
+	// sinsp::next_batch() (see sysdig.cpp)
+	//
 	bool run(sinsp_evt* evt);
 	void do_timeout(sinsp_evt* evt);
 	void do_end_of_sample();
@@ -285,6 +285,7 @@ int lua_cbacks::request_field(lua_State *ls)
 	}
 
 	chk->parse_field_name(fld, true);
+	chk->m_field_name = fld;
 
 	lua_pushlightuserdata(ls, chk);
 
@@ -318,7 +319,7 @@ int lua_cbacks::field(lua_State *ls)
 	}
 
 	uint32_t vlen;
-	uint8_t* rawval = chk->extract(evt, &vlen);
+	uint8_t* rawval = chk->extract_cached(evt, &vlen);
 
 	if(rawval != NULL)
 	{
@@ -635,7 +636,7 @@ int lua_cbacks::get_machine_info(lua_State *ls)
 int lua_cbacks::get_thread_table(lua_State *ls) 
 {
 	threadinfo_map_iterator_t it;
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+	fdinfo_map_iterator_t fdit;
 	uint32_t j;
 	sinsp_filter_compiler* compiler = NULL;
 	sinsp_filter* filter = NULL;
@@ -713,6 +714,12 @@ int lua_cbacks::get_thread_table(lua_State *ls)
 				int64_t tlefd = tevt.m_tinfo->m_lastevent_fd;
 				tevt.m_tinfo->m_lastevent_fd = fdit->first;
 
+				//
+				// tevt is reused for every row, so the cached field values of
+				// the previous row must not be picked up
+				//
+				ch->m_inspector->get_field_cache()->invalidate();
+
 				if(filter->run(&tevt))
 				{
 					match = true;
@@ -817,7 +824,7 @@ int lua_cbacks::get_thread_table(lua_State *ls)
 		//
 		lua_pushstring(ls, "args");
 
-		vector<string>* args = &(it->second.m_args);
+		vector<sinsp_istring>* args = &(it->second.m_args);
 		lua_newtable(ls);
 		for(j = 0; j < args->size(); j++)
 		{
@@ -857,6 +864,8 @@ int lua_cbacks::get_thread_table(lua_State *ls)
 
 			if(filter != NULL)
 			{
+				ch->m_inspector->get_field_cache()->invalidate();
+
 				if(filter->run(&tevt) == false)
 				{
 					continue;
@@ -1002,7 +1011,7 @@ int lua_cbacks::get_thread_table(lua_State *ls)
 
 int lua_cbacks::get_container_table(lua_State *ls) 
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+	fdinfo_map_iterator_t fdit;
 	uint32_t j;
 	sinsp_evt tevt;
 
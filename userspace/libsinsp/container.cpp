@@ -16,20 +16,30 @@ You should have received a copy of the GNU General Public License
 along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#ifndef _WIN32
-#include <sys/socket.h>
-#include <sys/un.h>
-#include <unistd.h>
-#endif
-
 #include "sinsp.h"
 #include "sinsp_int.h"
 #include "container.h"
+#include "dockerresolver.h"
+#include "parsers.h"
 
 sinsp_container_manager::sinsp_container_manager(sinsp* inspector) :
 	m_inspector(inspector),
-	m_last_flush_time_ns(0)
+	m_last_flush_time_ns(0),
+	m_docker_resolver(NULL),
+	m_n_cgroup_cache_hits(0),
+	m_n_cgroup_cache_misses(0)
 {
+	for(uint32_t j = 0; j < CGROUP_CACHE_SIZE; j++)
+	{
+		m_cgroup_cache[j].m_is_container = false;
+	}
+}
+
+sinsp_container_manager::~sinsp_container_manager()
+{
+#ifdef HAS_CAPTURE
+	delete m_docker_resolver;
+#endif
 }
 
 bool sinsp_container_manager::remove_inactive_containers()
@@ -50,22 +60,20 @@ bool sinsp_container_manager::remove_inactive_containers()
 
 		g_logger.format(sinsp_logger::SEV_INFO, "Flushing container table");
 
-		set<string> containers_in_use;
-
-		threadinfo_map_t* threadtable = m_inspector->m_thread_manager->get_threads();
-
-		for(threadinfo_map_iterator_t it = threadtable->begin(); it != threadtable->end(); ++it)
-		{
-			if(!it->second.m_container_id.empty())
-			{
-				containers_in_use.insert(it->second.m_container_id);
-			}
-		}
-
+		//
+		// The thread manager counts the threads of every container, so
+		// this doesn't need to go through the thread table
+		//
 		for(unordered_map<string, sinsp_container_info>::iterator it = m_containers.begin(); it != m_containers.end();)
 		{
-			if(containers_in_use.find(it->first) == containers_in_use.end())
+			if(m_inspector->m_thread_manager->get_container_thread_count(it->first) == 0)
 			{
+#ifdef HAS_CAPTURE
+				if(m_docker_resolver != NULL && it->second.m_type == CT_DOCKER)
+				{
+					m_docker_resolver->forget(it->first);
+				}
+#endif
 				m_containers.erase(it++);
 			}
 			else
@@ -73,11 +81,37 @@ bool sinsp_container_manager::remove_inactive_containers()
 				++it;
 			}
 		}
+
+		invalidate_cgroup_cache();
 	}
 
 	return res;
 }
 
+void sinsp_container_manager::invalidate_cgroup_cache()
+{
+	//
+	// Forget the cgroups of the containers that were removed
+	//
+	for(uint32_t j = 0; j < CGROUP_CACHE_SIZE; j++)
+	{
+		cgroup_cache_entry* ce = &m_cgroup_cache[j];
+
+		if(ce->m_is_container && m_containers.find(ce->m_id) == m_containers.end())
+		{
+			ce->m_cgroup = sinsp_istring();
+			ce->m_is_container = false;
+			ce->m_id.clear();
+		}
+	}
+}
+
+void sinsp_container_manager::get_cgroup_cache_stats(uint64_t* nhits, uint64_t* nmisses) const
+{
+	*nhits = m_n_cgroup_cache_hits;
+	*nmisses = m_n_cgroup_cache_misses;
+}
+
 bool sinsp_container_manager::get_container(const string& container_id, sinsp_container_info* container_info) const
 {
 	unordered_map<string, sinsp_container_info>::const_iterator it = m_containers.find(container_id);
@@ -169,118 +203,146 @@ string sinsp_container_manager::get_mesos_task_id(const string& container_id)
 	return mesos_task_id;
 }
 
-bool sinsp_container_manager::resolve_container(sinsp_threadinfo* tinfo, bool query_os_for_missing_info)
+bool sinsp_container_manager::match_cgroup(const string& cgroup, sinsp_container_info* container_info)
 {
-	ASSERT(tinfo);
-	bool valid_id = false;
-	sinsp_container_info container_info;
+	size_t pos;
 
-	for(auto it = tinfo->m_cgroups.begin(); it != tinfo->m_cgroups.end(); ++it)
+	//
+	// Non-systemd Docker
+	//
+	pos = cgroup.find_last_of("/");
+	if(pos != string::npos)
 	{
-		string cgroup = it->second;
-		size_t pos;
-
-		//
-		// Non-systemd Docker
-		//
-		pos = cgroup.find_last_of("/");
-		if(pos != string::npos)
+		if(cgroup.length() - pos - 1 == 64 &&
+			cgroup.find_first_not_of("0123456789abcdefABCDEF", pos + 1) == string::npos)
 		{
-			if(cgroup.length() - pos - 1 == 64 &&
-				cgroup.find_first_not_of("0123456789abcdefABCDEF", pos + 1) == string::npos) 
-			{
-				container_info.m_type = CT_DOCKER;
-				container_info.m_id = cgroup.substr(pos + 1, 12);
-				valid_id = true;
-				break;
-			}
+			container_info->m_type = CT_DOCKER;
+			container_info->m_id = cgroup.substr(pos + 1, 12);
+			return true;
 		}
+	}
 
-		//
-		// systemd Docker
-		//
-		pos = cgroup.find("docker-");
-		if(pos != string::npos)
+	//
+	// systemd Docker
+	//
+	pos = cgroup.find("docker-");
+	if(pos != string::npos)
+	{
+		size_t pos2 = cgroup.find(".scope");
+		if(pos2 != string::npos &&
+			pos2 - pos - sizeof("docker-") + 1 == 64)
 		{
-			size_t pos2 = cgroup.find(".scope");
-			if(pos2 != string::npos &&
-				pos2 - pos - sizeof("docker-") + 1 == 64)
-			{
-				container_info.m_type = CT_DOCKER;
-				container_info.m_id = cgroup.substr(pos + sizeof("docker-") - 1, 12);
-				valid_id = true;
-				break;
-			}
+			container_info->m_type = CT_DOCKER;
+			container_info->m_id = cgroup.substr(pos + sizeof("docker-") - 1, 12);
+			return true;
 		}
+	}
 
-		//
-		// Non-systemd libvirt-lxc
-		//
-		pos = cgroup.find(".libvirt-lxc");
-		if(pos != string::npos &&
-			pos == cgroup.length() - sizeof(".libvirt-lxc") + 1)
+	//
+	// Non-systemd libvirt-lxc
+	//
+	pos = cgroup.find(".libvirt-lxc");
+	if(pos != string::npos &&
+		pos == cgroup.length() - sizeof(".libvirt-lxc") + 1)
+	{
+		size_t pos2 = cgroup.find_last_of("/");
+		if(pos2 != string::npos)
 		{
-			size_t pos2 = cgroup.find_last_of("/");
-			if(pos2 != string::npos)
-			{
-				container_info.m_type = CT_LIBVIRT_LXC;
-				container_info.m_id = cgroup.substr(pos2 + 1, pos - pos2 - 1);
-				valid_id = true;
-				break;
-			}
+			container_info->m_type = CT_LIBVIRT_LXC;
+			container_info->m_id = cgroup.substr(pos2 + 1, pos - pos2 - 1);
+			return true;
 		}
+	}
 
-		//
-		// systemd libvirt-lxc
-		//
-		pos = cgroup.find("-lxc\\x2");
-		if(pos != string::npos)
+	//
+	// systemd libvirt-lxc
+	//
+	pos = cgroup.find("-lxc\\x2");
+	if(pos != string::npos)
+	{
+		size_t pos2 = cgroup.find(".scope");
+		if(pos2 != string::npos &&
+			pos2 == cgroup.length() - sizeof(".scope") + 1)
 		{
-			size_t pos2 = cgroup.find(".scope");
-			if(pos2 != string::npos &&
-				pos2 == cgroup.length() - sizeof(".scope") + 1)
-			{
-				container_info.m_type = CT_LIBVIRT_LXC;
-				container_info.m_id = cgroup.substr(pos + sizeof("-lxc\\x2"), pos2 - pos - sizeof("-lxc\\x2"));
-				valid_id = true;
-				break;
-			}
+			container_info->m_type = CT_LIBVIRT_LXC;
+			container_info->m_id = cgroup.substr(pos + sizeof("-lxc\\x2"), pos2 - pos - sizeof("-lxc\\x2"));
+			return true;
 		}
+	}
 
-		//
-		// Legacy libvirt-lxc
-		//
-		pos = cgroup.find("/libvirt/lxc/");
-		if(pos != string::npos)
+	//
+	// Legacy libvirt-lxc
+	//
+	pos = cgroup.find("/libvirt/lxc/");
+	if(pos != string::npos)
+	{
+		container_info->m_type = CT_LIBVIRT_LXC;
+		container_info->m_id = cgroup.substr(pos + sizeof("/libvirt/lxc/") - 1);
+		return true;
+	}
+
+	//
+	// Non-systemd LXC
+	//
+	pos = cgroup.find("/lxc/");
+	if(pos != string::npos)
+	{
+		container_info->m_type = CT_LXC;
+		container_info->m_id = cgroup.substr(pos + sizeof("/lxc/") - 1);
+		return true;
+	}
+
+	//
+	// Mesos
+	//
+	pos = cgroup.find("/mesos/");
+	if(pos != string::npos)
+	{
+		container_info->m_type = CT_MESOS;
+		container_info->m_id = cgroup.substr(pos + sizeof("/mesos/") - 1);
+		return true;
+	}
+
+	return false;
+}
+
+bool sinsp_container_manager::resolve_container(sinsp_threadinfo* tinfo, bool query_os_for_missing_info)
+{
+	ASSERT(tinfo);
+	bool valid_id = false;
+	sinsp_container_info container_info;
+
+	for(auto it = tinfo->m_cgroups.begin(); it != tinfo->m_cgroups.end(); ++it)
+	{
+		const sinsp_istring& cgroup = it->second;
+		cgroup_cache_entry* ce = &m_cgroup_cache[get_cgroup_cache_index(cgroup)];
+
+		if(ce->m_cgroup == cgroup && !cgroup.empty())
 		{
-			container_info.m_type = CT_LIBVIRT_LXC;
-			container_info.m_id = cgroup.substr(pos + sizeof("/libvirt/lxc/") - 1);
-			valid_id = true;
-			break;
+			m_n_cgroup_cache_hits++;
 		}
-
-		//
-		// Non-systemd LXC
-		//
-		pos = cgroup.find("/lxc/");
-		if(pos != string::npos)
+		else
 		{
-			container_info.m_type = CT_LXC;
-			container_info.m_id = cgroup.substr(pos + sizeof("/lxc/") - 1);
-			valid_id = true;
-			break;
+			m_n_cgroup_cache_misses++;
+
+			ce->m_cgroup = cgroup;
+			ce->m_is_container = match_cgroup(cgroup, &container_info);
+			if(ce->m_is_container)
+			{
+				ce->m_type = container_info.m_type;
+				ce->m_id = container_info.m_id;
+			}
 		}
 
-		//
-		// Mesos
-		//
-		pos = cgroup.find("/mesos/");
-		if(pos != string::npos)
+		if(ce->m_is_container)
 		{
-			container_info.m_type = CT_MESOS;
-			container_info.m_id = cgroup.substr(pos + sizeof("/mesos/") - 1);
+			container_info.m_type = ce->m_type;
+			container_info.m_id = ce->m_id;
+			if(container_info.m_type == CT_MESOS)
+			{
+				set_mesos_task_id(&container_info, tinfo);
+			}
 			valid_id = true;
-			set_mesos_task_id(&container_info, tinfo);
 			break;
 		}
 	}
@@ -288,19 +350,21 @@ bool sinsp_container_manager::resolve_container(sinsp_threadinfo* tinfo, bool qu
 	string rkt_podid, rkt_appname;
 	if(!valid_id)
 	{
+		const string& root = tinfo->m_root;
+
 		// Try parsing from process root,
 		// Strings used to detect rkt stage1-cores pods
 		static const string COREOS_PREFIX = "/opt/stage2/";
 		static const string COREOS_APP_SUFFIX = "/rootfs";
 		static const string COREOS_PODID_VAR = "container_uuid=";
 
-		auto prefix = tinfo->m_root.find(COREOS_PREFIX);
+		auto prefix = root.find(COREOS_PREFIX);
 		if(prefix == 0)
 		{
-			auto suffix = tinfo->m_root.find(COREOS_APP_SUFFIX, prefix);
+			auto suffix = root.find(COREOS_APP_SUFFIX, prefix);
 			if(suffix != string::npos)
 			{
-				rkt_appname = tinfo->m_root.substr(prefix + COREOS_PREFIX.size(), suffix - prefix - COREOS_PREFIX.size());
+				rkt_appname = root.substr(prefix + COREOS_PREFIX.size(), suffix - prefix - COREOS_PREFIX.size());
 				// It is a rkt pod with stage1-coreos
 				sinsp_threadinfo* tinfo_it = tinfo;
 				while(!valid_id && tinfo_it != nullptr)
@@ -329,17 +393,17 @@ bool sinsp_container_manager::resolve_container(sinsp_threadinfo* tinfo, bool qu
 			static const string FLY_PODID_SUFFIX = "/stage1/rootfs/opt/stage2/";
 			static const string FLY_APP_SUFFIX = "/rootfs";
 
-			auto prefix = tinfo->m_root.find(FLY_PREFIX);
+			auto prefix = root.find(FLY_PREFIX);
 			if(prefix == 0)
 			{
-				auto podid_suffix = tinfo->m_root.find(FLY_PODID_SUFFIX, prefix+FLY_PREFIX.size());
+				auto podid_suffix = root.find(FLY_PODID_SUFFIX, prefix+FLY_PREFIX.size());
 				if(podid_suffix != string::npos)
 				{
-					rkt_podid = tinfo->m_root.substr(prefix + FLY_PREFIX.size(), podid_suffix - prefix - FLY_PREFIX.size());
-					auto appname_suffix = tinfo->m_root.find(FLY_APP_SUFFIX, podid_suffix+FLY_PODID_SUFFIX.size());
+					rkt_podid = root.substr(prefix + FLY_PREFIX.size(), podid_suffix - prefix - FLY_PREFIX.size());
+					auto appname_suffix = root.find(FLY_APP_SUFFIX, podid_suffix+FLY_PODID_SUFFIX.size());
 					if(appname_suffix != string::npos)
 					{
-						rkt_appname = tinfo->m_root.substr(podid_suffix + FLY_PODID_SUFFIX.size(),
+						rkt_appname = root.substr(podid_suffix + FLY_PODID_SUFFIX.size(),
 														   appname_suffix-podid_suffix-FLY_PODID_SUFFIX.size());
 						container_info.m_type = CT_RKT;
 						container_info.m_id = rkt_podid + ":" + rkt_appname;
@@ -352,7 +416,7 @@ bool sinsp_container_manager::resolve_container(sinsp_threadinfo* tinfo, bool qu
 	}
 	if(valid_id)
 	{
-		tinfo->m_container_id = container_info.m_id;
+		m_inspector->m_thread_manager->set_container_id(tinfo, container_info.m_id);
 
 		unordered_map<string, sinsp_container_info>::const_iterator it = m_containers.find(container_info.m_id);
 		if(it == m_containers.end())
@@ -360,10 +424,25 @@ bool sinsp_container_manager::resolve_container(sinsp_threadinfo* tinfo, bool qu
 			switch(container_info.m_type)
 			{
 				case CT_DOCKER:
-#ifndef _WIN32
+#ifdef HAS_CAPTURE
+					//
+					// Asking the daemon can take long, so the container goes in
+					// the table with what we have, and the details are filled in
+					// by update_docker_containers() when they arrive
+					//
 					if(query_os_for_missing_info)
 					{
-						parse_docker(&container_info);
+						if(m_docker_resolver == NULL)
+						{
+							if(m_docker_socket_path.empty())
+							{
+								m_docker_socket_path = string(scap_get_host_root()) + "/var/run/docker.sock";
+							}
+
+							m_docker_resolver = new sinsp_docker_resolver(m_docker_socket_path, DOCKER_RESOLVER_MAX_WORKERS);
+						}
+
+						m_docker_resolver->request(container_info, m_inspector->m_lastevent_ts);
 					}
 #endif
 					break;
@@ -394,6 +473,17 @@ bool sinsp_container_manager::resolve_container(sinsp_threadinfo* tinfo, bool qu
 				m_inspector->m_meta_evt_pending = true;
 			}
 		}
+#ifdef HAS_CAPTURE
+		else if(it->second.m_type == CT_DOCKER && query_os_for_missing_info && m_docker_resolver != NULL)
+		{
+			//
+			// The daemon may not have known the container when it was first
+			// asked. Ask again for the new threads, once the last failure is
+			// old enough.
+			//
+			m_docker_resolver->retry(it->second, m_inspector->m_lastevent_ts);
+		}
+#endif
 	}
 
 	return valid_id;
@@ -408,10 +498,10 @@ string sinsp_container_manager::container_to_json(const sinsp_container_info& co
 	container["name"] = container_info.m_name;
 	container["image"] = container_info.m_image;
 
-	char addrbuff[100];
-	uint32_t iph = ntohl(container_info.m_container_ip);
-	inet_ntop(AF_INET, &iph, addrbuff, sizeof(addrbuff));
-	container["ip"] = addrbuff;
+	char addrbuff[100];
+	uint32_t iph = ntohl(container_info.m_container_ip);
+	inet_ntop(AF_INET, &iph, addrbuff, sizeof(addrbuff));
+	container["ip"] = addrbuff;
 
 	if(!container_info.m_mesos_task_id.empty())
 	{
@@ -452,60 +542,55 @@ bool sinsp_container_manager::container_to_sinsp_event(const string& json, sinsp
 	return true;
 }
 
-#ifndef _WIN32
-bool sinsp_container_manager::parse_docker(sinsp_container_info* container)
+void sinsp_container_manager::update_docker_containers()
 {
-	string file = string(scap_get_host_root()) + "/var/run/docker.sock";
-
-	int sock = socket(PF_UNIX, SOCK_STREAM, 0);
-	if(sock < 0)
+#ifdef HAS_CAPTURE
+	if(m_docker_resolver == NULL)
 	{
-		ASSERT(false);
-		return false;
+		return;
 	}
 
-	struct sockaddr_un address;
-	memset(&address, 0, sizeof(struct sockaddr_un));
-
-	address.sun_family = AF_UNIX;
-	strncpy(address.sun_path, file.c_str(), sizeof(address.sun_path) - 1);
-	address.sun_path[sizeof(address.sun_path) - 1]= '\0';
-
-	if(connect(sock, (struct sockaddr *) &address, sizeof(struct sockaddr_un)) != 0)
+	vector<sinsp_container_info> containers;
+	if(m_docker_resolver->get_results(&containers, m_inspector->m_lastevent_ts))
 	{
-		return false;
-	}
+		for(auto& container : containers)
+		{
+			//
+			// Skip the containers that went away while we were waiting
+			//
+			unordered_map<string, sinsp_container_info>::iterator it = m_containers.find(container.m_id);
+			if(it == m_containers.end())
+			{
+				continue;
+			}
 
-	string message = "GET /containers/" + container->m_id + "/json HTTP/1.0\r\n\n";
-	if(write(sock, message.c_str(), message.length()) != (ssize_t) message.length())
-	{
-		ASSERT(false);
-		close(sock);
-		return false;
+			it->second = std::move(container);
+			m_container_events.push_back(container_to_json(it->second));
+		}
 	}
 
-	char buf[256];
-	string json;
-	ssize_t res;
-	while((res = read(sock, buf, sizeof(buf))) != 0)
+	//
+	// Only one group of meta events can be in flight, the remaining
+	// containers go with the next batch
+	//
+	if(!m_container_events.empty() && m_inspector->m_parser && m_inspector->m_meta_event_callback == NULL)
 	{
-		if(res == -1 || json.size() > MAX_JSON_SIZE_B)
-		{
-			ASSERT(false);
-			close(sock);
-			return false;
-		}
-
-		buf[res] = 0;
-		json += buf;
+		m_inspector->m_parser->schedule_container_events(&m_inspector->m_meta_evt, &m_container_events);
 	}
+#endif // HAS_CAPTURE
+}
 
-	close(sock);
+void sinsp_container_manager::set_docker_socket_path(const string& path)
+{
+	m_docker_socket_path = path;
+}
 
+#ifndef _WIN32
+bool sinsp_container_manager::parse_docker(const string& json, sinsp_container_info* container)
+{
 	size_t pos = json.find("{");
 	if(pos == string::npos)
 	{
-		ASSERT(false);
 		return false;
 	}
 
@@ -514,7 +599,6 @@ bool sinsp_container_manager::parse_docker(sinsp_container_info* container)
 	bool parsingSuccessful = reader.parse(json.substr(pos), root);
 	if(!parsingSuccessful)
 	{
-		ASSERT(false);
 		return false;
 	}
 
@@ -711,17 +795,13 @@ void sinsp_container_manager::add_container(const sinsp_container_info& containe
 	m_containers[container_info.m_id] = container_info;
 }
 
-void sinsp_container_manager::dump_containers(scap_dumper_t* dumper)
+void sinsp_container_manager::dump_containers(sinsp_dump_writer* writer)
 {
 	for(unordered_map<string, sinsp_container_info>::const_iterator it = m_containers.begin(); it != m_containers.end(); ++it)
 	{
 		if(container_to_sinsp_event(container_to_json(it->second), &m_inspector->m_meta_evt))
 		{
-			int32_t res = scap_dump(m_inspector->m_h, dumper, m_inspector->m_meta_evt.m_pevt, m_inspector->m_meta_evt.m_cpuid, 0);
-			if(res != SCAP_SUCCESS)
-			{
-				throw sinsp_exception(scap_getlasterr(m_inspector->m_h));
-			}
+			writer->dump(m_inspector->m_meta_evt.m_pevt, m_inspector->m_meta_evt.m_cpuid, 0);
 		}
 	}
 }
@@ -70,31 +70,88 @@ public:
 	int64_t m_cpu_period;
 };
 
+class sinsp_docker_resolver;
+
 class sinsp_container_manager
 {
 public:
 	sinsp_container_manager(sinsp* inspector);
+	~sinsp_container_manager();
 
 	const unordered_map<string, sinsp_container_info>* get_containers();
 	bool remove_inactive_containers();
 	void add_container(const sinsp_container_info& container_info);
 	bool get_container(const string& id, sinsp_container_info* container_info) const;
 	bool resolve_container(sinsp_threadinfo* tinfo, bool query_os_for_missing_info);
-	void dump_containers(scap_dumper_t* dumper);
+	void dump_containers(sinsp_dump_writer* writer);
 	string get_container_name(sinsp_threadinfo* tinfo);
 	string get_env_mesos_task_id(sinsp_threadinfo* tinfo);
 	bool set_mesos_task_id(sinsp_container_info* container, sinsp_threadinfo* tinfo);
 	string get_mesos_task_id(const string& container_id);
 
+	//
+	// Store the Docker containers whose details arrived since the last call,
+	// and add a container event for each of them to the event stream
+	//
+	void update_docker_containers();
+
+	//
+	// Query the Docker daemon on the given socket instead of
+	// /var/run/docker.sock under the host root
+	//
+	void set_docker_socket_path(const string& path);
+
+	//
+	// Number of the cgroups that were found in the cache of the container
+	// ids, and of the ones that had to be parsed
+	//
+	void get_cgroup_cache_stats(uint64_t* nhits, uint64_t* nmisses) const;
+
 private:
+	//
+	// Container id that a cgroup resolves to. The threads of a container
+	// share their cgroups, so most of them are resolved without going
+	// through the heuristics of match_cgroup().
+	//
+	struct cgroup_cache_entry
+	{
+		sinsp_istring m_cgroup;
+		bool m_is_container; // false if the cgroup is not a container's
+		sinsp_container_type m_type;
+		string m_id;
+	};
+
+	static bool match_cgroup(const string& cgroup, sinsp_container_info* container_info);
+	inline uint32_t get_cgroup_cache_index(const sinsp_istring& cgroup) const
+	{
+		//
+		// The entries of the pool are heap addresses, which share their high
+		// bits and their alignment, so all the bits are mixed
+		//
+		uint64_t h = cgroup.get_id();
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		return (uint32_t)h & (CGROUP_CACHE_SIZE - 1);
+	}
+	void invalidate_cgroup_cache();
+
 	string container_to_json(const sinsp_container_info& container_info);
 	bool container_to_sinsp_event(const string& json, sinsp_evt* evt);
-	bool parse_docker(sinsp_container_info* container);
-	string get_mesos_task_id(const Json::Value& env_vars, const string& mti);
+	static bool parse_docker(const string& json, sinsp_container_info* container);
+	static string get_mesos_task_id(const Json::Value& env_vars, const string& mti);
 	bool parse_rkt(sinsp_container_info* container, const string& podid, const string& appname);
 	sinsp_container_info* get_container(const string& id);
 
 	sinsp* m_inspector;
 	unordered_map<string, sinsp_container_info> m_containers;
 	uint64_t m_last_flush_time_ns;
+	string m_docker_socket_path;
+	sinsp_docker_resolver* m_docker_resolver;
+	deque<string> m_container_events; // JSON of the containers whose details arrived
+	cgroup_cache_entry m_cgroup_cache[CGROUP_CACHE_SIZE];
+	uint64_t m_n_cgroup_cache_hits;
+	uint64_t m_n_cgroup_cache_misses;
+
+	friend class sinsp_docker_resolver;
 };
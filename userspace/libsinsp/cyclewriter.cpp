@@ -13,7 +13,7 @@ cycle_writer::cycle_writer(bool is_live) :
 	m_file_index(0),
 	m_first_consider(false),
 	m_event_count(0L),
-	m_dumper(NULL),
+	m_writer(NULL),
 	m_past_names(NULL)
 {
 	//
@@ -27,7 +27,7 @@ cycle_writer::cycle_writer(bool is_live) :
 	this->live = is_live;
 }
 
-bool cycle_writer::setup(string base_file_name, int rollover_mb, int duration_seconds, int file_limit, unsigned long event_limit, scap_dumper_t** dumper)
+bool cycle_writer::setup(string base_file_name, int rollover_mb, int duration_seconds, int file_limit, unsigned long event_limit, sinsp_dump_writer** writer)
 {
 	if(m_first_consider) 
 	{
@@ -38,7 +38,7 @@ bool cycle_writer::setup(string base_file_name, int rollover_mb, int duration_se
 	m_duration_seconds = duration_seconds;
 	m_file_limit = file_limit;
 	m_event_limit = event_limit;
-	m_dumper = dumper;
+	m_writer = writer;
 
 	if(duration_seconds > 0 && file_limit > 0)
 	{
@@ -107,7 +107,7 @@ cycle_writer::conclusion cycle_writer::consider(sinsp_evt* evt)
 		}
 	}
 
-	if(m_rollover_mb > 0 && scap_dump_get_offset(*m_dumper) > m_rollover_mb)
+	if(m_rollover_mb > 0 && (int64_t)(*m_writer)->written_bytes() > m_rollover_mb)
 	{
 		m_last_reason = "Maximum File Size Reached";
 		return next_file();
@@ -49,7 +49,7 @@ public:
 	// (via a call to consider()), then this will
 	// be locked down and return false.
 	//
-	bool setup(string base_file_name, int rollover_mb, int duration_seconds, int file_limit, unsigned long event_limit, scap_dumper_t** dumper);
+	bool setup(string base_file_name, int rollover_mb, int duration_seconds, int file_limit, unsigned long event_limit, sinsp_dump_writer** writer);
 	
 	//
 	// Consider file size at the current time
@@ -144,7 +144,7 @@ private:
 	// number of events
 	unsigned long m_event_count; // = 0L
 
-	scap_dumper_t** m_dumper;
+	sinsp_dump_writer** m_writer;
 
 	bool live;
 
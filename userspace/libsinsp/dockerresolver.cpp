@@ -0,0 +1,299 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAS_CAPTURE
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "dockerresolver.h"
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+//
+// How long a worker waits on the socket before checking if it has to stop
+//
+#define POLL_INTERVAL_MS 100
+
+sinsp_docker_resolver::sinsp_docker_resolver(const std::string& socket_path, uint32_t max_workers):
+	m_socket_path(socket_path),
+	m_max_workers(max_workers),
+	m_n_in_flight(0),
+	m_n_idle(0),
+	m_stop(false)
+{
+	ASSERT(max_workers > 0);
+}
+
+sinsp_docker_resolver::~sinsp_docker_resolver()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cond.notify_all();
+
+	for(auto& worker : m_workers)
+	{
+		worker.join();
+	}
+}
+
+bool sinsp_docker_resolver::request(const sinsp_container_info& container, uint64_t ts)
+{
+	auto it = m_requests.find(container.m_id);
+	if(it != m_requests.end() && (it->second.m_in_flight || ts < it->second.m_retry_ts))
+	{
+		return false;
+	}
+
+	request_state& state = m_requests[container.m_id];
+	state.m_in_flight = true;
+	state.m_retry_ts = 0;
+
+	//
+	// Keep the container for later instead of dropping it, nothing else
+	// would ask for it again if its processes don't start new threads
+	//
+	if(m_n_in_flight >= DOCKER_RESOLVER_MAX_QUEUED_REQUESTS)
+	{
+		g_logger.format(sinsp_logger::SEV_DEBUG, "Too many Docker requests in flight, container %s will be resolved later", container.m_id.c_str());
+		state.m_pending = true;
+		m_pending.push_back(container);
+		return true;
+	}
+
+	state.m_pending = false;
+	submit(container);
+
+	return true;
+}
+
+void sinsp_docker_resolver::submit(const sinsp_container_info& container)
+{
+	m_n_in_flight++;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_queue.push_back(container);
+
+		//
+		// Start another worker if all of them are busy, so that a slow answer
+		// doesn't hold up the other containers
+		//
+		if(m_n_idle == 0 && m_workers.size() < m_max_workers)
+		{
+			m_workers.push_back(std::thread(&sinsp_docker_resolver::run, this));
+		}
+	}
+	m_cond.notify_one();
+}
+
+bool sinsp_docker_resolver::retry(const sinsp_container_info& container, uint64_t ts)
+{
+	auto it = m_requests.find(container.m_id);
+	if(it == m_requests.end() || it->second.m_in_flight || ts < it->second.m_retry_ts)
+	{
+		return false;
+	}
+
+	return request(container, ts);
+}
+
+void sinsp_docker_resolver::forget(const std::string& id)
+{
+	m_requests.erase(id);
+}
+
+bool sinsp_docker_resolver::get_results(std::vector<sinsp_container_info>* containers, uint64_t ts)
+{
+	std::deque<result> results;
+
+	if(m_n_in_flight != 0)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		results.swap(m_results);
+	}
+
+	for(auto& res : results)
+	{
+		ASSERT(m_n_in_flight > 0);
+		m_n_in_flight--;
+
+		if(res.m_valid)
+		{
+			m_requests.erase(res.m_container.m_id);
+			containers->push_back(std::move(res.m_container));
+		}
+		else
+		{
+			//
+			// Remember the failure, unless the container went away in the
+			// meantime
+			//
+			auto it = m_requests.find(res.m_container.m_id);
+			if(it != m_requests.end())
+			{
+				it->second.m_in_flight = false;
+				it->second.m_retry_ts = ts + DOCKER_FAILED_REQUEST_TTL_NS;
+			}
+		}
+	}
+
+	//
+	// Skip the pending containers that were forgotten in the meantime. A
+	// container that was forgotten and requested again is in the list
+	// twice, the second copy finds m_pending cleared.
+	//
+	while(!m_pending.empty() && m_n_in_flight < DOCKER_RESOLVER_MAX_QUEUED_REQUESTS)
+	{
+		auto it = m_requests.find(m_pending.front().m_id);
+		if(it != m_requests.end() && it->second.m_pending)
+		{
+			it->second.m_pending = false;
+			submit(m_pending.front());
+		}
+		m_pending.pop_front();
+	}
+
+	return !containers->empty();
+}
+
+void sinsp_docker_resolver::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while(!m_stop)
+	{
+		if(m_queue.empty())
+		{
+			m_n_idle++;
+			m_cond.wait(lock);
+			m_n_idle--;
+			continue;
+		}
+
+		result res;
+		res.m_container = std::move(m_queue.front());
+		m_queue.pop_front();
+
+		lock.unlock();
+
+		std::string json;
+		res.m_valid = fetch(res.m_container.m_id, &json) &&
+			sinsp_container_manager::parse_docker(json, &res.m_container);
+		if(!res.m_valid && !m_stop)
+		{
+			g_logger.format(sinsp_logger::SEV_DEBUG, "Cannot get the details of Docker container %s", res.m_container.m_id.c_str());
+		}
+
+		lock.lock();
+		m_results.push_back(std::move(res));
+	}
+}
+
+bool sinsp_docker_resolver::fetch(const std::string& id, std::string* json)
+{
+	int sock = socket(PF_UNIX, SOCK_STREAM, 0);
+	if(sock < 0)
+	{
+		return false;
+	}
+
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(struct sockaddr_un));
+
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, m_socket_path.c_str(), sizeof(address.sun_path) - 1);
+	address.sun_path[sizeof(address.sun_path) - 1]= '\0';
+
+	if(connect(sock, (struct sockaddr *) &address, sizeof(struct sockaddr_un)) != 0)
+	{
+		close(sock);
+		return false;
+	}
+
+	std::string message = "GET /containers/" + id + "/json HTTP/1.0\r\n\n";
+	if(write(sock, message.c_str(), message.length()) != (ssize_t) message.length())
+	{
+		close(sock);
+		return false;
+	}
+
+	//
+	// Wait for the answer in short steps, so that the workers can be stopped
+	// while the daemon is hanging
+	//
+	struct pollfd pfd;
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+
+	char buf[4096];
+	uint64_t waited_ms = 0;
+
+	while(!m_stop)
+	{
+		int pres = poll(&pfd, 1, POLL_INTERVAL_MS);
+		if(pres == 0)
+		{
+			waited_ms += POLL_INTERVAL_MS;
+			if(waited_ms >= DOCKER_REQUEST_TIMEOUT_MS)
+			{
+				g_logger.format(sinsp_logger::SEV_WARNING, "Timeout waiting for the Docker daemon, container %s", id.c_str());
+				break;
+			}
+			continue;
+		}
+		else if(pres < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+
+		ssize_t res = read(sock, buf, sizeof(buf));
+		if(res == 0)
+		{
+			close(sock);
+			return true;
+		}
+		else if(res < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+
+		if(json->size() + res > MAX_JSON_SIZE_B)
+		{
+			break;
+		}
+
+		json->append(buf, res);
+	}
+
+	close(sock);
+	return false;
+}
+
+#endif // HAS_CAPTURE
@@ -0,0 +1,138 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#ifdef HAS_CAPTURE
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "sinsp.h"
+
+/*!
+  \brief Fetches the details of Docker containers from the Docker daemon in
+   background threads.
+
+  The capture queues a request for every new container and goes on with the
+  partial information it found in the cgroups. Up to max_workers threads take
+  the requests out of the queue, query the daemon socket and parse its answer,
+  and the capture picks up the complete containers with \ref get_results().
+
+  When DOCKER_RESOLVER_MAX_QUEUED_REQUESTS requests are in flight, the new
+  ones wait in a pending list, which \ref get_results() moves to the queue as
+  the requests in flight complete.
+
+  The requests in flight and the ones that failed are remembered until the
+  container is forgotten. A failed request is made again by \ref retry(), but
+  not before DOCKER_FAILED_REQUEST_TTL_NS, so that a container whose processes
+  come and go isn't requested over and over while the daemon can't answer for
+  it.
+*/
+class SINSP_PUBLIC sinsp_docker_resolver
+{
+public:
+	sinsp_docker_resolver(const std::string& socket_path, uint32_t max_workers);
+	~sinsp_docker_resolver();
+
+	/*!
+	  \brief Queue a request for the details of container, which has its id
+	   and type set. Return false if the request is already in flight or
+	   pending, or if it failed recently.
+	*/
+	bool request(const sinsp_container_info& container, uint64_t ts);
+
+	/*!
+	  \brief Queue the request for container again if the last one failed
+	   at least DOCKER_FAILED_REQUEST_TTL_NS ago. Return false if the
+	   container was resolved, if it was never requested, or if it's too
+	   early.
+	*/
+	bool retry(const sinsp_container_info& container, uint64_t ts);
+
+	/*!
+	  \brief Forget the requests for a container that went away.
+	*/
+	void forget(const std::string& id);
+
+	/*!
+	  \brief Move the containers whose details arrived into containers.
+	   Return false if there were none. Queue the pending requests for
+	   which there is room again.
+	*/
+	bool get_results(std::vector<sinsp_container_info>* containers, uint64_t ts);
+
+	/*!
+	  \brief Return the number of requests in flight.
+	*/
+	uint32_t get_n_in_flight() const
+	{
+		return m_n_in_flight;
+	}
+
+	/*!
+	  \brief Return the number of requests waiting for room in the queue.
+	*/
+	uint32_t get_n_pending() const
+	{
+		return (uint32_t)m_pending.size();
+	}
+
+private:
+	struct request_state
+	{
+		bool m_in_flight; // Queued, being fetched or pending
+		bool m_pending; // Waiting in m_pending
+		uint64_t m_retry_ts; // When a failed request can be made again
+	};
+
+	struct result
+	{
+		sinsp_container_info m_container;
+		bool m_valid;
+	};
+
+	void submit(const sinsp_container_info& container);
+	void run();
+	bool fetch(const std::string& id, std::string* json);
+
+	std::string m_socket_path;
+	uint32_t m_max_workers;
+
+	//
+	// Only used by the capture
+	//
+	std::unordered_map<std::string, request_state> m_requests;
+	uint32_t m_n_in_flight;
+	std::deque<sinsp_container_info> m_pending;
+
+	std::vector<std::thread> m_workers;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	std::deque<sinsp_container_info> m_queue; // Protected by m_mutex
+	std::deque<result> m_results; // Protected by m_mutex
+	uint32_t m_n_idle; // Workers waiting for a request, protected by m_mutex
+	std::atomic<bool> m_stop;
+};
+
+#endif // HAS_CAPTURE
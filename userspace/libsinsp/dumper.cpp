@@ -24,81 +24,71 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 sinsp_dumper::sinsp_dumper(sinsp* inspector)
 {
 	m_inspector = inspector;
-	m_dumper = NULL;
+	m_writer = NULL;
 }
 
 sinsp_dumper::~sinsp_dumper()
 {
-	if(m_dumper != NULL)
+	if(m_writer != NULL)
 	{
-		scap_dump_close(m_dumper);
+		delete m_writer;
 	}
 }
 
 void sinsp_dumper::open(const string& filename, bool compress)
 {
+	open(filename, compress? SCAP_COMPRESSION_GZIP : SCAP_COMPRESSION_NONE);
+}
+
+void sinsp_dumper::open(const string& filename, compression_mode compress)
+{
+	scap_dump_params params;
+
 	if(m_inspector->m_h == NULL)
 	{
 		throw sinsp_exception("can't start event dump, inspector not opened yet");
 	}
 
-	if(compress)
-	{
-		m_dumper = scap_dump_open(m_inspector->m_h, filename.c_str(), SCAP_COMPRESSION_GZIP);
-	}
-	else
-	{
-		m_dumper = scap_dump_open(m_inspector->m_h, filename.c_str(), SCAP_COMPRESSION_NONE);
-	}
+	memset(&params, 0, sizeof(params));
+	params.compress = compress;
+	params.compression_level = m_inspector->m_dump_compression_level;
 
-	if(m_dumper == NULL)
+	if(m_writer == NULL)
 	{
-		throw sinsp_exception(scap_getlasterr(m_inspector->m_h));
+		m_writer = new sinsp_dump_writer(m_inspector, m_inspector->m_dump_async);
 	}
 
-	m_inspector->m_container_manager.dump_containers(m_dumper);
+	m_writer->open(filename, params);
 }
 
 void sinsp_dumper::dump(sinsp_evt* evt)
 {
-	if(m_dumper == NULL)
+	if(m_writer == NULL)
 	{
 		throw sinsp_exception("dumper not opened yet");
 	}
 
 	scap_evt* pdevt = (evt->m_poriginal_evt)? evt->m_poriginal_evt : evt->m_pevt;
 
-	int32_t res = scap_dump(m_inspector->m_h, 
-		m_dumper, pdevt, evt->m_cpuid, 0);
-
-	if(res != SCAP_SUCCESS)
-	{
-		throw sinsp_exception(scap_getlasterr(m_inspector->m_h));
-	}
+	m_writer->dump(pdevt, evt->m_cpuid, 0);
 }
 
 uint64_t sinsp_dumper::written_bytes()
 {
-	if(m_dumper == NULL)
+	if(m_writer == NULL)
 	{
 		throw sinsp_exception("dumper not opened yet");
 	}
 
-	int64_t written_bytes = scap_dump_get_offset(m_dumper);
-	if(written_bytes == -1)
-	{
-		throw sinsp_exception("error getting offset");		
-	}
-
-	return written_bytes;
+	return m_writer->written_bytes();
 }
 
 void sinsp_dumper::flush()
 {
-	if(m_dumper == NULL)
+	if(m_writer == NULL)
 	{
 		throw sinsp_exception("dumper not opened yet");
 	}
 
-	scap_dump_flush(m_dumper);
+	m_writer->flush();
 }
@@ -54,6 +54,15 @@ public:
 	*/
 	void open(const string& filename, bool compress);
 
+	/*!
+	  \brief Like \ref open(const string&, bool), with a choice of the
+	   tracefile format.
+
+	  \note The options set with \ref sinsp::set_dump_options() apply to
+	   this file too.
+	*/
+	void open(const string& filename, compression_mode compress);
+
 	/*!
 	  \brief Return the current size of a tracefile.
 
@@ -75,7 +84,7 @@ public:
 
 private:
 	sinsp* m_inspector;
-	scap_dumper_t* m_dumper;
+	sinsp_dump_writer* m_writer;
 };
 
 /*@}*/
@@ -0,0 +1,627 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+#include "../libscap/scap.h"
+#include "dumpwriter.h"
+
+//
+// Records in the ring are aligned to 8 bytes
+//
+#define RECORD_ALIGN(len) (((len) + 7) & ~7)
+
+//
+// How long the writer sleeps when the queue is empty. Events don't wake it
+// up, only control records and a capture waiting for room do.
+//
+#define WRITER_IDLE_WAIT_MS 10
+
+//
+// How many records the writer processes before updating the file size that
+// written_bytes() returns. Getting the size of a file costs a system call.
+//
+#define WRITER_PUBLISH_INTERVAL 256
+
+//
+// How many events the capture writes between two samples of the queue depth
+//
+#define QUEUE_DEPTH_SAMPLE_INTERVAL 256
+
+sinsp_dump_writer::sinsp_dump_writer(sinsp* inspector, bool async, uint64_t queue_size)
+{
+	m_inspector = inspector;
+	m_async = async;
+	m_is_open = false;
+	m_n_evts = 0;
+	m_n_files = 0;
+	m_dumper = NULL;
+	m_queue = NULL;
+	m_queue_size = 0;
+	m_head = 0;
+	m_tail = 0;
+	m_stop = false;
+	m_failed = false;
+	m_capture_waiting = false;
+	m_cached_tail = 0;
+	m_file_seq = 0;
+	m_file_queued = 0;
+	m_max_queue_depth = 0;
+	m_n_stalls = 0;
+	m_stall_ns = 0;
+	m_written_file_seq = 0;
+	m_written_off = 0;
+	m_written_consumed = 0;
+	m_writer_snapshot = NULL;
+	m_writer_dumper = NULL;
+	m_writer_file_seq = 0;
+	m_writer_consumed = 0;
+
+	if(m_async)
+	{
+		m_queue_size = RECORD_ALIGN(queue_size);
+		m_queue = new char[m_queue_size];
+		m_thread = std::thread(&sinsp_dump_writer::run, this);
+	}
+}
+
+sinsp_dump_writer::~sinsp_dump_writer()
+{
+	if(m_async)
+	{
+		//
+		// The writer empties the queue before leaving, closing the last file
+		//
+		close();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+			m_cond.notify_one();
+		}
+
+		m_thread.join();
+
+		if(m_failed)
+		{
+			g_logger.log("dump error: " + m_error, sinsp_logger::SEV_ERROR);
+		}
+
+		delete[] m_queue;
+	}
+	else
+	{
+		close();
+	}
+}
+
+void sinsp_dump_writer::open(const string& filename, const scap_dump_params& params)
+{
+	if(m_inspector->m_h == NULL)
+	{
+		throw sinsp_exception("can't start event dump, inspector not opened yet");
+	}
+
+	if(!m_async)
+	{
+		close();
+
+		m_dumper = scap_dump_open_ex(m_inspector->m_h, filename.c_str(), &params);
+		if(m_dumper == NULL)
+		{
+			throw sinsp_exception(scap_getlasterr(m_inspector->m_h));
+		}
+	}
+	else
+	{
+		char error[SCAP_LASTERR_SIZE];
+		open_record orec;
+
+		check_error();
+
+		orec.m_snapshot = scap_dump_snapshot(m_inspector->m_h, error);
+		if(orec.m_snapshot == NULL)
+		{
+			throw sinsp_exception(error);
+		}
+
+		orec.m_params = params;
+		orec.m_params.async = false;
+
+		//
+		// The file name follows the record, including its terminator
+		//
+		string payload((const char*)&orec, sizeof(orec));
+		payload.append(filename.c_str(), filename.size() + 1);
+
+		push_control(RT_OPEN, payload.data(), (uint32_t)payload.size());
+
+		m_file_seq++;
+		m_file_queued = 0;
+	}
+
+	m_is_open = true;
+	m_n_files++;
+
+	m_inspector->m_container_manager.dump_containers(this);
+}
+
+void sinsp_dump_writer::close()
+{
+	if(!m_is_open)
+	{
+		return;
+	}
+
+	m_is_open = false;
+
+	if(!m_async)
+	{
+		scap_dump_close(m_dumper);
+		m_dumper = NULL;
+	}
+	else
+	{
+		push_control(RT_CLOSE, NULL, 0);
+	}
+}
+
+void sinsp_dump_writer::dump(scap_evt* evt, uint16_t cpuid, uint32_t flags)
+{
+	if(!m_is_open)
+	{
+		throw sinsp_exception("dumper not opened yet");
+	}
+
+	if(!m_async)
+	{
+		if(scap_dump(m_inspector->m_h, m_dumper, evt, cpuid, flags) != SCAP_SUCCESS)
+		{
+			throw sinsp_exception(scap_getlasterr(m_inspector->m_h));
+		}
+	}
+	else
+	{
+		uint32_t len = RECORD_ALIGN(sizeof(record_header) + evt->len);
+		int32_t blocklen;
+		record_header* hdr;
+
+		check_error();
+
+		hdr = (record_header*)reserve(len);
+		hdr->m_type = RT_EVT;
+		hdr->m_len = len;
+		hdr->m_flags = flags;
+		hdr->m_cpuid = cpuid;
+		memcpy(hdr + 1, evt, evt->len);
+		commit(len);
+
+		scap_number_of_bytes_to_write(evt, cpuid, &blocklen);
+		m_file_queued += blocklen;
+	}
+
+	m_n_evts++;
+}
+
+uint64_t sinsp_dump_writer::written_bytes()
+{
+	if(!m_is_open)
+	{
+		throw sinsp_exception("dumper not opened yet");
+	}
+
+	if(!m_async)
+	{
+		int64_t written_bytes = scap_dump_get_offset(m_dumper);
+		if(written_bytes == -1)
+		{
+			throw sinsp_exception("error getting offset");
+		}
+
+		return written_bytes;
+	}
+
+	//
+	// Until the writer has reached the current file, only count what has
+	// been queued for it. The writer stores m_written_consumed before
+	// m_written_off, so the result can be smaller than the real size, but
+	// never larger.
+	//
+	if(m_written_file_seq.load(std::memory_order_acquire) == m_file_seq)
+	{
+		uint64_t off = m_written_off.load(std::memory_order_acquire);
+		uint64_t consumed = m_written_consumed.load(std::memory_order_relaxed);
+
+		if(m_written_file_seq.load(std::memory_order_acquire) == m_file_seq && consumed <= m_file_queued)
+		{
+			return off + m_file_queued - consumed;
+		}
+	}
+
+	return m_file_queued;
+}
+
+void sinsp_dump_writer::flush()
+{
+	if(!m_is_open)
+	{
+		throw sinsp_exception("dumper not opened yet");
+	}
+
+	if(!m_async)
+	{
+		scap_dump_flush(m_dumper);
+		return;
+	}
+
+	push_control(RT_FLUSH, NULL, 0);
+	wait_tail(m_head.load(std::memory_order_relaxed));
+
+	check_error();
+}
+
+void sinsp_dump_writer::get_stats(sinsp_dump_stats* stats)
+{
+	stats->m_n_evts = m_n_evts;
+	stats->m_n_files = m_n_files;
+	stats->m_queue_size = m_queue_size;
+	stats->m_queue_depth = 0;
+	stats->m_max_queue_depth = m_max_queue_depth;
+	stats->m_n_stalls = m_n_stalls;
+	stats->m_stall_ns = m_stall_ns;
+
+	if(m_async)
+	{
+		stats->m_queue_depth = m_head.load(std::memory_order_relaxed) - m_tail.load(std::memory_order_acquire);
+	}
+}
+
+void sinsp_dump_writer::check_error()
+{
+	if(m_failed.load(std::memory_order_acquire))
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		throw sinsp_exception(m_error);
+	}
+}
+
+//
+// Return room for a record of len bytes at the head of the ring, waiting for
+// the writer if needed. A record never wraps around the end of the ring: if
+// it doesn't fit there, the end is skipped.
+//
+char* sinsp_dump_writer::reserve(uint32_t len)
+{
+	uint64_t head = m_head.load(std::memory_order_relaxed);
+	uint64_t contig = m_queue_size - head % m_queue_size;
+	uint64_t needed = (len > contig)? contig + len : len;
+
+	//
+	// With a bigger record, the skipped end plus the record could exceed the
+	// size of the ring
+	//
+	if(len > m_queue_size / 2)
+	{
+		throw sinsp_exception("event too large for the dump queue");
+	}
+
+	//
+	// The position of the writer is read again only when it's needed, and
+	// once in a while to sample the depth of the queue
+	//
+	if(m_queue_size - (head - m_cached_tail) < needed || (m_n_evts % QUEUE_DEPTH_SAMPLE_INTERVAL) == 0)
+	{
+		m_cached_tail = m_tail.load(std::memory_order_acquire);
+
+		if(head - m_cached_tail > m_max_queue_depth)
+		{
+			m_max_queue_depth = head - m_cached_tail;
+		}
+
+		if(m_queue_size - (head - m_cached_tail) < needed)
+		{
+			uint64_t start = sinsp_utils::get_current_time_ns();
+
+			m_n_stalls++;
+			wait_tail(head + needed - m_queue_size);
+
+			m_stall_ns += sinsp_utils::get_current_time_ns() - start;
+		}
+	}
+
+	if(len > contig)
+	{
+		//
+		// The writer skips the end of the ring by itself when there's no
+		// room for a header there
+		//
+		if(contig >= sizeof(record_header))
+		{
+			record_header* pad = (record_header*)(m_queue + head % m_queue_size);
+			pad->m_type = RT_PAD;
+			pad->m_len = (uint32_t)contig;
+		}
+
+		head += contig;
+		m_head.store(head, std::memory_order_release);
+	}
+
+	return m_queue + head % m_queue_size;
+}
+
+void sinsp_dump_writer::commit(uint32_t len)
+{
+	m_head.store(m_head.load(std::memory_order_relaxed) + len, std::memory_order_release);
+}
+
+void sinsp_dump_writer::push_control(record_type type, const char* payload, uint32_t payload_len)
+{
+	uint32_t len = RECORD_ALIGN(sizeof(record_header) + payload_len);
+	record_header* hdr = (record_header*)reserve(len);
+
+	hdr->m_type = type;
+	hdr->m_len = len;
+	hdr->m_flags = 0;
+	hdr->m_cpuid = 0;
+
+	if(payload_len != 0)
+	{
+		memcpy(hdr + 1, payload, payload_len);
+	}
+
+	commit(len);
+	wake_writer();
+}
+
+//
+// Notifying with the lock held makes sure that the writer is either still
+// checking the queue, and sees what was just committed, or already waiting
+//
+void sinsp_dump_writer::wake_writer()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_cond.notify_one();
+}
+
+//
+// Wait until the writer has moved past the given position of the ring
+//
+void sinsp_dump_writer::wait_tail(uint64_t tail)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	//
+	// The writer checks m_capture_waiting after storing m_tail, and the
+	// predicate reads m_tail after setting it. Both are sequentially
+	// consistent, so either the writer sees the flag and notifies, or the
+	// predicate sees the new tail.
+	//
+	m_capture_waiting.store(true);
+	m_cond.notify_one();
+
+	m_space_cond.wait(lock, [this, tail]
+	{
+		m_cached_tail = m_tail.load();
+		return m_cached_tail >= tail;
+	});
+
+	m_capture_waiting.store(false, std::memory_order_relaxed);
+}
+
+//
+// Writer side of wait_tail()
+//
+void sinsp_dump_writer::writer_advance(uint64_t tail)
+{
+	m_tail.store(tail);
+
+	if(m_capture_waiting.load())
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_space_cond.notify_one();
+	}
+}
+
+//
+// Writer thread
+//
+void sinsp_dump_writer::run()
+{
+	uint32_t nrecords = 0;
+
+	while(true)
+	{
+		uint64_t tail = m_tail.load(std::memory_order_relaxed);
+		uint64_t head = m_head.load(std::memory_order_acquire);
+
+		if(tail == head)
+		{
+			writer_publish();
+			nrecords = 0;
+
+			//
+			// Records committed just before the stop, like the last close,
+			// may not have been seen yet. Leave only when the queue is empty
+			// after the stop is seen.
+			//
+			if(m_stop)
+			{
+				if(m_head.load(std::memory_order_acquire) != tail)
+				{
+					continue;
+				}
+
+				break;
+			}
+
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_cond.wait_for(lock, std::chrono::milliseconds(WRITER_IDLE_WAIT_MS), [this, tail]
+			{
+				return m_stop || m_head.load(std::memory_order_acquire) != tail;
+			});
+			continue;
+		}
+
+		while(tail != head)
+		{
+			uint64_t contig = m_queue_size - tail % m_queue_size;
+			record_header* hdr;
+
+			if(contig < sizeof(record_header))
+			{
+				tail += contig;
+				continue;
+			}
+
+			hdr = (record_header*)(m_queue + tail % m_queue_size);
+
+			switch(hdr->m_type)
+			{
+			case RT_EVT:
+				{
+					scap_evt* evt = (scap_evt*)(hdr + 1);
+					int32_t blocklen;
+
+					if(m_writer_dumper != NULL)
+					{
+						if(scap_dump(m_writer_snapshot, m_writer_dumper, evt, hdr->m_cpuid, hdr->m_flags) != SCAP_SUCCESS)
+						{
+							writer_fail(scap_getlasterr(m_writer_snapshot));
+						}
+					}
+
+					scap_number_of_bytes_to_write(evt, hdr->m_cpuid, &blocklen);
+					m_writer_consumed += blocklen;
+				}
+				break;
+			case RT_OPEN:
+				{
+					open_record orec;
+
+					memcpy(&orec, hdr + 1, sizeof(orec));
+					writer_open(&orec, (const char*)(hdr + 1) + sizeof(orec));
+				}
+				break;
+			case RT_CLOSE:
+				writer_close();
+				break;
+			case RT_FLUSH:
+				if(m_writer_dumper != NULL)
+				{
+					scap_dump_flush(m_writer_dumper);
+				}
+				break;
+			case RT_PAD:
+				break;
+			default:
+				ASSERT(false);
+				break;
+			}
+
+			tail += hdr->m_len;
+			writer_advance(tail);
+
+			if(++nrecords == WRITER_PUBLISH_INTERVAL)
+			{
+				writer_publish();
+				nrecords = 0;
+			}
+		}
+
+		writer_advance(tail);
+	}
+
+	writer_close();
+}
+
+void sinsp_dump_writer::writer_open(open_record* orec, const char* filename)
+{
+	writer_close();
+
+	m_writer_file_seq++;
+	m_writer_consumed = 0;
+	m_writer_snapshot = orec->m_snapshot;
+
+	//
+	// After a failure, the remaining files are not written, but the queue
+	// keeps being emptied
+	//
+	if(!m_failed.load(std::memory_order_relaxed))
+	{
+		m_writer_dumper = scap_dump_open_ex(m_writer_snapshot, filename, &orec->m_params);
+		if(m_writer_dumper == NULL)
+		{
+			writer_fail(scap_getlasterr(m_writer_snapshot));
+		}
+	}
+
+	writer_publish();
+	m_written_file_seq.store(m_writer_file_seq, std::memory_order_release);
+}
+
+void sinsp_dump_writer::writer_close()
+{
+	if(m_writer_dumper != NULL)
+	{
+		scap_dump_close(m_writer_dumper);
+		m_writer_dumper = NULL;
+	}
+
+	if(m_writer_snapshot != NULL)
+	{
+		scap_dump_snapshot_free(m_writer_snapshot);
+		m_writer_snapshot = NULL;
+	}
+}
+
+void sinsp_dump_writer::writer_publish()
+{
+	m_written_consumed.store(m_writer_consumed, std::memory_order_relaxed);
+
+	if(m_writer_dumper != NULL)
+	{
+		m_written_off.store(scap_dump_get_offset(m_writer_dumper), std::memory_order_release);
+	}
+	else
+	{
+		m_written_off.store(0, std::memory_order_release);
+	}
+}
+
+void sinsp_dump_writer::writer_fail(const char* error)
+{
+	if(m_failed.load(std::memory_order_relaxed))
+	{
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_error = error;
+	}
+
+	m_failed.store(true, std::memory_order_release);
+
+	if(m_writer_dumper != NULL)
+	{
+		scap_dump_close(m_writer_dumper);
+		m_writer_dumper = NULL;
+	}
+}
@@ -0,0 +1,196 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class sinsp;
+
+/** @defgroup dump Dumping events to disk
+ *  @{
+ */
+
+/*!
+  \brief Counters of the event dump, returned by \ref sinsp::get_dump_stats().
+*/
+typedef struct sinsp_dump_stats
+{
+	uint64_t m_n_evts; ///< Number of events passed to the dump.
+	uint64_t m_n_files; ///< Number of files that have been opened.
+	uint64_t m_queue_size; ///< Size of the queue toward the writer thread, in bytes. 0 if the dump is synchronous.
+	uint64_t m_queue_depth; ///< Bytes currently in the queue.
+	uint64_t m_max_queue_depth; ///< Highest value of m_queue_depth seen so far.
+	uint64_t m_n_stalls; ///< Number of times the capture had to wait for room in the queue.
+	uint64_t m_stall_ns; ///< Total time the capture spent waiting for room in the queue.
+}sinsp_dump_stats;
+
+/*!
+  \brief Writes events to a sequence of trace files, either directly or from
+   a background thread.
+
+  In asynchronous mode, events are copied into a single-producer
+  single-consumer ring, and a writer thread takes them out and calls
+  scap_dump(). Opening a file only takes a snapshot of the tables that go at
+  its beginning: the writer does the slow part, which includes reading /proc
+  for live captures, so a rollover doesn't block the capture. If the ring
+  fills up, the capture sleeps until the writer makes room, and the wait is
+  counted in the stats.
+
+  Errors of the writer thread are reported by the next call to
+  \ref dump() or \ref flush().
+*/
+class SINSP_PUBLIC sinsp_dump_writer
+{
+public:
+	sinsp_dump_writer(sinsp* inspector, bool async, uint64_t queue_size = DUMP_WRITER_QUEUE_SIZE);
+	~sinsp_dump_writer();
+
+	/*!
+	  \brief Start a new file. The current one, if any, is closed.
+	*/
+	void open(const string& filename, const scap_dump_params& params);
+
+	/*!
+	  \brief Close the current file. In asynchronous mode, the file is closed
+	   by the writer after the events that are still in the queue.
+	*/
+	void close();
+
+	bool is_open()
+	{
+		return m_is_open;
+	}
+
+	/*!
+	  \brief Write an event to the current file.
+	*/
+	void dump(scap_evt* evt, uint16_t cpuid, uint32_t flags);
+
+	/*!
+	  \brief Return the size of the current file, including the events that
+	   haven't been written yet, which are counted uncompressed.
+	*/
+	uint64_t written_bytes();
+
+	/*!
+	  \brief Wait until all the queued events are in the file.
+	*/
+	void flush();
+
+	void get_stats(sinsp_dump_stats* stats);
+
+private:
+	enum record_type
+	{
+		RT_EVT,
+		RT_OPEN,
+		RT_CLOSE,
+		RT_FLUSH,
+		RT_PAD, // Fills the end of the ring when a record doesn't fit there
+	};
+
+	struct record_header
+	{
+		uint32_t m_type;
+		uint32_t m_len; // Total length of the record, header included
+		uint32_t m_flags;
+		uint16_t m_cpuid;
+	};
+
+	//
+	// RT_OPEN payload, followed by the file name
+	//
+	struct open_record
+	{
+		scap_t* m_snapshot;
+		scap_dump_params m_params;
+	};
+
+	void check_error();
+	char* reserve(uint32_t len);
+	void commit(uint32_t len);
+	void push_control(record_type type, const char* payload, uint32_t payload_len);
+	void wake_writer();
+	void wait_tail(uint64_t tail);
+
+	void run();
+	void writer_advance(uint64_t tail);
+	void writer_open(open_record* orec, const char* filename);
+	void writer_close();
+	void writer_publish();
+	void writer_fail(const char* error);
+
+	sinsp* m_inspector;
+	bool m_async;
+	bool m_is_open;
+	uint64_t m_n_evts;
+	uint64_t m_n_files;
+
+	//
+	// Synchronous mode
+	//
+	scap_dumper_t* m_dumper;
+
+	//
+	// Asynchronous mode. m_head is only written by the capture and m_tail
+	// only by the writer.
+	//
+	char* m_queue;
+	uint64_t m_queue_size;
+	std::atomic<uint64_t> m_head;
+	std::atomic<uint64_t> m_tail;
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_cond; // Wakes up the writer when it's idle
+	std::condition_variable m_space_cond; // Wakes up the capture when the writer advances m_tail
+	std::atomic<bool> m_capture_waiting; // The capture is waiting on m_space_cond
+	std::atomic<bool> m_stop;
+	std::atomic<bool> m_failed;
+	string m_error; // Protected by m_mutex
+
+	//
+	// Capture side
+	//
+	uint64_t m_cached_tail;
+	uint64_t m_file_seq; // Incremented at every open()
+	uint64_t m_file_queued; // Bytes of the current file pushed to the queue
+	uint64_t m_max_queue_depth;
+	uint64_t m_n_stalls;
+	uint64_t m_stall_ns;
+
+	//
+	// Published by the writer for written_bytes()
+	//
+	std::atomic<uint64_t> m_written_file_seq;
+	std::atomic<uint64_t> m_written_off;
+	std::atomic<uint64_t> m_written_consumed;
+
+	//
+	// Writer side
+	//
+	scap_t* m_writer_snapshot;
+	scap_dumper_t* m_writer_dumper;
+	uint64_t m_writer_file_seq;
+	uint64_t m_writer_consumed;
+};
+
+/*@}*/
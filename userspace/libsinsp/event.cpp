@@ -60,6 +60,8 @@ sinsp_evt::sinsp_evt() :
 	m_paramstr_storage(256), m_resolved_paramstr_storage(1024)
 {
 	m_flags = EF_NONE;
+	m_nparams_loaded = 0;
+	m_dump_flags = 0;
 	m_tinfo = NULL;
 #ifdef _DEBUG
 	m_filtered_out = false;
@@ -72,6 +74,8 @@ sinsp_evt::sinsp_evt(sinsp *inspector) :
 {
 	m_inspector = inspector;
 	m_flags = EF_NONE;
+	m_nparams_loaded = 0;
+	m_dump_flags = 0;
 	m_tinfo = NULL;
 #ifdef _DEBUG
 	m_filtered_out = false;
@@ -102,7 +106,7 @@ uint64_t sinsp_evt::get_ts()
 
 uint32_t sinsp_evt::get_dump_flags()
 {
-	return scap_event_get_dump_flags(m_inspector->m_h);
+	return m_dump_flags;
 }
 
 const char *sinsp_evt::get_name()
@@ -158,36 +162,8 @@ int64_t sinsp_evt::get_fd_num()
 }
 
 
-uint32_t sinsp_evt::get_num_params()
-{
-	if((m_flags & sinsp_evt::SINSP_EF_PARAMS_LOADED) == 0)
-	{
-		load_params();
-		m_flags |= (uint32_t)sinsp_evt::SINSP_EF_PARAMS_LOADED;
-	}
-
-	return (uint32_t)m_params.size();
-}
-
-sinsp_evt_param *sinsp_evt::get_param(uint32_t id)
-{
-	if((m_flags & sinsp_evt::SINSP_EF_PARAMS_LOADED) == 0)
-	{
-		load_params();
-		m_flags |= (uint32_t)sinsp_evt::SINSP_EF_PARAMS_LOADED;
-	}
-
-	return &(m_params[id]);
-}
-
 const char *sinsp_evt::get_param_name(uint32_t id)
 {
-	if((m_flags & sinsp_evt::SINSP_EF_PARAMS_LOADED) == 0)
-	{
-		load_params();
-		m_flags |= (uint32_t)sinsp_evt::SINSP_EF_PARAMS_LOADED;
-	}
-
 	ASSERT(id < m_info->nparams);
 
 	return m_info->params[id].name;
@@ -195,12 +171,6 @@ const char *sinsp_evt::get_param_name(uint32_t id)
 
 const struct ppm_param_info* sinsp_evt::get_param_info(uint32_t id)
 {
-	if((m_flags & sinsp_evt::SINSP_EF_PARAMS_LOADED) == 0)
-	{
-		load_params();
-		m_flags |= (uint32_t)sinsp_evt::SINSP_EF_PARAMS_LOADED;
-	}
-
 	ASSERT(id < m_info->nparams);
 
 	return &(m_info->params[id]);
@@ -731,15 +701,6 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 	uint16_t payload_len;
 	Json::Value ret;
 
-	//
-	// Make sure the params are actually loaded
-	//
-	if((m_flags & sinsp_evt::SINSP_EF_PARAMS_LOADED) == 0)
-	{
-		load_params();
-		m_flags |= (uint32_t)sinsp_evt::SINSP_EF_PARAMS_LOADED;
-	}
-
 	//
 	// Reset the resolved string
 	//
@@ -748,7 +709,7 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 	//
 	// Get the parameter
 	//
-	sinsp_evt_param *param = &(m_params[id]);
+	sinsp_evt_param *param = get_param(id);
 	payload = param->m_val;
 	payload_len = param->m_len;
 	param_info = &(m_info->params[id]);
@@ -821,7 +782,7 @@ Json::Value sinsp_evt::get_param_as_json(uint32_t id, OUT const char** resolved_
 			sinsp_threadinfo* atinfo = m_inspector->get_thread(*(int64_t *)payload, false, true);
 			if(atinfo != NULL)
 			{
-				string& tcomm = atinfo->m_comm;
+				const string& tcomm = atinfo->m_comm;
 
 				//
 				// Make sure the string will fit
@@ -1363,15 +1324,6 @@ const char* sinsp_evt::get_param_as_str(uint32_t id, OUT const char** resolved_s
 	uint16_t payload_len;
 	ASSERT(id < m_info->nparams);
 
-	//
-	// Make sure the params are actually loaded
-	//
-	if((m_flags & sinsp_evt::SINSP_EF_PARAMS_LOADED) == 0)
-	{
-		load_params();
-		m_flags |= (uint32_t)sinsp_evt::SINSP_EF_PARAMS_LOADED;
-	}
-
 	//
 	// Reset the resolved string
 	//
@@ -1380,7 +1332,7 @@ const char* sinsp_evt::get_param_as_str(uint32_t id, OUT const char** resolved_s
 	//
 	// Get the parameter
 	//
-	sinsp_evt_param *param = &(m_params[id]);
+	sinsp_evt_param *param = get_param(id);
 	payload = param->m_val;
 	payload_len = param->m_len;
 	param_info = &(m_info->params[id]);
@@ -1458,7 +1410,7 @@ const char* sinsp_evt::get_param_as_str(uint32_t id, OUT const char** resolved_s
 			sinsp_threadinfo* atinfo = m_inspector->get_thread(*(int64_t *)payload, false, true);
 			if(atinfo != NULL)
 			{
-				string& tcomm = atinfo->m_comm;
+				const string& tcomm = atinfo->m_comm;
 
 				//
 				// Make sure the string will fit
@@ -2291,15 +2243,6 @@ const char* sinsp_evt::get_param_value_str(const char* name, OUT const char** re
 
 const sinsp_evt_param* sinsp_evt::get_param_value_raw(const char* name)
 {
-	//
-	// Make sure the params are actually loaded
-	//
-	if((m_flags & sinsp_evt::SINSP_EF_PARAMS_LOADED) == 0)
-	{
-		load_params();
-		m_flags |= (uint32_t)sinsp_evt::SINSP_EF_PARAMS_LOADED;
-	}
-
 	//
 	// Locate the parameter given the name
 	//
@@ -2309,7 +2252,7 @@ const sinsp_evt_param* sinsp_evt::get_param_value_raw(const char* name)
 	{
 		if(strcmp(name, get_param_name(j)) == 0)
 		{
-			return &(m_params[j]);
+			return get_param(j);
 		}
 	}
 
@@ -241,7 +241,10 @@ public:
 	/*!
 	  \brief Return the number of parameters that this event has.
 	*/
-	uint32_t get_num_params();
+	inline uint32_t get_num_params()
+	{
+		return m_info->nparams;
+	}
 
 	/*!
 	  \brief Get the name of one of the event parameters, e.g. 'fd' or 'addr'.
@@ -264,8 +267,19 @@ public:
 	  \brief Get a parameter in raw format.
 
 	  \param id The parameter number.
+
+	  \note The parameters are located on demand: the offset of a parameter
+	   is computed the first time it, or one that follows it, is requested.
 	*/
-	sinsp_evt_param* get_param(uint32_t id);
+	inline sinsp_evt_param* get_param(uint32_t id)
+	{
+		if(id >= m_nparams_loaded)
+		{
+			load_params(id);
+		}
+
+		return &(m_params[id]);
+	}
 
 	/*!
 	  \brief Get a parameter in raw format.
@@ -323,6 +337,7 @@ private:
 	inline void init()
 	{
 		m_flags = EF_NONE;
+		m_nparams_loaded = 0;
 		m_info = &(m_event_info_table[m_pevt->type]);
 		m_tinfo = NULL;
 		m_fdinfo = NULL;
@@ -332,6 +347,7 @@ private:
 	inline void init(uint8_t* evdata, uint16_t cpuid)
 	{
 		m_flags = EF_NONE;
+		m_nparams_loaded = 0;
 		m_pevt = (scap_evt *)evdata;
 		m_info = &(m_event_info_table[m_pevt->type]);
 		m_tinfo = NULL;
@@ -341,23 +357,33 @@ private:
 		m_evtnum = 0;
 		m_poriginal_evt = NULL;
 	}
-	inline void load_params()
+	//
+	// Locate the parameters up to and including id, starting from the
+	// first one that hasn't been located yet. Each parameter follows the
+	// previous one, so this is just a running sum of the lens array.
+	//
+	inline void load_params(uint32_t id)
 	{
-		uint32_t j;
-		uint32_t nparams;
-		sinsp_evt_param par;
-
-		nparams = m_info->nparams;
+		uint32_t j = m_nparams_loaded;
 		uint16_t *lens = (uint16_t *)((char *)m_pevt + sizeof(struct ppm_evt_hdr));
-		char *valptr = (char *)lens + nparams * sizeof(uint16_t);
-		m_params.clear();
+		char *valptr;
 
-		for(j = 0; j < nparams; j++)
+		if(j == 0)
+		{
+			valptr = (char *)lens + m_info->nparams * sizeof(uint16_t);
+		}
+		else
 		{
-			par.init(valptr, lens[j]);
-			m_params.push_back(par);
+			valptr = m_params[j - 1].m_val + m_params[j - 1].m_len;
+		}
+
+		for(; j <= id; j++)
+		{
+			m_params[j].init(valptr, lens[j]);
 			valptr += lens[j];
 		}
+
+		m_nparams_loaded = j;
 	}
 	string get_param_value_str(uint32_t id, bool resolved);
 	string get_param_value_str(const char* name, bool resolved = true);
@@ -369,7 +395,6 @@ VISIBILITY_PRIVATE
 	enum flags
 	{
 		SINSP_EF_NONE = 0,
-		SINSP_EF_PARAMS_LOADED = 1,
 		SINSP_EF_IS_TRACER = (1 << 1),
 	};
 
@@ -378,11 +403,12 @@ VISIBILITY_PRIVATE
 	scap_evt* m_poriginal_evt;	// This is used when the original event is replaced by a different one (e.g. in the case of user events)
 	uint16_t m_cpuid;
 	uint64_t m_evtnum;
+	uint32_t m_dump_flags;
 	uint32_t m_flags;
 	int32_t m_check_id = 0;
-	bool m_params_loaded;
 	const struct ppm_event_info* m_info;
-	vector<sinsp_evt_param> m_params;
+	uint32_t m_nparams_loaded; // Parameters of m_params that have been located
+	sinsp_evt_param m_params[PPM_MAX_EVENT_PARAMS];
 
 	vector<char> m_paramstr_storage;
 	vector<char> m_resolved_paramstr_storage;
@@ -139,7 +139,10 @@ void sinsp_evt_formatter::set_format(const string& fmt)
 
 			m_chks_to_free.push_back(chk);
 
-			j += chk->parse_field_name(cfmt + j + 1, true);
+			int32_t fldlen = chk->parse_field_name(cfmt + j + 1, true);
+			chk->m_field_name = string(cfmt + j + 1, fldlen);
+
+			j += fldlen;
 			ASSERT(j <= lfmt.length());
 
 			m_tokens.push_back(chk);
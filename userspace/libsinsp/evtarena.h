@@ -0,0 +1,291 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// The storage of the enter events that the parsers keep until the matching
+// exit event arrives.
+//
+// The buffers come in size classes, from 32 bytes up to SP_EVT_BUF_SIZE, so
+// that an event takes a buffer close to its size. Each class has a free
+// list, and the slabs that the buffers are carved from are shared by all the
+// threads of the inspector: the memory follows the number of syscalls in
+// flight, not the number of threads that ever made one. trim() gives back
+// the slabs that a burst of syscalls left empty.
+///////////////////////////////////////////////////////////////////////////////
+class sinsp_evt_arena
+{
+private:
+	static const uint32_t MIN_BUF_SIZE = 32;
+	static const uint32_t NCLASSES = 8;
+	static_assert((MIN_BUF_SIZE << (NCLASSES - 1)) == SP_EVT_BUF_SIZE,
+		"the biggest class must match SP_EVT_BUF_SIZE");
+
+	//
+	// Every buffer is preceded by its size class and by the index of its
+	// slab. The header is 8 bytes long to keep the event data aligned.
+	//
+	struct header
+	{
+		uint32_t m_class;
+		uint32_t m_slab;
+	};
+
+	struct slab
+	{
+		uint8_t* m_data;
+		uint32_t m_len;
+		uint32_t m_class;
+		uint32_t m_nused; // Buffers of the slab currently in use
+		bool m_trim; // Set by trim() for the slabs that it frees
+	};
+
+	//
+	// Free buffers are linked through their data
+	//
+	struct free_buf
+	{
+		free_buf* m_next;
+	};
+
+public:
+	sinsp_evt_arena():
+		m_size(0),
+		m_used(0)
+	{
+		for(uint32_t j = 0; j < NCLASSES; j++)
+		{
+			m_free[j] = NULL;
+		}
+	}
+
+	~sinsp_evt_arena()
+	{
+		for(size_t j = 0; j < m_slabs.size(); j++)
+		{
+			delete[] m_slabs[j].m_data;
+		}
+	}
+
+	sinsp_evt_arena(const sinsp_evt_arena&) = delete;
+	sinsp_evt_arena& operator=(const sinsp_evt_arena&) = delete;
+
+	//
+	// Return a buffer that can hold at least len bytes, or NULL if len is
+	// bigger than SP_EVT_BUF_SIZE
+	//
+	uint8_t* reserve(uint32_t len)
+	{
+		uint32_t cl = 0;
+
+		while((MIN_BUF_SIZE << cl) < len)
+		{
+			if(++cl == NCLASSES)
+			{
+				return NULL;
+			}
+		}
+
+		if(m_free[cl] == NULL)
+		{
+			refill(cl);
+		}
+
+		free_buf* res = m_free[cl];
+		m_free[cl] = res->m_next;
+		m_slabs[((header*)res - 1)->m_slab].m_nused++;
+		m_used += MIN_BUF_SIZE << cl;
+		return (uint8_t*)res;
+	}
+
+	void release(uint8_t* buf)
+	{
+		header* hdr = (header*)buf - 1;
+		free_buf* fb = (free_buf*)buf;
+
+		fb->m_next = m_free[hdr->m_class];
+		m_free[hdr->m_class] = fb;
+		m_slabs[hdr->m_slab].m_nused--;
+		m_used -= MIN_BUF_SIZE << hdr->m_class;
+	}
+
+	//
+	// Free the slabs that have no buffer in use, except reserve_slabs of
+	// them for each size class, so that the next burst doesn't allocate
+	// right away. This walks the free lists, so it's meant to be called once
+	// in a while rather than for every event.
+	//
+	void trim(uint32_t reserve_slabs)
+	{
+		uint32_t nempty[NCLASSES] = {0};
+		bool classes[NCLASSES] = {false};
+		bool found = false;
+		size_t j;
+		size_t k;
+
+		for(j = 0; j < m_slabs.size(); j++)
+		{
+			slab* sl = &m_slabs[j];
+
+			if(sl->m_nused == 0 && ++nempty[sl->m_class] > reserve_slabs)
+			{
+				sl->m_trim = true;
+				classes[sl->m_class] = true;
+				found = true;
+			}
+		}
+
+		if(!found)
+		{
+			return;
+		}
+
+		//
+		// Unlink the buffers of those slabs from the free lists
+		//
+		for(uint32_t cl = 0; cl < NCLASSES; cl++)
+		{
+			if(!classes[cl])
+			{
+				continue;
+			}
+
+			free_buf** pnext = &m_free[cl];
+
+			while(*pnext != NULL)
+			{
+				if(m_slabs[((header*)*pnext - 1)->m_slab].m_trim)
+				{
+					*pnext = (*pnext)->m_next;
+				}
+				else
+				{
+					pnext = &(*pnext)->m_next;
+				}
+			}
+		}
+
+		//
+		// Free them, and renumber the buffers of the slabs that move down
+		//
+		for(j = 0, k = 0; j < m_slabs.size(); j++)
+		{
+			if(m_slabs[j].m_trim)
+			{
+				m_size -= m_slabs[j].m_len;
+				delete[] m_slabs[j].m_data;
+				continue;
+			}
+
+			if(k != j)
+			{
+				m_slabs[k] = m_slabs[j];
+				set_slab_index(k);
+			}
+
+			k++;
+		}
+
+		m_slabs.resize(k);
+	}
+
+	//
+	// Number of bytes that a buffer returned by reserve() can hold
+	//
+	static uint32_t get_buf_size(const uint8_t* buf)
+	{
+		return MIN_BUF_SIZE << ((const header*)buf - 1)->m_class;
+	}
+
+	//
+	// Bytes allocated for the slabs
+	//
+	uint64_t get_size() const
+	{
+		return m_size;
+	}
+
+	uint32_t get_nslabs() const
+	{
+		return (uint32_t)m_slabs.size();
+	}
+
+	//
+	// Bytes of the buffers currently in use
+	//
+	uint64_t get_used() const
+	{
+		return m_used;
+	}
+
+private:
+	//
+	// Carve a new slab into buffers of the given class
+	//
+	void refill(uint32_t cl)
+	{
+		uint32_t stride = sizeof(header) + (MIN_BUF_SIZE << cl);
+		uint32_t nbufs = SP_EVT_ARENA_SLAB_SIZE / stride;
+		slab sl;
+
+		sl.m_data = new uint8_t[nbufs * stride];
+		sl.m_len = nbufs * stride;
+		sl.m_class = cl;
+		sl.m_nused = 0;
+		sl.m_trim = false;
+
+		m_slabs.reserve(m_slabs.size() + 1);
+		m_slabs.push_back(sl);
+		m_size += sl.m_len;
+
+		for(uint32_t j = 0; j < nbufs; j++)
+		{
+			header* hdr = (header*)(sl.m_data + j * stride);
+			free_buf* fb = (free_buf*)(hdr + 1);
+
+			hdr->m_class = cl;
+			hdr->m_slab = (uint32_t)(m_slabs.size() - 1);
+			fb->m_next = m_free[cl];
+			m_free[cl] = fb;
+		}
+	}
+
+	//
+	// Update the slab index in the headers of the buffers of a slab that
+	// moved in m_slabs
+	//
+	void set_slab_index(uint32_t idx)
+	{
+		slab* sl = &m_slabs[idx];
+		uint32_t stride = sizeof(header) + (MIN_BUF_SIZE << sl->m_class);
+
+		for(uint32_t off = 0; off + stride <= sl->m_len; off += stride)
+		{
+			((header*)(sl->m_data + off))->m_slab = idx;
+		}
+	}
+
+	free_buf* m_free[NCLASSES];
+	std::vector<slab> m_slabs;
+	uint64_t m_size;
+	uint64_t m_used;
+};
@@ -0,0 +1,166 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures the latency of sinsp::get_thread() with thread tables of
+// different sizes. Three access patterns are timed: a few threads that
+// interleave, like the ones that are busy on the CPUs at a given time, random
+// threads of the table, and threads that are not in the table.
+//
+// Usage: sinsp-threadtable [lookups per pattern]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+//
+// The benchmark fills the table directly, without a capture
+//
+#define VISIBILITY_PRIVATE public:
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+#define DEFAULT_NLOOKUPS 10000000
+#define NHOT_THREADS 16
+
+static uint64_t get_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//
+// Time the lookups of the given tids, cycling through them. Returns the
+// average time of a lookup in nanoseconds, and the number of lookups that
+// found a thread in *nfound.
+//
+static double time_lookups(sinsp* inspector, const vector<int64_t>& tids, uint64_t nlookups, uint64_t* nfound)
+{
+	uint64_t found = 0;
+	uint64_t start = get_time_ns();
+	size_t pos = 0;
+
+	for(uint64_t j = 0; j < nlookups; j++)
+	{
+		if(inspector->get_thread(tids[pos], false, false) != NULL)
+		{
+			found++;
+		}
+
+		if(++pos == tids.size())
+		{
+			pos = 0;
+		}
+	}
+
+	*nfound = found;
+	return (double)(get_time_ns() - start) / nlookups;
+}
+
+static int run(uint32_t nthreads, uint64_t nlookups)
+{
+	sinsp inspector;
+	vector<int64_t> tids;
+	vector<int64_t> hot;
+	vector<int64_t> random_tids;
+	vector<int64_t> missing;
+	uint32_t seed = 12345;
+	uint64_t nfound;
+	uint32_t j;
+
+	inspector.m_max_thread_table_size = nthreads + 1;
+
+	//
+	// The tids are spread like the ones of a busy machine, where most of the
+	// old ones are gone
+	//
+	for(j = 0; j < nthreads; j++)
+	{
+		int64_t tid = 1000 + (int64_t)j * 3;
+		sinsp_threadinfo tinfo(&inspector);
+
+		tinfo.m_tid = tid;
+		tinfo.m_pid = tid;
+		tinfo.m_ptid = 1;
+		tinfo.m_comm = "bench";
+		inspector.add_thread(std::move(tinfo));
+		tids.push_back(tid);
+	}
+
+	for(j = 0; j < NHOT_THREADS; j++)
+	{
+		hot.push_back(tids[(tids.size() / NHOT_THREADS) * j]);
+	}
+
+	for(j = 0; j < 1024 * 1024; j++)
+	{
+		seed = seed * 1103515245 + 12345;
+		random_tids.push_back(tids[(seed >> 8) % tids.size()]);
+		missing.push_back(1000 + (int64_t)((seed >> 8) % nthreads) * 3 + 1);
+	}
+
+	double hot_ns = time_lookups(&inspector, hot, nlookups, &nfound);
+	if(nfound != nlookups)
+	{
+		fprintf(stderr, "threads missing from the table\n");
+		return -1;
+	}
+
+	double random_ns = time_lookups(&inspector, random_tids, nlookups, &nfound);
+	if(nfound != nlookups)
+	{
+		fprintf(stderr, "threads missing from the table\n");
+		return -1;
+	}
+
+	double miss_ns = time_lookups(&inspector, missing, nlookups, &nfound);
+	if(nfound != 0)
+	{
+		fprintf(stderr, "found threads that are not in the table\n");
+		return -1;
+	}
+
+	printf("%10u %12.1f %12.1f %12.1f\n", nthreads, hot_ns, random_ns, miss_ns);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	static const uint32_t table_sizes[] = {1000, 50000, 500000};
+	uint64_t nlookups = DEFAULT_NLOOKUPS;
+
+	if(argc > 1)
+	{
+		nlookups = strtoull(argv[1], NULL, 10);
+	}
+
+	printf("%10s %12s %12s %12s\n", "threads", "hot ns", "random ns", "miss ns");
+
+	for(uint32_t j = 0; j < sizeof(table_sizes) / sizeof(table_sizes[0]); j++)
+	{
+		if(run(table_sizes[j], nlookups) != 0)
+		{
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
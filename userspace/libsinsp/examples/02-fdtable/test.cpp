@@ -0,0 +1,184 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures the fd table of a process with the fd layouts that are common on
+// real systems: a small process with the standard fds and a few files, a
+// server with many sockets, a process that moved some fds high up with
+// dup2(), and a process with fds scattered over a large range. For each of
+// them, lookups of random open fds and open/close churn are timed.
+//
+// Usage: sinsp-fdtable [operations per test]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+//
+// The benchmark fills the table directly, without a capture
+//
+#define VISIBILITY_PRIVATE public:
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+#define DEFAULT_NOPS 10000000
+
+static uint64_t get_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t next_rand(uint32_t* seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+struct fd_layout
+{
+	const char* m_name;
+	uint32_t m_nlow; // fds 0..m_nlow - 1
+	uint32_t m_nhigh; // fds right below 10000, like the ones moved by dup2()
+	uint32_t m_nsparse; // fds spread over 0..65535
+};
+
+static int run(const fd_layout* layout, uint64_t nops)
+{
+	sinsp inspector;
+	sinsp_fdtable table(&inspector);
+	sinsp_fdinfo_t fdinfo;
+	vector<int64_t> fds;
+	vector<int64_t> lookups;
+	uint32_t seed = 12345;
+	uint64_t nfound = 0;
+	uint64_t start;
+	uint64_t j;
+
+	inspector.m_max_fdtable_size = 1000000;
+	fdinfo.m_type = SCAP_FD_FILE;
+	fdinfo.m_name = "/tmp/bench";
+
+	for(j = 0; j < layout->m_nlow; j++)
+	{
+		fds.push_back(j);
+	}
+
+	for(j = 0; j < layout->m_nhigh; j++)
+	{
+		fds.push_back(9999 - j);
+	}
+
+	for(j = 0; j < fds.size(); j++)
+	{
+		table.add(fds[j], &fdinfo);
+	}
+
+	for(j = 0; j < layout->m_nsparse; j++)
+	{
+		int64_t fd = next_rand(&seed) % 65536;
+		if(table.find(fd) == NULL)
+		{
+			table.add(fd, &fdinfo);
+			fds.push_back(fd);
+		}
+	}
+
+	for(j = 0; j < 1024 * 1024; j++)
+	{
+		lookups.push_back(fds[next_rand(&seed) % fds.size()]);
+	}
+
+	//
+	// Lookups of open fds
+	//
+	start = get_time_ns();
+
+	for(j = 0; j < nops; j++)
+	{
+		if(table.find(lookups[j & (1024 * 1024 - 1)]) != NULL)
+		{
+			nfound++;
+		}
+	}
+
+	double find_ns = (double)(get_time_ns() - start) / nops;
+
+	if(nfound != nops)
+	{
+		fprintf(stderr, "fds missing from the table\n");
+		return -1;
+	}
+
+	//
+	// Close an open fd and open it again, like a process that keeps
+	// reusing the lowest free fd
+	//
+	start = get_time_ns();
+
+	for(j = 0; j < nops; j++)
+	{
+		int64_t fd = lookups[j & (1024 * 1024 - 1)];
+
+		table.erase(fd);
+		table.add(fd, &fdinfo);
+	}
+
+	double churn_ns = (double)(get_time_ns() - start) / nops;
+
+	if(table.size() != fds.size())
+	{
+		fprintf(stderr, "wrong table size %u, expected %u\n", (uint32_t)table.size(), (uint32_t)fds.size());
+		return -1;
+	}
+
+	printf("%-10s %8u %12.1f %12.1f\n", layout->m_name, (uint32_t)fds.size(), find_ns, churn_ns);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	static const fd_layout layouts[] =
+	{
+		{"small", 12, 0, 0},
+		{"server", 800, 0, 0},
+		{"dup2", 40, 4, 0},
+		{"sparse", 16, 0, 2000},
+	};
+	uint64_t nops = DEFAULT_NOPS;
+
+	if(argc > 1)
+	{
+		nops = strtoull(argv[1], NULL, 10);
+	}
+
+	printf("%-10s %8s %12s %12s\n", "layout", "fds", "find ns", "churn ns");
+
+	for(uint32_t j = 0; j < sizeof(layouts) / sizeof(layouts[0]); j++)
+	{
+		if(run(&layouts[j], nops) != 0)
+		{
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,183 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures the cost of the thread and fd table churn of a build server. A
+// synthetic stream of fork/exec/exit is applied to the tables the way the
+// parsers do it: a make process keeps forking children, which inherit its
+// environment and fds, exec a compiler, open a couple of files and exit.
+//
+// Usage: sinsp-threadchurn [number of children]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <deque>
+
+//
+// The benchmark fills the tables directly, without a capture
+//
+#define VISIBILITY_PRIVATE public:
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+#define DEFAULT_NCHILDREN 1000000
+#define PARENT_PID 1000
+#define NLIVE_CHILDREN 32
+#define NPARENT_FDS 12
+#define NENV_VARS 30
+
+static uint64_t get_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void add_file(sinsp_threadinfo* tinfo, int64_t fd, const char* name)
+{
+	sinsp_fdinfo_t fdinfo;
+
+	fdinfo.m_type = SCAP_FD_FILE;
+	fdinfo.m_name = name;
+	tinfo->add_fd(fd, &fdinfo);
+}
+
+//
+// Like sinsp_parser::parse_clone_exit() for a new process
+//
+static void fork_child(sinsp* inspector, sinsp_threadinfo* ptinfo, int64_t tid)
+{
+	sinsp_threadinfo tinfo(inspector);
+
+	tinfo.m_tid = tid;
+	tinfo.m_pid = tid;
+	tinfo.m_ptid = ptinfo->m_tid;
+	tinfo.m_comm = ptinfo->m_comm;
+	tinfo.m_exe = ptinfo->m_exe;
+	tinfo.m_args = ptinfo->m_args;
+	tinfo.m_env = ptinfo->m_env;
+	tinfo.m_cwd = ptinfo->m_cwd;
+	tinfo.m_fdtable = *(ptinfo->get_fd_table());
+	tinfo.m_fdtable.reset_cache();
+
+	inspector->m_thread_manager->add_thread(std::move(tinfo), false);
+}
+
+//
+// Like sinsp_parser::parse_execve_exit(), followed by the opening of the
+// source and of the output of the compiler
+//
+static void exec_child(sinsp* inspector, int64_t tid)
+{
+	static const char* args[] = {"-quiet", "-imultiarch", "x86_64-linux-gnu",
+		"src/module.c", "-quiet", "-dumpbase", "module.c", "-mtune=generic",
+		"-march=x86-64", "-O2", "-o", "/tmp/ccXb3kQ1.s"};
+	sinsp_threadinfo* tinfo = inspector->get_thread(tid, false, true);
+	uint32_t j;
+
+	tinfo->m_comm = "cc1";
+	tinfo->m_exe = "/usr/lib/gcc/x86_64-linux-gnu/5/cc1";
+	tinfo->m_args.clear();
+	for(j = 0; j < sizeof(args) / sizeof(args[0]); j++)
+	{
+		tinfo->m_args.push_back(args[j]);
+	}
+
+	//
+	// The close-on-exec fds go away
+	//
+	for(j = 3; j < 6; j++)
+	{
+		tinfo->m_fdtable.erase(j);
+	}
+
+	add_file(tinfo, 3, "/home/build/project/src/module.c");
+	add_file(tinfo, 4, "/tmp/ccXb3kQ1.s");
+}
+
+int main(int argc, char** argv)
+{
+	sinsp inspector;
+	sinsp_threadinfo parent(&inspector);
+	deque<int64_t> live;
+	uint64_t nchildren = DEFAULT_NCHILDREN;
+	uint64_t j;
+
+	if(argc > 1)
+	{
+		nchildren = strtoull(argv[1], NULL, 10);
+	}
+
+	parent.m_tid = PARENT_PID;
+	parent.m_pid = PARENT_PID;
+	parent.m_ptid = 1;
+	parent.m_comm = "make";
+	parent.m_exe = "/usr/bin/make";
+	parent.m_args.push_back("-j8");
+	parent.m_args.push_back("all");
+	parent.m_cwd = "/home/build/project/";
+
+	for(j = 0; j < NENV_VARS; j++)
+	{
+		char var[64];
+		snprintf(var, sizeof(var), "BUILD_VARIABLE_%u=/opt/toolchain/%u/bin", (uint32_t)j, (uint32_t)j);
+		parent.m_env.push_back(var);
+	}
+
+	inspector.m_thread_manager->add_thread(std::move(parent), false);
+	sinsp_threadinfo* ptinfo = inspector.get_thread(PARENT_PID, false, true);
+
+	for(j = 0; j < NPARENT_FDS; j++)
+	{
+		add_file(ptinfo, j, "/home/build/project/Makefile");
+	}
+
+	uint64_t start = get_time_ns();
+
+	for(j = 0; j < nchildren; j++)
+	{
+		int64_t tid = PARENT_PID + 1 + (int64_t)j;
+
+		fork_child(&inspector, ptinfo, tid);
+		exec_child(&inspector, tid);
+		live.push_back(tid);
+
+		if(live.size() > NLIVE_CHILDREN)
+		{
+			inspector.remove_thread(live.front(), true);
+			live.pop_front();
+		}
+	}
+
+	uint64_t duration = get_time_ns() - start;
+
+	sinsp_thread_manager* manager = inspector.m_thread_manager;
+
+	printf("children: %" PRIu64 "\n", nchildren);
+	printf("ns per fork/exec/exit: %.1f\n", (double)duration / nchildren);
+	printf("thread entries in use/allocated: %" PRIu64 "/%" PRIu64 "\n",
+		manager->get_threads()->get_pool().get_used(),
+		manager->get_threads()->get_pool().get_capacity());
+	printf("fd entries in use/allocated: %" PRIu64 "/%" PRIu64 "\n",
+		manager->get_fdinfo_pool()->get_used(),
+		manager->get_fdinfo_pool()->get_capacity());
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,164 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures the memory taken by a large thread table, made of the threads
+// of a few JVMs running the same image in containers. Every thread has the
+// command line, cgroups and container id of its JVM, like the threads that
+// the parsers create on clone().
+//
+// Usage: sinsp-threadmemory [number of threads]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+//
+// The benchmark fills the table directly, without a capture
+//
+#define VISIBILITY_PRIVATE public:
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+#define DEFAULT_NTHREADS 40000
+#define NJVMS 8
+#define NCGROUP_SUBSYSTEMS 10
+
+//
+// Resident memory of the process, in bytes
+//
+static uint64_t get_rss()
+{
+	unsigned long size;
+	unsigned long resident = 0;
+
+	FILE* f = fopen("/proc/self/statm", "r");
+	if(f == NULL)
+	{
+		return 0;
+	}
+
+	if(fscanf(f, "%lu %lu", &size, &resident) != 2)
+	{
+		resident = 0;
+	}
+
+	fclose(f);
+	return (uint64_t)resident * sysconf(_SC_PAGESIZE);
+}
+
+static void init_jvm(sinsp_threadinfo* tinfo, uint32_t jvm)
+{
+	static const char* subsystems[NCGROUP_SUBSYSTEMS] = {"cpuset", "cpu", "cpuacct",
+		"memory", "devices", "freezer", "net_cls", "blkio", "perf_event", "hugetlb"};
+	char container_id[64];
+	string classpath;
+	uint32_t j;
+
+	snprintf(container_id, sizeof(container_id), "%012" PRIx64, (uint64_t)0x5e3d0f11a2bULL + jvm);
+
+	tinfo->m_tid = 1000 + jvm;
+	tinfo->m_pid = tinfo->m_tid;
+	tinfo->m_ptid = 1;
+	tinfo->m_comm = "java";
+	tinfo->m_exe = "/usr/lib/jvm/java-8-openjdk-amd64/jre/bin/java";
+	tinfo->m_cwd = "/opt/app/";
+	tinfo->m_root = "/";
+	tinfo->m_container_id = container_id;
+
+	for(j = 0; j < 60; j++)
+	{
+		classpath += "/opt/app/lib/dependency-" + to_string(j) + "-1.2.3.jar:";
+	}
+
+	tinfo->m_args.push_back("-Xmx4g");
+	tinfo->m_args.push_back("-XX:+UseG1GC");
+	tinfo->m_args.push_back("-XX:MaxGCPauseMillis=200");
+	tinfo->m_args.push_back("-Dcom.sun.management.jmxremote.port=9010");
+	tinfo->m_args.push_back("-Dlog4j.configurationFile=/opt/app/conf/log4j2.xml");
+	tinfo->m_args.push_back("-classpath");
+	tinfo->m_args.push_back(classpath);
+	tinfo->m_args.push_back("com.example.server.Main");
+
+	for(j = 0; j < NCGROUP_SUBSYSTEMS; j++)
+	{
+		tinfo->m_cgroups.push_back(make_pair(string(subsystems[j]),
+			string("/docker/") + container_id + "0123456789abcdef0123456789abcdef0123456789abcdef0123"));
+	}
+}
+
+int main(int argc, char** argv)
+{
+	sinsp inspector;
+	uint32_t nthreads = DEFAULT_NTHREADS;
+	uint64_t nstrings;
+	uint64_t nbytes;
+	uint32_t j;
+
+	if(argc > 1)
+	{
+		nthreads = (uint32_t)strtoul(argv[1], NULL, 10);
+	}
+
+	inspector.m_max_thread_table_size = nthreads + NJVMS + 1;
+
+	uint64_t rss_before = get_rss();
+
+	for(j = 0; j < NJVMS; j++)
+	{
+		sinsp_threadinfo tinfo(&inspector);
+		init_jvm(&tinfo, j);
+		inspector.m_thread_manager->add_thread(std::move(tinfo), true);
+	}
+
+	//
+	// The threads copy the state of their process, like on clone()
+	//
+	for(j = 0; j < nthreads; j++)
+	{
+		sinsp_threadinfo* ptinfo = inspector.get_thread(1000 + j % NJVMS, false, true);
+		sinsp_threadinfo tinfo(&inspector);
+
+		tinfo.m_tid = 100000 + j;
+		tinfo.m_pid = ptinfo->m_pid;
+		tinfo.m_ptid = ptinfo->m_tid;
+		tinfo.m_flags |= PPM_CL_CLONE_THREAD;
+		tinfo.m_comm = ptinfo->m_comm;
+		tinfo.m_exe = ptinfo->m_exe;
+		tinfo.m_args = ptinfo->m_args;
+		tinfo.m_cwd = ptinfo->m_cwd;
+		tinfo.m_root = ptinfo->m_root;
+		tinfo.m_cgroups = ptinfo->m_cgroups;
+		tinfo.m_container_id = ptinfo->m_container_id;
+		inspector.m_thread_manager->add_thread(std::move(tinfo), true);
+	}
+
+	uint64_t rss_after = get_rss();
+
+	sinsp_istring::get_pool_stats(&nstrings, &nbytes);
+
+	printf("threads: %u\n", nthreads);
+	printf("sizeof(sinsp_threadinfo): %u\n", (uint32_t)sizeof(sinsp_threadinfo));
+	printf("resident memory: %" PRIu64 " KB (%" PRIu64 " bytes per thread)\n",
+		(rss_after - rss_before) / 1024,
+		(rss_after - rss_before) / (nthreads + NJVMS));
+	printf("interned strings: %" PRIu64 " (%" PRIu64 " bytes)\n", nstrings, nbytes);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,212 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures the cost of running filters that look at a single parameter of
+// the events. A buffer of synthetic exit events with the mix of a busy
+// server (reads, writes, sends, opens, closes, stats, connects and some
+// clones) is filtered over and over, and the time per event is reported
+// for each filter.
+//
+// Usage: sinsp-evtparams [number of events per filter]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+//
+// The benchmark feeds the events to the filters directly, without a capture
+//
+#define VISIBILITY_PRIVATE public:
+#include "sinsp.h"
+#include "sinsp_int.h"
+#include "filter.h"
+
+#define DEFAULT_NEVTS 20000000
+#define NBUFFER_EVTS 4096
+
+static uint64_t get_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t next_rand(uint32_t* seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+//
+// Size of a parameter of the given type. Strings, buffers and addresses
+// get a payload of 32 bytes.
+//
+static uint16_t get_param_len(ppm_param_type type)
+{
+	switch(type)
+	{
+	case PT_INT8:
+	case PT_UINT8:
+	case PT_FLAGS8:
+	case PT_SIGTYPE:
+	case PT_L4PROTO:
+	case PT_SOCKFAMILY:
+		return 1;
+	case PT_INT16:
+	case PT_UINT16:
+	case PT_FLAGS16:
+	case PT_SYSCALLID:
+	case PT_PORT:
+		return 2;
+	case PT_INT32:
+	case PT_UINT32:
+	case PT_FLAGS32:
+	case PT_BOOL:
+	case PT_IPV4ADDR:
+	case PT_UID:
+	case PT_GID:
+	case PT_SIGSET:
+		return 4;
+	case PT_INT64:
+	case PT_UINT64:
+	case PT_ERRNO:
+	case PT_FD:
+	case PT_PID:
+	case PT_RELTIME:
+	case PT_ABSTIME:
+	case PT_DOUBLE:
+		return 8;
+	default:
+		return 32;
+	}
+}
+
+//
+// Append an event of the given type to buf. The first parameter, which for
+// exit events is the return value, is set to res.
+//
+static void add_event(sinsp* inspector, vector<char>* buf, uint16_t type, int64_t res)
+{
+	const ppm_event_info* info = &(inspector->get_event_info_tables()->m_event_info[type]);
+	size_t start = buf->size();
+	uint32_t len = sizeof(ppm_evt_hdr) + info->nparams * sizeof(uint16_t);
+	uint32_t j;
+
+	for(j = 0; j < info->nparams; j++)
+	{
+		len += get_param_len(info->params[j].type);
+	}
+
+	buf->resize(start + len);
+
+	ppm_evt_hdr* hdr = (ppm_evt_hdr*)&(*buf)[start];
+	hdr->ts = 0;
+	hdr->tid = 1000;
+	hdr->len = len;
+	hdr->type = type;
+
+	uint16_t* lens = (uint16_t*)(hdr + 1);
+	char* valptr = (char*)(lens + info->nparams);
+
+	for(j = 0; j < info->nparams; j++)
+	{
+		lens[j] = get_param_len(info->params[j].type);
+
+		if(j == 0 && lens[j] == sizeof(int64_t))
+		{
+			memcpy(valptr, &res, sizeof(int64_t));
+		}
+		else if(lens[j] == 32)
+		{
+			strcpy(valptr, "/var/lib/app/data/0000001.log");
+		}
+
+		valptr += lens[j];
+	}
+}
+
+int main(int argc, char** argv)
+{
+	static const uint16_t types[] =
+	{
+		PPME_SYSCALL_READ_X, PPME_SYSCALL_READ_X, PPME_SYSCALL_READ_X,
+		PPME_SYSCALL_WRITE_X, PPME_SYSCALL_WRITE_X,
+		PPME_SOCKET_SENDTO_X, PPME_SOCKET_RECVFROM_X,
+		PPME_SYSCALL_OPEN_X, PPME_SYSCALL_CLOSE_X, PPME_SYSCALL_STAT_X,
+		PPME_SOCKET_CONNECT_X, PPME_SYSCALL_MMAP_X, PPME_SYSCALL_CLONE_20_X,
+	};
+	static const char* filters[] =
+	{
+		"evt.type=open and evt.failed=true",
+		"evt.failed=true",
+		"evt.rawres<0",
+		"evt.rawarg.fd=3",
+	};
+	sinsp inspector;
+	sinsp_evt evt(&inspector);
+	vector<char> buf;
+	vector<size_t> offsets;
+	uint64_t nevts = DEFAULT_NEVTS;
+	uint32_t seed = 1;
+	uint32_t j;
+
+	if(argc > 1)
+	{
+		nevts = strtoull(argv[1], NULL, 10);
+	}
+
+	for(j = 0; j < NBUFFER_EVTS; j++)
+	{
+		offsets.push_back(buf.size());
+		add_event(&inspector, &buf,
+			types[next_rand(&seed) % (sizeof(types) / sizeof(types[0]))],
+			(next_rand(&seed) % 16 == 0)? -2 : 3);
+	}
+
+	printf("%-36s %10s %10s\n", "filter", "matches", "ns/event");
+
+	for(j = 0; j < sizeof(filters) / sizeof(filters[0]); j++)
+	{
+		sinsp_filter_compiler compiler(&inspector, filters[j]);
+		sinsp_filter* filter = compiler.compile();
+		uint64_t nmatches = 0;
+
+		uint64_t start = get_time_ns();
+
+		for(uint64_t k = 0; k < nevts; k++)
+		{
+			evt.init((uint8_t*)&buf[offsets[k % NBUFFER_EVTS]], 0);
+
+			if(filter->run(&evt))
+			{
+				nmatches++;
+			}
+		}
+
+		uint64_t duration = get_time_ns() - start;
+
+		printf("%-36s %10" PRIu64 " %10.1f\n", filters[j], nmatches, (double)duration / nevts);
+		delete filter;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,288 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures the latency that the expiry of inactive threads and containers
+// adds to the events on a large host. The thread table is filled with 200k
+// threads in 500 containers, then a synthetic stream of events looks up
+// random threads, with some processes exiting and new ones starting, and
+// runs the periodic cleanup once per batch like sinsp::next() does. The scan
+// period is shortened to 10 seconds, so that the stream goes through a
+// hundred of them. The per-event latency percentiles are reported.
+//
+// One process in ten has threads. Half of those exit like exit_group(),
+// threads first, and the other half lose their main thread first, which is
+// kept until its threads are gone. At the end, the benchmark fails if the
+// thread count of a main thread doesn't match the table, or if an exited
+// main thread without threads is still there after a scan period.
+//
+// Usage: sinsp-threadexpiry [number of events]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+//
+// The benchmark fills the tables directly, without a capture
+//
+#define VISIBILITY_PRIVATE public:
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+#define DEFAULT_NEVTS 10000000
+#define NTHREADS 200000
+#define NCONTAINERS 500
+#define FIRST_TID 100000
+#define EVT_INTERVAL_NS 100000
+#define SCAN_INTERVAL_NS (10 * ONE_SECOND_IN_NS)
+#define EXIT_INTERVAL 1000
+#define FIRST_CHILD_TID (FIRST_TID + NTHREADS)
+#define NCHILDS 3
+
+static uint64_t get_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t next_rand(uint32_t* seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+static string get_container_id(uint32_t j)
+{
+	char id[64];
+	snprintf(id, sizeof(id), "%012" PRIx64, (uint64_t)0x5e3d0f11a2bULL + j);
+	return id;
+}
+
+static void add_thread(sinsp* inspector, int64_t tid)
+{
+	sinsp_threadinfo tinfo(inspector);
+
+	tinfo.m_tid = tid;
+	tinfo.m_pid = tid;
+	tinfo.m_ptid = 1;
+	tinfo.m_comm = "java";
+	tinfo.m_container_id = get_container_id((uint32_t)(tid % NCONTAINERS));
+	tinfo.m_lastaccess_ts = inspector->m_lastevent_ts;
+	inspector->m_thread_manager->add_thread(std::move(tinfo), false);
+}
+
+static void add_process(sinsp* inspector, int64_t pid, vector<int64_t>* childs)
+{
+	add_thread(inspector, pid);
+
+	for(int64_t tid : *childs)
+	{
+		sinsp_threadinfo tinfo(inspector);
+
+		tinfo.m_tid = tid;
+		tinfo.m_pid = pid;
+		tinfo.m_ptid = pid;
+		tinfo.m_flags |= PPM_CL_CLONE_THREAD;
+		tinfo.m_comm = "java";
+		tinfo.m_container_id = get_container_id((uint32_t)(pid % NCONTAINERS));
+		tinfo.m_lastaccess_ts = inspector->m_lastevent_ts;
+		inspector->m_thread_manager->add_thread(std::move(tinfo), false);
+	}
+}
+
+static void exit_thread(sinsp* inspector, int64_t tid)
+{
+	sinsp_threadinfo* tinfo = inspector->find_thread(tid, true);
+
+	if(tinfo != NULL)
+	{
+		tinfo->m_flags |= PPM_CL_CLOSED;
+		inspector->remove_thread(tid, false);
+	}
+}
+
+//
+// Returns the number of main threads whose thread count is wrong, and the
+// number of exited main threads that should have been removed
+//
+static uint32_t check_childs(sinsp* inspector, OUT uint32_t* nleft)
+{
+	threadinfo_map_t* threads = inspector->m_thread_manager->get_threads();
+	unordered_map<int64_t, uint64_t> nchilds;
+	uint32_t nerrors = 0;
+
+	*nleft = 0;
+
+	for(auto it = threads->begin(); it != threads->end(); ++it)
+	{
+		if(it->second.m_tid != it->second.m_pid)
+		{
+			nchilds[it->second.m_pid]++;
+		}
+	}
+
+	for(auto it = threads->begin(); it != threads->end(); ++it)
+	{
+		if(it->second.m_tid != it->second.m_pid)
+		{
+			continue;
+		}
+
+		if(it->second.m_nchilds != nchilds[it->second.m_tid])
+		{
+			nerrors++;
+		}
+
+		if((it->second.m_flags & PPM_CL_CLOSED) && it->second.m_nchilds == 0)
+		{
+			(*nleft)++;
+		}
+	}
+
+	return nerrors;
+}
+
+int main(int argc, char** argv)
+{
+	sinsp inspector;
+	vector<uint32_t> latencies;
+	unordered_map<int64_t, vector<int64_t>> childs;
+	uint64_t nevts = DEFAULT_NEVTS;
+	uint32_t seed = 1;
+	uint32_t nerrors;
+	uint32_t nleft;
+	uint64_t j;
+
+	if(argc > 1)
+	{
+		nevts = strtoull(argv[1], NULL, 10);
+	}
+
+	inspector.m_max_thread_table_size = NTHREADS * 2;
+	inspector.m_inactive_thread_scan_time_ns = SCAN_INTERVAL_NS;
+	inspector.m_inactive_container_scan_time_ns = SCAN_INTERVAL_NS;
+	inspector.m_lastevent_ts = 1500000000 * ONE_SECOND_IN_NS;
+
+	for(j = 0; j < NCONTAINERS; j++)
+	{
+		sinsp_container_info container;
+
+		container.m_id = get_container_id((uint32_t)j);
+		container.m_type = CT_DOCKER;
+		container.m_name = container.m_id;
+		inspector.m_container_manager.add_container(container);
+	}
+
+	for(j = 0; j < NTHREADS; j++)
+	{
+		vector<int64_t>* pchilds = &childs[FIRST_TID + j];
+
+		if(j % 10 == 0)
+		{
+			for(uint32_t k = 0; k < NCHILDS; k++)
+			{
+				pchilds->push_back(FIRST_CHILD_TID + j / 10 * NCHILDS + k);
+			}
+		}
+
+		add_process(&inspector, FIRST_TID + j, pchilds);
+	}
+
+	latencies.reserve(nevts);
+
+	for(j = 0; j < nevts; j++)
+	{
+		uint64_t start = get_time_ns();
+
+		inspector.m_lastevent_ts += EVT_INTERVAL_NS;
+
+		int64_t tid = FIRST_TID + next_rand(&seed) % NTHREADS;
+		sinsp_threadinfo* tinfo = inspector.find_thread(tid, false);
+
+		//
+		// A process exits and another one takes its tid. A process whose
+		// main thread exits first can't be replaced until it's removed.
+		//
+		if(j % EXIT_INTERVAL == 0 && tinfo != NULL && !(tinfo->m_flags & PPM_CL_CLOSED))
+		{
+			vector<int64_t>* pchilds = &childs[tid];
+
+			if(pchilds->empty() || (j / EXIT_INTERVAL) % 2 == 0)
+			{
+				for(int64_t ctid : *pchilds)
+				{
+					exit_thread(&inspector, ctid);
+				}
+
+				exit_thread(&inspector, tid);
+				add_process(&inspector, tid, pchilds);
+			}
+			else
+			{
+				exit_thread(&inspector, tid);
+
+				for(int64_t ctid : *pchilds)
+				{
+					exit_thread(&inspector, ctid);
+				}
+
+				pchilds->clear();
+			}
+		}
+
+		if(j % SCAP_NEXT_BATCH_SIZE == 0)
+		{
+			inspector.remove_inactive_threads();
+			inspector.m_container_manager.remove_inactive_containers();
+		}
+
+		latencies.push_back((uint32_t)(get_time_ns() - start));
+	}
+
+	//
+	// Let a scan period go by, so that the exited main threads are checked
+	// again
+	//
+	inspector.m_lastevent_ts += 2 * SCAN_INTERVAL_NS;
+
+	while(inspector.remove_inactive_threads())
+	{
+	}
+
+	nerrors = check_childs(&inspector, &nleft);
+
+	sort(latencies.begin(), latencies.end());
+
+	printf("events: %" PRIu64 ", threads: %u\n", nevts, inspector.m_thread_manager->get_thread_count());
+	printf("ns per event: p50 %u, p99 %u, p99.9 %u, p99.99 %u, max %u\n",
+		latencies[nevts / 2],
+		latencies[nevts * 99 / 100],
+		latencies[nevts * 999 / 1000],
+		latencies[nevts * 9999 / 10000],
+		latencies[nevts - 1]);
+	printf("main threads with a wrong thread count: %u, exited main threads left: %u\n",
+		nerrors,
+		nleft);
+
+	return (nerrors == 0 && nleft == 0)? EXIT_SUCCESS : EXIT_FAILURE;
+}
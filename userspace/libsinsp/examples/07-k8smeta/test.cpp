@@ -0,0 +1,426 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures what keeping the Kubernetes state up to date costs to the event
+// loop. A stand-in API server runs on 127.0.0.1 and serves the lists of
+// nodes, namespaces, pods, replication controllers and services, followed by
+// a stream of watch events. Like a real API server, it ends the watches
+// after a while, so the client has to reconnect. Each batch of the event loop picks up the state
+// and looks up the pods of a few containers, and the time per batch is
+// reported.
+//
+// With "thread", the state is refreshed by the metadata thread of the
+// inspector. With "inline", the loop calls watch() on the client itself once
+// a second, and reconnects it when needed, like the inspector used to.
+//
+// The server replays recorded API responses when a directory is given:
+// <component>.json is returned for the list of the component, and the lines
+// of watch-<component>.json are streamed to its watch, over and over. The
+// responses are synthesized for the components that have no file.
+//
+// Usage: sinsp-k8smeta [thread|inline] [seconds] [recorded responses dir]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+//
+// The benchmark drives the metadata update directly, without a capture
+//
+#define VISIBILITY_PRIVATE public:
+#include "sinsp.h"
+#include "sinsp_int.h"
+#include "k8s.h"
+#include "metadatathread.h"
+
+#define DEFAULT_DURATION_S 20
+#define NNODES 50
+#define NPODS 5000
+#define NAPPS 100
+#define WATCH_EVTS_PER_S 200
+#define WATCH_TIMEOUT_S 5
+#define BATCH_INTERVAL_US 250
+#define LOOKUPS_PER_BATCH 64
+
+static string g_dir;
+
+static uint64_t get_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static string get_container_id(uint32_t j)
+{
+	char id[80];
+	snprintf(id, sizeof(id), "%012x%052x", 0xc0a7a1e5U + j, j);
+	return id;
+}
+
+static bool read_file(const string& name, string* data)
+{
+	if(g_dir.empty())
+	{
+		return false;
+	}
+
+	std::ifstream f(g_dir + "/" + name);
+	if(!f)
+	{
+		return false;
+	}
+
+	std::ostringstream os;
+	os << f.rdbuf();
+	*data = os.str();
+	return true;
+}
+
+static string pod_json(uint32_t j, uint32_t restarts)
+{
+	std::ostringstream os;
+	os << "{\"metadata\":{\"name\":\"pod-" << j << "\",\"uid\":\"pod-uid-" << j
+		<< "\",\"namespace\":\"default\",\"labels\":{\"app\":\"app-" << j % NAPPS << "\"}},"
+		<< "\"spec\":{\"nodeName\":\"node-" << j % NNODES << "\",\"containers\":[{\"name\":\"c\"}]},"
+		<< "\"status\":{\"phase\":\"Running\",\"hostIP\":\"10.0.0." << j % NNODES
+		<< "\",\"podIP\":\"10.1." << j / 250 << "." << j % 250
+		<< "\",\"containerStatuses\":[{\"name\":\"c\",\"restartCount\":" << restarts
+		<< ",\"containerID\":\"docker://" << get_container_id(j) << "\"}]}}";
+	return os.str();
+}
+
+static string list_json(const string& component)
+{
+	string data;
+	if(read_file(component + ".json", &data))
+	{
+		return data;
+	}
+
+	std::ostringstream os;
+	os << "{\"kind\":\"List\",\"apiVersion\":\"v1\",\"items\":[";
+	if(component == "nodes")
+	{
+		for(uint32_t j = 0; j < NNODES; j++)
+		{
+			os << (j ? "," : "") << "{\"metadata\":{\"name\":\"node-" << j << "\",\"uid\":\"node-uid-" << j
+				<< "\"},\"spec\":{\"externalID\":\"node-" << j << "\"},"
+				<< "\"status\":{\"addresses\":[{\"type\":\"InternalIP\",\"address\":\"10.0.0." << j << "\"}]}}";
+		}
+	}
+	else if(component == "namespaces")
+	{
+		os << "{\"metadata\":{\"name\":\"default\",\"uid\":\"ns-uid-0\"},"
+			<< "\"spec\":{\"finalizers\":[\"kubernetes\"]},\"status\":{\"phase\":\"Active\"}}";
+	}
+	else if(component == "pods")
+	{
+		for(uint32_t j = 0; j < NPODS; j++)
+		{
+			os << (j ? "," : "") << pod_json(j, 0);
+		}
+	}
+	else if(component == "replicationcontrollers" || component == "services")
+	{
+		for(uint32_t j = 0; j < NAPPS; j++)
+		{
+			os << (j ? "," : "") << "{\"metadata\":{\"name\":\"app-" << j << "\",\"uid\":\"" << component << "-uid-" << j
+				<< "\",\"namespace\":\"default\",\"labels\":{\"app\":\"app-" << j << "\"}},"
+				<< "\"spec\":{\"replicas\":" << NPODS / NAPPS << ",\"selector\":{\"app\":\"app-" << j << "\"},"
+				<< "\"clusterIP\":\"10.2.0." << j << "\",\"ports\":[{\"port\":80,\"protocol\":\"TCP\",\"targetPort\":8080}]},"
+				<< "\"status\":{\"replicas\":" << NPODS / NAPPS << "}}";
+		}
+	}
+	os << "]}";
+	return os.str();
+}
+
+static bool send_all(int fd, const string& data)
+{
+	size_t off = 0;
+	while(off < data.size())
+	{
+		ssize_t res = send(fd, data.c_str() + off, data.size() - off, MSG_NOSIGNAL);
+		if(res <= 0)
+		{
+			return false;
+		}
+		off += res;
+	}
+	return true;
+}
+
+static void serve_watch(int fd, const string& component)
+{
+	vector<string> lines;
+	string data;
+
+	if(read_file("watch-" + component + ".json", &data))
+	{
+		std::istringstream is(data);
+		string line;
+		while(std::getline(is, line))
+		{
+			if(!line.empty())
+			{
+				lines.push_back(line + "\n");
+			}
+		}
+	}
+	else if(component == "pods")
+	{
+		//
+		// The pods restart one after the other
+		//
+		for(uint32_t j = 0; j < NPODS; j++)
+		{
+			lines.push_back("{\"type\":\"MODIFIED\",\"object\":" + pod_json(j, 1) + "}\n");
+		}
+	}
+
+	if(!send_all(fd, "HTTP/1.0 200 OK\r\nContent-Type: application/json\r\n\r\n"))
+	{
+		return;
+	}
+
+	if(lines.empty())
+	{
+		//
+		// Keep the connection open, like a quiet API server
+		//
+		sleep(WATCH_TIMEOUT_S);
+		return;
+	}
+
+	uint64_t start = get_time_ns();
+	for(size_t j = 0; get_time_ns() - start < WATCH_TIMEOUT_S * ONE_SECOND_IN_NS; j = (j + 1) % lines.size())
+	{
+		if(!send_all(fd, lines[j]))
+		{
+			return;
+		}
+		usleep(1000000 / WATCH_EVTS_PER_S);
+	}
+}
+
+static void serve(int fd)
+{
+	string request;
+	char buf[4096];
+
+	while(request.find("\r\n\r\n") == string::npos)
+	{
+		ssize_t res = recv(fd, buf, sizeof(buf), 0);
+		if(res <= 0)
+		{
+			close(fd);
+			return;
+		}
+		request.append(buf, res);
+	}
+
+	//
+	// GET /api/v1/[watch/]<component>[?selector] HTTP/1.x
+	//
+	string path = request.substr(4, request.find(' ', 4) - 4);
+	path = path.substr(0, path.find('?'));
+	string component = path.substr(path.rfind('/') + 1);
+
+	if(path.find("/watch/") != string::npos)
+	{
+		serve_watch(fd, component);
+	}
+	else
+	{
+		string body = list_json(component);
+		std::ostringstream os;
+		os << "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: " << body.size()
+			<< "\r\nConnection: close\r\n\r\n" << body;
+		send_all(fd, os.str());
+	}
+
+	close(fd);
+}
+
+static uint16_t start_api_server()
+{
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+
+	if(fd < 0 ||
+		bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+		listen(fd, 64) != 0 ||
+		getsockname(fd, (struct sockaddr*)&addr, &addrlen) != 0)
+	{
+		fprintf(stderr, "cannot start the API server\n");
+		exit(EXIT_FAILURE);
+	}
+
+	std::thread([fd]()
+	{
+		int cfd;
+		while((cfd = accept(fd, NULL, NULL)) >= 0)
+		{
+			std::thread(serve, cfd).detach();
+		}
+	}).detach();
+
+	return ntohs(addr.sin_port);
+}
+
+int main(int argc, char** argv)
+{
+	sinsp inspector;
+	vector<uint32_t> latencies;
+	bool inline_watch = false;
+	uint64_t duration_ns = DEFAULT_DURATION_S * ONE_SECOND_IN_NS;
+	uint64_t nfound = 0;
+	uint64_t nlookups = 0;
+	uint64_t nstates = 0;
+	uint64_t ncapture_evts = 0;
+	uint32_t seed = 1;
+
+	if(argc > 1)
+	{
+		inline_watch = (string(argv[1]) == "inline");
+	}
+	if(argc > 2)
+	{
+		duration_ns = strtoull(argv[2], NULL, 10) * ONE_SECOND_IN_NS;
+	}
+	if(argc > 3)
+	{
+		g_dir = argv[3];
+	}
+
+	std::ostringstream url;
+	url << "http://127.0.0.1:" << start_api_server();
+
+	k8s* client = NULL;
+	if(inline_watch)
+	{
+		client = new k8s(url.str(), true, false, true);
+		nstates++;
+	}
+	else
+	{
+		inspector.init_k8s_client(new string(url.str()), NULL);
+	}
+
+	uint64_t start = get_time_ns();
+	uint64_t last_watch = start;
+	const k8s_state_t* state = NULL;
+
+	while(get_time_ns() - start < duration_ns)
+	{
+		uint64_t bstart = get_time_ns();
+
+		if(inline_watch)
+		{
+			if(bstart - last_watch > ONE_SECOND_IN_NS)
+			{
+				last_watch = bstart;
+				if(!client->is_alive())
+				{
+					delete client;
+					client = new k8s(url.str(), true, false, true);
+					nstates++;
+				}
+				client->watch();
+				while(!client->get_capture_events().empty())
+				{
+					client->dequeue_capture_event();
+					ncapture_evts++;
+				}
+			}
+			state = &client->get_state();
+		}
+		else
+		{
+			uint64_t generation = inspector.m_metadata_generation;
+			deque<string> events;
+
+			inspector.update_metadata_state();
+			if(inspector.m_metadata_generation != generation)
+			{
+				nstates++;
+			}
+
+			//
+			// There's no capture to add the events to
+			//
+			if(inspector.m_metadata_thread->get_k8s_capture_events(&events))
+			{
+				ncapture_evts += events.size();
+			}
+			state = inspector.get_k8s_state();
+		}
+
+		for(uint32_t j = 0; j < LOOKUPS_PER_BATCH; j++)
+		{
+			seed = seed * 1103515245 + 12345;
+			if(state->get_pod(get_container_id((seed >> 8) % NPODS).substr(0, 12)) != NULL)
+			{
+				nfound++;
+			}
+			nlookups++;
+		}
+
+		latencies.push_back((uint32_t)(get_time_ns() - bstart));
+		usleep(BATCH_INTERVAL_US);
+	}
+
+	sort(latencies.begin(), latencies.end());
+	size_t n = latencies.size();
+
+	printf("mode: %s, batches: %zu, pods: %zu, found: %" PRIu64 "/%" PRIu64 ", states: %" PRIu64 ", capture events: %" PRIu64 "\n",
+		inline_watch ? "inline" : "thread",
+		n,
+		state->get_pods().size(),
+		nfound,
+		nlookups,
+		nstates,
+		ncapture_evts);
+	printf("ns per batch: p50 %u, p99 %u, p99.9 %u, max %u\n",
+		latencies[n / 2],
+		latencies[n * 99 / 100],
+		latencies[n * 999 / 1000],
+		latencies[n - 1]);
+
+	delete client;
+	return EXIT_SUCCESS;
+}
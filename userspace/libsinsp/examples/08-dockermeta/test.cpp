@@ -0,0 +1,335 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures how much a slow Docker daemon holds up the event loop. A stand-in
+// daemon listens on a Unix socket and answers the container inspect requests
+// after the given delay. A synthetic stream of events starts a process in a
+// new container every CONTAINER_INTERVAL events, resolves its container like
+// the parser does, and collects the container details once per batch like
+// sinsp::next() does. The per-event latency percentiles are reported, along
+// with the number of containers whose details arrived and of container
+// events that were added to the stream.
+//
+// With "async", the details are fetched by the resolver threads. With
+// "sync", the loop waits for the details of each new container before going
+// on, like the parser used to.
+//
+// With "burst", all the containers start at once, before any answer can
+// arrive, so that the requests overflow DOCKER_RESOLVER_MAX_QUEUED_REQUESTS.
+// The ones that don't fit must still be resolved once there is room, and the
+// program fails if any container is left without its details.
+//
+// Usage: sinsp-dockermeta [async|sync|burst] [number of containers] [daemon delay ms]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+//
+// The benchmark drives the container manager directly, without a capture
+//
+#define VISIBILITY_PRIVATE public:
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+#define DEFAULT_NCONTAINERS 100
+#define DEFAULT_DELAY_MS 50
+#define BURST_NCONTAINERS (DOCKER_RESOLVER_MAX_QUEUED_REQUESTS + 500)
+#define BURST_DELAY_MS 1
+#define CONTAINER_INTERVAL 10000
+#define EVT_INTERVAL_NS 100000
+
+static uint32_t g_delay_ms = DEFAULT_DELAY_MS;
+
+static uint64_t get_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static string get_container_id(uint32_t j)
+{
+	char id[80];
+	snprintf(id, sizeof(id), "%012x%052x", 0xd0c4e7U + j, j);
+	return id;
+}
+
+static string inspect_json(const string& id)
+{
+	std::ostringstream os;
+	os << "{\"Id\":\"" << id << "\",\"Name\":\"/name-" << id << "\","
+		<< "\"Config\":{\"Image\":\"registry/image-" << id << ":latest\","
+		<< "\"Labels\":{\"app\":\"benchmark\",\"tier\":\"backend\"},"
+		<< "\"Env\":[\"PATH=/usr/bin\",\"MESOS_TASK_ID=task-" << id << "\"]},"
+		<< "\"NetworkSettings\":{\"IPAddress\":\"172.17.0.2\","
+		<< "\"Ports\":{\"8080/tcp\":[{\"HostIp\":\"0.0.0.0\",\"HostPort\":\"32768\"}]}},"
+		<< "\"HostConfig\":{\"Memory\":536870912,\"MemorySwap\":-1,\"CpuShares\":512,"
+		<< "\"CpuQuota\":50000,\"CpuPeriod\":100000}}";
+	return os.str();
+}
+
+static void serve(int fd)
+{
+	string request;
+	char buf[1024];
+
+	while(request.find("\r\n") == string::npos)
+	{
+		ssize_t res = recv(fd, buf, sizeof(buf), 0);
+		if(res <= 0)
+		{
+			close(fd);
+			return;
+		}
+		request.append(buf, res);
+	}
+
+	//
+	// GET /containers/<id>/json HTTP/1.0
+	//
+	size_t pos = request.find("/containers/");
+	string id = request.substr(pos + sizeof("/containers/") - 1);
+	id = id.substr(0, id.find('/'));
+
+	usleep(g_delay_ms * 1000);
+
+	string body = inspect_json(id);
+	std::ostringstream os;
+	os << "HTTP/1.0 200 OK\r\nContent-Type: application/json\r\nContent-Length: " << body.size()
+		<< "\r\n\r\n" << body;
+
+	string response = os.str();
+	size_t sent = 0;
+	while(sent < response.size())
+	{
+		ssize_t res = send(fd, response.c_str() + sent, response.size() - sent, MSG_NOSIGNAL);
+		if(res <= 0)
+		{
+			break;
+		}
+		sent += res;
+	}
+
+	close(fd);
+}
+
+static string start_docker_daemon()
+{
+	char path[64];
+	snprintf(path, sizeof(path), "/tmp/sinsp-dockermeta-%d.sock", getpid());
+	unlink(path);
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd < 0 ||
+		bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+		listen(fd, 64) != 0)
+	{
+		fprintf(stderr, "cannot start the Docker daemon\n");
+		exit(EXIT_FAILURE);
+	}
+
+	std::thread([fd]()
+	{
+		int cfd;
+		while((cfd = accept(fd, NULL, NULL)) >= 0)
+		{
+			std::thread(serve, cfd).detach();
+		}
+	}).detach();
+
+	return path;
+}
+
+static bool has_details(sinsp* inspector, const string& id)
+{
+	sinsp_container_info container;
+	return inspector->m_container_manager.get_container(id, &container) &&
+		!container.m_image.empty();
+}
+
+//
+// Go through the meta events like sinsp::next() does, and count the
+// container events
+//
+static uint64_t drain_meta_events(sinsp* inspector)
+{
+	uint64_t n = 0;
+
+	while(inspector->m_metaevt != NULL)
+	{
+		sinsp_evt* evt = inspector->m_metaevt;
+		inspector->m_metaevt = NULL;
+
+		if(inspector->m_meta_event_callback != NULL)
+		{
+			inspector->m_meta_event_callback(inspector, inspector->m_meta_event_callback_data);
+		}
+
+		if(evt->get_type() == PPME_CONTAINER_JSON_E)
+		{
+			n++;
+		}
+	}
+
+	return n;
+}
+
+int main(int argc, char** argv)
+{
+	sinsp inspector;
+	vector<uint32_t> latencies;
+	bool sync = false;
+	bool burst = false;
+	uint32_t ncontainers = DEFAULT_NCONTAINERS;
+	uint64_t ncontainer_evts = 0;
+	uint32_t nresolved = 0;
+	uint32_t j;
+
+	if(argc > 1)
+	{
+		sync = (string(argv[1]) == "sync");
+		burst = (string(argv[1]) == "burst");
+	}
+
+	if(burst)
+	{
+		ncontainers = BURST_NCONTAINERS;
+		g_delay_ms = BURST_DELAY_MS;
+	}
+
+	if(argc > 2)
+	{
+		ncontainers = strtoul(argv[2], NULL, 10);
+	}
+	if(argc > 3)
+	{
+		g_delay_ms = strtoul(argv[3], NULL, 10);
+	}
+
+	string socket_path = start_docker_daemon();
+	inspector.m_container_manager.set_docker_socket_path(socket_path);
+	inspector.m_lastevent_ts = 1500000000 * ONE_SECOND_IN_NS;
+
+	uint64_t nevts = (uint64_t)ncontainers * CONTAINER_INTERVAL;
+	latencies.reserve(nevts);
+	uint64_t start = get_time_ns();
+
+	for(uint64_t e = 0; e < nevts; e++)
+	{
+		uint64_t estart = get_time_ns();
+
+		inspector.m_lastevent_ts += EVT_INTERVAL_NS;
+
+		if((burst && e == 0) || (!burst && e % CONTAINER_INTERVAL == 0))
+		{
+			uint32_t first = burst ? 0 : (uint32_t)(e / CONTAINER_INTERVAL);
+			uint32_t last = burst ? ncontainers : first + 1;
+
+			for(j = first; j < last; j++)
+			{
+				sinsp_threadinfo tinfo(&inspector);
+
+				tinfo.m_tid = 1000 + j;
+				tinfo.m_cgroups.push_back(make_pair(sinsp_istring("cpu"), sinsp_istring("/docker/" + get_container_id(j))));
+				inspector.m_container_manager.resolve_container(&tinfo, true);
+			}
+
+			if(sync)
+			{
+				string id = get_container_id(first).substr(0, 12);
+				while(!has_details(&inspector, id))
+				{
+					inspector.m_container_manager.update_docker_containers();
+					ncontainer_evts += drain_meta_events(&inspector);
+				}
+			}
+		}
+
+		if(e % SCAP_NEXT_BATCH_SIZE == 0)
+		{
+			inspector.m_container_manager.update_docker_containers();
+			ncontainer_evts += drain_meta_events(&inspector);
+		}
+
+		latencies.push_back((uint32_t)(get_time_ns() - estart));
+	}
+
+	uint64_t loop_ns = get_time_ns() - start;
+
+	//
+	// Wait for the answers that are still on their way
+	//
+	for(j = 0; j < ncontainers; j++)
+	{
+		string id = get_container_id(j).substr(0, 12);
+		while(!has_details(&inspector, id) && get_time_ns() - start < loop_ns + 30 * ONE_SECOND_IN_NS)
+		{
+			usleep(1000);
+			inspector.m_container_manager.update_docker_containers();
+			ncontainer_evts += drain_meta_events(&inspector);
+		}
+
+		if(has_details(&inspector, id))
+		{
+			nresolved++;
+		}
+	}
+	ncontainer_evts += drain_meta_events(&inspector);
+
+	unlink(socket_path.c_str());
+
+	sort(latencies.begin(), latencies.end());
+
+	printf("mode: %s, events: %" PRIu64 ", loop: %" PRIu64 " ms, containers resolved: %u/%u, container events: %" PRIu64 "\n",
+		sync ? "sync" : (burst ? "burst" : "async"),
+		nevts,
+		loop_ns / 1000000,
+		nresolved,
+		ncontainers,
+		ncontainer_evts);
+	printf("ns per event: p50 %u, p99 %u, p99.9 %u, p99.99 %u, max %u\n",
+		latencies[nevts / 2],
+		latencies[nevts * 99 / 100],
+		latencies[nevts * 999 / 1000],
+		latencies[nevts * 9999 / 10000],
+		latencies[nevts - 1]);
+
+	if(burst && nresolved != ncontainers)
+	{
+		fprintf(stderr, "%u containers were not resolved\n", ncontainers - nresolved);
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,213 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures the cost of resolving the container of new threads on a host
+// that runs short-lived containerized jobs. The threads have the cgroups of
+// a cgroup v1 host, in Kubernetes pods, systemd Docker containers, LXC and
+// Mesos containers, or on the host itself. Every job runs THREADS_PER_JOB
+// threads and is then replaced by a new container, and the containers of the
+// jobs that are over are flushed every FLUSH_INTERVAL threads. The time per
+// resolve_container() call and the hit rate of the cgroup cache are reported.
+//
+// Usage: sinsp-cgroupcache [number of threads]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <algorithm>
+#include <vector>
+
+//
+// The benchmark drives the container manager directly, without a capture
+//
+#define VISIBILITY_PRIVATE public:
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+#define DEFAULT_NTHREADS 2000000
+#define NJOBS 400
+#define THREADS_PER_JOB 200
+#define FLUSH_INTERVAL 100000ULL
+#define EVT_INTERVAL_NS 1000000ULL
+
+typedef vector<pair<sinsp_istring, sinsp_istring>> cgroups_t;
+
+static const char* g_subsystems[] =
+{
+	"cpuset", "cpu,cpuacct", "blkio", "memory", "devices", "freezer",
+	"net_cls,net_prio", "perf_event", "hugetlb", "pids", "name=systemd"
+};
+
+static uint64_t get_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t next_rand(uint32_t* seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+static string hex_id(uint32_t j, uint32_t len)
+{
+	char id[80];
+	uint32_t h = j * 2654435761U;
+	snprintf(id, sizeof(id), "%08x%08x%08x%08x%08x%08x%08x%08x", h, j, ~h, 0xc9a11ceU, h ^ 0x5bd1e995U, ~j, h * 3, j + 1);
+	return string(id, len);
+}
+
+//
+// The cgroups of the threads of job j
+//
+static cgroups_t job_cgroups(uint32_t j)
+{
+	cgroups_t cgroups;
+	string cgroup;
+
+	switch(j % 10)
+	{
+	case 0: case 1: case 2: case 3:
+		cgroup = "/kubepods/burstable/pod" + hex_id(j, 8) + "-" + hex_id(j + 1, 4) + "-" +
+			hex_id(j + 2, 4) + "-" + hex_id(j + 3, 12) + "/" + hex_id(j, 64);
+		break;
+	case 4: case 5:
+		cgroup = "/system.slice/docker-" + hex_id(j, 64) + ".scope";
+		break;
+	case 6:
+		cgroup = "/lxc/job-" + to_string(j);
+		break;
+	case 7:
+		cgroup = "/mesos/" + hex_id(j, 8) + "-" + hex_id(j + 1, 4) + "-" + hex_id(j + 2, 12);
+		break;
+	default:
+		cgroup = "/user.slice/user-1000.slice/session-" + to_string(j % 20) + ".scope";
+		break;
+	}
+
+	for(uint32_t k = 0; k < sizeof(g_subsystems) / sizeof(g_subsystems[0]); k++)
+	{
+		//
+		// The host cgroups are only set for some of the subsystems
+		//
+		if(j % 10 >= 8 && k % 2 == 1)
+		{
+			cgroups.push_back(make_pair(sinsp_istring(g_subsystems[k]), sinsp_istring("/")));
+		}
+		else
+		{
+			cgroups.push_back(make_pair(sinsp_istring(g_subsystems[k]), sinsp_istring(cgroup)));
+		}
+	}
+
+	return cgroups;
+}
+
+int main(int argc, char** argv)
+{
+	sinsp inspector;
+	vector<cgroups_t> jobs(NJOBS);
+	vector<uint32_t> job_threads(NJOBS, 0);
+	vector<int64_t> job_tids(NJOBS, -1);
+	vector<uint32_t> latencies;
+	uint64_t nthreads = DEFAULT_NTHREADS;
+	uint64_t ncontainers = 0;
+	uint32_t next_job = 0;
+	uint32_t seed = 1;
+	uint64_t j;
+
+	if(argc > 1)
+	{
+		nthreads = strtoull(argv[1], NULL, 10);
+	}
+
+	inspector.m_lastevent_ts = 1500000000 * ONE_SECOND_IN_NS;
+	inspector.m_inactive_thread_scan_time_ns = FLUSH_INTERVAL * EVT_INTERVAL_NS;
+	inspector.m_inactive_container_scan_time_ns = FLUSH_INTERVAL * EVT_INTERVAL_NS;
+
+	for(j = 0; j < NJOBS; j++)
+	{
+		jobs[j] = job_cgroups(next_job++);
+	}
+
+	latencies.reserve(nthreads);
+
+	for(j = 0; j < nthreads; j++)
+	{
+		uint32_t job = next_rand(&seed) % NJOBS;
+
+		//
+		// The job is over, a new one takes its place
+		//
+		if(++job_threads[job] == THREADS_PER_JOB)
+		{
+			jobs[job] = job_cgroups(next_job++);
+			job_threads[job] = 0;
+		}
+
+		sinsp_threadinfo tinfo(&inspector);
+		tinfo.m_tid = j;
+		tinfo.m_cgroups = jobs[job];
+
+		uint64_t start = get_time_ns();
+		if(inspector.m_container_manager.resolve_container(&tinfo, false))
+		{
+			ncontainers++;
+		}
+		latencies.push_back((uint32_t)(get_time_ns() - start));
+
+		//
+		// The last thread of the job stays in the table, so the container of
+		// a running job isn't flushed
+		//
+		if(job_tids[job] != -1)
+		{
+			inspector.remove_thread(job_tids[job], true);
+		}
+		job_tids[job] = tinfo.m_tid;
+		inspector.add_thread(std::move(tinfo));
+
+		inspector.m_lastevent_ts += EVT_INTERVAL_NS;
+		inspector.m_container_manager.remove_inactive_containers();
+	}
+
+	sort(latencies.begin(), latencies.end());
+
+	uint64_t nhits;
+	uint64_t nmisses;
+	inspector.m_container_manager.get_cgroup_cache_stats(&nhits, &nmisses);
+
+	printf("threads: %" PRIu64 ", in containers: %" PRIu64 ", jobs: %u, cgroup cache hits: %" PRIu64 " (%.1f%%), misses: %" PRIu64 "\n",
+		nthreads,
+		ncontainers,
+		next_job,
+		nhits,
+		(nhits + nmisses)? 100.0 * nhits / (nhits + nmisses) : 0,
+		nmisses);
+	printf("ns per thread: p50 %u, p99 %u, p99.9 %u, max %u\n",
+		latencies[nthreads / 2],
+		latencies[nthreads * 99 / 100],
+		latencies[nthreads * 999 / 1000],
+		latencies[nthreads - 1]);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,208 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures the cost of running Falco-style rules on the events of a trace
+// file. Every rule is compiled twice: once lowered into a filter program and
+// once left as an expression tree. Both are run on every event, alternating
+// which one goes first, and the time that each evaluator spends on the whole
+// rule set is reported per event. The number of events matched by each rule
+// is reported too, and the benchmark fails if the two evaluators disagree.
+//
+// Usage: sinsp-filterbench <trace file> [filter]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+static const char* g_rules[][2] =
+{
+	{"shell_in_container", "evt.type = execve and evt.dir = < and container.id != host and proc.name in (bash, sh, zsh, ksh, csh, tcsh)"},
+	{"write_below_etc", "evt.type in (open, openat) and evt.is_open_write = true and fd.typechar = f and fd.directory in (/etc, /bin, /sbin, /usr/bin)"},
+	{"read_sensitive_file", "fd.name startswith /etc/shadow and evt.is_open_read = true and not proc.name in (sshd, login, sudo)"},
+	{"inbound_ssh", "(evt.type = accept or evt.type = connect) and evt.dir = < and fd.sport = 22 and not proc.name = sshd"},
+	{"netcat_remote_shell", "proc.cmdline contains \"nc -e\" or proc.cmdline contains \"ncat -e\""},
+	{"exec_from_tmp", "evt.type = execve and proc.exe glob /tmp/* and user.name != root"},
+	{"high_fd", "fd.num >= 1000 and fd.type = file and thread.tid > 1 and proc.pname != systemd"},
+	{"unexpected_port", "fd.type = ipv4 and fd.sport != 80 and fd.sport != 443 and fd.sport != 53 and fd.sport < 1024"},
+};
+
+struct rule
+{
+	string m_name;
+	sinsp_filter* m_program;
+	sinsp_filter* m_tree;
+	uint64_t m_program_matches;
+	uint64_t m_tree_matches;
+};
+
+static uint64_t get_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static sinsp_filter* compile(sinsp* inspector, const string& fltstr, bool lowered)
+{
+	sinsp_filter_compiler compiler(inspector, fltstr);
+	sinsp_filter* filter = compiler.compile();
+
+	if(!lowered)
+	{
+		filter->reset_program();
+	}
+
+	return filter;
+}
+
+static uint64_t run_rules(vector<rule>* rules, sinsp_evt* evt, bool lowered)
+{
+	uint64_t start = get_time_ns();
+
+	for(auto& r : *rules)
+	{
+		if(lowered)
+		{
+			r.m_program_matches += r.m_program->run(evt);
+		}
+		else
+		{
+			r.m_tree_matches += r.m_tree->run(evt);
+		}
+	}
+
+	return get_time_ns() - start;
+}
+
+int main(int argc, char** argv)
+{
+	sinsp inspector;
+	vector<rule> rules;
+	sinsp_evt* evt;
+	uint64_t nevts = 0;
+	uint64_t program_ns = 0;
+	uint64_t tree_ns = 0;
+	int res = EXIT_SUCCESS;
+
+	if(argc < 2)
+	{
+		fprintf(stderr, "usage: %s <trace file> [filter]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	try
+	{
+		if(argc > 2)
+		{
+			rules.push_back({"custom", compile(&inspector, argv[2], true), compile(&inspector, argv[2], false), 0, 0});
+		}
+		else
+		{
+			for(uint32_t j = 0; j < sizeof(g_rules) / sizeof(g_rules[0]); j++)
+			{
+				rules.push_back({g_rules[j][0], compile(&inspector, g_rules[j][1], true), compile(&inspector, g_rules[j][1], false), 0, 0});
+			}
+		}
+
+		//
+		// Otherwise the evaluator that goes second would find the values of
+		// the fields in the field cache
+		//
+		inspector.get_field_cache()->set_enabled(false);
+
+		inspector.open(argv[1]);
+
+		while(true)
+		{
+			int32_t rc = inspector.next(&evt);
+
+			if(rc == SCAP_TIMEOUT)
+			{
+				continue;
+			}
+			else if(rc == SCAP_EOF)
+			{
+				break;
+			}
+			else if(rc != SCAP_SUCCESS)
+			{
+				throw sinsp_exception(inspector.getlasterr());
+			}
+
+			//
+			// The evaluator that goes second finds the caches of the event
+			// warm, so the order is switched at every event
+			//
+			if(nevts & 1)
+			{
+				tree_ns += run_rules(&rules, evt, false);
+				program_ns += run_rules(&rules, evt, true);
+			}
+			else
+			{
+				program_ns += run_rules(&rules, evt, true);
+				tree_ns += run_rules(&rules, evt, false);
+			}
+
+			nevts++;
+		}
+
+		inspector.close();
+	}
+	catch(sinsp_exception& e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+		return EXIT_FAILURE;
+	}
+
+	if(nevts == 0)
+	{
+		fprintf(stderr, "no events in %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	printf("events: %" PRIu64 ", rules: %u\n", nevts, (uint32_t)rules.size());
+	printf("ns per event: program %.1f, tree %.1f\n",
+		(double)program_ns / nevts,
+		(double)tree_ns / nevts);
+
+	for(auto& r : rules)
+	{
+		printf("  %-24s matches: %" PRIu64 "\n", r.m_name.c_str(), r.m_program_matches);
+
+		if(r.m_program_matches != r.m_tree_matches)
+		{
+			fprintf(stderr, "rule %s: the program matched %" PRIu64 " events, the tree %" PRIu64 "\n",
+				r.m_name.c_str(),
+				r.m_program_matches,
+				r.m_tree_matches);
+			res = EXIT_FAILURE;
+		}
+
+		delete r.m_program;
+		delete r.m_tree;
+	}
+
+	return res;
+}
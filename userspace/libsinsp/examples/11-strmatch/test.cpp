@@ -0,0 +1,270 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures the cost of matching a string against a growing number of OR'ed
+// "startswith" or "contains" terms, like "fd.name startswith /etc or
+// fd.name startswith /bin or ..." and "proc.cmdline contains ... or ...".
+// The file names of a busy host are matched against sensitive directories
+// and the command lines of its processes against suspicious arguments. Every
+// term compared one at a time, like the expression tree does, is compared
+// with a sinsp_string_matcher that has all of them. The benchmark fails if
+// the two disagree on any string.
+//
+// Usage: sinsp-strmatch [number of strings]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+#include "stringmatcher.h"
+
+#define DEFAULT_NSTRINGS 200000
+
+static const char* g_sensitive_dirs[] =
+{
+	"/etc/", "/bin/", "/sbin/", "/usr/bin/", "/usr/sbin/", "/boot/", "/lib/modules/",
+	"/root/.ssh/", "/var/lib/dpkg/", "/var/lib/rpm/", "/etc/sudoers.d/", "/etc/pam.d/",
+	"/etc/cron.d/", "/var/spool/cron/", "/usr/local/bin/", "/dev/mem", "/dev/kmem",
+	"/proc/sys/kernel/", "/sys/kernel/", "/var/run/docker.sock", "/etc/kubernetes/",
+	"/var/lib/kubelet/pki/", "/root/.aws/", "/root/.kube/", "/etc/ssl/private/",
+};
+
+static const char* g_suspicious_args[] =
+{
+	"nc -e", "ncat -e", "bash -i", "/dev/tcp/", "/dev/udp/", "base64 -d", "python -c",
+	"perl -e", "ruby -e", "mkfifo /tmp/", "chmod +s", "curl -s http", "wget -q http",
+	"xmrig", "stratum+tcp://", "--donate-level", "LD_PRELOAD=", "iptables -F",
+	"history -c", "rm -rf /var/log", "insmod ", "setenforce 0", "socat exec:",
+};
+
+static const char* g_dirs[] =
+{
+	"/usr/lib/x86_64-linux-gnu/", "/usr/share/locale/", "/proc/", "/sys/fs/cgroup/",
+	"/home/dev/project/src/", "/var/lib/docker/overlay2/", "/tmp/", "/var/log/",
+	"/usr/lib/python3/dist-packages/", "/etc/", "/usr/bin/", "/dev/",
+};
+
+static const char* g_commands[] =
+{
+	"nginx: worker process", "java -Xmx2g -jar /opt/app/service.jar --spring.profiles.active=prod",
+	"python3 /usr/bin/supervisord -n -c /etc/supervisor/supervisord.conf",
+	"node /srv/app/server.js --port 8080", "sh -c ls -la /var/lib/app",
+	"postgres: writer process", "/usr/sbin/sshd -D", "bash -c cat /etc/hostname",
+	"kubelet --config=/var/lib/kubelet/config.yaml --kubeconfig=/etc/kubernetes/kubelet.conf",
+	"containerd-shim -namespace moby -workdir /var/lib/containerd",
+};
+
+static uint64_t get_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t next_rand(uint32_t* seed)
+{
+	*seed = *seed * 1103515245 + 12345;
+	return *seed >> 8;
+}
+
+//
+// The first patterns are the real ones, the other ones are made up variations
+// of them, like the per-application terms of a large rule set
+//
+static vector<string> make_patterns(const char** base, uint32_t nbase, uint32_t npatterns)
+{
+	vector<string> patterns;
+	char suffix[32];
+
+	for(uint32_t j = 0; j < npatterns; j++)
+	{
+		if(j < nbase)
+		{
+			patterns.push_back(base[j]);
+		}
+		else
+		{
+			snprintf(suffix, sizeof(suffix), "%u", j);
+			patterns.push_back(string(base[j % nbase]) + suffix);
+		}
+	}
+
+	return patterns;
+}
+
+static vector<string> make_paths(uint32_t nstrings, uint32_t* seed)
+{
+	vector<string> paths;
+	char name[64];
+
+	for(uint32_t j = 0; j < nstrings; j++)
+	{
+		const char* dir = g_dirs[next_rand(seed) % (sizeof(g_dirs) / sizeof(g_dirs[0]))];
+
+		snprintf(name, sizeof(name), "%x/file%u.%s",
+			next_rand(seed) % 4096,
+			next_rand(seed) % 100,
+			(next_rand(seed) & 1)? "so" : "conf");
+
+		paths.push_back(string(dir) + name);
+	}
+
+	return paths;
+}
+
+static vector<string> make_cmdlines(uint32_t nstrings, uint32_t* seed)
+{
+	vector<string> cmdlines;
+	char args[64];
+
+	for(uint32_t j = 0; j < nstrings; j++)
+	{
+		const char* cmd = g_commands[next_rand(seed) % (sizeof(g_commands) / sizeof(g_commands[0]))];
+
+		snprintf(args, sizeof(args), " --id=%u --threads=%u", next_rand(seed) % 100000, next_rand(seed) % 64);
+
+		//
+		// Some of the processes do something suspicious
+		//
+		if(next_rand(seed) % 200 == 0)
+		{
+			cmdlines.push_back(string("sh -c ") + g_suspicious_args[next_rand(seed) % (sizeof(g_suspicious_args) / sizeof(g_suspicious_args[0]))] + args);
+		}
+		else
+		{
+			cmdlines.push_back(string(cmd) + args);
+		}
+	}
+
+	return cmdlines;
+}
+
+//
+// Match every string against the patterns one at a time and with a matcher,
+// and print the time per string of both
+//
+static bool run(const char* name, const vector<string>& strings, const vector<string>& patterns, bool prefix)
+{
+	sinsp_string_matcher matcher;
+	vector<bool> naive_res(strings.size());
+	uint64_t nmatches = 0;
+	bool res = true;
+
+	for(auto& p : patterns)
+	{
+		if(prefix)
+		{
+			matcher.add_prefix(p.c_str(), (uint32_t)p.size());
+		}
+		else
+		{
+			matcher.add_substring(p.c_str(), (uint32_t)p.size());
+		}
+	}
+
+	uint64_t start = get_time_ns();
+	matcher.build();
+	uint64_t build_ns = get_time_ns() - start;
+
+	start = get_time_ns();
+	for(uint32_t j = 0; j < strings.size(); j++)
+	{
+		const char* str = strings[j].c_str();
+		bool match = false;
+
+		for(auto& p : patterns)
+		{
+			if(prefix? strncmp(str, p.c_str(), p.size()) == 0 : strstr(str, p.c_str()) != NULL)
+			{
+				match = true;
+				break;
+			}
+		}
+
+		naive_res[j] = match;
+	}
+	uint64_t naive_ns = get_time_ns() - start;
+
+	start = get_time_ns();
+	for(uint32_t j = 0; j < strings.size(); j++)
+	{
+		bool match = matcher.match(strings[j].c_str());
+
+		if(match != naive_res[j])
+		{
+			fprintf(stderr, "%s: the matcher says %d for %s\n", name, match, strings[j].c_str());
+			res = false;
+		}
+
+		nmatches += match;
+	}
+	uint64_t matcher_ns = get_time_ns() - start;
+
+	printf("%-10s patterns: %4u, matches: %6" PRIu64 ", ns per string: one at a time %8.1f, matcher %6.1f, build us: %" PRIu64 "\n",
+		name,
+		(uint32_t)patterns.size(),
+		nmatches,
+		(double)naive_ns / strings.size(),
+		(double)matcher_ns / strings.size(),
+		build_ns / 1000);
+
+	return res;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t nstrings = DEFAULT_NSTRINGS;
+	uint32_t seed = 1;
+	uint32_t npatterns[] = {4, 16, 64, 256, 1024};
+	int res = EXIT_SUCCESS;
+
+	if(argc > 1)
+	{
+		nstrings = (uint32_t)strtoul(argv[1], NULL, 10);
+	}
+
+	vector<string> paths = make_paths(nstrings, &seed);
+	vector<string> cmdlines = make_cmdlines(nstrings, &seed);
+
+	for(uint32_t n : npatterns)
+	{
+		vector<string> patterns = make_patterns(g_sensitive_dirs, sizeof(g_sensitive_dirs) / sizeof(g_sensitive_dirs[0]), n);
+
+		if(!run("startswith", paths, patterns, true))
+		{
+			res = EXIT_FAILURE;
+		}
+	}
+
+	for(uint32_t n : npatterns)
+	{
+		vector<string> patterns = make_patterns(g_suspicious_args, sizeof(g_suspicious_args) / sizeof(g_suspicious_args[0]), n);
+
+		if(!run("contains", cmdlines, patterns, false))
+		{
+			res = EXIT_FAILURE;
+		}
+	}
+
+	return res;
+}
@@ -0,0 +1,417 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Measures what the field cache saves on a large rule set. About 300 rules
+// are made from a few Falco-style templates, so that most of them look at the
+// same handful of fields, and the events that match a rule are formatted with
+// an output line that uses those fields too. The trace file is read twice,
+// once with the field cache of the inspector disabled and once with it
+// enabled, and the time per event and the hit rate of the cache are
+// reported. The benchmark fails if the two runs match or format the events
+// differently.
+//
+// The trace file is then read once more to check the tables made from the
+// thread table, which run a filter over one fake event per thread. A table
+// of the threads with a given name must have the same rows as the full
+// table has for that name.
+//
+// Usage: sinsp-fieldcache <trace file> [number of rules]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+#include "table.h"
+
+#define DEFAULT_NRULES 300
+
+static const char* g_shells[] = {"bash", "sh", "zsh", "ksh", "csh", "tcsh", "dash", "fish"};
+static const char* g_dirs[] = {"/etc/", "/bin/", "/sbin/", "/usr/bin/", "/root/.ssh/", "/var/lib/dpkg/", "/etc/pam.d/", "/boot/"};
+static const char* g_args[] = {"nc -e", "bash -i", "/dev/tcp/", "base64 -d", "python -c", "xmrig", "LD_PRELOAD=", "iptables -F"};
+static const char* g_parents[] = {"nginx", "httpd", "java", "node", "postgres", "mysqld", "redis-server", "php-fpm"};
+static const char* g_ports[] = {"22", "23", "25", "53", "80", "443", "3306", "6379"};
+
+struct rule_template
+{
+	const char* m_fmt;
+	const char** m_vals;
+	uint32_t m_nvals;
+	bool m_numeric;
+};
+
+static rule_template g_templates[] =
+{
+	{"evt.type = execve and evt.dir = < and container.id != host and proc.name = %s", g_shells, 8, false},
+	{"evt.type in (open, openat) and evt.is_open_write = true and fd.name startswith %s and not proc.name in (dpkg, rpm, yum)", g_dirs, 8, false},
+	{"evt.type = execve and evt.dir = < and proc.cmdline contains \"%s\" and user.name != root", g_args, 8, false},
+	{"evt.type = execve and evt.dir = < and proc.pname = %s and proc.name in (bash, sh, zsh)", g_parents, 8, false},
+	{"(evt.type = accept or evt.type = connect) and evt.dir = < and fd.sport = %s and not proc.name = sshd", g_ports, 8, true},
+	{"fd.typechar = f and fd.directory = %s and user.name != root and container.id != host", g_dirs, 8, false},
+};
+
+static const char* g_output = "%evt.type %user.name %container.id %proc.name %proc.pname %proc.cmdline %fd.name";
+
+struct rule
+{
+	sinsp_filter* m_filter;
+	uint64_t m_matches;
+};
+
+struct run_result
+{
+	uint64_t m_nevts;
+	uint64_t m_ns;
+	vector<uint64_t> m_matches;
+	size_t m_output_hash;
+	uint64_t m_hits;
+	uint64_t m_misses;
+	uint32_t m_nentries;
+};
+
+static uint64_t get_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+//
+// Rule j uses template j modulo the number of templates. Once the values of
+// a template are used up, they get a suffix, or are made up for the ports,
+// like the per-application variants of a large rule set.
+//
+static vector<string> make_rules(uint32_t nrules)
+{
+	vector<string> rules;
+	uint32_t ntemplates = sizeof(g_templates) / sizeof(g_templates[0]);
+	char buf[512];
+
+	for(uint32_t j = 0; j < nrules; j++)
+	{
+		rule_template* t = &g_templates[j % ntemplates];
+		uint32_t v = j / ntemplates;
+		string val;
+
+		if(v < t->m_nvals)
+		{
+			val = t->m_vals[v];
+		}
+		else if(t->m_numeric)
+		{
+			val = to_string(1024 + v);
+		}
+		else
+		{
+			val = string(t->m_vals[v % t->m_nvals]) + to_string(v);
+		}
+
+		snprintf(buf, sizeof(buf), t->m_fmt, val.c_str());
+		rules.push_back(buf);
+	}
+
+	return rules;
+}
+
+static run_result run(const char* fname, const vector<string>& rulestrs, bool cached)
+{
+	sinsp inspector;
+	vector<rule> rules;
+	sinsp_evt* evt;
+	string line;
+	run_result res;
+
+	res.m_nevts = 0;
+	res.m_ns = 0;
+	res.m_output_hash = 0;
+
+	inspector.get_field_cache()->set_enabled(cached);
+
+	for(auto& r : rulestrs)
+	{
+		sinsp_filter_compiler compiler(&inspector, r);
+		rules.push_back({compiler.compile(), 0});
+	}
+
+	sinsp_evt_formatter formatter(&inspector, g_output);
+
+	inspector.open(fname);
+
+	while(true)
+	{
+		int32_t rc = inspector.next(&evt);
+
+		if(rc == SCAP_TIMEOUT)
+		{
+			continue;
+		}
+		else if(rc == SCAP_EOF)
+		{
+			break;
+		}
+		else if(rc != SCAP_SUCCESS)
+		{
+			throw sinsp_exception(inspector.getlasterr());
+		}
+
+		uint64_t start = get_time_ns();
+
+		for(auto& r : rules)
+		{
+			if(r.m_filter->run(evt))
+			{
+				r.m_matches++;
+				formatter.tostring(evt, &line);
+				res.m_output_hash = res.m_output_hash * 31 + std::hash<string>()(line);
+			}
+		}
+
+		res.m_ns += get_time_ns() - start;
+		res.m_nevts++;
+	}
+
+	inspector.close();
+
+	for(auto& r : rules)
+	{
+		res.m_matches.push_back(r.m_matches);
+		delete r.m_filter;
+	}
+
+	inspector.get_field_cache()->get_stats(&res.m_hits, &res.m_misses);
+	res.m_nentries = inspector.get_field_cache()->size();
+
+	return res;
+}
+
+static sinsp_table* make_thread_table(sinsp* inspector, const string& filter)
+{
+	vector<sinsp_view_column_info> columns;
+	vector<string> tags;
+
+	columns.push_back(sinsp_view_column_info("thread.tid", "TID", "", 8, TEF_IS_KEY, A_NONE, A_NONE, tags, ""));
+	columns.push_back(sinsp_view_column_info("proc.name", "NAME", "", 16, 0, A_NONE, A_NONE, tags, ""));
+
+	sinsp_table* table = new sinsp_table(inspector, sinsp_table::TT_TABLE, ONE_SECOND_IN_NS, false);
+	table->configure(&columns, filter, false, 0);
+	table->set_sorting_col(1);
+
+	return table;
+}
+
+static void count_names(vector<sinsp_sample_row>* sample, OUT unordered_map<string, uint32_t>* counts)
+{
+	counts->clear();
+
+	for(auto& row : *sample)
+	{
+		(*counts)[string((char*)row.m_values[0].m_val)]++;
+	}
+}
+
+//
+// Every second of the trace, the thread table is added to a table with all
+// the threads and to one with the threads of a single name, which is the
+// least frequent name of the first sample so that the two tables can't have
+// the same rows by chance. The filter uses 'in', because 'proc.name =' is
+// compared on the interned name and doesn't go through the field cache.
+// Returns the number of mismatching samples.
+//
+static uint32_t check_thread_tables(const char* fname, OUT uint32_t* nsamples)
+{
+	sinsp inspector;
+	sinsp_evt* evt;
+	sinsp_table* all = make_thread_table(&inspector, "");
+	sinsp_table* filtered = NULL;
+	string name;
+	uint32_t nerrors = 0;
+
+	*nsamples = 0;
+
+	inspector.open(fname);
+
+	while(true)
+	{
+		int32_t rc = inspector.next(&evt);
+
+		if(rc == SCAP_TIMEOUT)
+		{
+			continue;
+		}
+		else if(rc == SCAP_EOF)
+		{
+			break;
+		}
+		else if(rc != SCAP_SUCCESS)
+		{
+			throw sinsp_exception(inspector.getlasterr());
+		}
+
+		if(evt->get_ts() < all->m_next_flush_time_ns)
+		{
+			continue;
+		}
+
+		unordered_map<string, uint32_t> all_counts;
+		unordered_map<string, uint32_t> filtered_counts;
+
+		all->flush(evt);
+		count_names(all->get_sample(0), &all_counts);
+
+		if(filtered == NULL)
+		{
+			if(all_counts.size() < 2)
+			{
+				continue;
+			}
+
+			uint32_t min_count = 0;
+
+			for(auto& it : all_counts)
+			{
+				if(min_count == 0 || it.second < min_count)
+				{
+					name = it.first;
+					min_count = it.second;
+				}
+			}
+
+			filtered = make_thread_table(&inspector, "proc.name in (\"" + name + "\")");
+
+			//
+			// The first flush only schedules the next one
+			//
+			filtered->flush(evt);
+			continue;
+		}
+
+		filtered->flush(evt);
+		count_names(filtered->get_sample(0), &filtered_counts);
+		(*nsamples)++;
+
+		if(filtered_counts.size() > 1 || filtered_counts[name] != all_counts[name])
+		{
+			fprintf(stderr, "%" PRIu64 ": %u threads named %s, the filtered table has %u of %u\n",
+				evt->get_ts(),
+				all_counts[name],
+				name.c_str(),
+				filtered_counts[name],
+				(uint32_t)filtered->get_sample(0)->size());
+			nerrors++;
+		}
+	}
+
+	inspector.close();
+
+	delete filtered;
+	delete all;
+
+	return nerrors;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t nrules = DEFAULT_NRULES;
+	run_result uncached;
+	run_result cached;
+	int res = EXIT_SUCCESS;
+
+	if(argc < 2)
+	{
+		fprintf(stderr, "usage: %s <trace file> [number of rules]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if(argc > 2)
+	{
+		nrules = (uint32_t)strtoul(argv[2], NULL, 10);
+	}
+
+	vector<string> rules = make_rules(nrules);
+
+	try
+	{
+		uncached = run(argv[1], rules, false);
+		cached = run(argv[1], rules, true);
+	}
+	catch(sinsp_exception& e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+		return EXIT_FAILURE;
+	}
+
+	if(cached.m_nevts == 0)
+	{
+		fprintf(stderr, "no events in %s\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	uint64_t nextractions = cached.m_hits + cached.m_misses;
+
+	printf("events: %" PRIu64 ", rules: %u\n", cached.m_nevts, nrules);
+	printf("ns per event: uncached %.1f, cached %.1f\n",
+		(double)uncached.m_ns / uncached.m_nevts,
+		(double)cached.m_ns / cached.m_nevts);
+	printf("field cache: %u entries, %" PRIu64 " extractions, %" PRIu64 " hits (%.1f%%)\n",
+		cached.m_nentries,
+		nextractions,
+		cached.m_hits,
+		nextractions? (double)cached.m_hits * 100 / nextractions : 0);
+
+	for(uint32_t j = 0; j < nrules; j++)
+	{
+		if(cached.m_matches[j] != uncached.m_matches[j])
+		{
+			fprintf(stderr, "rule %s: matched %" PRIu64 " events with the cache, %" PRIu64 " without\n",
+				rules[j].c_str(),
+				cached.m_matches[j],
+				uncached.m_matches[j]);
+			res = EXIT_FAILURE;
+		}
+	}
+
+	if(cached.m_output_hash != uncached.m_output_hash)
+	{
+		fprintf(stderr, "the events were formatted differently with the cache\n");
+		res = EXIT_FAILURE;
+	}
+
+	try
+	{
+		uint32_t nsamples;
+		uint32_t nerrors = check_thread_tables(argv[1], &nsamples);
+
+		printf("thread tables: %u samples, %u with different rows\n", nsamples, nerrors);
+
+		if(nsamples == 0 || nerrors != 0)
+		{
+			res = EXIT_FAILURE;
+		}
+	}
+	catch(sinsp_exception& e)
+	{
+		fprintf(stderr, "%s\n", e.what());
+		return EXIT_FAILURE;
+	}
+
+	return res;
+}
@@ -0,0 +1,204 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Checks that the memory of the stored enter events goes back down after a
+// burst. A burst of threads blocked in syscalls takes buffers of all the size
+// classes, and then most of the syscalls return. Every round trims the arena
+// like the inspector does, and the benchmark fails if the slabs left are more
+// than what the buffers still in use and the reserve need, or if a buffer
+// handed out after a trim overlaps one in use.
+//
+// Usage: sinsp-evtarena [number of buffers in the burst] [rounds]
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+#define DEFAULT_NBUFS 200000
+#define DEFAULT_NROUNDS 5
+
+//
+// Buffers that stay in use across the rounds, like threads blocked in
+// epoll_wait for the whole capture
+//
+#define NLONG_LIVED 1000
+
+static uint64_t get_time_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+struct entry
+{
+	uint8_t* m_buf;
+	uint32_t m_len;
+	uint8_t m_fill;
+};
+
+static bool check_entry(const entry& e)
+{
+	for(uint32_t j = 0; j < e.m_len; j++)
+	{
+		if(e.m_buf[j] != e.m_fill)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	uint32_t nbufs = (argc > 1)? atoi(argv[1]) : DEFAULT_NBUFS;
+	uint32_t nrounds = (argc > 2)? atoi(argv[2]) : DEFAULT_NROUNDS;
+	sinsp_evt_arena arena;
+	vector<entry> long_lived;
+	vector<entry> burst;
+	uint32_t seed = 12345;
+	int res = EXIT_SUCCESS;
+
+	for(uint32_t j = 0; j < NLONG_LIVED; j++)
+	{
+		entry e;
+
+		seed = seed * 1103515245 + 12345;
+		e.m_len = 8 + (seed >> 8) % 64;
+		e.m_buf = arena.reserve(e.m_len);
+		e.m_fill = (uint8_t)j;
+		memset(e.m_buf, e.m_fill, e.m_len);
+		long_lived.push_back(e);
+	}
+
+	printf("%6s %12s %12s %8s %12s %12s\n", "round", "peak bytes", "after trim", "slabs", "in use", "trim us");
+
+	for(uint32_t r = 0; r < nrounds; r++)
+	{
+		uint64_t peak;
+		uint64_t start;
+		uint64_t trim_ns;
+
+		for(uint32_t j = 0; j < nbufs; j++)
+		{
+			entry e;
+
+			seed = seed * 1103515245 + 12345;
+			e.m_len = 1 + (seed >> 8) % SP_EVT_BUF_SIZE;
+			e.m_buf = arena.reserve(e.m_len);
+			e.m_fill = (uint8_t)(seed >> 24);
+			memset(e.m_buf, e.m_fill, e.m_len);
+			burst.push_back(e);
+		}
+
+		peak = arena.get_size();
+
+		//
+		// Most of the syscalls of the burst return, in no particular order
+		//
+		for(uint32_t j = 0; j < burst.size();)
+		{
+			seed = seed * 1103515245 + 12345;
+
+			if((seed >> 8) % 100 < 99)
+			{
+				if(!check_entry(burst[j]))
+				{
+					fprintf(stderr, "round %u: buffer %u overwritten\n", r, j);
+					res = EXIT_FAILURE;
+				}
+
+				arena.release(burst[j].m_buf);
+				burst[j] = burst.back();
+				burst.pop_back();
+			}
+			else
+			{
+				j++;
+			}
+		}
+
+		start = get_time_ns();
+		arena.trim(SP_EVT_ARENA_RESERVE_SLABS);
+		trim_ns = get_time_ns() - start;
+
+		printf("%6u %12" PRIu64 " %12" PRIu64 " %8u %12" PRIu64 " %12.1lf\n",
+			r,
+			peak,
+			arena.get_size(),
+			arena.get_nslabs(),
+			arena.get_used(),
+			(double)trim_ns / 1000);
+
+		//
+		// Every slab left holds a buffer in use, or is part of the reserve
+		//
+		if(arena.get_nslabs() > long_lived.size() + burst.size() + 8 * SP_EVT_ARENA_RESERVE_SLABS)
+		{
+			fprintf(stderr, "round %u: %u slabs left for %u buffers in use\n",
+				r, arena.get_nslabs(), (uint32_t)(long_lived.size() + burst.size()));
+			res = EXIT_FAILURE;
+		}
+
+		if(r == 0 && arena.get_size() >= peak)
+		{
+			fprintf(stderr, "round %u: the trim freed nothing\n", r);
+			res = EXIT_FAILURE;
+		}
+	}
+
+	for(uint32_t j = 0; j < long_lived.size(); j++)
+	{
+		if(!check_entry(long_lived[j]))
+		{
+			fprintf(stderr, "long lived buffer %u overwritten\n", j);
+			res = EXIT_FAILURE;
+		}
+
+		arena.release(long_lived[j].m_buf);
+	}
+
+	for(uint32_t j = 0; j < burst.size(); j++)
+	{
+		if(!check_entry(burst[j]))
+		{
+			fprintf(stderr, "buffer %u overwritten\n", j);
+			res = EXIT_FAILURE;
+		}
+
+		arena.release(burst[j].m_buf);
+	}
+
+	arena.trim(0);
+
+	if(arena.get_size() != 0 || arena.get_used() != 0)
+	{
+		fprintf(stderr, "%" PRIu64 " bytes left after releasing everything\n", arena.get_size());
+		res = EXIT_FAILURE;
+	}
+
+	return res;
+}
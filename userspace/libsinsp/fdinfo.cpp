@@ -281,12 +281,70 @@ template<> void sinsp_fdinfo_t::unregister_event_callback(sinsp_pd_callback_type
 ///////////////////////////////////////////////////////////////////////////////
 // sinsp_fdtable implementation
 ///////////////////////////////////////////////////////////////////////////////
-sinsp_fdtable::sinsp_fdtable(sinsp* inspector)
+fdinfo_pool_t* sinsp_fdtable::get_pool(sinsp* inspector)
+{
+	if(inspector == NULL || inspector->m_thread_manager == NULL)
+	{
+		return NULL;
+	}
+
+	return &inspector->m_thread_manager->m_fdinfo_pool;
+}
+
+sinsp_fdtable::sinsp_fdtable(sinsp* inspector) :
+	m_table(get_pool(inspector))
 {
 	m_inspector = inspector;
+	m_lazy_pid = -1;
 	reset_cache();
 }
 
+sinsp_fdinfo_t* sinsp_fdtable::lazy_import(int64_t fd)
+{
+	scap_fdinfo scap_fdi;
+	sinsp_fdinfo_t newfdi;
+
+	if(!m_lazy_tried.insert(fd).second)
+	{
+#ifdef GATHER_INTERNAL_STATS
+		m_inspector->m_stats.m_n_failed_fd_lookups++;
+#endif
+		return NULL;
+	}
+
+	if(scap_fd_lookup(m_inspector->m_h, m_lazy_pid, fd, &scap_fdi) != SCAP_SUCCESS)
+	{
+#ifdef GATHER_INTERNAL_STATS
+		m_inspector->m_stats.m_n_failed_fd_lookups++;
+#endif
+		return NULL;
+	}
+
+	//
+	// The fd is added by the thread, which knows how to convert it
+	//
+	sinsp_threadinfo* tinfo = m_inspector->get_thread(m_lazy_pid, false, true);
+	if(tinfo == NULL || &tinfo->m_fdtable != this)
+	{
+		return NULL;
+	}
+
+	tinfo->add_fd_from_scap(&scap_fdi, &newfdi);
+
+	sinsp_fdinfo_t* fdinfo = m_table.get(fd);
+	if(fdinfo == NULL)
+	{
+		return NULL;
+	}
+
+	tinfo->fix_socket_coming_from_proc(fdinfo);
+
+#ifdef GATHER_INTERNAL_STATS
+	m_inspector->m_stats.m_n_lazy_fd_imports++;
+#endif
+	return fdinfo;
+}
+
 sinsp_fdinfo_t* sinsp_fdtable::add(int64_t fd, sinsp_fdinfo_t* fdinfo)
 {
 	//
@@ -299,6 +357,11 @@ sinsp_fdinfo_t* sinsp_fdtable::add(int64_t fd, sinsp_fdinfo_t* fdinfo)
 	//   a. the table size is under the limit so create a new entry
 	//   b. table size is over the limit, discard the fd
 	// 2. fd is already in the table, replace it
+	if(m_lazy_pid != -1)
+	{
+		m_lazy_tried.insert(fd);
+	}
+
 	if(it == m_table.end())
 	{
 		if(m_table.size() < m_inspector->m_max_fdtable_size)
@@ -310,8 +373,7 @@ sinsp_fdinfo_t* sinsp_fdtable::add(int64_t fd, sinsp_fdinfo_t* fdinfo)
 #ifdef GATHER_INTERNAL_STATS
 			m_inspector->m_stats.m_n_added_fds++;
 #endif
-			pair<unordered_map<int64_t, sinsp_fdinfo_t>::iterator, bool> insert_res = m_table.emplace(fd, *fdinfo);
-			return &(insert_res.first->second);
+			return m_table.insert(fd, *fdinfo);
 		}
 		else
 		{
@@ -334,7 +396,7 @@ sinsp_fdinfo_t* sinsp_fdtable::add(int64_t fd, sinsp_fdinfo_t* fdinfo)
 			fdinfo->m_flags &= ~sinsp_fdinfo_t::FLAGS_CLOSE_IN_PROGRESS;
 			fdinfo->m_flags |= sinsp_fdinfo_t::FLAGS_CLOSE_CANCELED;
 
-			m_table[CANCELED_FD_NUMBER] = it->second;
+			m_table.insert(CANCELED_FD_NUMBER, it->second);
 		}
 		else
 		{
@@ -361,7 +423,7 @@ sinsp_fdinfo_t* sinsp_fdtable::add(int64_t fd, sinsp_fdinfo_t* fdinfo)
 
 void sinsp_fdtable::erase(int64_t fd)
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit = m_table.find(fd);
+	fdinfo_map_iterator_t fdit = m_table.find(fd);
 
 	if(fd == m_last_accessed_fd)
 	{
@@ -394,6 +456,7 @@ void sinsp_fdtable::erase(int64_t fd)
 void sinsp_fdtable::clear()
 {
 	m_table.clear();
+	m_lazy_tried.clear();
 }
 
 size_t sinsp_fdtable::size()
@@ -391,6 +391,10 @@ private:
 ///////////////////////////////////////////////////////////////////////////////
 // fd info table
 ///////////////////////////////////////////////////////////////////////////////
+typedef sinsp_fd_map<sinsp_fdinfo_t, FD_TABLE_DIRECT_SIZE> fdinfo_map_t;
+typedef fdinfo_map_t::iterator fdinfo_map_iterator_t;
+typedef fdinfo_map_t::pool_t fdinfo_pool_t;
+
 class sinsp_fdtable
 {
 public:
@@ -398,26 +402,43 @@ public:
 
 	inline sinsp_fdinfo_t* find(int64_t fd)
 	{
-		unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+		sinsp_fdinfo_t* fdinfo;
 
-		//
-		// Try looking up in our simple cache
-		//
-		if(m_last_accessed_fd != -1 && fd == m_last_accessed_fd)
+		if(m_table.is_direct(fd))
+		{
+			//
+			// Low fds are a single indexed load, no need for the cache
+			//
+			fdinfo = m_table.get_direct(fd);
+		}
+		else
 		{
+			//
+			// Try looking up in our simple cache
+			//
+			if(m_last_accessed_fd != -1 && fd == m_last_accessed_fd)
+			{
 	#ifdef GATHER_INTERNAL_STATS
-			m_inspector->m_stats.m_n_cached_fd_lookups++;
+				m_inspector->m_stats.m_n_cached_fd_lookups++;
 	#endif
-			return m_last_accessed_fdinfo;
-		}
+				return m_last_accessed_fdinfo;
+			}
 
-		//
-		// Caching failed, do a real lookup
-		//
-		fdit = m_table.find(fd);
+			fdinfo = m_table.get_spilled(fd);
+			if(fdinfo != NULL)
+			{
+				m_last_accessed_fd = fd;
+				m_last_accessed_fdinfo = fdinfo;
+			}
+		}
 
-		if(fdit == m_table.end())
+		if(fdinfo == NULL)
 		{
+			if(m_lazy_pid != -1)
+			{
+				return lazy_import(fd);
+			}
+
 	#ifdef GATHER_INTERNAL_STATS
 			m_inspector->m_stats.m_n_failed_fd_lookups++;
 	#endif
@@ -428,9 +449,7 @@ public:
 	#ifdef GATHER_INTERNAL_STATS
 			m_inspector->m_stats.m_n_noncached_fd_lookups++;
 	#endif
-			m_last_accessed_fd = fd;
-			m_last_accessed_fdinfo = &(fdit->second);
-			return &(fdit->second);
+			return fdinfo;
 		}
 	}
 	
@@ -443,11 +462,28 @@ public:
 	void reset_cache();
 
 	sinsp* m_inspector;
-	unordered_map<int64_t, sinsp_fdinfo_t> m_table;
+	fdinfo_map_t m_table;
 
 	//
-	// Simple fd cache
+	// Simple fd cache, for the fds that are not in the direct part of the table
 	//
 	int64_t m_last_accessed_fd;
 	sinsp_fdinfo_t *m_last_accessed_fdinfo;
+
+	//
+	// If the process was found in /proc when the fds are read lazily, its
+	// pid. The fds that are not in the table are then looked up in /proc the
+	// first time they're used. m_lazy_tried has the fds that have been looked
+	// up or added since, which don't need to be looked up again.
+	//
+	int64_t m_lazy_pid;
+	unordered_set<int64_t> m_lazy_tried;
+
+private:
+	sinsp_fdinfo_t* lazy_import(int64_t fd);
+
+	//
+	// The tables of an inspector share its pool of entries
+	//
+	static fdinfo_pool_t* get_pool(sinsp* inspector);
 };
@@ -0,0 +1,453 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "objpool.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// A map from fd number to fd info, used for the fd table of a process.
+//
+// The fds of a process are mostly small, dense integers. The ones below
+// DIRECT_SIZE are found by indexing an array of pointers, which grows up to
+// the highest of them that has been added, and their entries can come from
+// a pool shared by all the tables. Other fds, like the high ones
+// handed out by dup2() and the fake CANCELED_FD_NUMBER, spill into an
+// unordered_map.
+//
+// The entries never move, so pointers to them stay valid until they are
+// erased, like with unordered_map. Iteration returns the direct fds in fd
+// order, then the spilled ones.
+///////////////////////////////////////////////////////////////////////////////
+template<typename T, int64_t DIRECT_SIZE>
+class sinsp_fd_map
+{
+public:
+	typedef std::pair<const int64_t, T> value_type;
+	typedef sinsp_obj_pool<value_type> pool_t;
+
+private:
+	typedef std::unordered_map<int64_t, T> spill_map_t;
+
+public:
+	class iterator
+	{
+	public:
+		iterator():
+			m_map(NULL),
+			m_pos(0)
+		{
+		}
+
+		value_type& operator*() const
+		{
+			return *get();
+		}
+
+		value_type* operator->() const
+		{
+			return get();
+		}
+
+		iterator& operator++()
+		{
+			if(m_pos < m_map->m_direct.size())
+			{
+				m_pos = m_map->next_direct(m_pos + 1);
+				if(m_pos == m_map->m_direct.size())
+				{
+					m_spill_it = m_map->m_spill.begin();
+				}
+			}
+			else
+			{
+				++m_spill_it;
+			}
+
+			return *this;
+		}
+
+		iterator operator++(int)
+		{
+			iterator res = *this;
+			++(*this);
+			return res;
+		}
+
+		bool operator==(const iterator& other) const
+		{
+			if(m_map != other.m_map || m_pos != other.m_pos)
+			{
+				return false;
+			}
+
+			return m_pos < m_map->m_direct.size() || m_spill_it == other.m_spill_it;
+		}
+
+		bool operator!=(const iterator& other) const
+		{
+			return !(*this == other);
+		}
+
+	private:
+		iterator(sinsp_fd_map* map, size_t pos, typename spill_map_t::iterator spill_it):
+			m_map(map),
+			m_pos(pos),
+			m_spill_it(spill_it)
+		{
+		}
+
+		value_type* get() const
+		{
+			if(m_pos < m_map->m_direct.size())
+			{
+				return m_map->m_direct[m_pos];
+			}
+
+			return &(*m_spill_it);
+		}
+
+		//
+		// Position in the direct part. Once it's past its end, m_spill_it
+		// walks the spilled fds.
+		//
+		sinsp_fd_map* m_map;
+		size_t m_pos;
+		typename spill_map_t::iterator m_spill_it;
+
+		friend class sinsp_fd_map;
+	};
+
+	//
+	// The entries of the direct part are taken from pool, or from the heap if
+	// it's NULL. The pool must outlive the map.
+	//
+	sinsp_fd_map(pool_t* pool = NULL):
+		m_pool(pool),
+		m_size(0)
+	{
+	}
+
+	//
+	// The copy shares the pool of other
+	//
+	sinsp_fd_map(const sinsp_fd_map& other):
+		m_pool(other.m_pool),
+		m_size(0)
+	{
+		copy_from(other);
+	}
+
+	//
+	// The moved map takes the entries and the pool of other
+	//
+	sinsp_fd_map(sinsp_fd_map&& other):
+		m_pool(other.m_pool),
+		m_direct(std::move(other.m_direct)),
+		m_spill(std::move(other.m_spill)),
+		m_size(other.m_size)
+	{
+		other.m_direct.clear();
+		other.m_spill.clear();
+		other.m_size = 0;
+	}
+
+	~sinsp_fd_map()
+	{
+		clear();
+	}
+
+	//
+	// The assigned map keeps its own pool
+	//
+	sinsp_fd_map& operator=(const sinsp_fd_map& other)
+	{
+		if(this != &other)
+		{
+			clear();
+			copy_from(other);
+		}
+
+		return *this;
+	}
+
+	//
+	// The entries of other are taken only if they come from the same pool,
+	// otherwise they are copied
+	//
+	sinsp_fd_map& operator=(sinsp_fd_map&& other)
+	{
+		if(this == &other)
+		{
+			return *this;
+		}
+
+		clear();
+
+		if(m_pool != other.m_pool)
+		{
+			copy_from(other);
+			return *this;
+		}
+
+		m_direct.swap(other.m_direct);
+		m_spill.swap(other.m_spill);
+		m_size = other.m_size;
+		other.m_size = 0;
+
+		return *this;
+	}
+
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	bool empty() const
+	{
+		return m_size == 0;
+	}
+
+	iterator begin()
+	{
+		size_t pos = next_direct(0);
+		return iterator(this, pos, m_spill.begin());
+	}
+
+	iterator end()
+	{
+		return iterator(this, m_direct.size(), m_spill.end());
+	}
+
+	//
+	// True if fd belongs to the direct part of the table, where get_direct()
+	// can look it up
+	//
+	inline bool is_direct(int64_t fd) const
+	{
+		return fd >= 0 && fd < DIRECT_SIZE;
+	}
+
+	inline T* get_direct(int64_t fd)
+	{
+		if((uint64_t)fd < m_direct.size())
+		{
+			value_type* entry = m_direct[fd];
+			if(entry != NULL)
+			{
+				return &entry->second;
+			}
+		}
+
+		return NULL;
+	}
+
+	T* get_spilled(int64_t fd)
+	{
+		if(m_spill.empty())
+		{
+			return NULL;
+		}
+
+		typename spill_map_t::iterator it = m_spill.find(fd);
+		if(it == m_spill.end())
+		{
+			return NULL;
+		}
+
+		return &it->second;
+	}
+
+	//
+	// Return a pointer to the value of fd, or NULL if it's not in the table
+	//
+	inline T* get(int64_t fd)
+	{
+		if(is_direct(fd))
+		{
+			return get_direct(fd);
+		}
+
+		return get_spilled(fd);
+	}
+
+	iterator find(int64_t fd)
+	{
+		if(is_direct(fd))
+		{
+			if((uint64_t)fd < m_direct.size() && m_direct[fd] != NULL)
+			{
+				return iterator(this, fd, m_spill.begin());
+			}
+
+			return end();
+		}
+
+		typename spill_map_t::iterator it = m_spill.find(fd);
+		if(it == m_spill.end())
+		{
+			return end();
+		}
+
+		return iterator(this, m_direct.size(), it);
+	}
+
+	//
+	// Set the value of fd to a copy of value, adding it if it's not in the
+	// table. Return the value in the table.
+	//
+	T* insert(int64_t fd, const T& value)
+	{
+		if(is_direct(fd))
+		{
+			if((uint64_t)fd >= m_direct.size())
+			{
+				//
+				// Grow geometrically, so that a process that opens many fds
+				// doesn't resize the array at every open
+				//
+				size_t size = m_direct.empty()? 16 : m_direct.size() * 2;
+				while(size <= (uint64_t)fd)
+				{
+					size *= 2;
+				}
+
+				if(size > (size_t)DIRECT_SIZE)
+				{
+					size = DIRECT_SIZE;
+				}
+
+				m_direct.resize(size, NULL);
+			}
+
+			value_type** pentry = &m_direct[fd];
+			if(*pentry != NULL)
+			{
+				(*pentry)->second = value;
+			}
+			else
+			{
+				*pentry = new_entry(fd, value);
+				m_size++;
+			}
+
+			return &(*pentry)->second;
+		}
+
+		std::pair<typename spill_map_t::iterator, bool> res = m_spill.emplace(fd, value);
+		if(res.second)
+		{
+			m_size++;
+		}
+		else
+		{
+			res.first->second = value;
+		}
+
+		return &res.first->second;
+	}
+
+	void erase(iterator it)
+	{
+		if(it.m_pos < m_direct.size())
+		{
+			delete_entry(m_direct[it.m_pos]);
+			m_direct[it.m_pos] = NULL;
+		}
+		else
+		{
+			m_spill.erase(it.m_spill_it);
+		}
+
+		m_size--;
+	}
+
+	void clear()
+	{
+		for(size_t j = 0; j < m_direct.size(); j++)
+		{
+			if(m_direct[j] != NULL)
+			{
+				delete_entry(m_direct[j]);
+			}
+		}
+
+		m_direct.clear();
+		m_spill.clear();
+		m_size = 0;
+	}
+
+private:
+	value_type* new_entry(int64_t fd, const T& value)
+	{
+		if(m_pool != NULL)
+		{
+			return m_pool->create(fd, value);
+		}
+
+		return new value_type(fd, value);
+	}
+
+	void delete_entry(value_type* entry)
+	{
+		if(m_pool != NULL)
+		{
+			m_pool->destroy(entry);
+		}
+		else
+		{
+			delete entry;
+		}
+	}
+
+	size_t next_direct(size_t pos) const
+	{
+		while(pos < m_direct.size() && m_direct[pos] == NULL)
+		{
+			pos++;
+		}
+
+		return pos;
+	}
+
+	void copy_from(const sinsp_fd_map& other)
+	{
+		m_direct.resize(other.m_direct.size(), NULL);
+
+		for(size_t j = 0; j < other.m_direct.size(); j++)
+		{
+			if(other.m_direct[j] != NULL)
+			{
+				m_direct[j] = new_entry(other.m_direct[j]->first, other.m_direct[j]->second);
+			}
+		}
+
+		m_spill = other.m_spill;
+
+		m_size = other.m_size;
+	}
+
+	pool_t* m_pool;
+	std::vector<value_type*> m_direct;
+	spill_map_t m_spill;
+	size_t m_size;
+};
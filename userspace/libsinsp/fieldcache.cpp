@@ -0,0 +1,96 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+#ifdef HAS_FILTERING
+#include "filterchecks.h"
+
+sinsp_field_cache::sinsp_field_cache()
+{
+	m_enabled = true;
+	m_generation = 1;
+	m_n_hits = 0;
+	m_n_misses = 0;
+}
+
+shared_ptr<sinsp_field_cache_entry> sinsp_field_cache::get_entry(const string& field, bool sanitize_strings)
+{
+	shared_ptr<sinsp_field_cache_entry>& entry = m_entries[sanitize_strings][field];
+
+	if(!entry)
+	{
+		entry = make_shared<sinsp_field_cache_entry>();
+		entry->m_generation = 0;
+		entry->m_evt = NULL;
+		entry->m_owner = NULL;
+		entry->m_val = NULL;
+		entry->m_len = 0;
+	}
+
+	return entry;
+}
+
+uint8_t* sinsp_field_cache::extract(sinsp_filter_check* chk, sinsp_field_cache_entry* entry, sinsp_field_cache_entry* sibling, sinsp_evt* evt, OUT uint32_t* len, bool sanitize_strings)
+{
+	if(!m_enabled)
+	{
+		return chk->extract(evt, len, sanitize_strings);
+	}
+
+	if(entry->m_generation == m_generation && entry->m_evt == evt)
+	{
+		m_n_hits++;
+		*len = entry->m_len;
+		return entry->m_val;
+	}
+
+	m_n_misses++;
+
+	if(sibling != NULL)
+	{
+		release(chk, sibling);
+	}
+
+	//
+	// Not all the extractors set the length, and the value is shared with
+	// callers that rely on it being 0 in that case
+	//
+	*len = 0;
+	entry->m_val = chk->extract(evt, len, sanitize_strings);
+	entry->m_len = *len;
+	entry->m_generation = m_generation;
+	entry->m_evt = evt;
+	entry->m_owner = chk;
+
+	return entry->m_val;
+}
+
+void sinsp_field_cache::release(sinsp_filter_check* chk, sinsp_field_cache_entry* entry)
+{
+	if(entry->m_owner == chk)
+	{
+		entry->m_generation = 0;
+		entry->m_evt = NULL;
+		entry->m_owner = NULL;
+		entry->m_val = NULL;
+	}
+}
+
+#endif // HAS_FILTERING
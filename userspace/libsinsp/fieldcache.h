@@ -0,0 +1,118 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#ifdef HAS_FILTERING
+
+class sinsp_filter_check;
+
+//
+// The value of a field for the current event. The value stays in the storage
+// of the check that extracted it, which is the owner of the entry.
+//
+struct sinsp_field_cache_entry
+{
+	uint64_t m_generation; // 0 if the entry is empty
+	sinsp_evt* m_evt;
+	sinsp_filter_check* m_owner;
+	uint8_t* m_val;
+	uint32_t m_len;
+};
+
+/*!
+  \brief The values of the fields extracted from the current event.
+
+  The checks of the same field, in the filters, the formatters and the
+  chisels, share an entry, so that the field is extracted only once per
+  event. The field is identified by its name as it was written, including
+  its argument, and by whether its strings are sanitized. The entries are
+  valid for the event and the generation they were filled for, and every
+  \ref sinsp::next() starts a new generation.
+*/
+class SINSP_PUBLIC sinsp_field_cache
+{
+public:
+	sinsp_field_cache();
+
+	/*!
+	  \brief Invalidate all the entries. Called for every new event, and
+	   by the code that reuses a fake event for every row of the thread
+	   table, before each row.
+	*/
+	inline void invalidate()
+	{
+		m_generation++;
+	}
+
+	/*!
+	  \brief Enable or disable the cache. When it's disabled, every value is
+	   extracted by the check that asks for it. The cache is enabled by
+	   default.
+	*/
+	void set_enabled(bool enabled)
+	{
+		m_enabled = enabled;
+		invalidate();
+	}
+
+	/*!
+	  \brief Return the entry of the given field, adding it if needed.
+	*/
+	shared_ptr<sinsp_field_cache_entry> get_entry(const string& field, bool sanitize_strings);
+
+	/*!
+	  \brief Return the value of the entry for the given event, extracting it
+	   with the given check if the entry is for another event.
+
+	  \param sibling The entry of the same check with the other sanitize mode,
+	   or NULL. Extracting the value overwrites the storage of the check, so
+	   the sibling is dropped if the check owns it.
+	*/
+	uint8_t* extract(sinsp_filter_check* chk, sinsp_field_cache_entry* entry, sinsp_field_cache_entry* sibling, sinsp_evt* evt, OUT uint32_t* len, bool sanitize_strings);
+
+	/*!
+	  \brief Drop the value that the given check owns, when the check goes
+	   away.
+	*/
+	static void release(sinsp_filter_check* chk, sinsp_field_cache_entry* entry);
+
+	/*!
+	  \brief Return the number of values that were found in the cache, and
+	   the number of ones that had to be extracted.
+	*/
+	void get_stats(OUT uint64_t* nhits, OUT uint64_t* nmisses) const
+	{
+		*nhits = m_n_hits;
+		*nmisses = m_n_misses;
+	}
+
+	uint32_t size() const
+	{
+		return (uint32_t)(m_entries[0].size() + m_entries[1].size());
+	}
+
+private:
+	unordered_map<string, shared_ptr<sinsp_field_cache_entry>> m_entries[2];
+	bool m_enabled;
+	uint64_t m_generation;
+	uint64_t m_n_hits;
+	uint64_t m_n_misses;
+};
+
+#endif // HAS_FILTERING
@@ -39,6 +39,7 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 #ifdef HAS_FILTERING
 #include "filter.h"
 #include "filterchecks.h"
+#include "filterprogram.h"
 #include "value_parser.h"
 #ifndef _WIN32
 #include "arpa/inet.h"
@@ -541,11 +542,57 @@ sinsp_filter_check::sinsp_filter_check()
 	m_val_storages_max_size = (numeric_limits<uint32_t>::min)();
 }
 
+
+sinsp_filter_check::~sinsp_filter_check()
+{
+	//
+	// The entries might still point to the storage of this check
+	//
+	for(uint32_t j = 0; j < 2; j++)
+	{
+		if(m_cache_entries[j])
+		{
+			sinsp_field_cache::release(this, m_cache_entries[j].get());
+		}
+	}
+}
+
 void sinsp_filter_check::set_inspector(sinsp* inspector)
 {
 	m_inspector = inspector;
 }
 
+uint8_t* sinsp_filter_check::extract_cached(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings)
+{
+	uint32_t mode = sanitize_strings? 1 : 0;
+
+	if(!m_cache_lookup_done[mode])
+	{
+		//
+		// The field name is what identifies the value, so checks that
+		// weren't created from a field name are never cached
+		//
+		if(m_inspector != NULL && !m_field_name.empty() && has_cacheable_value())
+		{
+			m_cache_entries[mode] = m_inspector->get_field_cache()->get_entry(m_field_name, sanitize_strings);
+		}
+
+		m_cache_lookup_done[mode] = true;
+	}
+
+	if(!m_cache_entries[mode])
+	{
+		return extract(evt, len, sanitize_strings);
+	}
+
+	return m_inspector->get_field_cache()->extract(this,
+		m_cache_entries[mode].get(),
+		m_cache_entries[1 - mode].get(),
+		evt,
+		len,
+		sanitize_strings);
+}
+
 Json::Value sinsp_filter_check::rawval_to_json(uint8_t* rawval, const filtercheck_field_info* finfo, uint32_t len)
 {
 	ASSERT(rawval != NULL);
@@ -942,7 +989,7 @@ char* sinsp_filter_check::rawval_to_string(uint8_t* rawval, const filtercheck_fi
 char* sinsp_filter_check::tostring(sinsp_evt* evt)
 {
 	uint32_t len;
-	uint8_t* rawval = extract(evt, &len);
+	uint8_t* rawval = extract_cached(evt, &len);
 
 	if(rawval == NULL)
 	{
@@ -959,7 +1006,7 @@ Json::Value sinsp_filter_check::tojson(sinsp_evt* evt)
 
 	if(jsonval == Json::nullValue)
 	{
-		uint8_t* rawval = extract(evt, &len);
+		uint8_t* rawval = extract_cached(evt, &len);
 		if(rawval == NULL)
 		{
 			return Json::nullValue;
@@ -1022,6 +1069,20 @@ void sinsp_filter_check::add_filter_value(const char* str, uint32_t len, uint16_
 
 	parse_filter_value(str, len, filter_value_p(i), filter_value(i).size());
 
+	if(i > 0)
+	{
+		m_val_text += ", ";
+	}
+
+	if(len == 0 || memchr(str, ' ', len) != NULL)
+	{
+		m_val_text += '"' + string(str, len) + '"';
+	}
+	else
+	{
+		m_val_text.append(str, len);
+	}
+
 	// XXX/mstemm this doesn't work if someone called
 	// add_filter_value more than once for a given index.
 	filter_value_member_t item(filter_value_p(i), len);
@@ -1099,7 +1160,7 @@ bool sinsp_filter_check::compare(sinsp_evt *evt)
 {
 	uint32_t evt_val_len=0;
 	bool sanitize_strings = false;
-	uint8_t* extracted_val = extract(evt, &evt_val_len, sanitize_strings);
+	uint8_t* extracted_val = extract_cached(evt, &evt_val_len, sanitize_strings);
 
 	if(extracted_val == NULL)
 	{
@@ -1113,6 +1174,120 @@ bool sinsp_filter_check::compare(sinsp_evt *evt)
 			   m_val_storage_len);
 }
 
+uint32_t sinsp_filter_check::get_compare_cost()
+{
+	ppm_param_type type = m_info.m_fields[m_field_id].m_type;
+	bool is_string = (type == PT_CHARBUF || type == PT_BYTEBUF);
+
+	switch(m_cmpop)
+	{
+	case CO_EXISTS:
+		return 0;
+	case CO_IN:
+		return 3;
+	case CO_CONTAINS:
+	case CO_ICONTAINS:
+	case CO_STARTSWITH:
+		return 4;
+	case CO_GLOB:
+		return 8;
+	default:
+		return is_string? 2 : 1;
+	}
+}
+
+uint32_t sinsp_filter_check::get_cost()
+{
+	return 5 + get_compare_cost();
+}
+
+double sinsp_filter_check::get_true_rate()
+{
+	sinsp_evttype_set can_be_true;
+	sinsp_evttype_set can_be_false;
+	double rate;
+
+	//
+	// Guesses for the fields that don't restrict the event types
+	//
+	switch(m_cmpop)
+	{
+	case CO_EQ:
+	case CO_CONTAINS:
+	case CO_ICONTAINS:
+	case CO_STARTSWITH:
+	case CO_GLOB:
+		rate = 0.1;
+		break;
+	case CO_NE:
+	case CO_EXISTS:
+		rate = 0.9;
+		break;
+	case CO_IN:
+		rate = min(0.1 * m_val_storages_members.size(), 0.5);
+		break;
+	default:
+		rate = 0.5;
+		break;
+	}
+
+	get_evttypes(&can_be_true, &can_be_false);
+
+	return min(rate, (double)can_be_true.count() / can_be_true.size());
+}
+
+string sinsp_filter_check::get_filter_text()
+{
+	string res = m_field_name;
+
+	if(res.empty() && m_field != NULL)
+	{
+		res = m_field->m_name;
+	}
+
+	switch(m_cmpop)
+	{
+	case CO_EQ:
+		res += " = ";
+		break;
+	case CO_NE:
+		res += " != ";
+		break;
+	case CO_LT:
+		res += " < ";
+		break;
+	case CO_LE:
+		res += " <= ";
+		break;
+	case CO_GT:
+		res += " > ";
+		break;
+	case CO_GE:
+		res += " >= ";
+		break;
+	case CO_CONTAINS:
+		res += " contains ";
+		break;
+	case CO_ICONTAINS:
+		res += " icontains ";
+		break;
+	case CO_STARTSWITH:
+		res += " startswith ";
+		break;
+	case CO_GLOB:
+		res += " glob ";
+		break;
+	case CO_IN:
+		return res + " in (" + m_val_text + ")";
+	case CO_EXISTS:
+		return res + " exists";
+	default:
+		return res;
+	}
+
+	return res + m_val_text;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // sinsp_filter_expression implementation
 ///////////////////////////////////////////////////////////////////////////////
@@ -1237,6 +1412,284 @@ bool sinsp_filter_expression::compare(sinsp_evt *evt)
 	return res;
 }
 
+//
+// Estimate a check or a subexpression, not counting the negation
+//
+static void estimate_check(sinsp_filter_check* chk, OUT double* cost, OUT double* true_rate)
+{
+	sinsp_filter_expression* subexpr = dynamic_cast<sinsp_filter_expression*>(chk);
+
+	if(subexpr != NULL)
+	{
+		subexpr->estimate(cost, true_rate);
+	}
+	else
+	{
+		*cost = chk->get_cost();
+		*true_rate = chk->get_true_rate();
+	}
+}
+
+bool sinsp_filter_expression::is_movable()
+{
+	for(auto chk : m_checks)
+	{
+		sinsp_filter_expression* subexpr = dynamic_cast<sinsp_filter_expression*>(chk);
+
+		if(subexpr != NULL)
+		{
+			if(!subexpr->is_movable())
+			{
+				return false;
+			}
+		}
+		else if(chk->has_side_effects() || chk->get_check_id() != 0)
+		{
+			//
+			// The check id that the event gets depends on which checks run
+			//
+			return false;
+		}
+	}
+
+	return true;
+}
+
+//
+// A run of checks of the chain that is moved as a whole
+//
+struct filter_chain_unit
+{
+	uint32_t m_first;
+	uint32_t m_size;
+	double m_rank;
+};
+
+bool sinsp_filter_expression::reorder()
+{
+	uint32_t size = (uint32_t)m_checks.size();
+	bool changed = false;
+	uint32_t j;
+
+	for(j = 0; j < size; j++)
+	{
+		sinsp_filter_expression* subexpr = dynamic_cast<sinsp_filter_expression*>(m_checks[j]);
+
+		if(subexpr != NULL && subexpr->reorder())
+		{
+			changed = true;
+		}
+	}
+
+	if(size < 2)
+	{
+		return changed;
+	}
+
+	//
+	// The checks are joined from left to right, so only a chain with a
+	// single operator can be reordered without changing its meaning
+	//
+	boolop chainop = (m_checks[1]->m_boolop & BO_AND)? BO_AND : BO_OR;
+
+	for(j = 1; j < size; j++)
+	{
+		if(!(m_checks[j]->m_boolop & chainop))
+		{
+			return changed;
+		}
+	}
+
+	if(!is_movable())
+	{
+		return changed;
+	}
+
+	//
+	// Split the chain in units. The ORs of the same field stay together, so
+	// that the filter program can still match them all at once.
+	//
+	vector<filter_chain_unit> units;
+
+	for(j = 0; j < size; j++)
+	{
+		sinsp_filter_check* chk = m_checks[j];
+
+		if(chainop == BO_OR && units.size() != 0 &&
+			!(chk->m_boolop & BO_NOT) &&
+			!chk->m_field_name.empty() &&
+			dynamic_cast<sinsp_filter_expression*>(chk) == NULL)
+		{
+			sinsp_filter_check* prev = m_checks[j - 1];
+
+			if(!(prev->m_boolop & BO_NOT) && prev->m_field_name == chk->m_field_name)
+			{
+				units.back().m_size++;
+				continue;
+			}
+		}
+
+		units.push_back({j, 1, 0});
+	}
+
+	//
+	// A chain of ANDs stops at the first false check, one of ORs at the first
+	// true one, so the units run in order of cost over the chance of
+	// stopping
+	//
+	for(auto& unit : units)
+	{
+		double cost = 0;
+		double false_rate = 1;
+
+		for(j = unit.m_first; j < unit.m_first + unit.m_size; j++)
+		{
+			double chk_cost;
+			double chk_true_rate;
+
+			estimate_check(m_checks[j], &chk_cost, &chk_true_rate);
+
+			if(m_checks[j]->m_boolop & BO_NOT)
+			{
+				chk_true_rate = 1 - chk_true_rate;
+			}
+
+			cost += chk_cost * false_rate;
+			false_rate *= 1 - chk_true_rate;
+		}
+
+		double stop_rate = (chainop == BO_AND)? false_rate : 1 - false_rate;
+
+		unit.m_rank = (stop_rate > 0)? cost / stop_rate : numeric_limits<double>::max();
+	}
+
+	stable_sort(units.begin(), units.end(),
+		[](const filter_chain_unit& a, const filter_chain_unit& b)
+		{
+			return a.m_rank < b.m_rank;
+		});
+
+	vector<sinsp_filter_check*> checks;
+
+	for(auto& unit : units)
+	{
+		for(j = unit.m_first; j < unit.m_first + unit.m_size; j++)
+		{
+			checks.push_back(m_checks[j]);
+		}
+	}
+
+	if(checks == m_checks)
+	{
+		return changed;
+	}
+
+	for(j = 0; j < size; j++)
+	{
+		uint32_t negate = checks[j]->m_boolop & BO_NOT;
+
+		checks[j]->m_boolop = (boolop)(((j == 0)? BO_NONE : chainop) | negate);
+	}
+
+	m_checks = checks;
+	return true;
+}
+
+void sinsp_filter_expression::estimate(OUT double* cost, OUT double* true_rate)
+{
+	*cost = 0;
+	*true_rate = 1;
+
+	//
+	// "a or b and c" is "a or (b and c)", so the estimates are combined from
+	// the last check back
+	//
+	for(int32_t j = (int32_t)m_checks.size() - 1; j >= 0; j--)
+	{
+		sinsp_filter_check* chk = m_checks[j];
+		double chk_cost;
+		double chk_true_rate;
+
+		estimate_check(chk, &chk_cost, &chk_true_rate);
+
+		if(chk->m_boolop & BO_NOT)
+		{
+			chk_true_rate = 1 - chk_true_rate;
+		}
+
+		if(j == (int32_t)m_checks.size() - 1)
+		{
+			*cost = chk_cost;
+			*true_rate = chk_true_rate;
+		}
+		else if(m_checks[j + 1]->m_boolop & BO_OR)
+		{
+			*cost = chk_cost + (1 - chk_true_rate) * *cost;
+			*true_rate = chk_true_rate + (1 - chk_true_rate) * *true_rate;
+		}
+		else
+		{
+			*cost = chk_cost + chk_true_rate * *cost;
+			*true_rate = chk_true_rate * *true_rate;
+		}
+	}
+}
+
+void sinsp_filter_expression::explain(uint32_t depth, OUT string* res)
+{
+	string indent(depth * 4, ' ');
+	char estimates[64];
+
+	for(auto chk : m_checks)
+	{
+		sinsp_filter_expression* subexpr = dynamic_cast<sinsp_filter_expression*>(chk);
+		double cost;
+		double true_rate;
+		string op;
+
+		switch(chk->m_boolop)
+		{
+		case BO_NOT:
+			op = "not ";
+			break;
+		case BO_AND:
+			op = "and ";
+			break;
+		case BO_OR:
+			op = "or ";
+			break;
+		case BO_ANDNOT:
+			op = "and not ";
+			break;
+		case BO_ORNOT:
+			op = "or not ";
+			break;
+		default:
+			break;
+		}
+
+		estimate_check(chk, &cost, &true_rate);
+
+		if(chk->m_boolop & BO_NOT)
+		{
+			true_rate = 1 - true_rate;
+		}
+
+		snprintf(estimates, sizeof(estimates), " [cost %.1f, true %.1f%%]\n", cost, true_rate * 100);
+
+		if(subexpr != NULL)
+		{
+			*res += indent + op + "(\n";
+			subexpr->explain(depth + 1, res);
+			*res += indent + ")" + estimates;
+		}
+		else
+		{
+			*res += indent + op + chk->get_filter_text() + estimates;
+		}
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // sinsp_filter implementation
 ///////////////////////////////////////////////////////////////////////////////
@@ -1245,7 +1698,7 @@ sinsp_filter::sinsp_filter(sinsp* inspector)
 	m_inspector = inspector;
 	m_filter = new sinsp_filter_expression();
 	m_curexpr = m_filter;
-
+	m_program = NULL;
 }
 
 sinsp_filter::~sinsp_filter()
@@ -1254,6 +1707,8 @@ sinsp_filter::~sinsp_filter()
 	{
 		delete m_filter;
 	}
+
+	delete m_program;
 }
 
 void sinsp_filter::push_expression(boolop op)
@@ -1277,14 +1732,78 @@ bool sinsp_filter::run(sinsp_evt *evt)
 {
 	//	printf("m_filter: %p", (void*) m_filter);
 	//	ASSERT(m_filter != NULL);
+	if(m_program != NULL)
+	{
+		return m_program->run(evt);
+	}
+
 	return m_filter->compare(evt);
 }
 
 void sinsp_filter::add_check(sinsp_filter_check* chk)
 {
+	//
+	// The program doesn't know about the new check
+	//
+	delete m_program;
+	m_program = NULL;
+
 	m_curexpr->add_check(chk);
 }
 
+void sinsp_filter::compile_program()
+{
+	if(m_filter->reorder())
+	{
+		g_logger.log("filter checks reordered", sinsp_logger::SEV_DEBUG);
+	}
+
+	delete m_program;
+	m_program = new sinsp_filter_program();
+
+	if(!m_program->build(m_filter))
+	{
+		g_logger.log("filter can't be lowered, using the expression tree", sinsp_logger::SEV_DEBUG);
+		delete m_program;
+		m_program = NULL;
+	}
+}
+
+void sinsp_filter::reset_program()
+{
+	delete m_program;
+	m_program = NULL;
+}
+
+bool sinsp_filter::get_evttypes(OUT sinsp_evttype_set* evttypes)
+{
+	if(m_program == NULL)
+	{
+		evttypes->set();
+		return false;
+	}
+
+	*evttypes = m_program->get_evttypes();
+	return !evttypes->all();
+}
+
+string sinsp_filter::explain()
+{
+	string res;
+	double cost;
+	double true_rate;
+	char estimates[128];
+
+	m_filter->explain(0, &res);
+	m_filter->estimate(&cost, &true_rate);
+
+	snprintf(estimates, sizeof(estimates), "estimated cost per event: %.1f, true for %.1f%% of the events\n",
+		cost,
+		true_rate * 100);
+
+	return res + estimates;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // sinsp_filter_compiler implementation
 ///////////////////////////////////////////////////////////////////////////////
@@ -1643,6 +2162,7 @@ void sinsp_filter_compiler::parse_check()
 	chk->m_cmpop = co;
 
 	chk->parse_field_name((char *)&operand1[0], true);
+	chk->m_field_name = str_operand1;
 
 	if(co == CO_IN)
 	{
@@ -1837,6 +2357,7 @@ sinsp_filter* sinsp_filter_compiler::compile_()
 			//
 			// Good filter
 			//
+			m_filter->compile_program();
 			return m_filter;
 
 			break;
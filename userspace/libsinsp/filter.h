@@ -22,6 +22,7 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 
 class sinsp_filter_expression;
 class sinsp_filter_check;
+class sinsp_filter_program;
 
 /*
  * Operators to compare events
@@ -54,6 +55,11 @@ enum boolop
 	BO_ANDNOT = 5,
 };
 
+//
+// A set of event types, indexed by the PPM event type
+//
+typedef bitset<PPM_EVENT_MAX> sinsp_evttype_set;
+
 /** @defgroup filter Filtering events
  * Filtering infrastructure.
  *  @{
@@ -86,6 +92,43 @@ public:
 	void pop_expression();
 	void add_check(sinsp_filter_check* chk);
 
+	/*!
+	  \brief Lower the complete filter into a program, which \ref run() then
+	   executes instead of walking the expression tree. If the filter can't
+	   be lowered, the tree keeps being used. Before that, the AND and OR
+	   chains of the tree are reordered to run the cheap and selective checks
+	   first.
+	*/
+	void compile_program();
+
+	/*!
+	  \brief Drop the program, so that \ref run() walks the expression tree
+	   again.
+	*/
+	void reset_program();
+
+	/*!
+	  \brief Get the event types that the filter can accept. They are found
+	   when the filter is lowered, from the evt.type, evt.dir and
+	   evt.category checks and from the fields that only apply to some
+	   events, like the fd ones.
+
+	  \param evttypes Filled with the event types that the filter can accept.
+	  \return false if the filter can accept any event type, or if it was not
+	   lowered.
+	*/
+	bool get_evttypes(OUT sinsp_evttype_set* evttypes);
+
+	/*!
+	  \brief Describe how the filter is evaluated: its checks in the order
+	   chosen by the compiler, with the estimated cost of each one and the
+	   estimated fraction of the events for which it's true.
+
+	  \return one line per check, followed by the estimates for the whole
+	   filter.
+	*/
+	string explain();
+
 private:
 
 	void parse_check(sinsp_filter_expression* parent_expr, boolop op);
@@ -95,6 +138,7 @@ private:
 
 	sinsp_filter_expression* m_curexpr;
 	sinsp_filter_expression* m_filter;
+	sinsp_filter_program* m_program;
 
 	friend class sinsp_evt_formatter;
 };
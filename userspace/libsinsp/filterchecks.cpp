@@ -285,7 +285,7 @@ uint8_t* sinsp_filter_check_fd::extract_from_null_fd(sinsp_evt *evt, OUT uint32_
 	{
 		if(extract_fdname_from_creator(evt, len, sanitize_strings) == true)
 		{
-			m_tstr = m_tinfo->m_container_id + ':' + m_tstr;
+			m_tstr = m_tinfo->m_container_id.str() + ':' + m_tstr;
 			*len = m_tstr.size();
 			return (uint8_t*)m_tstr.c_str();
 		}
@@ -346,7 +346,7 @@ uint8_t* sinsp_filter_check_fd::extract_from_null_fd(sinsp_evt *evt, OUT uint32_
 				m_tstr = "/";
 			}
 
-			m_tstr = m_tinfo->m_container_id + ':' + m_tstr;
+			m_tstr = m_tinfo->m_container_id.str() + ':' + m_tstr;
 			*len = m_tstr.size();
 			return (uint8_t*)m_tstr.c_str();
 		}
@@ -483,7 +483,7 @@ uint8_t* sinsp_filter_check_fd::extract(sinsp_evt *evt, OUT uint32_t* len, bool
 		if(m_field_id == TYPE_CONTAINERNAME)
 		{
 			ASSERT(m_tinfo != NULL);
-			m_tstr = m_tinfo->m_container_id + ':' + m_fdinfo->m_name;
+			m_tstr = m_tinfo->m_container_id.str() + ':' + m_fdinfo->m_name;
 		}
 		else
 		{
@@ -540,7 +540,7 @@ uint8_t* sinsp_filter_check_fd::extract(sinsp_evt *evt, OUT uint32_t* len, bool
 
 			if(m_field_id == TYPE_CONTAINERDIRECTORY)
 			{
-				m_tstr = m_tinfo->m_container_id + ':' + m_tstr;
+				m_tstr = m_tinfo->m_container_id.str() + ':' + m_tstr;
 			}
 
 			*len = m_tstr.size();
@@ -1272,7 +1272,7 @@ bool sinsp_filter_check_fd::compare(sinsp_evt *evt)
 	//
 	uint32_t len = 0;
 	bool sanitize_strings = false;
-	uint8_t* extracted_val = extract(evt, &len, sanitize_strings);
+	uint8_t* extracted_val = extract_cached(evt, &len, sanitize_strings);
 
 	if(extracted_val == NULL)
 	{
@@ -1285,6 +1285,57 @@ bool sinsp_filter_check_fd::compare(sinsp_evt *evt)
 			   len);
 }
 
+bool sinsp_filter_check_fd::has_plain_compare()
+{
+	return m_field_id != TYPE_IP &&
+		m_field_id != TYPE_PORT &&
+		m_field_id != TYPE_PROTO &&
+		m_field_id != TYPE_NET;
+}
+
+uint32_t sinsp_filter_check_fd::get_cost()
+{
+	switch(m_field_id)
+	{
+	//
+	// Filter only fields, that look at both ends of the connection
+	//
+	case TYPE_IP:
+	case TYPE_PORT:
+	case TYPE_PROTO:
+	case TYPE_NET:
+		return 8;
+	//
+	// These build a new string from the name of the fd
+	//
+	case TYPE_DIRECTORY:
+	case TYPE_FILENAME:
+	case TYPE_CONTAINERNAME:
+	case TYPE_CONTAINERDIRECTORY:
+		return 10 + get_compare_cost();
+	default:
+		return 3 + get_compare_cost();
+	}
+}
+
+void sinsp_filter_check_fd::get_evttypes(OUT sinsp_evttype_set* can_be_true, OUT sinsp_evttype_set* can_be_false)
+{
+	//
+	// extract_fd() finds no fd, and compare() fails, for the events that
+	// don't create, use or destroy one
+	//
+	can_be_true->reset();
+	can_be_false->set();
+
+	for(uint32_t j = 0; j < PPM_EVENT_MAX; j++)
+	{
+		if(g_infotables.m_event_info[j].flags & (EF_CREATES_FD | EF_USES_FD | EF_DESTROYS_FD))
+		{
+			can_be_true->set(j);
+		}
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // sinsp_filter_check_thread implementation
 ///////////////////////////////////////////////////////////////////////////////
@@ -1627,13 +1678,11 @@ uint8_t* sinsp_filter_check_thread::extract(sinsp_evt *evt, OUT uint32_t* len, b
 			}
 		}
 	case TYPE_NAME:
-		m_tstr = tinfo->get_comm();
-		*len = m_tstr.size();
-		return (uint8_t*)m_tstr.c_str();
+		*len = tinfo->m_comm.size();
+		return (uint8_t*)tinfo->m_comm.c_str();
 	case TYPE_EXE:
-		m_tstr = tinfo->get_exe();
-		*len = m_tstr.size();
-		return (uint8_t*)m_tstr.c_str();
+		*len = tinfo->m_exe.size();
+		return (uint8_t*)tinfo->m_exe.c_str();
 	case TYPE_ARGS:
 		{
 			m_tstr.clear();
@@ -2206,6 +2255,34 @@ bool sinsp_filter_check_thread::compare_full_aname(sinsp_evt *evt)
 	return false;
 }
 
+void sinsp_filter_check_thread::parse_filter_value(const char* str, uint32_t len, uint8_t *storage, uint32_t storage_len)
+{
+	sinsp_filter_check::parse_filter_value(str, len, storage, storage_len);
+
+	if(m_field_id == TYPE_NAME || m_field_id == TYPE_EXE)
+	{
+		m_interned_val = string(str, len);
+	}
+}
+
+//
+// The command name and the executable are interned, so an equality check is a
+// pointer comparison with the interned filter value
+//
+bool sinsp_filter_check_thread::compare_interned(sinsp_evt *evt)
+{
+	sinsp_threadinfo* tinfo = evt->get_thread_info();
+
+	if(tinfo == NULL)
+	{
+		return false;
+	}
+
+	bool res = ((m_field_id == TYPE_NAME)? tinfo->m_comm : tinfo->m_exe) == m_interned_val;
+
+	return (m_cmpop == CO_EQ)? res : !res;
+}
+
 bool sinsp_filter_check_thread::compare(sinsp_evt *evt)
 {
 	if(m_field_id == TYPE_APID)
@@ -2222,10 +2299,106 @@ bool sinsp_filter_check_thread::compare(sinsp_evt *evt)
 			return compare_full_aname(evt);
 		}
 	}
+	else if(m_field_id == TYPE_NAME || m_field_id == TYPE_EXE)
+	{
+		if(m_cmpop == CO_EQ || m_cmpop == CO_NE)
+		{
+			return compare_interned(evt);
+		}
+	}
 
 	return sinsp_filter_check::compare(evt);
 }
 
+bool sinsp_filter_check_thread::has_plain_compare()
+{
+	if(m_field_id == TYPE_APID || m_field_id == TYPE_ANAME)
+	{
+		return m_argid != -1;
+	}
+	else if(m_field_id == TYPE_NAME || m_field_id == TYPE_EXE)
+	{
+		return m_cmpop != CO_EQ && m_cmpop != CO_NE;
+	}
+
+	return true;
+}
+
+bool sinsp_filter_check_thread::has_cacheable_value()
+{
+	switch(m_field_id)
+	{
+	//
+	// These ones keep per-check state across the events
+	//
+	case TYPE_EXECTIME:
+	case TYPE_TOTEXECTIME:
+	case TYPE_THREAD_CPU:
+	case TYPE_THREAD_CPU_USER:
+	case TYPE_THREAD_CPU_SYSTEM:
+		return false;
+	case TYPE_APID:
+	case TYPE_ANAME:
+		return m_argid != -1;
+	default:
+		return true;
+	}
+}
+
+uint32_t sinsp_filter_check_thread::get_cost()
+{
+	switch(m_field_id)
+	{
+	case TYPE_NAME:
+	case TYPE_EXE:
+		if(m_cmpop == CO_EQ || m_cmpop == CO_NE)
+		{
+			return 2;
+		}
+
+		return 2 + get_compare_cost();
+	//
+	// Walk the ancestors of the thread, all of them if no generation is given
+	//
+	case TYPE_APID:
+	case TYPE_ANAME:
+		if(m_argid == -1)
+		{
+			return 100;
+		}
+
+		return 5 * (m_argid + 1) + get_compare_cost();
+	case TYPE_SNAME:
+	case TYPE_LOGINSHELLID:
+		return 50 + get_compare_cost();
+	case TYPE_PPID:
+	case TYPE_PNAME:
+		return 5 + get_compare_cost();
+	//
+	// These build a new string
+	//
+	case TYPE_ARGS:
+	case TYPE_ENV:
+	case TYPE_CMDLINE:
+	case TYPE_EXELINE:
+	case TYPE_CWD:
+	case TYPE_CGROUPS:
+	case TYPE_CGROUP:
+		return 10 + get_compare_cost();
+	default:
+		return 2 + get_compare_cost();
+	}
+}
+
+bool sinsp_filter_check_thread::has_side_effects()
+{
+	return m_field_id == TYPE_EXECTIME ||
+		m_field_id == TYPE_TOTEXECTIME ||
+		m_field_id == TYPE_THREAD_CPU ||
+		m_field_id == TYPE_THREAD_CPU_USER ||
+		m_field_id == TYPE_THREAD_CPU_SYSTEM;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // sinsp_filter_check_event implementation
 ///////////////////////////////////////////////////////////////////////////////
@@ -2834,6 +3007,68 @@ uint8_t* sinsp_filter_check_event::extract_error_count(sinsp_evt *evt, OUT uint3
 	return NULL;
 }
 
+//
+// The value of evt.category for the given category and, for the I/O events,
+// the subcategory that the fd of the event gives
+//
+static const char* get_category_name(ppm_event_category category, sinsp_evt::subcategory subcategory)
+{
+	switch(category)
+	{
+	case EC_UNKNOWN:
+		return "unknown";
+	case EC_OTHER:
+		return "other";
+	case EC_FILE:
+		return "file";
+	case EC_NET:
+		return "net";
+	case EC_IPC:
+		return "IPC";
+	case EC_MEMORY:
+		return "memory";
+	case EC_PROCESS:
+		return "process";
+	case EC_SLEEP:
+		return "sleep";
+	case EC_SYSTEM:
+		return "system";
+	case EC_SIGNAL:
+		return "signal";
+	case EC_USER:
+		return "user";
+	case EC_TIME:
+		return "time";
+	case EC_PROCESSING:
+		return "processing";
+	case EC_IO_READ:
+	case EC_IO_WRITE:
+	case EC_IO_OTHER:
+		switch(subcategory)
+		{
+		case sinsp_evt::SC_FILE:
+			return "file";
+		case sinsp_evt::SC_NET:
+			return "net";
+		case sinsp_evt::SC_IPC:
+			return "ipc";
+		case sinsp_evt::SC_NONE:
+		case sinsp_evt::SC_UNKNOWN:
+		case sinsp_evt::SC_OTHER:
+			return "unknown";
+		default:
+			ASSERT(false);
+			return "unknown";
+		}
+	case EC_WAIT:
+		return "wait";
+	case EC_SCHEDULER:
+		return "scheduler";
+	default:
+		return "unknown";
+	}
+}
+
 uint8_t* sinsp_filter_check_event::extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings)
 {
 	switch(m_field_id)
@@ -3141,84 +3376,7 @@ uint8_t* sinsp_filter_check_event::extract(sinsp_evt *evt, OUT uint32_t* len, bo
 		sinsp_evt::category cat;
 		evt->get_category(&cat);
 
-		switch(cat.m_category)
-		{
-		case EC_UNKNOWN:
-			m_strstorage = "unknown";
-			break;
-		case EC_OTHER:
-			m_strstorage = "other";
-			break;
-		case EC_FILE:
-			m_strstorage = "file";
-			break;
-		case EC_NET:
-			m_strstorage = "net";
-			break;
-		case EC_IPC:
-			m_strstorage = "IPC";
-			break;
-		case EC_MEMORY:
-			m_strstorage = "memory";
-			break;
-		case EC_PROCESS:
-			m_strstorage = "process";
-			break;
-		case EC_SLEEP:
-			m_strstorage = "sleep";
-			break;
-		case EC_SYSTEM:
-			m_strstorage = "system";
-			break;
-		case EC_SIGNAL:
-			m_strstorage = "signal";
-			break;
-		case EC_USER:
-			m_strstorage = "user";
-			break;
-		case EC_TIME:
-			m_strstorage = "time";
-			break;
-		case EC_PROCESSING:
-			m_strstorage = "processing";
-			break;
-		case EC_IO_READ:
-		case EC_IO_WRITE:
-		case EC_IO_OTHER:
-		{
-			switch(cat.m_subcategory)
-			{
-			case sinsp_evt::SC_FILE:
-				m_strstorage = "file";
-				break;
-			case sinsp_evt::SC_NET:
-				m_strstorage = "net";
-				break;
-			case sinsp_evt::SC_IPC:
-				m_strstorage = "ipc";
-				break;
-			case sinsp_evt::SC_NONE:
-			case sinsp_evt::SC_UNKNOWN:
-			case sinsp_evt::SC_OTHER:
-				m_strstorage = "unknown";
-				break;
-			default:
-				ASSERT(false);
-				m_strstorage = "unknown";
-				break;
-			}
-		}
-		break;
-		case EC_WAIT:
-			m_strstorage = "wait";
-			break;
-		case EC_SCHEDULER:
-			m_strstorage = "scheduler";
-			break;
-		default:
-			m_strstorage = "unknown";
-			break;
-		}
+		m_strstorage = get_category_name(cat.m_category, cat.m_subcategory);
 
 		*len = m_strstorage.size();
 		return (uint8_t*)m_strstorage.c_str();
@@ -3909,6 +4067,103 @@ bool sinsp_filter_check_event::compare(sinsp_evt *evt)
 	return res;
 }
 
+uint32_t sinsp_filter_check_event::get_cost()
+{
+	switch(m_field_id)
+	{
+	//
+	// Read from the header of the event or from the event table
+	//
+	case TYPE_NUMBER:
+	case TYPE_RAWTS:
+	case TYPE_RAWTS_S:
+	case TYPE_RAWTS_NS:
+	case TYPE_DIR:
+	case TYPE_TYPE:
+	case TYPE_TYPE_IS:
+	case TYPE_SYSCALL_TYPE:
+	case TYPE_CATEGORY:
+	case TYPE_CPU:
+		return 1 + get_compare_cost();
+	case TYPE_AROUND:
+		return 2;
+	//
+	// Decode the parameters of the event
+	//
+	case TYPE_ARGS:
+	case TYPE_ARGSTR:
+	case TYPE_ARGRAW:
+	case TYPE_INFO:
+	case TYPE_BUFFER:
+	case TYPE_RESSTR:
+	case TYPE_RESRAW:
+	case TYPE_ABSPATH:
+		return 10 + get_compare_cost();
+	default:
+		return 4 + get_compare_cost();
+	}
+}
+
+void sinsp_filter_check_event::get_evttypes(OUT sinsp_evttype_set* can_be_true, OUT sinsp_evttype_set* can_be_false)
+{
+	if((m_field_id != TYPE_TYPE && m_field_id != TYPE_DIR && m_field_id != TYPE_CATEGORY) ||
+		m_cmpop == CO_EXISTS)
+	{
+		sinsp_filter_check::get_evttypes(can_be_true, can_be_false);
+		return;
+	}
+
+	can_be_true->reset();
+	can_be_false->reset();
+
+	for(uint32_t j = 0; j < PPM_EVENT_MAX; j++)
+	{
+		const struct ppm_event_info* info = &g_infotables.m_event_info[j];
+		vector<const char*> values;
+
+		if(m_field_id == TYPE_DIR)
+		{
+			values.push_back(PPME_IS_ENTER(j)? ">" : "<");
+		}
+		else if(j == PPME_GENERIC_E || j == PPME_GENERIC_X)
+		{
+			//
+			// The name and the category of these events come from the syscall
+			// table, so they can be anything
+			//
+			can_be_true->set(j);
+			can_be_false->set(j);
+			continue;
+		}
+		else if(m_field_id == TYPE_TYPE)
+		{
+			values.push_back(info->name);
+		}
+		else
+		{
+			//
+			// The category of the I/O events depends on their fd
+			//
+			for(uint32_t k = sinsp_evt::SC_UNKNOWN; k <= sinsp_evt::SC_IPC; k++)
+			{
+				values.push_back(get_category_name(info->category, (sinsp_evt::subcategory)k));
+			}
+		}
+
+		for(const char* val : values)
+		{
+			if(flt_compare(m_cmpop, PT_CHARBUF, (void*)val, (uint32_t)strlen(val)))
+			{
+				can_be_true->set(j);
+			}
+			else
+			{
+				can_be_false->set(j);
+			}
+		}
+	}
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 // sinsp_filter_check_user implementation
 ///////////////////////////////////////////////////////////////////////////////
@@ -6142,14 +6397,14 @@ const k8s_pod_t* sinsp_filter_check_k8s::find_pod_for_thread(const sinsp_threadi
 		return NULL;
 	}
 
-	const k8s_state_t& k8s_state = m_inspector->m_k8s_client->get_state();
+	const k8s_state_t& k8s_state = *m_inspector->get_k8s_state();
 
 	return k8s_state.get_pod(tinfo->m_container_id);
 }
 
 const k8s_ns_t* sinsp_filter_check_k8s::find_ns_by_name(const string& ns_name)
 {
-	const k8s_state_t& k8s_state = m_inspector->m_k8s_client->get_state();
+	const k8s_state_t& k8s_state = *m_inspector->get_k8s_state();
 
 	const k8s_state_t::namespace_map& ns_map = k8s_state.get_namespace_map();
 	k8s_state_t::namespace_map::const_iterator it = ns_map.find(ns_name);
@@ -6163,7 +6418,7 @@ const k8s_ns_t* sinsp_filter_check_k8s::find_ns_by_name(const string& ns_name)
 
 const k8s_rc_t* sinsp_filter_check_k8s::find_rc_by_pod(const k8s_pod_t* pod)
 {
-	const k8s_state_t& k8s_state = m_inspector->m_k8s_client->get_state();
+	const k8s_state_t& k8s_state = *m_inspector->get_k8s_state();
 
 	const k8s_state_t::pod_rc_map& pod_rcs = k8s_state.get_pod_rc_map();
 	k8s_state_t::pod_rc_map::const_iterator it = pod_rcs.find(pod->get_uid());
@@ -6177,7 +6432,7 @@ const k8s_rc_t* sinsp_filter_check_k8s::find_rc_by_pod(const k8s_pod_t* pod)
 
 vector<const k8s_service_t*> sinsp_filter_check_k8s::find_svc_by_pod(const k8s_pod_t* pod)
 {
-	const k8s_state_t& k8s_state = m_inspector->m_k8s_client->get_state();
+	const k8s_state_t& k8s_state = *m_inspector->get_k8s_state();
 	vector<const k8s_service_t*> services;
 
 
@@ -6224,7 +6479,7 @@ bool sinsp_filter_check_k8s::find_label(const k8s_pair_list& labels, const strin
 
 uint8_t* sinsp_filter_check_k8s::extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings)
 {
-	if(m_inspector->m_k8s_client == NULL)
+	if(m_inspector->get_k8s_state() == NULL)
 	{
 		return NULL;
 	}
@@ -6562,7 +6817,8 @@ mesos_task::ptr_t sinsp_filter_check_mesos::find_task_for_thread(const sinsp_thr
 			return NULL;
 		}
 
-		if(m_inspector && m_inspector->m_mesos_client)
+		const mesos_state_t* mesos_state;
+		if(m_inspector && (mesos_state = m_inspector->get_mesos_state()) != NULL)
 		{
 			sinsp_container_info container_info;
 			bool found = m_inspector->m_container_manager.get_container(tinfo->m_container_id, &container_info);
@@ -6570,8 +6826,7 @@ mesos_task::ptr_t sinsp_filter_check_mesos::find_task_for_thread(const sinsp_thr
 			{
 				return NULL;
 			}
-			const mesos_state_t& mesos_state = m_inspector->m_mesos_client->get_state();
-			return mesos_state.get_task(container_info.m_mesos_task_id);
+			return mesos_state->get_task(container_info.m_mesos_task_id);
 		}
 	}
 
@@ -6580,28 +6835,30 @@ mesos_task::ptr_t sinsp_filter_check_mesos::find_task_for_thread(const sinsp_thr
 
 const mesos_framework* sinsp_filter_check_mesos::find_framework_by_task(mesos_task::ptr_t task)
 {
-	if(task && m_inspector && m_inspector->m_mesos_client)
+	const mesos_state_t* mesos_state;
+	if(task && m_inspector && (mesos_state = m_inspector->get_mesos_state()) != NULL)
 	{
-		const mesos_state_t& mesos_state = m_inspector->m_mesos_client->get_state();
-		return mesos_state.get_framework_for_task(task->get_uid());
+		return mesos_state->get_framework_for_task(task->get_uid());
 	}
 	return NULL;
 }
 
 marathon_app::ptr_t sinsp_filter_check_mesos::find_app_by_task(mesos_task::ptr_t task)
 {
-	if(m_inspector && m_inspector->m_mesos_client)
+	const mesos_state_t* mesos_state;
+	if(m_inspector && (mesos_state = m_inspector->get_mesos_state()) != NULL)
 	{
-		return m_inspector->m_mesos_client->get_state().get_app(task);
+		return mesos_state->get_app(task);
 	}
 	return NULL;
 }
 
 marathon_group::ptr_t sinsp_filter_check_mesos::find_group_by_task(mesos_task::ptr_t task)
 {
-	if(m_inspector && m_inspector->m_mesos_client)
+	const mesos_state_t* mesos_state;
+	if(m_inspector && (mesos_state = m_inspector->get_mesos_state()) != NULL)
 	{
-		return m_inspector->m_mesos_client->get_state().get_group(task);
+		return mesos_state->get_group(task);
 	}
 	return NULL;
 }
@@ -6639,7 +6896,7 @@ bool sinsp_filter_check_mesos::find_label(const mesos_pair_list& labels, const s
 
 uint8_t* sinsp_filter_check_mesos::extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings)
 {
-	if(!m_inspector || !m_inspector->m_mesos_client)
+	if(!m_inspector || !m_inspector->get_mesos_state())
 	{
 		return NULL;
 	}
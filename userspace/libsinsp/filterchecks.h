@@ -91,9 +91,7 @@ class sinsp_filter_check
 public:
 	sinsp_filter_check();
 
-	virtual ~sinsp_filter_check()
-	{
-	}
+	virtual ~sinsp_filter_check();
 
 	//
 	// Allocate a new check of the same type.
@@ -139,6 +137,13 @@ public:
 	//
 	virtual uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true) = 0;
 
+	//
+	// Like extract(), but the value is shared through the field cache of the
+	// inspector with the other checks of the same field, so that it's only
+	// extracted once per event
+	//
+	uint8_t* extract_cached(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true);
+
 	//
 	// Extract the field as json from the event (by default, fall
 	// back to the regular extract functionality)
@@ -153,6 +158,63 @@ public:
 	//
 	virtual bool compare(sinsp_evt *evt);
 
+	//
+	// Return true if compare() just compares the extracted field with the
+	// filter value, so that a filter program can do the comparison itself
+	//
+	virtual bool has_plain_compare()
+	{
+		return true;
+	}
+
+	//
+	// Return true if the value returned by extract() only depends on the
+	// event and on the state of the inspector, and not on the check, so that
+	// it can be shared by all the checks of the field
+	//
+	virtual bool has_cacheable_value()
+	{
+		return false;
+	}
+
+	//
+	// Return the estimated cost of compare(), in units of a compare of two
+	// integers that were already extracted. The base version assumes a plain
+	// extraction and adds the cost of the operator.
+	//
+	virtual uint32_t get_cost();
+
+	//
+	// Return the estimated fraction of the events for which compare() returns
+	// true, from the event types that it can accept and from the operator
+	//
+	double get_true_rate();
+
+	//
+	// Return true if compare() changes some state, like the counters that
+	// some fields keep across the events. The filter compiler doesn't move
+	// these checks, so that they keep running for the same events.
+	//
+	virtual bool has_side_effects()
+	{
+		return false;
+	}
+
+	//
+	// Return the check as it's written in a filter
+	//
+	string get_filter_text();
+
+	//
+	// Set the event types for which compare() can return true and the ones
+	// for which it can return false. By default, both for any event type.
+	//
+	virtual void get_evttypes(OUT sinsp_evttype_set* can_be_true, OUT sinsp_evttype_set* can_be_false)
+	{
+		can_be_true->set();
+		can_be_false->set();
+	}
+
 	//
 	// Extract the value from the event and convert it into a string
 	//
@@ -174,6 +236,7 @@ public:
 	bool m_needs_state_tracking = false;
 	boolop m_boolop;
 	cmpop m_cmpop;
+	string m_field_name; // The field as written by the user, set by the code that parses it
 	sinsp_field_aggregation m_aggregation;
 	sinsp_field_aggregation m_merge_aggregation;
 
@@ -183,6 +246,7 @@ protected:
 	char* rawval_to_string(uint8_t* rawval, const filtercheck_field_info* finfo, uint32_t len);
 	Json::Value rawval_to_json(uint8_t* rawval, const filtercheck_field_info* finfo, uint32_t len);
 	void string_to_rawval(const char* str, uint32_t len, ppm_param_type ptype);
+	uint32_t get_compare_cost();
 
 	char m_getpropertystr_storage[1024];
 	vector<vector<uint8_t>> m_val_storages;
@@ -195,6 +259,7 @@ protected:
 
 	uint32_t m_val_storages_min_size;
 	uint32_t m_val_storages_max_size;
+	string m_val_text; // The values as written in the filter, separated by commas
 
 	const filtercheck_field_info* m_field;
 	filter_check_info m_info;
@@ -206,7 +271,15 @@ private:
 	void set_inspector(sinsp* inspector);
 	int32_t m_check_id = 0;
 
+	//
+	// The field cache entries of the check, with and without sanitized
+	// strings, which are looked up at the first extraction
+	//
+	shared_ptr<sinsp_field_cache_entry> m_cache_entries[2];
+	bool m_cache_lookup_done[2] = {false, false};
+
 friend class sinsp_filter_check_list;
+friend class sinsp_filter_program;
 };
 
 //
@@ -243,6 +316,11 @@ public:
 	void parse(string expr);
 	bool compare(sinsp_evt *evt);
 
+	bool has_plain_compare()
+	{
+		return false;
+	}
+
 	//
 	// The following methods are part of the filter check interface but are irrelevant
 	// for this class, because they are used only for the leaves of the filtering tree.
@@ -267,8 +345,33 @@ public:
 
 	int32_t get_check_id();
 
+	//
+	// Reorder the chains of ANDs and of ORs of the expression and of its
+	// subexpressions, so that the checks that are cheap and likely to decide
+	// the result run first. Chains that mix the operators, or that have
+	// checks with side effects or with check ids, keep their order. Return
+	// true if any order changed.
+	//
+	bool reorder();
+
+	//
+	// Estimate the cost of evaluating the expression in its current order,
+	// in the units of sinsp_filter_check::get_cost(), and the fraction of the
+	// events for which it's true
+	//
+	void estimate(OUT double* cost, OUT double* true_rate);
+
+	//
+	// Append to res one line per check, in evaluation order, with the
+	// estimates of each check and subexpression
+	//
+	void explain(uint32_t depth, OUT string* res);
+
 	sinsp_filter_expression* m_parent;
 	vector<sinsp_filter_check*> m_checks;
+
+private:
+	bool is_movable();
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -340,6 +443,13 @@ public:
 	bool compare_net(sinsp_evt *evt);
 	bool compare_port(sinsp_evt *evt);
 	bool compare(sinsp_evt *evt);
+	bool has_plain_compare();
+	uint32_t get_cost();
+	bool has_cacheable_value()
+	{
+		return true;
+	}
+	void get_evttypes(OUT sinsp_evttype_set* can_be_true, OUT sinsp_evttype_set* can_be_false);
 
 	sinsp_threadinfo* m_tinfo;
 	sinsp_fdinfo_t* m_fdinfo;
@@ -410,6 +520,11 @@ public:
 	int32_t parse_field_name(const char* str, bool alloc_state);
 	uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true);
 	bool compare(sinsp_evt *evt);
+	bool has_plain_compare();
+	uint32_t get_cost();
+	bool has_side_effects();
+	bool has_cacheable_value();
+	void parse_filter_value(const char* str, uint32_t len, uint8_t *storage, uint32_t storage_len);
 
 private:
 	uint64_t extract_exectime(sinsp_evt *evt);
@@ -417,6 +532,7 @@ private:
 	uint8_t* extract_thread_cpu(sinsp_evt *evt, sinsp_threadinfo* tinfo, bool extract_user, bool extract_system);
 	inline bool compare_full_apid(sinsp_evt *evt);
 	bool compare_full_aname(sinsp_evt *evt);
+	inline bool compare_interned(sinsp_evt *evt);
 
 	int32_t m_argid;
 	string m_argname;
@@ -428,6 +544,7 @@ private:
 	vector<uint64_t> m_last_proc_switch_times;
 	uint32_t m_th_state_id;
 	uint64_t m_cursec_ts;
+	sinsp_istring m_interned_val; // The filter value, for the fields that are interned strings
 };
 
 //
@@ -512,6 +629,16 @@ public:
 	uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true);
 	Json::Value extract_as_js(sinsp_evt *evt, OUT uint32_t* len);
 	bool compare(sinsp_evt *evt);
+	void get_evttypes(OUT sinsp_evttype_set* can_be_true, OUT sinsp_evttype_set* can_be_false);
+	uint32_t get_cost();
+
+	//
+	// extract() works differently when called by compare()
+	//
+	bool has_plain_compare()
+	{
+		return false;
+	}
 
 	uint64_t m_u64val;
 	uint64_t m_tsdelta;
@@ -560,6 +687,18 @@ public:
 	sinsp_filter_check_user();
 	sinsp_filter_check* allocate_new();
 	uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true);
+	bool has_cacheable_value()
+	{
+		return true;
+	}
+
+	uint32_t get_cost()
+	{
+		//
+		// A lookup in the user table
+		//
+		return 4 + get_compare_cost();
+	}
 
 	uint32_t m_uid;
 	string m_strval;
@@ -580,6 +719,18 @@ public:
 	sinsp_filter_check_group();
 	sinsp_filter_check* allocate_new();
 	uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true);
+	bool has_cacheable_value()
+	{
+		return true;
+	}
+
+	uint32_t get_cost()
+	{
+		//
+		// A lookup in the group table
+		//
+		return 4 + get_compare_cost();
+	}
 
 	uint32_t m_gid;
 	string m_name;
@@ -685,6 +836,14 @@ public:
 	uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true);
 	bool compare(sinsp_evt *evt);
 
+	//
+	// extract() works differently when called by compare()
+	//
+	bool has_plain_compare()
+	{
+		return false;
+	}
+
 	uint64_t m_u64val;
 	uint64_t m_tsdelta;
 	uint32_t m_u32val;
@@ -773,6 +932,18 @@ public:
 	sinsp_filter_check_container();
 	sinsp_filter_check* allocate_new();
 	uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true);
+	bool has_cacheable_value()
+	{
+		return true;
+	}
+
+	uint32_t get_cost()
+	{
+		//
+		// A lookup in the container table
+		//
+		return 8 + get_compare_cost();
+	}
 
 private:
 	string m_tstr;
@@ -890,6 +1061,18 @@ public:
 	sinsp_filter_check* allocate_new();
 	int32_t parse_field_name(const char* str, bool alloc_state);
 	uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true);
+	bool has_cacheable_value()
+	{
+		return true;
+	}
+
+	uint32_t get_cost()
+	{
+		//
+		// A lookup in the k8s state
+		//
+		return 20 + get_compare_cost();
+	}
 
 private:
 	int32_t extract_arg(const string& fldname, const string& val);
@@ -927,6 +1110,18 @@ public:
 	sinsp_filter_check* allocate_new();
 	int32_t parse_field_name(const char* str, bool alloc_state);
 	uint8_t* extract(sinsp_evt *evt, OUT uint32_t* len, bool sanitize_strings = true);
+	bool has_cacheable_value()
+	{
+		return true;
+	}
+
+	uint32_t get_cost()
+	{
+		//
+		// A lookup in the mesos state
+		//
+		return 20 + get_compare_cost();
+	}
 
 private:
 
@@ -0,0 +1,602 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+#include "utils.h"
+
+#ifdef HAS_FILTERING
+#include "filter.h"
+#include "filterchecks.h"
+#include "filterprogram.h"
+#include "stringmatcher.h"
+
+#ifndef _GNU_SOURCE
+//
+// Fallback implementation of memmem
+//
+void *memmem(const void *haystack, size_t haystacklen, const void *needle, size_t needlelen);
+#endif
+
+sinsp_filter_program::sinsp_filter_program()
+{
+	m_entry = FPC_ACCEPT;
+	m_evttypes.set();
+}
+
+sinsp_filter_program::~sinsp_filter_program()
+{
+	clear();
+}
+
+void sinsp_filter_program::clear()
+{
+	for(auto matcher : m_matchers)
+	{
+		delete matcher;
+	}
+
+	m_matchers.clear();
+	m_insns.clear();
+	m_entry = FPC_ACCEPT;
+	m_evttypes.set();
+}
+
+bool sinsp_filter_program::build(sinsp_filter_expression* expr)
+{
+	sinsp_evttype_set can_be_false;
+
+	clear();
+
+	try
+	{
+		m_entry = emit_expression(expr, FPC_ACCEPT, FPC_REJECT);
+		get_evttypes(expr, &m_evttypes, &can_be_false);
+	}
+	catch(sinsp_exception&)
+	{
+		clear();
+		return false;
+	}
+
+	//
+	// The expressions are emitted from their last check to their first, so
+	// the list is reversed to have the compares in the order of the filter
+	//
+	int32_t last = (int32_t)m_insns.size() - 1;
+
+	reverse(m_insns.begin(), m_insns.end());
+
+	for(auto& insn : m_insns)
+	{
+		for(uint32_t j = 0; j < 2; j++)
+		{
+			if(insn.m_next[j] >= 0)
+			{
+				insn.m_next[j] = last - insn.m_next[j];
+			}
+		}
+	}
+
+	if(m_entry >= 0)
+	{
+		m_entry = last - m_entry;
+	}
+
+	return true;
+}
+
+//
+// Find the event types for which the expression can be true and the ones for
+// which it can be false, joining the ones of its checks in the same order as
+// emit_expression() does
+//
+void sinsp_filter_program::get_evttypes(sinsp_filter_expression* expr, OUT sinsp_evttype_set* can_be_true, OUT sinsp_evttype_set* can_be_false)
+{
+	int32_t size = (int32_t)expr->m_checks.size();
+
+	can_be_true->set();
+	can_be_false->reset();
+
+	for(int32_t j = size - 1; j >= 0; j--)
+	{
+		sinsp_filter_check* chk = expr->m_checks[j];
+		sinsp_filter_expression* subexpr = dynamic_cast<sinsp_filter_expression*>(chk);
+		sinsp_evttype_set chk_true;
+		sinsp_evttype_set chk_false;
+
+		if(subexpr != NULL)
+		{
+			get_evttypes(subexpr, &chk_true, &chk_false);
+		}
+		else
+		{
+			chk->get_evttypes(&chk_true, &chk_false);
+		}
+
+		if(chk->m_boolop & BO_NOT)
+		{
+			swap(chk_true, chk_false);
+		}
+
+		if(j == size - 1)
+		{
+			*can_be_true = chk_true;
+			*can_be_false = chk_false;
+		}
+		else if(expr->m_checks[j + 1]->m_boolop & BO_OR)
+		{
+			*can_be_true |= chk_true;
+			*can_be_false &= chk_false;
+		}
+		else
+		{
+			*can_be_true &= chk_true;
+			*can_be_false |= chk_false;
+		}
+	}
+}
+
+//
+// The checks of an expression are joined from left to right and the first
+// result that decides the expression ends it, so "a or b and c" is
+// "a or (b and c)". Going from the last check to the first, the targets of
+// every check are the ones of the expression or the entry of the following
+// check, depending on the operator that comes after it.
+//
+int32_t sinsp_filter_program::emit_expression(sinsp_filter_expression* expr, int32_t on_true, int32_t on_false)
+{
+	int32_t entry = on_true;
+	int32_t size = (int32_t)expr->m_checks.size();
+
+	for(int32_t j = size - 1; j >= 0; j--)
+	{
+		int32_t last = j;
+		int32_t next[2];
+		int32_t check_id[2] = {0, 0};
+
+		//
+		// A group of OR'ed checks is joined to the rest of the expression by
+		// the operator of its first check and by the one that follows its
+		// last check
+		//
+		j = get_match_group(expr, last);
+
+		sinsp_filter_check* chk = expr->m_checks[j];
+		bool negate = (chk->m_boolop & BO_NOT) != 0;
+
+		if(j == 0)
+		{
+			if(chk->m_boolop != BO_NONE && chk->m_boolop != BO_NOT)
+			{
+				throw sinsp_exception("unexpected operator at the beginning of a filter expression");
+			}
+		}
+		else if(chk->m_boolop != BO_OR && chk->m_boolop != BO_AND &&
+			chk->m_boolop != BO_ORNOT && chk->m_boolop != BO_ANDNOT)
+		{
+			throw sinsp_exception("unexpected operator in a filter expression");
+		}
+
+		if(last == size - 1)
+		{
+			next[1] = on_true;
+			next[0] = on_false;
+		}
+		else if(expr->m_checks[last + 1]->m_boolop & BO_OR)
+		{
+			next[1] = on_true;
+			next[0] = entry;
+		}
+		else
+		{
+			next[1] = entry;
+			next[0] = on_false;
+		}
+
+		if(negate)
+		{
+			swap(next[0], next[1]);
+		}
+
+		sinsp_filter_expression* subexpr = dynamic_cast<sinsp_filter_expression*>(chk);
+		if(subexpr != NULL)
+		{
+			entry = emit_expression(subexpr, next[1], next[0]);
+		}
+		else if(j != last)
+		{
+			check_id[1] = chk->get_check_id();
+			entry = emit_match(expr, j, last, next, check_id);
+		}
+		else
+		{
+			//
+			// The event gets the id of the checks that are true, except for a
+			// negated first check
+			//
+			if(!negate)
+			{
+				check_id[1] = chk->get_check_id();
+			}
+			else if(j != 0)
+			{
+				check_id[0] = chk->get_check_id();
+			}
+
+			entry = emit_check(chk, next, check_id);
+		}
+	}
+
+	return entry;
+}
+
+int32_t sinsp_filter_program::emit_check(sinsp_filter_check* chk, const int32_t* next, const int32_t* check_id)
+{
+	sinsp_filter_insn insn;
+
+	memset(&insn, 0, sizeof(insn));
+	insn.m_check = chk;
+	insn.m_next[0] = next[0];
+	insn.m_next[1] = next[1];
+	insn.m_check_id[0] = check_id[0];
+	insn.m_check_id[1] = check_id[1];
+	insn.m_opcode = get_opcode(chk, &insn);
+
+	m_insns.push_back(insn);
+	return (int32_t)m_insns.size() - 1;
+}
+
+//
+// Find the first check of the group of OR'ed string compares that ends with
+// the given check. The checks of a group compare the same field with the same
+// check id and aren't negated, and since the checks of an expression are
+// joined from left to right, the group can only be followed by another OR.
+// Return the given check if there's no such group, or if it's too small.
+//
+int32_t sinsp_filter_program::get_match_group(sinsp_filter_expression* expr, int32_t last)
+{
+	sinsp_filter_check* chk = expr->m_checks[last];
+	int32_t first = last;
+
+	if(!can_match(chk) ||
+		(last != (int32_t)expr->m_checks.size() - 1 && !(expr->m_checks[last + 1]->m_boolop & BO_OR)))
+	{
+		return last;
+	}
+
+	while(first > 0 && expr->m_checks[first]->m_boolop == BO_OR)
+	{
+		sinsp_filter_check* prev = expr->m_checks[first - 1];
+
+		if(!can_match(prev) ||
+			prev->m_field_name != chk->m_field_name ||
+			prev->get_check_id() != chk->get_check_id())
+		{
+			break;
+		}
+
+		first--;
+	}
+
+	//
+	// Comparing a few values one at a time is faster than running the
+	// matcher
+	//
+	uint32_t npatterns = 0;
+
+	for(int32_t j = first; j <= last; j++)
+	{
+		sinsp_filter_check* member = expr->m_checks[j];
+		npatterns += (member->m_cmpop == CO_IN)? (uint32_t)member->m_val_storages_members.size() : 1;
+	}
+
+	if(npatterns < FILTER_MATCHER_MIN_PATTERNS)
+	{
+		return last;
+	}
+
+	return first;
+}
+
+bool sinsp_filter_program::can_match(sinsp_filter_check* chk)
+{
+	if(dynamic_cast<sinsp_filter_expression*>(chk) != NULL ||
+		!chk->has_plain_compare() ||
+		chk->m_field_name.empty() ||
+		(chk->m_boolop & BO_NOT) ||
+		chk->m_info.m_fields[chk->m_field_id].m_type != PT_CHARBUF)
+	{
+		return false;
+	}
+
+	return chk->m_cmpop == CO_EQ ||
+		chk->m_cmpop == CO_IN ||
+		chk->m_cmpop == CO_STARTSWITH ||
+		chk->m_cmpop == CO_CONTAINS;
+}
+
+int32_t sinsp_filter_program::emit_match(sinsp_filter_expression* expr, int32_t first, int32_t last, const int32_t* next, const int32_t* check_id)
+{
+	sinsp_string_matcher* matcher = new sinsp_string_matcher();
+	m_matchers.push_back(matcher);
+
+	for(int32_t j = first; j <= last; j++)
+	{
+		sinsp_filter_check* chk = expr->m_checks[j];
+		const char* val = (const char*)chk->filter_value_p();
+
+		switch(chk->m_cmpop)
+		{
+		case CO_EQ:
+			matcher->add_exact(val, (uint32_t)strlen(val));
+			break;
+		case CO_IN:
+			for(auto& member : chk->m_val_storages_members)
+			{
+				matcher->add_exact((const char*)member.first, member.second);
+			}
+			break;
+		case CO_STARTSWITH:
+			matcher->add_prefix(val, (uint32_t)strlen(val));
+			break;
+		case CO_CONTAINS:
+			matcher->add_substring(val, (uint32_t)strlen(val));
+			break;
+		default:
+			ASSERT(false);
+			throw sinsp_exception("unexpected operator in a string match");
+		}
+	}
+
+	matcher->build();
+
+	int32_t entry = emit_check(expr->m_checks[first], next, check_id);
+	m_insns[entry].m_opcode = FOP_STR_MATCH;
+	m_insns[entry].m_matcher = matcher;
+
+	return entry;
+}
+
+uint32_t sinsp_filter_program::get_opcode(sinsp_filter_check* chk, sinsp_filter_insn* insn)
+{
+	if(!chk->has_plain_compare())
+	{
+		return FOP_CHECK;
+	}
+
+	cmpop op = chk->m_cmpop;
+	ppm_param_type type = chk->m_info.m_fields[chk->m_field_id].m_type;
+	uint8_t* val = chk->filter_value_p();
+	bool is_numeric_op = (op >= CO_EQ && op <= CO_GE);
+
+	if(op == CO_EXISTS)
+	{
+		return FOP_EXISTS;
+	}
+	else if(op == CO_IN)
+	{
+		return FOP_IN;
+	}
+
+	switch(type)
+	{
+	case PT_CHARBUF:
+		insn->m_str = (const char*)val;
+		insn->m_len = (uint32_t)strlen((const char*)val);
+
+		switch(op)
+		{
+		case CO_EQ:
+			return FOP_STR_EQ;
+		case CO_NE:
+			return FOP_STR_NE;
+		case CO_CONTAINS:
+			return FOP_STR_CONTAINS;
+		case CO_STARTSWITH:
+			return FOP_STR_STARTSWITH;
+		case CO_GLOB:
+			return FOP_STR_GLOB;
+		default:
+			return FOP_CHECK;
+		}
+	case PT_BYTEBUF:
+		insn->m_str = (const char*)val;
+		insn->m_len = chk->m_val_storage_len;
+
+		switch(op)
+		{
+		case CO_EQ:
+			return FOP_BUF_EQ;
+		case CO_NE:
+			return FOP_BUF_NE;
+		case CO_CONTAINS:
+			return FOP_BUF_CONTAINS;
+		case CO_STARTSWITH:
+			return FOP_BUF_STARTSWITH;
+		default:
+			return FOP_CHECK;
+		}
+	case PT_INT8:
+		insn->m_val.m_i64 = *(int8_t*)val;
+		return is_numeric_op ? FOP_I8 + op - CO_EQ : FOP_CHECK;
+	case PT_INT16:
+		insn->m_val.m_i64 = *(int16_t*)val;
+		return is_numeric_op ? FOP_I16 + op - CO_EQ : FOP_CHECK;
+	case PT_INT32:
+		insn->m_val.m_i64 = *(int32_t*)val;
+		return is_numeric_op ? FOP_I32 + op - CO_EQ : FOP_CHECK;
+	case PT_INT64:
+	case PT_FD:
+	case PT_PID:
+	case PT_ERRNO:
+		insn->m_val.m_i64 = *(int64_t*)val;
+		return is_numeric_op ? FOP_I64 + op - CO_EQ : FOP_CHECK;
+	case PT_FLAGS8:
+	case PT_UINT8:
+	case PT_SIGTYPE:
+		insn->m_val.m_u64 = *(uint8_t*)val;
+		return is_numeric_op ? FOP_U8 + op - CO_EQ : FOP_CHECK;
+	case PT_FLAGS16:
+	case PT_UINT16:
+	case PT_PORT:
+	case PT_SYSCALLID:
+		insn->m_val.m_u64 = *(uint16_t*)val;
+		return is_numeric_op ? FOP_U16 + op - CO_EQ : FOP_CHECK;
+	case PT_UINT32:
+	case PT_FLAGS32:
+	case PT_BOOL:
+	case PT_IPV4ADDR:
+		insn->m_val.m_u64 = *(uint32_t*)val;
+		return is_numeric_op ? FOP_U32 + op - CO_EQ : FOP_CHECK;
+	case PT_UINT64:
+	case PT_RELTIME:
+	case PT_ABSTIME:
+		insn->m_val.m_u64 = *(uint64_t*)val;
+		return is_numeric_op ? FOP_U64 + op - CO_EQ : FOP_CHECK;
+	case PT_DOUBLE:
+		insn->m_val.m_d = *(double*)val;
+		return is_numeric_op ? FOP_DOUBLE + op - CO_EQ : FOP_CHECK;
+	default:
+		return FOP_CHECK;
+	}
+}
+
+//
+// The six compares of a numeric type, loading the extracted value as ctype
+// and comparing it as the given member of the filter value
+//
+#define FOP_NUMERIC_CASES(base, ctype, member) \
+	case base: \
+		res = (*(ctype*)val == insn->m_val.member); \
+		break; \
+	case base + 1: \
+		res = (*(ctype*)val != insn->m_val.member); \
+		break; \
+	case base + 2: \
+		res = (*(ctype*)val < insn->m_val.member); \
+		break; \
+	case base + 3: \
+		res = (*(ctype*)val <= insn->m_val.member); \
+		break; \
+	case base + 4: \
+		res = (*(ctype*)val > insn->m_val.member); \
+		break; \
+	case base + 5: \
+		res = (*(ctype*)val >= insn->m_val.member); \
+		break;
+
+bool sinsp_filter_program::run(sinsp_evt* evt)
+{
+	int32_t pc = m_entry;
+
+	if(!m_evttypes[evt->get_type()])
+	{
+		return false;
+	}
+
+	while(pc >= 0)
+	{
+		const sinsp_filter_insn* insn = &m_insns[pc];
+		bool res;
+
+		if(insn->m_opcode == FOP_CHECK)
+		{
+			res = insn->m_check->compare(evt);
+		}
+		else
+		{
+			uint32_t len = 0;
+			uint8_t* val = insn->m_check->extract_cached(evt, &len, false);
+
+			if(val == NULL)
+			{
+				res = false;
+			}
+			else
+			{
+				switch(insn->m_opcode)
+				{
+				case FOP_EXISTS:
+					res = true;
+					break;
+				case FOP_IN:
+					res = insn->m_check->flt_compare(CO_IN,
+						insn->m_check->m_info.m_fields[insn->m_check->m_field_id].m_type,
+						val,
+						len);
+					break;
+				case FOP_STR_EQ:
+					res = (val[0] == insn->m_str[0] && strcmp((char*)val, insn->m_str) == 0);
+					break;
+				case FOP_STR_NE:
+					res = (val[0] != insn->m_str[0] || strcmp((char*)val, insn->m_str) != 0);
+					break;
+				case FOP_STR_CONTAINS:
+					res = (strstr((char*)val, insn->m_str) != NULL);
+					break;
+				case FOP_STR_STARTSWITH:
+					res = (strncmp((char*)val, insn->m_str, insn->m_len) == 0);
+					break;
+				case FOP_STR_GLOB:
+					res = sinsp_utils::glob_match(insn->m_str, (char*)val);
+					break;
+				case FOP_BUF_EQ:
+					res = (len == insn->m_len && memcmp(val, insn->m_str, len) == 0);
+					break;
+				case FOP_BUF_NE:
+					res = (len != insn->m_len || memcmp(val, insn->m_str, len) != 0);
+					break;
+				case FOP_BUF_CONTAINS:
+					res = (memmem(val, len, insn->m_str, insn->m_len) != NULL);
+					break;
+				case FOP_BUF_STARTSWITH:
+					res = (len >= insn->m_len && memcmp(val, insn->m_str, insn->m_len) == 0);
+					break;
+				case FOP_STR_MATCH:
+					res = insn->m_matcher->match((char*)val);
+					break;
+				FOP_NUMERIC_CASES(FOP_U8, uint8_t, m_u64)
+				FOP_NUMERIC_CASES(FOP_U16, uint16_t, m_u64)
+				FOP_NUMERIC_CASES(FOP_U32, uint32_t, m_u64)
+				FOP_NUMERIC_CASES(FOP_U64, uint64_t, m_u64)
+				FOP_NUMERIC_CASES(FOP_I8, int8_t, m_i64)
+				FOP_NUMERIC_CASES(FOP_I16, int16_t, m_i64)
+				FOP_NUMERIC_CASES(FOP_I32, int32_t, m_i64)
+				FOP_NUMERIC_CASES(FOP_I64, int64_t, m_i64)
+				FOP_NUMERIC_CASES(FOP_DOUBLE, double, m_d)
+				default:
+					ASSERT(false);
+					res = false;
+					break;
+				}
+			}
+		}
+
+		if(insn->m_check_id[res] != 0)
+		{
+			evt->set_check_id(insn->m_check_id[res]);
+		}
+
+		pc = insn->m_next[res];
+	}
+
+	return pc == FPC_ACCEPT;
+}
+
+#endif // HAS_FILTERING
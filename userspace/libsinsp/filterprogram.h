@@ -0,0 +1,161 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#ifdef HAS_FILTERING
+
+class sinsp_filter_check;
+class sinsp_filter_expression;
+class sinsp_string_matcher;
+
+//
+// Instructions of a filter program. The numeric compares of every type are
+// laid out in the order of the cmpop values from CO_EQ to CO_GE, so that the
+// opcode of a compare is the one of its type plus the operator.
+//
+enum sinsp_filter_opcode
+{
+	FOP_CHECK = 0, // Run compare() of the check
+	FOP_EXISTS = 1,
+	FOP_IN = 2,
+	FOP_STR_EQ = 3,
+	FOP_STR_NE = 4,
+	FOP_STR_CONTAINS = 5,
+	FOP_STR_STARTSWITH = 6,
+	FOP_STR_GLOB = 7,
+	FOP_BUF_EQ = 8,
+	FOP_BUF_NE = 9,
+	FOP_BUF_CONTAINS = 10,
+	FOP_BUF_STARTSWITH = 11,
+	FOP_U8 = 12,
+	FOP_U16 = FOP_U8 + 6,
+	FOP_U32 = FOP_U16 + 6,
+	FOP_U64 = FOP_U32 + 6,
+	FOP_I8 = FOP_U64 + 6,
+	FOP_I16 = FOP_I8 + 6,
+	FOP_I32 = FOP_I16 + 6,
+	FOP_I64 = FOP_I32 + 6,
+	FOP_DOUBLE = FOP_I64 + 6,
+	FOP_STR_MATCH = FOP_DOUBLE + 6, // Match m_matcher, for a group of OR'ed checks
+};
+
+//
+// Targets of the jumps that end the program
+//
+#define FPC_REJECT -1
+#define FPC_ACCEPT -2
+
+/*!
+  \brief A single test of a filter program.
+
+  It extracts the field of a check and compares it with the filter value.
+  m_next and m_check_id are indexed by the result of the compare: the next
+  instruction to run, or FPC_ACCEPT/FPC_REJECT, and the check id to set on
+  the event (0 for none).
+*/
+struct sinsp_filter_insn
+{
+	uint32_t m_opcode;
+	int32_t m_next[2];
+	int32_t m_check_id[2];
+	sinsp_filter_check* m_check;
+	union
+	{
+		uint64_t m_u64;
+		int64_t m_i64;
+		double m_d;
+	} m_val;
+	const char* m_str;
+	uint32_t m_len;
+	sinsp_string_matcher* m_matcher;
+};
+
+/*!
+  \brief A filter expression lowered into a flat list of compares.
+
+  The boolean operators become the jump targets of the compares, so that the
+  short circuits of the expression tree are followed without recursion and
+  the type and the operator of every compare are decided when the program
+  is built rather than for every event. The checks whose compare() does more
+  than comparing the extracted value are run through their compare().
+
+  The event types that the expression can accept are found when it's
+  lowered, and the other ones are rejected before running any compare.
+
+  The string compares of the same field that are OR'ed together, like
+  "fd.name startswith /etc or fd.name startswith /bin or ...", become a
+  single instruction that extracts the field once and looks for all the
+  values with a \ref sinsp_string_matcher.
+*/
+class SINSP_PUBLIC sinsp_filter_program
+{
+public:
+	sinsp_filter_program();
+	~sinsp_filter_program();
+
+	/*!
+	  \brief Lower the given expression tree. The checks are referenced, not
+	   copied, and must outlive the program.
+
+	  \return false if the tree has a shape the program can't express, in
+	   which case the tree has to be evaluated instead.
+	*/
+	bool build(sinsp_filter_expression* expr);
+
+	/*!
+	  \brief Run the program on the given event.
+
+	  \return true if the event is accepted, like
+	   sinsp_filter_expression::compare().
+	*/
+	bool run(sinsp_evt* evt);
+
+	/*!
+	  \brief Return the number of instructions of the program.
+	*/
+	uint32_t size() const
+	{
+		return (uint32_t)m_insns.size();
+	}
+
+	/*!
+	  \brief Return the event types that the program can accept.
+	*/
+	const sinsp_evttype_set& get_evttypes() const
+	{
+		return m_evttypes;
+	}
+
+private:
+	static void get_evttypes(sinsp_filter_expression* expr, OUT sinsp_evttype_set* can_be_true, OUT sinsp_evttype_set* can_be_false);
+	int32_t emit_expression(sinsp_filter_expression* expr, int32_t on_true, int32_t on_false);
+	int32_t emit_check(sinsp_filter_check* chk, const int32_t* next, const int32_t* check_id);
+	int32_t emit_match(sinsp_filter_expression* expr, int32_t first, int32_t last, const int32_t* next, const int32_t* check_id);
+	static int32_t get_match_group(sinsp_filter_expression* expr, int32_t last);
+	static bool can_match(sinsp_filter_check* chk);
+	void clear();
+	static uint32_t get_opcode(sinsp_filter_check* chk, sinsp_filter_insn* insn);
+
+	vector<sinsp_filter_insn> m_insns;
+	vector<sinsp_string_matcher*> m_matchers;
+	int32_t m_entry;
+	sinsp_evttype_set m_evttypes;
+};
+
+#endif // HAS_FILTERING
@@ -130,6 +130,11 @@ public:
 		m_value = 0;
 	}
 
+	void set(uint64_t value)
+	{
+		m_value = value;
+	}
+
 	const uint64_t get_value()
 	{
 		return m_value;
@@ -0,0 +1,140 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// The pool of the interned strings
+///////////////////////////////////////////////////////////////////////////////
+namespace
+{
+//
+// The pool is split in shards by the hash of the string, each with its own
+// mutex, so that the threads interning or releasing different strings
+// rarely wait for each other.
+//
+#define ISTRING_POOL_SHARDS 64
+
+struct istring_pool_shard
+{
+	istring_pool_shard():
+		m_nbytes(0)
+	{
+	}
+
+	//
+	// Interning and the last release of a string take the mutex of its
+	// shard. The other reference count changes don't.
+	//
+	std::mutex m_mutex;
+	unordered_map<string, std::atomic<uint32_t>> m_table;
+	uint64_t m_nbytes;
+};
+
+struct istring_pool
+{
+	istring_pool_shard* get_shard(const string& str)
+	{
+		return &m_shards[std::hash<string>()(str) % ISTRING_POOL_SHARDS];
+	}
+
+	istring_pool_shard m_shards[ISTRING_POOL_SHARDS];
+};
+
+//
+// The pool is never destroyed, so that the sinsp_istrings in static objects
+// can be released at exit
+//
+istring_pool* get_istring_pool()
+{
+	static istring_pool* pool = new istring_pool();
+	return pool;
+}
+}
+
+sinsp_istring::entry_t* sinsp_istring::intern(const string& str)
+{
+	if(str.empty())
+	{
+		return NULL;
+	}
+
+	istring_pool_shard* shard = get_istring_pool()->get_shard(str);
+	std::lock_guard<std::mutex> lock(shard->m_mutex);
+
+	pool_t::iterator it = shard->m_table.find(str);
+	if(it == shard->m_table.end())
+	{
+		it = shard->m_table.emplace(std::piecewise_construct,
+			std::forward_as_tuple(str),
+			std::forward_as_tuple(0)).first;
+		shard->m_nbytes += str.size();
+	}
+
+	it->second.fetch_add(1, std::memory_order_relaxed);
+	return &(*it);
+}
+
+void sinsp_istring::release(entry_t* entry)
+{
+	//
+	// Unless this is the last reference, just drop it. The count can't reach
+	// zero outside of the mutex, so intern() never finds a dying entry.
+	//
+	uint32_t refs = entry->second.load(std::memory_order_relaxed);
+	while(refs > 1)
+	{
+		if(entry->second.compare_exchange_weak(refs, refs - 1, std::memory_order_release, std::memory_order_relaxed))
+		{
+			return;
+		}
+	}
+
+	istring_pool_shard* shard = get_istring_pool()->get_shard(entry->first);
+	std::lock_guard<std::mutex> lock(shard->m_mutex);
+
+	if(entry->second.fetch_sub(1, std::memory_order_acq_rel) == 1)
+	{
+		shard->m_nbytes -= entry->first.size();
+		shard->m_table.erase(shard->m_table.find(entry->first));
+	}
+}
+
+const string& sinsp_istring::empty_string()
+{
+	static const string empty;
+	return empty;
+}
+
+void sinsp_istring::get_pool_stats(uint64_t* nstrings, uint64_t* nbytes)
+{
+	istring_pool* pool = get_istring_pool();
+	uint32_t j;
+
+	*nstrings = 0;
+	*nbytes = 0;
+
+	for(j = 0; j < ISTRING_POOL_SHARDS; j++)
+	{
+		std::lock_guard<std::mutex> lock(pool->m_shards[j].m_mutex);
+
+		*nstrings += pool->m_shards[j].m_table.size();
+		*nbytes += pool->m_shards[j].m_nbytes;
+	}
+}
@@ -0,0 +1,325 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+///////////////////////////////////////////////////////////////////////////////
+// An immutable, interned string.
+//
+// All the sinsp_istrings with the same value point to a single copy of it,
+// which is kept in a process-wide pool with a reference count. This is
+// used for the strings that many threads have in common, like the command
+// name, the executable and the cgroups: copying a thread copies a pointer,
+// and two sinsp_istrings are equal if they point to the same copy.
+//
+// The reference counts are atomic, so sinsp_istrings can be copied and
+// destroyed from any thread.
+//
+// The read-only part of the std::string interface is available, and a
+// sinsp_istring converts to const std::string&, so the code that reads the
+// fields that used to be std::string keeps working unchanged.
+///////////////////////////////////////////////////////////////////////////////
+class SINSP_PUBLIC sinsp_istring
+{
+public:
+	sinsp_istring():
+		m_entry(NULL)
+	{
+	}
+
+	sinsp_istring(const std::string& str):
+		m_entry(intern(str))
+	{
+	}
+
+	sinsp_istring(const char* str):
+		m_entry((str == NULL || str[0] == 0)? NULL : intern(std::string(str)))
+	{
+	}
+
+	sinsp_istring(const sinsp_istring& other):
+		m_entry(other.m_entry)
+	{
+		if(m_entry != NULL)
+		{
+			m_entry->second.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	sinsp_istring(sinsp_istring&& other):
+		m_entry(other.m_entry)
+	{
+		other.m_entry = NULL;
+	}
+
+	~sinsp_istring()
+	{
+		if(m_entry != NULL)
+		{
+			release(m_entry);
+		}
+	}
+
+	sinsp_istring& operator=(const sinsp_istring& other)
+	{
+		sinsp_istring tmp(other);
+		std::swap(m_entry, tmp.m_entry);
+		return *this;
+	}
+
+	sinsp_istring& operator=(sinsp_istring&& other)
+	{
+		std::swap(m_entry, other.m_entry);
+		return *this;
+	}
+
+	sinsp_istring& operator=(const std::string& str)
+	{
+		sinsp_istring tmp(str);
+		std::swap(m_entry, tmp.m_entry);
+		return *this;
+	}
+
+	sinsp_istring& operator=(const char* str)
+	{
+		sinsp_istring tmp(str);
+		std::swap(m_entry, tmp.m_entry);
+		return *this;
+	}
+
+	inline const std::string& str() const
+	{
+		return (m_entry != NULL)? m_entry->first : empty_string();
+	}
+
+	inline operator const std::string&() const
+	{
+		return str();
+	}
+
+	inline const char* c_str() const
+	{
+		return str().c_str();
+	}
+
+	inline size_t size() const
+	{
+		return str().size();
+	}
+
+	inline size_t length() const
+	{
+		return str().size();
+	}
+
+	inline bool empty() const
+	{
+		return m_entry == NULL;
+	}
+
+	inline char operator[](size_t pos) const
+	{
+		return str()[pos];
+	}
+
+	inline const char* data() const
+	{
+		return str().data();
+	}
+
+	inline std::string::const_iterator begin() const
+	{
+		return str().begin();
+	}
+
+	inline std::string::const_iterator end() const
+	{
+		return str().end();
+	}
+
+	inline size_t find(const std::string& s, size_t pos = 0) const
+	{
+		return str().find(s, pos);
+	}
+
+	inline size_t find(char c, size_t pos = 0) const
+	{
+		return str().find(c, pos);
+	}
+
+	inline size_t rfind(const std::string& s, size_t pos = std::string::npos) const
+	{
+		return str().rfind(s, pos);
+	}
+
+	inline size_t rfind(char c, size_t pos = std::string::npos) const
+	{
+		return str().rfind(c, pos);
+	}
+
+	inline size_t find_first_of(const std::string& s, size_t pos = 0) const
+	{
+		return str().find_first_of(s, pos);
+	}
+
+	inline size_t find_last_of(const std::string& s, size_t pos = std::string::npos) const
+	{
+		return str().find_last_of(s, pos);
+	}
+
+	inline std::string substr(size_t pos = 0, size_t len = std::string::npos) const
+	{
+		return str().substr(pos, len);
+	}
+
+	inline int compare(const std::string& s) const
+	{
+		return str().compare(s);
+	}
+
+	//
+	// Interned strings are equal if they are the same copy
+	//
+	inline bool operator==(const sinsp_istring& other) const
+	{
+		return m_entry == other.m_entry;
+	}
+
+	inline bool operator!=(const sinsp_istring& other) const
+	{
+		return m_entry != other.m_entry;
+	}
+
+	inline bool operator==(const std::string& other) const
+	{
+		return str() == other;
+	}
+
+	inline bool operator!=(const std::string& other) const
+	{
+		return str() != other;
+	}
+
+	inline bool operator==(const char* other) const
+	{
+		return str() == other;
+	}
+
+	inline bool operator!=(const char* other) const
+	{
+		return str() != other;
+	}
+
+	//
+	// Orders by value, like std::string, so that sinsp_istrings can be keys
+	// of sorted containers
+	//
+	inline bool operator<(const sinsp_istring& other) const
+	{
+		return m_entry != other.m_entry && str() < other.str();
+	}
+
+	//
+	// Identifies the value in the pool, the same for all the sinsp_istrings
+	// that are equal. 0 for the empty string.
+	//
+	inline uintptr_t get_id() const
+	{
+		return (uintptr_t)m_entry;
+	}
+
+	//
+	// Number of sinsp_istrings that share this value, 0 for the empty string
+	//
+	inline uint32_t get_refcount() const
+	{
+		return (m_entry != NULL)? m_entry->second.load(std::memory_order_relaxed) : 0;
+	}
+
+	//
+	// Number of distinct strings in the pool, and total size of their
+	// characters
+	//
+	static void get_pool_stats(uint64_t* nstrings, uint64_t* nbytes);
+
+private:
+	typedef std::unordered_map<std::string, std::atomic<uint32_t>> pool_t;
+	typedef pool_t::value_type entry_t;
+
+	static entry_t* intern(const std::string& str);
+	static void release(entry_t* entry);
+	static const std::string& empty_string();
+
+	entry_t* m_entry; // NULL for the empty string
+};
+
+//
+// The std::string operators are templates, so they don't apply the
+// conversion when the sinsp_istring is on the right side
+//
+inline bool operator==(const std::string& lhs, const sinsp_istring& rhs)
+{
+	return rhs == lhs;
+}
+
+inline bool operator!=(const std::string& lhs, const sinsp_istring& rhs)
+{
+	return rhs != lhs;
+}
+
+inline bool operator==(const char* lhs, const sinsp_istring& rhs)
+{
+	return rhs == lhs;
+}
+
+inline bool operator!=(const char* lhs, const sinsp_istring& rhs)
+{
+	return rhs != lhs;
+}
+
+inline std::string operator+(const std::string& lhs, const sinsp_istring& rhs)
+{
+	return lhs + rhs.str();
+}
+
+inline std::string operator+(const sinsp_istring& lhs, const std::string& rhs)
+{
+	return lhs.str() + rhs;
+}
+
+inline std::string operator+(const char* lhs, const sinsp_istring& rhs)
+{
+	return lhs + rhs.str();
+}
+
+inline std::string operator+(const sinsp_istring& lhs, const char* rhs)
+{
+	return lhs.str() + rhs;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const sinsp_istring& str)
+{
+	return os << str.str();
+}
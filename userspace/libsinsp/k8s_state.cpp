@@ -16,10 +16,35 @@ const std::string k8s_state_t::m_docker_prefix = "docker://";
 const std::string k8s_state_t::m_rkt_prefix = "rkt://";
 const unsigned    k8s_state_t::m_id_length = 12u;
 
-k8s_state_t::k8s_state_t(bool is_captured) : m_is_captured(is_captured)
+k8s_state_t::k8s_state_t(bool is_captured) : m_is_captured(is_captured), m_generation(0)
 {
 }
 
+k8s_state_t::k8s_state_t(const k8s_state_t& other) :
+	m_namespaces(other.m_namespaces),
+	m_nodes(other.m_nodes),
+	m_pods(other.m_pods),
+	m_controllers(other.m_controllers),
+	m_replicasets(other.m_replicasets),
+	m_services(other.m_services),
+	m_daemonsets(other.m_daemonsets),
+	m_deployments(other.m_deployments),
+	m_events(other.m_events),
+	m_component_map(other.m_component_map),
+	m_is_captured(false),
+	m_generation(other.m_generation)
+{
+	//
+	// The caches point into the component lists, so they are rebuilt
+	// for the copied lists
+	//
+	update_cache(k8s_component::K8S_NAMESPACES);
+	update_cache(k8s_component::K8S_PODS);
+	update_cache(k8s_component::K8S_REPLICATIONCONTROLLERS);
+	update_cache(k8s_component::K8S_SERVICES);
+	m_generation = other.m_generation;
+}
+
 // state/pods
 
 void k8s_state_t::update_pod(k8s_pod_t& pod, const Json::Value& item)
@@ -220,6 +245,8 @@ k8s_node_t* k8s_state_t::get_node(const std::string& uid)
 
 void k8s_state_t::clear(k8s_component::type type)
 {
+	++m_generation;
+
 	if(type == k8s_component::K8S_COMPONENT_COUNT)
 	{
 		m_namespaces.clear();
@@ -270,6 +297,8 @@ void k8s_state_t::clear(k8s_component::type type)
 
 void k8s_state_t::update_cache(const k8s_component::type_map::key_type& component)
 {
+	++m_generation;
+
 	switch (component)
 	{
 		case k8s_component::K8S_NAMESPACES:
@@ -28,6 +28,19 @@ public:
 
 	k8s_state_t(bool is_captured = false);
 
+	//
+	// Copies the components and rebuilds the lookup caches for them, so that
+	// the copy can be read while the original keeps being updated. The
+	// capture events are not copied.
+	//
+	k8s_state_t(const k8s_state_t& other);
+	k8s_state_t& operator=(const k8s_state_t& other) = delete;
+
+	//
+	// Incremented every time the state changes
+	//
+	uint64_t get_generation() const { return m_generation; }
+
 	//
 	// namespaces
 	//
@@ -350,6 +363,7 @@ private:
 	// used by to quickly lookup any component by uid
 	component_map_t m_component_map;
 	bool            m_is_captured;
+	uint64_t        m_generation;
 
 	friend class k8s_dispatcher;
 	friend class k8s;
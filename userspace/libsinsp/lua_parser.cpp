@@ -55,6 +55,7 @@ sinsp_filter* lua_parser::get_filter(bool reset_filter)
 	}
 
 	sinsp_filter *ret = m_filter;
+	ret->compile_program();
 
 	if (reset_filter)
 	{
@@ -12,8 +12,6 @@
 // component
 //
 
-marathon_component::task_app_map_t marathon_component::m_task_app_cache;
-
 const marathon_component::component_map marathon_component::list =
 {
 	{ marathon_component::MARATHON_GROUP, "group" },
@@ -89,26 +87,6 @@ marathon_component::type marathon_component::get_type(const std::string& name)
 	throw sinsp_exception(os.str().c_str());
 }
 
-void marathon_component::cache_task_app(const std::string& task_id, app_ptr_t app)
-{
-	m_task_app_cache[task_id] = app;
-}
-
-void marathon_component::uncache_task_app(const std::string& task_id)
-{
-	m_task_app_cache.erase(task_id);
-}
-
-marathon_component::app_ptr_t marathon_component::get_cached_app(const std::string& task_id)
-{
-	task_app_map_t::iterator it = m_task_app_cache.find(task_id);
-	if(it != m_task_app_cache.end())
-	{
-		return it->second;
-	}
-	return 0;
-}
-
 //
 // app
 //
@@ -133,7 +111,6 @@ void marathon_app::add_task(mesos_framework::task_ptr_t ptask)
 			if(task == task_id) { return; }
 		}
 		m_tasks.push_back(task_id);
-		cache_task_app(task_id, shared_from_this());
 	}
 	else
 	{
@@ -148,7 +125,6 @@ bool marathon_app::remove_task(const std::string& task_id)
 		if(task_id == *it)
 		{
 			m_tasks.erase(it);
-			uncache_task_app(task_id);
 			return true;
 		}
 	}
@@ -328,7 +304,22 @@ bool marathon_group::remove_task(const std::string& id)
 
 marathon_group::app_ptr_t marathon_group::get_app(mesos_task::ptr_t task) const
 {
-	return get_cached_app(task->get_uid());
+	for(const auto& app : m_apps)
+	{
+		if(app.second && app.second->has_task(task->get_uid()))
+		{
+			return app.second;
+		}
+	}
+	for(const auto& group : m_groups)
+	{
+		app_ptr_t app = group.second->get_app(task);
+		if(app)
+		{
+			return app;
+		}
+	}
+	return 0;
 }
 
 marathon_group::ptr_t marathon_group::get_group(mesos_task::ptr_t task)
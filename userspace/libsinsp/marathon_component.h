@@ -63,18 +63,9 @@ public:
 
 	static type get_type(const std::string& name);
 
-protected:
-	typedef std::shared_ptr<marathon_app> app_ptr_t;
-	typedef std::map<std::string, app_ptr_t> task_app_map_t;
-	static void cache_task_app(const std::string& task_id, app_ptr_t app);
-	static void uncache_task_app(const std::string& task_id);
-	static app_ptr_t get_cached_app(const std::string& task_id);
-
 private:
 	type        m_type;
 	std::string m_id;
-
-	static task_app_map_t m_task_app_cache;
 };
 
 //
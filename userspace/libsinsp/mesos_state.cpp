@@ -21,6 +21,64 @@ mesos_state_t::mesos_state_t(bool is_captured, bool verbose) :
 {
 }
 
+mesos_state_t::mesos_state_t(const mesos_state_t& other) :
+	m_frameworks(other.m_frameworks),
+	m_marathon_uri(other.m_marathon_uri),
+	m_slaves(other.m_slaves),
+	m_verbose(other.m_verbose)
+#ifdef HAS_CAPTURE
+	, m_is_captured(false)
+#endif // HAS_CAPTURE
+{
+	//
+	// The apps update the tasks they are given, so the copy gets its own
+	// tasks, groups and apps instead of sharing them with the original
+	//
+	for(auto& framework : m_frameworks)
+	{
+		for(auto& task : framework.get_tasks())
+		{
+			task.second = std::make_shared<mesos_task>(*task.second);
+			m_task_framework_cache[task.first] = &framework;
+		}
+	}
+
+	app_copy_map_t apps;
+	for(const auto& group : other.m_groups)
+	{
+		m_groups.insert({group.first, copy_group(*group.second, apps)});
+	}
+
+	for(const auto& task_app : other.m_task_app_cache)
+	{
+		marathon_app::ptr_t& app = apps[task_app.second.get()];
+		if(!app)
+		{
+			app = std::make_shared<marathon_app>(*task_app.second);
+		}
+		m_task_app_cache.insert({task_app.first, app});
+	}
+}
+
+marathon_group::ptr_t mesos_state_t::copy_group(const marathon_group& group, app_copy_map_t& apps)
+{
+	marathon_group::ptr_t copy = std::make_shared<marathon_group>(group.get_id(), group.get_framework_id());
+	for(const auto& app : group.get_apps())
+	{
+		if(app.second)
+		{
+			marathon_app::ptr_t app_copy = std::make_shared<marathon_app>(*app.second);
+			apps[app.second.get()] = app_copy;
+			copy->add_or_replace_app(app_copy);
+		}
+	}
+	for(const auto& subgroup : group.get_groups())
+	{
+		copy->add_or_replace_group(copy_group(*subgroup.second, apps));
+	}
+	return copy;
+}
+
 mesos_framework::task_ptr_t mesos_state_t::get_task(const std::string& uid) const
 {
 	for(auto& framework : get_frameworks())
@@ -87,13 +145,10 @@ marathon_app::ptr_t mesos_state_t::get_app(const std::string& app_id)
 
 marathon_app::ptr_t mesos_state_t::get_app(mesos_task::ptr_t task) const
 {
-	for(const auto& group : m_groups)
+	task_app_map_t::const_iterator it = m_task_app_cache.find(task->get_uid());
+	if(it != m_task_app_cache.end())
 	{
-		marathon_app::ptr_t app = group.second->get_app(task);
-		if(app)
-		{
-			return app;
-		}
+		return it->second;
 	}
 	return 0;
 }
@@ -155,6 +210,7 @@ void mesos_state_t::add_task_to_app(marathon_group::app_ptr_t app, const std::st
 		if(pt)
 		{
 			app->add_task(pt);
+			m_task_app_cache[task_id] = app;
 		}
 		else
 		{
@@ -100,6 +100,14 @@ public:
 
 	mesos_state_t(bool is_captured = false, bool verbose = false);
 
+	//
+	// Copies the frameworks, tasks, slaves and the Marathon groups and apps,
+	// so that the copy can be read while the original keeps being updated.
+	// The capture events are not copied.
+	//
+	mesos_state_t(const mesos_state_t& other);
+	mesos_state_t& operator=(const mesos_state_t& other) = delete;
+
 	//
 	// frameworks
 	//
@@ -179,6 +187,9 @@ private:
 	bool handle_groups(const Json::Value& groups, marathon_group::ptr_t p_groups, const std::string& framework_id);
 	marathon_app::ptr_t add_app(const Json::Value& app, const std::string& framework_id);
 
+	typedef std::unordered_map<const marathon_app*, marathon_app::ptr_t> app_copy_map_t;
+	static marathon_group::ptr_t copy_group(const marathon_group& group, app_copy_map_t& apps);
+
 	mesos_frameworks m_frameworks;
 	std::string      m_marathon_uri;
 	mesos_slaves     m_slaves;
@@ -191,6 +202,9 @@ private:
 
 	typedef std::unordered_map<std::string, mesos_framework*> task_framework_map_t;
 	task_framework_map_t m_task_framework_cache;
+
+	typedef std::unordered_map<std::string, marathon_app::ptr_t> task_app_map_t;
+	task_app_map_t m_task_app_cache;
 };
 
 //
@@ -338,6 +352,7 @@ inline void mesos_state_t::remove_task(mesos_framework& framework, const std::st
 	}
 	framework.remove_task(uid);
 	m_task_framework_cache.erase(uid);
+	m_task_app_cache.erase(uid);
 }
 
 //
@@ -449,6 +464,7 @@ inline void mesos_state_t::clear_mesos()
 inline void mesos_state_t::clear_marathon()
 {
 	m_groups.clear();
+	m_task_app_cache.clear();
 }
 
 inline bool mesos_state_t::has_data() const
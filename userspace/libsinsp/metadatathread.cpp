@@ -0,0 +1,504 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAS_CAPTURE
+
+#include <time.h>
+#include "metadatathread.h"
+#include "sinsp.h"
+#include "sinsp_int.h"
+#include "k8s.h"
+#include "mesos.h"
+
+sinsp_metadata_thread::sinsp_metadata_thread():
+	m_k8s_client(NULL),
+	m_k8s_epoch(0),
+	m_k8s_published_generation(0),
+	m_k8s_reconnect_ts(0),
+	m_mesos_client(NULL),
+	m_mesos_epoch(0),
+	m_mesos_last_request(0),
+	m_mesos_reconnect_ts(0),
+	m_stop(false),
+	m_generation(0)
+{
+}
+
+sinsp_metadata_thread::~sinsp_metadata_thread()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cond.notify_one();
+
+	if(m_thread.joinable())
+	{
+		m_thread.join();
+	}
+
+	delete m_k8s_client;
+	delete m_mesos_client;
+}
+
+void sinsp_metadata_thread::set_k8s_client(k8s* client, const k8s_factory_t& factory)
+{
+	std::shared_ptr<const k8s_state_t> snapshot;
+	std::deque<std::string> events;
+	uint64_t generation = 0;
+	k8s* old_client;
+
+	take_k8s_snapshot(client, true, &generation, &snapshot, &events);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		//
+		// If the thread is refreshing the old client, it sees that the epoch
+		// changed and deletes the client itself
+		//
+		old_client = m_k8s_client;
+		m_k8s_client = client;
+		m_k8s_factory = factory;
+		m_k8s_epoch++;
+		m_k8s_published_generation = generation;
+		m_k8s_reconnect_ts = 0;
+		publish_k8s(snapshot, &events);
+	}
+
+	delete old_client;
+	start();
+}
+
+void sinsp_metadata_thread::set_mesos_client(mesos* client, const mesos_factory_t& factory)
+{
+	std::shared_ptr<const mesos_state_t> snapshot;
+	std::deque<std::string> events;
+	mesos* old_client;
+
+	take_mesos_snapshot(client, &snapshot, &events);
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		old_client = m_mesos_client;
+		m_mesos_client = client;
+		m_mesos_factory = factory;
+		m_mesos_epoch++;
+		m_mesos_last_request = 0;
+		m_mesos_reconnect_ts = 0;
+		publish_mesos(snapshot, &events);
+	}
+
+	delete old_client;
+	start();
+}
+
+std::shared_ptr<const k8s_state_t> sinsp_metadata_thread::get_k8s_state() const
+{
+	return std::atomic_load(&m_k8s_state);
+}
+
+std::shared_ptr<const mesos_state_t> sinsp_metadata_thread::get_mesos_state() const
+{
+	return std::atomic_load(&m_mesos_state);
+}
+
+bool sinsp_metadata_thread::get_k8s_capture_events(std::deque<std::string>* events)
+{
+	std::lock_guard<std::mutex> lock(m_events_mutex);
+	if(m_k8s_events.empty())
+	{
+		return false;
+	}
+	events->swap(m_k8s_events);
+	return true;
+}
+
+bool sinsp_metadata_thread::get_mesos_capture_events(std::deque<std::string>* events)
+{
+	std::lock_guard<std::mutex> lock(m_events_mutex);
+	if(m_mesos_events.empty())
+	{
+		return false;
+	}
+	events->swap(m_mesos_events);
+	return true;
+}
+
+void sinsp_metadata_thread::start()
+{
+	if(!m_thread.joinable())
+	{
+		m_thread = std::thread(&sinsp_metadata_thread::run, this);
+	}
+}
+
+bool sinsp_metadata_thread::stopping()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stop;
+}
+
+//
+// m_mutex is only held to pick up the clients and to publish what they
+// returned. Reading the sockets, parsing the JSON and copying the states
+// happen without it, so that set_k8s_client(), set_mesos_client() and the
+// destructor never wait for the API servers.
+//
+void sinsp_metadata_thread::run()
+{
+	while(!stopping())
+	{
+		refresh_k8s();
+
+		if(stopping())
+		{
+			break;
+		}
+
+		refresh_mesos();
+		free_retired_states();
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_cond.wait_for(lock, std::chrono::milliseconds(METADATA_REFRESH_INTERVAL_MS), [this]
+		{
+			return m_stop;
+		});
+	}
+}
+
+void sinsp_metadata_thread::refresh_k8s()
+{
+	uint64_t now = sinsp_utils::get_current_time_ns();
+	std::shared_ptr<const k8s_state_t> snapshot;
+	std::deque<std::string> events;
+	k8s* client;
+	k8s_factory_t factory;
+	uint64_t epoch;
+	uint64_t generation;
+	bool force;
+	bool alive = false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if(m_k8s_client == NULL && (!m_k8s_factory || now < m_k8s_reconnect_ts))
+		{
+			return;
+		}
+
+		//
+		// The client is checked out while it's refreshed
+		//
+		client = m_k8s_client;
+		m_k8s_client = NULL;
+		factory = m_k8s_factory;
+		epoch = m_k8s_epoch;
+		generation = m_k8s_published_generation;
+		force = !std::atomic_load(&m_k8s_state);
+	}
+
+	if(client == NULL)
+	{
+		try
+		{
+			client = factory();
+			generation = 0;
+		}
+		catch(std::exception& ex)
+		{
+			g_logger.log(std::string("Kubernetes connection failed: ") + ex.what(), sinsp_logger::SEV_ERROR);
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if(epoch == m_k8s_epoch)
+			{
+				m_k8s_reconnect_ts = now + METADATA_RECONNECT_INTERVAL_MS * 1000000LL;
+			}
+			return;
+		}
+	}
+
+	try
+	{
+		if(client->is_alive())
+		{
+			client->watch();
+			take_k8s_snapshot(client, force, &generation, &snapshot, &events);
+			alive = true;
+		}
+		else
+		{
+			g_logger.format(sinsp_logger::SEV_WARNING, "Kubernetes connection not active anymore, retrying");
+		}
+	}
+	catch(std::exception& ex)
+	{
+		g_logger.log(std::string("Kubernetes exception: ") + ex.what(), sinsp_logger::SEV_ERROR);
+	}
+
+	//
+	// Keep the last published state until the new connection is up
+	//
+	if(!alive)
+	{
+		delete client;
+		client = NULL;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if(epoch == m_k8s_epoch)
+		{
+			m_k8s_client = client;
+			m_k8s_published_generation = generation;
+			if(!alive)
+			{
+				m_k8s_reconnect_ts = now + METADATA_RECONNECT_INTERVAL_MS * 1000000LL;
+			}
+			publish_k8s(snapshot, &events);
+			return;
+		}
+	}
+
+	//
+	// set_k8s_client() replaced the client in the meantime
+	//
+	delete client;
+}
+
+void sinsp_metadata_thread::refresh_mesos()
+{
+	uint64_t now = sinsp_utils::get_current_time_ns();
+	std::shared_ptr<const mesos_state_t> snapshot;
+	std::deque<std::string> events;
+	mesos* client;
+	mesos_factory_t factory;
+	uint64_t epoch;
+	time_t last_request;
+	bool changed = false;
+	bool alive = false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if(m_mesos_client == NULL && (!m_mesos_factory || now < m_mesos_reconnect_ts))
+		{
+			return;
+		}
+
+		client = m_mesos_client;
+		m_mesos_client = NULL;
+		factory = m_mesos_factory;
+		epoch = m_mesos_epoch;
+		last_request = m_mesos_last_request;
+	}
+
+	if(client == NULL)
+	{
+		try
+		{
+			client = factory();
+			last_request = 0;
+			changed = true;
+		}
+		catch(std::exception& ex)
+		{
+			g_logger.log(std::string("Mesos connection failed: ") + ex.what(), sinsp_logger::SEV_ERROR);
+
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if(epoch == m_mesos_epoch)
+			{
+				m_mesos_reconnect_ts = now + METADATA_RECONNECT_INTERVAL_MS * 1000000LL;
+			}
+			return;
+		}
+	}
+
+	try
+	{
+		if(client->is_alive())
+		{
+			time_t tnow;
+			time(&tnow);
+
+			if(last_request)
+			{
+				g_logger.log("Collecting Mesos data ...", sinsp_logger::SEV_DEBUG);
+				changed = client->collect_data() || changed;
+			}
+			if(difftime(tnow, last_request) > 10)
+			{
+				g_logger.log("Requesting Mesos data ...", sinsp_logger::SEV_DEBUG);
+				client->send_data_request(false);
+				last_request = tnow;
+			}
+
+			if(changed)
+			{
+				take_mesos_snapshot(client, &snapshot, &events);
+			}
+			alive = true;
+		}
+		else
+		{
+			g_logger.format(sinsp_logger::SEV_ERROR, "Mesos connection not active anymore, retrying ...");
+		}
+	}
+	catch(std::exception& ex)
+	{
+		g_logger.log(std::string("Mesos exception: ") + ex.what(), sinsp_logger::SEV_ERROR);
+	}
+
+	if(!alive)
+	{
+		delete client;
+		client = NULL;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if(epoch == m_mesos_epoch)
+		{
+			m_mesos_client = client;
+			m_mesos_last_request = last_request;
+			if(!alive)
+			{
+				m_mesos_reconnect_ts = now + METADATA_RECONNECT_INTERVAL_MS * 1000000LL;
+			}
+			publish_mesos(snapshot, &events);
+			return;
+		}
+	}
+
+	//
+	// set_mesos_client() replaced the client in the meantime
+	//
+	delete client;
+}
+
+//
+// Copy the state of the client if its generation is not the published one,
+// and take its capture events. Called without m_mutex.
+//
+void sinsp_metadata_thread::take_k8s_snapshot(k8s* client, bool force, uint64_t* generation,
+	std::shared_ptr<const k8s_state_t>* snapshot, std::deque<std::string>* events)
+{
+	const k8s_state_t& state = client->get_state();
+
+	if(force || state.get_generation() != *generation)
+	{
+		snapshot->reset(new k8s_state_t(state));
+		*generation = state.get_generation();
+	}
+
+	while(!client->get_capture_events().empty())
+	{
+		events->push_back(client->dequeue_capture_event());
+	}
+}
+
+//
+// The Mesos capture events are converted to JSON when they are dequeued,
+// so that is done here rather than by the capture. Called without m_mutex.
+//
+void sinsp_metadata_thread::take_mesos_snapshot(mesos* client,
+	std::shared_ptr<const mesos_state_t>* snapshot, std::deque<std::string>* events)
+{
+	snapshot->reset(new mesos_state_t(client->get_state()));
+
+	while(!client->get_capture_events().empty())
+	{
+		events->push_back(client->dequeue_capture_event());
+	}
+}
+
+//
+// Called with m_mutex held
+//
+void sinsp_metadata_thread::publish_k8s(const std::shared_ptr<const k8s_state_t>& snapshot, std::deque<std::string>* events)
+{
+	if(!snapshot && events->empty())
+	{
+		return;
+	}
+
+	if(snapshot)
+	{
+		m_retired_states.push_back(std::atomic_exchange(&m_k8s_state, snapshot));
+	}
+
+	if(!events->empty())
+	{
+		std::lock_guard<std::mutex> lock(m_events_mutex);
+		m_k8s_events.insert(m_k8s_events.end(), events->begin(), events->end());
+	}
+
+	m_generation.fetch_add(1, std::memory_order_release);
+}
+
+//
+// Called with m_mutex held
+//
+void sinsp_metadata_thread::publish_mesos(const std::shared_ptr<const mesos_state_t>& snapshot, std::deque<std::string>* events)
+{
+	if(!snapshot && events->empty())
+	{
+		return;
+	}
+
+	if(snapshot)
+	{
+		m_retired_states.push_back(std::atomic_exchange(&m_mesos_state, snapshot));
+	}
+
+	if(!events->empty())
+	{
+		std::lock_guard<std::mutex> lock(m_events_mutex);
+		m_mesos_events.insert(m_mesos_events.end(), events->begin(), events->end());
+	}
+
+	m_generation.fetch_add(1, std::memory_order_release);
+}
+
+void sinsp_metadata_thread::free_retired_states()
+{
+	std::vector<std::shared_ptr<const void>> unused;
+
+	//
+	// A state is freed once the capture has moved to a newer one. The
+	// states are destroyed after m_mutex is released.
+	//
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for(auto it = m_retired_states.begin(); it != m_retired_states.end();)
+	{
+		if(!*it || it->use_count() == 1)
+		{
+			unused.push_back(std::move(*it));
+			it = m_retired_states.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
+#endif // HAS_CAPTURE
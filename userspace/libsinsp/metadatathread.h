@@ -0,0 +1,144 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#ifdef HAS_CAPTURE
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "sinsp.h"
+
+class k8s;
+class k8s_state_t;
+class mesos;
+class mesos_state_t;
+
+/*!
+  \brief Keeps the Kubernetes and Mesos state up to date from a background
+   thread.
+
+  The thread owns the orchestrator clients: it reads their sockets, parses
+  the JSON, and reconnects them when the connection goes down. Every time a
+  state changes, the thread publishes an immutable copy of it. The capture
+  picks up the new copies with \ref get_k8s_state() and
+  \ref get_mesos_state(), without waiting for the thread, and can keep using
+  a copy for as long as it holds it.
+
+  The copies that the capture dropped are freed by the thread, so that a big
+  state is never destroyed in the middle of the event processing.
+*/
+class SINSP_PUBLIC sinsp_metadata_thread
+{
+public:
+	typedef std::function<k8s*()> k8s_factory_t;
+	typedef std::function<mesos*()> mesos_factory_t;
+
+	sinsp_metadata_thread();
+	~sinsp_metadata_thread();
+
+	/*!
+	  \brief Hand a connected Kubernetes client over to the thread, which
+	   deletes it when it's done. factory is called to create a new client
+	   when the connection goes down.
+	*/
+	void set_k8s_client(k8s* client, const k8s_factory_t& factory);
+
+	/*!
+	  \brief Hand a connected Mesos client over to the thread, which
+	   deletes it when it's done. factory is called to create a new client
+	   when the connection goes down.
+	*/
+	void set_mesos_client(mesos* client, const mesos_factory_t& factory);
+
+	/*!
+	  \brief Return a number that changes every time a new state or new
+	   capture events are published.
+	*/
+	uint64_t get_generation() const
+	{
+		return m_generation.load(std::memory_order_acquire);
+	}
+
+	std::shared_ptr<const k8s_state_t> get_k8s_state() const;
+	std::shared_ptr<const mesos_state_t> get_mesos_state() const;
+
+	/*!
+	  \brief Move the pending capture events of the orchestrator into events.
+	   Return false if there were none.
+	*/
+	bool get_k8s_capture_events(std::deque<std::string>* events);
+	bool get_mesos_capture_events(std::deque<std::string>* events);
+
+private:
+	void start();
+	bool stopping();
+	void run();
+	void refresh_k8s();
+	void refresh_mesos();
+	void take_k8s_snapshot(k8s* client, bool force, uint64_t* generation,
+		std::shared_ptr<const k8s_state_t>* snapshot, std::deque<std::string>* events);
+	void take_mesos_snapshot(mesos* client,
+		std::shared_ptr<const mesos_state_t>* snapshot, std::deque<std::string>* events);
+	void publish_k8s(const std::shared_ptr<const k8s_state_t>& snapshot, std::deque<std::string>* events);
+	void publish_mesos(const std::shared_ptr<const mesos_state_t>& snapshot, std::deque<std::string>* events);
+	void free_retired_states();
+
+	//
+	// Owned by the thread, protected by m_mutex. While the thread refreshes
+	// a client, it takes it out of here and leaves NULL. The epochs are
+	// incremented when a client is replaced, so that the thread drops the
+	// one it was refreshing instead of putting it back.
+	//
+	k8s* m_k8s_client;
+	k8s_factory_t m_k8s_factory;
+	uint64_t m_k8s_epoch;
+	uint64_t m_k8s_published_generation;
+	uint64_t m_k8s_reconnect_ts;
+	mesos* m_mesos_client;
+	mesos_factory_t m_mesos_factory;
+	uint64_t m_mesos_epoch;
+	time_t m_mesos_last_request;
+	uint64_t m_mesos_reconnect_ts;
+	std::vector<std::shared_ptr<const void>> m_retired_states;
+
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	bool m_stop; // Protected by m_mutex
+
+	//
+	// Published to the capture
+	//
+	std::shared_ptr<const k8s_state_t> m_k8s_state;
+	std::shared_ptr<const mesos_state_t> m_mesos_state;
+	std::atomic<uint64_t> m_generation;
+
+	std::mutex m_events_mutex;
+	std::deque<std::string> m_k8s_events; // Protected by m_events_mutex
+	std::deque<std::string> m_mesos_events; // Protected by m_events_mutex
+};
+
+#endif // HAS_CAPTURE
@@ -0,0 +1,156 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// A pool of objects of type T, used for the entries of the thread and fd
+// tables.
+//
+// The objects are carved out of slabs of SLAB_SIZE of them, and the freed
+// ones go to a free list, so that the threads and fds that come and go
+// don't hit malloc for every entry. The slabs are only released by clear()
+// or when the pool is destroyed, and the objects don't move.
+///////////////////////////////////////////////////////////////////////////////
+template<typename T, uint32_t SLAB_SIZE = 256>
+class sinsp_obj_pool
+{
+private:
+	//
+	// Object storage. Free objects are linked through m_next_free.
+	//
+	union storage
+	{
+		storage* m_next_free;
+		typename std::aligned_storage<sizeof(T), std::alignment_of<T>::value>::type m_value;
+	};
+
+public:
+	sinsp_obj_pool():
+		m_free(NULL),
+		m_slab_used(SLAB_SIZE),
+		m_nused(0)
+	{
+	}
+
+	~sinsp_obj_pool()
+	{
+		clear();
+	}
+
+	sinsp_obj_pool(const sinsp_obj_pool&) = delete;
+	sinsp_obj_pool& operator=(const sinsp_obj_pool&) = delete;
+
+	//
+	// Construct a new object with the given constructor arguments
+	//
+	template<typename... Args>
+	T* create(Args&&... args)
+	{
+		void* p = allocate();
+
+		try
+		{
+			return new (p) T(std::forward<Args>(args)...);
+		}
+		catch(...)
+		{
+			release(p);
+			throw;
+		}
+	}
+
+	void destroy(T* obj)
+	{
+		obj->~T();
+		release(obj);
+	}
+
+	//
+	// Release all the slabs. The objects must have been destroyed already.
+	//
+	void clear()
+	{
+		for(size_t j = 0; j < m_slabs.size(); j++)
+		{
+			delete[] m_slabs[j];
+		}
+
+		m_slabs.clear();
+		m_free = NULL;
+		m_slab_used = SLAB_SIZE;
+		m_nused = 0;
+	}
+
+	//
+	// Number of live objects
+	//
+	uint64_t get_used() const
+	{
+		return m_nused;
+	}
+
+	//
+	// Number of objects that fit in the slabs allocated so far
+	//
+	uint64_t get_capacity() const
+	{
+		return (uint64_t)m_slabs.size() * SLAB_SIZE;
+	}
+
+private:
+	void* allocate()
+	{
+		m_nused++;
+
+		if(m_free != NULL)
+		{
+			storage* res = m_free;
+			m_free = res->m_next_free;
+			return res;
+		}
+
+		if(m_slab_used == SLAB_SIZE)
+		{
+			m_slabs.reserve(m_slabs.size() + 1);
+			m_slabs.push_back(new storage[SLAB_SIZE]);
+			m_slab_used = 0;
+		}
+
+		return &m_slabs.back()[m_slab_used++];
+	}
+
+	void release(void* p)
+	{
+		storage* s = (storage*)p;
+		s->m_next_free = m_free;
+		m_free = s;
+		m_nused--;
+	}
+
+	std::vector<storage*> m_slabs;
+	storage* m_free;
+	uint32_t m_slab_used; // Objects taken from the last slab
+	uint64_t m_nused;
+};
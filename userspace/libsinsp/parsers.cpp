@@ -81,6 +81,7 @@ sinsp_parser::sinsp_parser(sinsp *inspector) :
 
 	init_metaevt(m_k8s_metaevents_state, PPME_K8S_E, SP_EVT_BUF_SIZE);
 	init_metaevt(m_mesos_metaevents_state, PPME_MESOS_E, SP_EVT_BUF_SIZE);
+	init_metaevt(m_container_metaevents_state, PPME_CONTAINER_JSON_E, SP_EVT_BUF_SIZE);
 	m_drop_event_flags = EF_NONE;
 }
 #endif
@@ -92,16 +93,11 @@ sinsp_parser::~sinsp_parser()
 		delete m_protodecoders[j];
 	}
 
-	while(!m_tmp_events_buffer.empty())
-	{
-		auto ptr = m_tmp_events_buffer.top();
-		free(ptr);
-		m_tmp_events_buffer.pop();
-	}
 	m_protodecoders.clear();
 
 	free(m_k8s_metaevents_state.m_piscapevt);
 	free(m_mesos_metaevents_state.m_piscapevt);
+	free(m_container_metaevents_state.m_piscapevt);
 
 	if(m_inspector->m_partial_tracers_pool != NULL)
 	{
@@ -275,7 +271,7 @@ void sinsp_parser::process_event(sinsp_evt *evt)
 		store_event(evt);
 		break;
 	case PPME_SYSCALL_WRITE_E:
-		if(!m_inspector->m_dumper)
+		if(!m_inspector->m_dump_writer)
 		{
 			evt->m_fdinfo = evt->m_tinfo->get_fd(evt->m_tinfo->m_lastevent_fd);
 			if(evt->m_fdinfo)
@@ -495,8 +491,7 @@ void sinsp_parser::event_cleanup(sinsp_evt *evt)
 	if(evt->get_direction() == SCAP_ED_OUT &&
 	   evt->m_tinfo && evt->m_tinfo->m_lastevent_data)
 	{
-		free_event_buffer(evt->m_tinfo->m_lastevent_data);
-		evt->m_tinfo->m_lastevent_data = NULL;
+		free_event_buffer(evt->m_tinfo);
 		evt->m_tinfo->set_lastevent_data_validity(false);
 	}
 }
@@ -752,10 +747,7 @@ void sinsp_parser::store_event(sinsp_evt *evt)
 	// Copy the data
 	//
 	auto tinfo = evt->m_tinfo;
-	if(tinfo->m_lastevent_data == NULL)
-	{
-		tinfo->m_lastevent_data = reserve_event_buffer();
-	}
+	reserve_event_buffer(tinfo, elen);
 	memcpy(tinfo->m_lastevent_data, evt->m_pevt, elen);
 	tinfo->m_lastevent_cpuid = evt->get_cpuid();
 
@@ -1205,6 +1197,15 @@ void sinsp_parser::parse_clone_exit(sinsp_evt *evt)
 		// referring to an element in the parent's table.
 		//
 		tinfo.m_fdtable.reset_cache();
+
+		//
+		// If the parent's fds are read lazily, the child inherited the ones that
+		// haven't been read yet, and can find them in its own /proc entry
+		//
+		if(tinfo.m_fdtable.m_lazy_pid != -1)
+		{
+			tinfo.m_fdtable.m_lazy_pid = tinfo.m_pid;
+		}
 	}
 	//if((tinfo.m_flags & (PPM_CL_CLONE_FILES)))
 	//{
@@ -1389,10 +1390,20 @@ void sinsp_parser::parse_clone_exit(sinsp_evt *evt)
 	//
 	tinfo.m_clone_ts = evt->get_ts();
 
+#ifdef _DEBUG
+	if(tid_collision)
+	{
+		g_logger.format(sinsp_logger::SEV_INFO,
+			"tid collision for %" PRIu64 "(%s)",
+			tinfo.m_tid, tinfo.m_comm.c_str());
+	}
+#endif
+
 	//
-	// Add the new thread to the table
+	// Add the new thread to the table. This moves the strings and the fd table
+	// of tinfo, rather than copying them.
 	//
-	m_inspector->add_thread(tinfo);
+	m_inspector->m_thread_manager->add_thread(std::move(tinfo), false);
 
 	//
 	// If we had to erase a previous entry for this tid and rebalance the table,
@@ -1403,12 +1414,7 @@ void sinsp_parser::parse_clone_exit(sinsp_evt *evt)
 	{
 		reset(evt);
 #ifdef HAS_ANALYZER
-		m_inspector->m_tid_collisions.push_back(tinfo.m_tid);
-#endif
-#ifdef _DEBUG
-		g_logger.format(sinsp_logger::SEV_INFO,
-			"tid collision for %" PRIu64 "(%s)",
-			tinfo.m_tid, tinfo.m_comm.c_str());
+		m_inspector->m_tid_collisions.push_back(childtid);
 #endif
 	}
 
@@ -1632,12 +1638,10 @@ void sinsp_parser::parse_openat_dir(sinsp_evt *evt, char* name, int64_t dirfd, O
 	}
 }
 
-template <typename T>
-void schedule_more_evts(sinsp* inspector, void* data, T* client, ppm_event_type evt_type)
+void schedule_more_evts(sinsp* inspector, void* data, ppm_event_type evt_type)
 {
 #ifdef HAS_CAPTURE
 	ASSERT(data);
-	bool good_event = false;
 	metaevents_state* state = (metaevents_state*)data;
 
 	if(state->m_new_group == true)
@@ -1647,18 +1651,19 @@ void schedule_more_evts(sinsp* inspector, void* data, T* client, ppm_event_type
 		return;
 	}
 
-	ASSERT(client);
-	if(!client->get_capture_events().size())
+	if(state->m_payloads.empty())
 	{
 		g_logger.log(std::string("An event scheduled but no events available."
 					"All pending event requests for "
-					"[") + typeid(T).name() + "] are cancelled.", sinsp_logger::SEV_ERROR);
+					"[") + g_infotables.m_event_info[evt_type].name + "] are cancelled.", sinsp_logger::SEV_ERROR);
 		state->m_new_group = false;
 		state->m_n_additional_events_to_add = 0;
 		inspector->remove_meta_event_callback();
 		return;
 	}
-	string payload = client->dequeue_capture_event();
+	string payload;
+	payload.swap(state->m_payloads.front());
+	state->m_payloads.pop_front();
 	std::size_t tot_len = sizeof(scap_evt) + sizeof(uint16_t) + payload.size() + 1;
 
 	if(tot_len > state->m_scap_buf_size)
@@ -1671,14 +1676,13 @@ void schedule_more_evts(sinsp* inspector, void* data, T* client, ppm_event_type
 	plen[0] = (uint16_t)payload.size() + 1;
 	uint8_t* edata = (uint8_t*)plen + sizeof(uint16_t);
 	memcpy(edata, payload.c_str(), plen[0]);
-	good_event = true;
 
 	state->m_n_additional_events_to_add--;
 	if(state->m_n_additional_events_to_add == 0)
 	{
 		inspector->remove_meta_event_callback();
 	}
-	else if(good_event)
+	else
 	{
 		inspector->add_meta_event(&state->m_metaevt);
 	}
@@ -1687,60 +1691,65 @@ void schedule_more_evts(sinsp* inspector, void* data, T* client, ppm_event_type
 
 void schedule_more_k8s_evts(sinsp* inspector, void* data)
 {
-	schedule_more_evts(inspector, data, inspector->get_k8s_client(), PPME_K8S_E);
+	schedule_more_evts(inspector, data, PPME_K8S_E);
 }
 
-void sinsp_parser::schedule_k8s_events(sinsp_evt *evt)
+void sinsp_parser::schedule_k8s_events(sinsp_evt *evt, deque<string>* events)
 {
 #ifdef HAS_CAPTURE
 	//
 	// schedule k8s events, if any available
 	//
-	k8s* k8s_client = 0;
-	if(m_inspector && (k8s_client = m_inspector->m_k8s_client))
-	{
-		int event_count = k8s_client->get_capture_events().size();
-		if(event_count)
-		{
-			m_k8s_metaevents_state.m_piscapevt->tid = evt->get_tid();
-			m_k8s_metaevents_state.m_piscapevt->ts = m_inspector->m_lastevent_ts;
-			m_k8s_metaevents_state.m_new_group = true;
-			m_k8s_metaevents_state.m_n_additional_events_to_add = event_count;
-			m_inspector->add_meta_event_callback(&schedule_more_k8s_evts, &m_k8s_metaevents_state);
-
-			schedule_more_k8s_evts(m_inspector, &m_k8s_metaevents_state);
-		}
-	}
+	schedule_metaevents(evt, &m_k8s_metaevents_state, events, &schedule_more_k8s_evts);
 #endif // HAS_CAPTURE
 }
 
 void schedule_more_mesos_evts(sinsp* inspector, void* data)
 {
-	schedule_more_evts(inspector, data, inspector->get_mesos_client(), PPME_MESOS_E);
+	schedule_more_evts(inspector, data, PPME_MESOS_E);
 }
 
-void sinsp_parser::schedule_mesos_events(sinsp_evt *evt)
+void sinsp_parser::schedule_mesos_events(sinsp_evt *evt, deque<string>* events)
 {
 #ifdef HAS_CAPTURE
 	//
 	// schedule mesos events, if any available
 	//
-	mesos* mesos_client = 0;
-	if(m_inspector && (mesos_client = m_inspector->m_mesos_client))
+	schedule_metaevents(evt, &m_mesos_metaevents_state, events, &schedule_more_mesos_evts);
+#endif // HAS_CAPTURE
+}
+
+void schedule_more_container_evts(sinsp* inspector, void* data)
+{
+	schedule_more_evts(inspector, data, PPME_CONTAINER_JSON_E);
+}
+
+void sinsp_parser::schedule_container_events(sinsp_evt *evt, deque<string>* events)
+{
+#ifdef HAS_CAPTURE
+	schedule_metaevents(evt, &m_container_metaevents_state, events, &schedule_more_container_evts);
+#endif // HAS_CAPTURE
+}
+
+void sinsp_parser::schedule_metaevents(sinsp_evt *evt, metaevents_state* state, deque<string>* events, meta_event_callback cback)
+{
+	for(auto& payload : *events)
 	{
-		int event_count = mesos_client->get_capture_events().size();
-		if(event_count)
-		{
-			m_mesos_metaevents_state.m_piscapevt->tid = evt->get_tid();
-			m_mesos_metaevents_state.m_piscapevt->ts = m_inspector->m_lastevent_ts;
-			m_mesos_metaevents_state.m_new_group = true;
-			m_mesos_metaevents_state.m_n_additional_events_to_add = event_count;
-			m_inspector->add_meta_event_callback(&schedule_more_mesos_evts, &m_mesos_metaevents_state);
+		state->m_payloads.push_back(std::move(payload));
+	}
+	events->clear();
 
-			schedule_more_mesos_evts(m_inspector, &m_mesos_metaevents_state);
-		}
+	uint32_t event_count = (uint32_t)state->m_payloads.size();
+	if(event_count && m_inspector)
+	{
+		state->m_piscapevt->tid = evt->get_tid();
+		state->m_piscapevt->ts = m_inspector->m_lastevent_ts;
+		state->m_new_group = true;
+		state->m_n_additional_events_to_add = event_count;
+		m_inspector->add_meta_event_callback(cback, state);
+
+		cback(m_inspector, state);
 	}
-#endif // HAS_CAPTURE
 }
 
 void sinsp_parser::parse_open_openat_creat_exit(sinsp_evt *evt)
@@ -2084,7 +2093,7 @@ void sinsp_parser::parse_connect_exit(sinsp_evt *evt)
 	sinsp_evt_param *parinfo;
 	uint8_t *packed_data;
 	uint8_t family;
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+	fdinfo_map_iterator_t fdit;
 	const char *parstr;
 	int64_t retval;
 
@@ -2230,7 +2239,7 @@ void sinsp_parser::parse_accept_exit(sinsp_evt *evt)
 	sinsp_evt_param *parinfo;
 	int64_t fd;
 	uint8_t* packed_data;
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+	fdinfo_map_iterator_t fdit;
 	sinsp_fdinfo_t fdi;
 	const char *parstr;
 
@@ -2798,7 +2807,7 @@ uint32_t sinsp_parser::parse_tracer(sinsp_evt *evt, int64_t retval)
 
 	if(p->m_res == sinsp_tracerparser::RES_TRUNCATED)
 	{
-		if(!m_inspector->m_dumper)
+		if(!m_inspector->m_dump_writer)
 		{
 			evt->m_filtered_out = true;
 		}
@@ -3704,10 +3713,7 @@ void sinsp_parser::parse_select_poll_epollwait_enter(sinsp_evt *evt)
 		return;
 	}
 
-	if(evt->m_tinfo->m_lastevent_data == NULL)
-	{
-		evt->m_tinfo->m_lastevent_data = reserve_event_buffer();
-	}
+	reserve_event_buffer(evt->m_tinfo, sizeof(uint64_t));
 	*(uint64_t*)evt->m_tinfo->m_lastevent_data = evt->get_ts();
 }
 void sinsp_parser::parse_fcntl_enter(sinsp_evt *evt)
@@ -3917,6 +3923,16 @@ void sinsp_parser::parse_setgid_exit(sinsp_evt *evt)
 
 void sinsp_parser::parse_container_json_evt(sinsp_evt *evt)
 {
+	//
+	// In a live capture these are the events that the container manager
+	// adds once it has stored the details of a container, which are more
+	// than what the JSON carries
+	//
+	if(m_inspector->m_islive)
+	{
+		return;
+	}
+
 	sinsp_evt_param *parinfo = evt->get_param(0);
 	ASSERT(parinfo);
 	ASSERT(parinfo->m_len > 0);
@@ -4011,18 +4027,24 @@ void sinsp_parser::parse_cpu_hotplug_enter(sinsp_evt *evt)
 #endif
 }
 
-uint8_t* sinsp_parser::reserve_event_buffer()
+//
+// Make sure that the stored event buffer of the thread can hold len bytes
+//
+void sinsp_parser::reserve_event_buffer(sinsp_threadinfo* tinfo, uint32_t len)
 {
-	if(m_tmp_events_buffer.empty())
-	{
-		return (uint8_t*)malloc(sizeof(uint8_t)*SP_EVT_BUF_SIZE);
-	}
-	else
+	sinsp_evt_arena* arena = m_inspector->m_thread_manager->get_evt_arena();
+
+	if(tinfo->m_lastevent_data != NULL)
 	{
-		auto ptr = m_tmp_events_buffer.top();
-		m_tmp_events_buffer.pop();
-		return ptr;
+		if(sinsp_evt_arena::get_buf_size(tinfo->m_lastevent_data) >= len)
+		{
+			return;
+		}
+
+		arena->release(tinfo->m_lastevent_data);
 	}
+
+	tinfo->m_lastevent_data = arena->reserve(len);
 }
 
 void sinsp_parser::parse_k8s_evt(sinsp_evt *evt)
@@ -4089,14 +4111,8 @@ void sinsp_parser::parse_setsid_exit(sinsp_evt *evt)
 	}
 }
 
-void sinsp_parser::free_event_buffer(uint8_t *ptr)
+void sinsp_parser::free_event_buffer(sinsp_threadinfo* tinfo)
 {
-	if(m_tmp_events_buffer.size() < m_inspector->m_thread_manager->m_threadtable.size())
-	{
-		m_tmp_events_buffer.push(ptr);
-	}
-	else
-	{
-		free(ptr);
-	}
+	m_inspector->m_thread_manager->get_evt_arena()->release(tinfo->m_lastevent_data);
+	tinfo->m_lastevent_data = NULL;
 }
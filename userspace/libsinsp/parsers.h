@@ -31,6 +31,7 @@ public:
 	sinsp_evt m_metaevt;
 	scap_evt* m_piscapevt;
 	uint32_t m_scap_buf_size;
+	deque<string> m_payloads; // Payloads of the events that remain to be added
 };
 
 class sinsp_parser
@@ -63,8 +64,18 @@ public:
 	sinsp_protodecoder* add_protodecoder(string decoder_name);
 	void register_event_callback(sinsp_pd_callback_type etype, sinsp_protodecoder* dec);
 
-	void schedule_k8s_events(sinsp_evt *evt);
-	void schedule_mesos_events(sinsp_evt *evt);
+	//
+	// Add the given orchestrator capture events to the event stream, as
+	// a group of meta events that follows evt
+	//
+	void schedule_k8s_events(sinsp_evt *evt, deque<string>* events);
+	void schedule_mesos_events(sinsp_evt *evt, deque<string>* events);
+
+	//
+	// Add the given container JSON descriptions to the event stream, as a
+	// group of container events that follows evt
+	//
+	void schedule_container_events(sinsp_evt *evt, deque<string>* events);
 
 	//
 	// Protocol decoders callback lists
@@ -90,6 +101,7 @@ private:
 	//
 	bool reset(sinsp_evt *evt);
 	inline void store_event(sinsp_evt* evt);
+	void schedule_metaevents(sinsp_evt *evt, metaevents_state* state, deque<string>* events, meta_event_callback cback);
 
 	//
 	// Parsers
@@ -150,8 +162,8 @@ private:
 	// Return false if the update didn't happen because the tuple is identical to the given address
 	bool set_unix_info(sinsp_fdinfo_t* fdinfo, uint8_t* packed_data);
 	void swap_ipv4_addresses(sinsp_fdinfo_t* fdinfo);
-	uint8_t* reserve_event_buffer();
-	void free_event_buffer(uint8_t*);
+	void reserve_event_buffer(sinsp_threadinfo* tinfo, uint32_t len);
+	void free_event_buffer(sinsp_threadinfo* tinfo);
 
 	//
 	// Pointers to inspector context
@@ -176,8 +188,8 @@ private:
 
 	metaevents_state m_k8s_metaevents_state;
 	metaevents_state m_mesos_metaevents_state;
+	metaevents_state m_container_metaevents_state;
 
-	stack<uint8_t*> m_tmp_events_buffer;
 	friend class sinsp_analyzer;
 	friend class sinsp_analyzer_fd_listener;
 	friend class sinsp_protodecoder;
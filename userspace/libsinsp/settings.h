@@ -24,11 +24,25 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 #define INCLUDE_UNKNOWN_SOCKET_FDS
 
 //
-// Memory storage size for an entry in the event storage LIFO.
-// Events bigger than SP_EVT_BUF_SIZE won't be be stored in the LIFO.
+// Memory storage size for a stored event.
+// Enter events bigger than SP_EVT_BUF_SIZE won't be be stored.
 //
 #define SP_EVT_BUF_SIZE 4096
 
+//
+// Size of the slabs that the buffers for the stored enter events are carved
+// from. Must be bigger than SP_EVT_BUF_SIZE.
+//
+#define SP_EVT_ARENA_SLAB_SIZE (64 * 1024)
+
+//
+// How often, in seconds of capture, the slabs of the stored enter events that
+// have no buffer in use are freed, and how many of them are kept for each size
+// class
+//
+#define SP_EVT_ARENA_TRIM_INTERVAL_S 10
+#define SP_EVT_ARENA_RESERVE_SLABS 1
+
 //
 // If defined, the filtering system is compiled
 //
@@ -51,16 +65,73 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 //
 #define SCAP_TIMEOUT_MS 30
 
+//
+// Maximum number of events that sinsp::next() fetches from libscap with a
+// single scap_next_batch() call
+//
+#define SCAP_NEXT_BATCH_SIZE 256
+
+//
+// Size of the queue between the capture and the thread that writes trace
+// files when dumps are asynchronous. It must absorb the events captured while
+// the writer rolls over to a new file and reads /proc to rebuild its tables.
+//
+#define DUMP_WRITER_QUEUE_SIZE (64 * 1024 * 1024)
+
+//
+// How often the metadata thread polls the Kubernetes and Mesos connections
+// and publishes the updated state to the capture
+//
+#define METADATA_REFRESH_INTERVAL_MS 250
+
+//
+// How long the metadata thread waits before reconnecting to an orchestrator
+// whose connection went down
+//
+#define METADATA_RECONNECT_INTERVAL_MS 1000
+
+//
+// Max number of threads that query the Docker daemon for the details of new
+// containers, and max number of queries that can be in flight
+//
+#define DOCKER_RESOLVER_MAX_WORKERS 4
+#define DOCKER_RESOLVER_MAX_QUEUED_REQUESTS 1024
+
+//
+// How long a query to the Docker daemon can take, and how long a container
+// whose query failed isn't queried again
+//
+#define DOCKER_REQUEST_TIMEOUT_MS 10000
+#define DOCKER_FAILED_REQUEST_TTL_NS (60 * ONE_SECOND_IN_NS)
+
 //
 // Max size that the thread table can reach
 //
 #define MAX_THREAD_TABLE_SIZE 32768
 
+//
+// Number of entries of the cache of the last looked up threads. Must be a
+// power of 2.
+//
+#define THREAD_LOOKASIDE_SIZE 64
+
+//
+// Number of entries of the cache of the container ids that the cgroups
+// resolve to. Must be a power of 2.
+//
+#define CGROUP_CACHE_SIZE 4096
+
 //
 // Max size that the FD table of a process can reach
 //
 #define MAX_FD_TABLE_SIZE 4096
 
+//
+// FDs below this number are kept in an array indexed by fd in the FD table of
+// a process. The other ones go in a tree.
+//
+#define FD_TABLE_DIRECT_SIZE 1024
+
 //
 // The time after an inactive thread is removed.
 //
@@ -76,6 +147,24 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 //
 #define DEFAULT_INACTIVE_CONTAINER_SCAN_TIME_S DEFAULT_INACTIVE_THREAD_SCAN_TIME_S
 
+//
+// Granularity and number of slots of the timing wheel that schedules the
+// checks for inactive threads. The wheel should cover the thread timeout.
+//
+#define THREAD_EXPIRY_WHEEL_SLOT_NS 1000000000LL
+#define THREAD_EXPIRY_WHEEL_NSLOTS 4096
+
+//
+// Max number of inactive thread checks done for each batch of events
+//
+#define THREAD_EXPIRY_CHECKS_PER_BATCH 64
+
+//
+// Min number of values that the OR'ed string compares of a field must have
+// to be matched all at once by a filter program
+//
+#define FILTER_MATCHER_MIN_PATTERNS 16
+
 //
 // Enables Lua chisel scripts support
 //
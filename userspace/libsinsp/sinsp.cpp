@@ -34,6 +34,7 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 #include "chisel.h"
 #include "cyclewriter.h"
 #include "protodecoder.h"
+#include "metadatathread.h"
 
 #ifdef HAS_ANALYZER
 #include "analyzer_int.h"
@@ -57,7 +58,7 @@ sinsp::sinsp() :
 {
 	m_h = NULL;
 	m_parser = NULL;
-	m_dumper = NULL;
+	m_dump_writer = NULL;
 	m_metaevt = NULL;
 	m_skipped_evt = NULL;
 	m_meinfo.m_piscapevt = NULL;
@@ -81,6 +82,11 @@ sinsp::sinsp() :
 #endif
 
 	m_fds_to_remove = new vector<int64_t>;
+	m_batch_evts.resize(SCAP_NEXT_BATCH_SIZE);
+	m_batch_cpuids.resize(SCAP_NEXT_BATCH_SIZE);
+	m_batch_dump_flags.resize(SCAP_NEXT_BATCH_SIZE);
+	m_batch_size = 0;
+	m_batch_pos = 0;
 	m_machine_info = NULL;
 #ifdef SIMULATE_DROP_MODE
 	m_isdropping = false;
@@ -96,9 +102,14 @@ sinsp::sinsp() :
 	m_hostname_and_port_resolution_enabled = true;
 	m_output_time_flag = 'h';
 	m_max_evt_output_len = 0;
+	m_dump_compression_level = 0;
+	m_dump_async = false;
 	m_filesize = -1;
 	m_track_tracers_state = false;
 	m_import_users = true;
+	m_lazy_fd_import = false;
+	m_offline_readahead = false;
+	m_offline_mmap = false;
 	m_meta_evt_buf = new char[SP_EVT_BUF_SIZE];
 	m_meta_evt.m_pevt = (scap_evt*) m_meta_evt_buf;
 	m_meta_evt_pending = false;
@@ -133,15 +144,15 @@ sinsp::sinsp() :
 	m_meinfo.m_n_procinfo_evts = 0;
 	m_meta_event_callback = NULL;
 	m_meta_event_callback_data = NULL;
-	m_k8s_client = NULL;
-	m_k8s_last_watch_time_ns = 0;
-
 	m_k8s_client = NULL;
 	m_k8s_api_server = NULL;
 	m_k8s_api_cert = NULL;
 
 	m_mesos_client = NULL;
-	m_mesos_last_watch_time_ns = 0;
+
+	m_metadata_thread = NULL;
+	m_metadata_generation = 0;
+	m_metadata_events_pending = false;
 
 	m_filter_proc_table_when_saving = false;
 }
@@ -184,6 +195,10 @@ sinsp::~sinsp()
 		delete[] m_meinfo.m_piscapevt;
 	}
 
+#ifdef HAS_CAPTURE
+	delete m_metadata_thread;
+#endif
+
 	delete m_k8s_client;
 	delete m_k8s_api_server;
 	delete m_k8s_api_cert;
@@ -273,6 +288,8 @@ void sinsp::init()
 	m_fds_to_remove->clear();
 	m_n_proc_lookups = 0;
 	m_n_proc_lookups_duration_ns = 0;
+	m_batch_size = 0;
+	m_batch_pos = 0;
 
 	//
 	// Return the tracers to the pool and clear the tracers list
@@ -384,7 +401,18 @@ void sinsp::set_import_users(bool import_users)
 	m_import_users = import_users;
 }
 
-void sinsp::open(uint32_t timeout_ms)
+void sinsp::set_lazy_fd_import(bool lazy)
+{
+	m_lazy_fd_import = lazy;
+}
+
+void sinsp::set_offline_read_options(bool readahead, bool mmap)
+{
+	m_offline_readahead = readahead;
+	m_offline_mmap = mmap;
+}
+
+void sinsp::open(uint32_t timeout_ms, const scap_wait_params* wait_params)
 {
 	char error[SCAP_LASTERR_SIZE];
 
@@ -410,6 +438,17 @@ void sinsp::open(uint32_t timeout_ms)
 		oargs.proc_callback_context = this;
 	}
 	oargs.import_users = m_import_users;
+	if(wait_params != NULL)
+	{
+		oargs.wait_params = *wait_params;
+	}
+	else
+	{
+		memset(&oargs.wait_params, 0, sizeof(oargs.wait_params));
+	}
+	oargs.readahead = false;
+	oargs.mmap = false;
+	oargs.lazy_fds = m_lazy_fd_import;
 
 	m_h = scap_open(oargs, error);
 
@@ -506,6 +545,10 @@ void sinsp::open(string filename)
 	oargs.proc_callback = NULL;
 	oargs.proc_callback_context = NULL;
 	oargs.import_users = m_import_users;
+	memset(&oargs.wait_params, 0, sizeof(oargs.wait_params));
+	oargs.readahead = m_offline_readahead;
+	oargs.mmap = m_offline_mmap;
+	oargs.lazy_fds = false;
 
 	m_h = scap_open(oargs, error);
 
@@ -532,10 +575,10 @@ void sinsp::close()
 		m_h = NULL;
 	}
 
-	if(NULL != m_dumper)
+	if(NULL != m_dump_writer)
 	{
-		scap_dump_close(m_dumper);
-		m_dumper = NULL;
+		delete m_dump_writer;
+		m_dump_writer = NULL;
 	}
 
 	if(NULL != m_network_interfaces)
@@ -560,32 +603,39 @@ void sinsp::close()
 }
 
 void sinsp::autodump_start(const string& dump_filename, bool compress)
+{
+	autodump_start(dump_filename, compress? SCAP_COMPRESSION_GZIP : SCAP_COMPRESSION_NONE);
+}
+
+void sinsp::autodump_start(const string& dump_filename, compression_mode compress)
 {
 	if(NULL == m_h)
 	{
 		throw sinsp_exception("inspector not opened yet");
 	}
 
-	if(compress)
-	{
-		m_dumper = scap_dump_open(m_h, dump_filename.c_str(), SCAP_COMPRESSION_GZIP);
-	}
-	else
-	{
-		m_dumper = scap_dump_open(m_h, dump_filename.c_str(), SCAP_COMPRESSION_NONE);
-	}
+	scap_dump_params params;
+	memset(&params, 0, sizeof(params));
+	params.compress = compress;
+	params.compression_level = m_dump_compression_level;
 
-	if(NULL == m_dumper)
+	if(NULL == m_dump_writer)
 	{
-		throw sinsp_exception(scap_getlasterr(m_h));
+		m_dump_writer = new sinsp_dump_writer(this, m_dump_async);
 	}
 
-	m_container_manager.dump_containers(m_dumper);
+	//
+	// If a file is open, the writer closes it
+	//
+	m_dump_writer->open(dump_filename, params);
 }
 
 void sinsp::autodump_next_file()
 {
-	autodump_stop();
+	//
+	// The writer is kept, so that with asynchronous dumps the rollover
+	// doesn't wait for the previous file to be closed
+	//
 	autodump_start(m_cycle_writer->get_current_file_name(), m_compress);
 }
 
@@ -596,13 +646,30 @@ void sinsp::autodump_stop()
 		throw sinsp_exception("inspector not opened yet");
 	}
 
-	if(m_dumper != NULL)
+	if(m_dump_writer != NULL)
 	{
-		scap_dump_close(m_dumper);
-		m_dumper = NULL;
+		delete m_dump_writer;
+		m_dump_writer = NULL;
 	}
 }
 
+void sinsp::set_dump_options(int32_t compression_level, bool async)
+{
+	m_dump_compression_level = compression_level;
+	m_dump_async = async;
+}
+
+void sinsp::get_dump_stats(sinsp_dump_stats* stats)
+{
+	if(m_dump_writer == NULL)
+	{
+		memset(stats, 0, sizeof(sinsp_dump_stats));
+		return;
+	}
+
+	m_dump_writer->get_stats(stats);
+}
+
 void sinsp::on_new_entry_from_proc(void* context,
 								   int64_t tid,
 								   scap_threadinfo* tinfo,
@@ -636,7 +703,7 @@ void sinsp::on_new_entry_from_proc(void* context,
 		sinsp_threadinfo newti(this);
 		newti.init(tinfo);
 
-		m_thread_manager->add_thread(newti, true);
+		m_thread_manager->add_thread(std::move(newti), true);
 	}
 	else
 	{
@@ -647,7 +714,7 @@ void sinsp::on_new_entry_from_proc(void* context,
 			sinsp_threadinfo newti(this);
 			newti.init(tinfo);
 
-			m_thread_manager->add_thread(newti, true);
+			m_thread_manager->add_thread(std::move(newti), true);
 
 			sinsp_tinfo = find_thread(tid, true);
 			if(sinsp_tinfo == NULL)
@@ -686,7 +753,7 @@ void sinsp::import_thread_table()
 	{
 		sinsp_threadinfo newti(this);
 		newti.init(pi);
-		m_thread_manager->add_thread(newti, true);
+		m_thread_manager->add_thread(std::move(newti), true);
 	}
 }
 
@@ -804,6 +871,7 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 {
 	sinsp_evt* evt;
 	int32_t res;
+	bool new_batch = false;
 
 	//
 	// Check if there are fake cpu events to  events
@@ -847,11 +915,42 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 		}
 
 		//
-		// Get the event from libscap
+		// Get the next batch of events from libscap if we consumed
+		// the previous one
 		//
-		res = scap_next(m_h, &(evt->m_pevt), &(evt->m_cpuid));
+		if(m_batch_pos == m_batch_size)
+		{
+			m_batch_pos = 0;
+
+			res = scap_next_batch(m_h,
+				SCAP_NEXT_BATCH_SIZE,
+				&m_batch_evts[0],
+				&m_batch_cpuids[0],
+				&m_batch_dump_flags[0],
+				&m_batch_size);
 
-		if(res != SCAP_SUCCESS)
+			if(res == SCAP_SUCCESS)
+			{
+				new_batch = true;
+			}
+			else
+			{
+				m_batch_size = 0;
+			}
+		}
+		else
+		{
+			res = SCAP_SUCCESS;
+		}
+
+		if(res == SCAP_SUCCESS)
+		{
+			evt->m_pevt = m_batch_evts[m_batch_pos];
+			evt->m_cpuid = m_batch_cpuids[m_batch_pos];
+			evt->m_dump_flags = m_batch_dump_flags[m_batch_pos];
+			m_batch_pos++;
+		}
+		else
 		{
 			if(res == SCAP_TIMEOUT)
 			{
@@ -941,6 +1040,10 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 	evt->m_evtnum = m_nevts;
 	m_lastevent_ts = ts;
 
+#ifdef HAS_FILTERING
+	m_field_cache.invalidate();
+#endif
+
 #ifndef HAS_ANALYZER
 	//
 	// Deleayed removal of threads from the thread table, so that
@@ -956,21 +1059,18 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 	}
 
 	//
-	// Run the periodic connection and thread table cleanup
+	// Run the periodic connection and thread table cleanup. The checks
+	// are time based, so running them once per batch is enough.
 	//
-	if(m_islive)
+	if(m_islive && new_batch)
 	{
 		m_thread_manager->remove_inactive_threads();
 		m_container_manager.remove_inactive_containers();
+		m_container_manager.update_docker_containers();
 
-		if(m_k8s_client)
-		{
-			update_kubernetes_state();
-		}
-
-		if(m_mesos_client)
+		if(m_metadata_thread)
 		{
-			update_mesos_state();
+			update_metadata_state();
 		}
 	}
 #endif // HAS_ANALYZER
@@ -1031,16 +1131,12 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 	//
 	// If needed, dump the event to file
 	//
-	if(NULL != m_dumper)
+	if(NULL != m_dump_writer)
 	{
 		if(m_meta_evt_pending)
 		{
 			m_meta_evt_pending = false;
-			res = scap_dump(m_h, m_dumper, m_meta_evt.m_pevt, m_meta_evt.m_cpuid, 0);
-			if(SCAP_SUCCESS != res)
-			{
-				throw sinsp_exception(scap_getlasterr(m_h));
-			}
+			m_dump_writer->dump(m_meta_evt.m_pevt, m_meta_evt.m_cpuid, 0);
 		}
 
 #if defined(HAS_FILTERING) && defined(HAS_CAPTURE_FILTERING)
@@ -1077,12 +1173,7 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 
 		scap_evt* pdevt = (evt->m_poriginal_evt)? evt->m_poriginal_evt : evt->m_pevt;
 
-		res = scap_dump(m_h, m_dumper, pdevt, evt->m_cpuid, dflags);
-
-		if(SCAP_SUCCESS != res)
-		{
-			throw sinsp_exception(scap_getlasterr(m_h));
-		}
+		m_dump_writer->dump(pdevt, evt->m_cpuid, dflags);
 	}
 
 #if defined(HAS_FILTERING) && defined(HAS_CAPTURE_FILTERING)
@@ -1142,6 +1233,95 @@ int32_t sinsp::next(OUT sinsp_evt **puevt)
 	return res;
 }
 
+int32_t sinsp::next_batch(uint32_t max_evts, OUT sinsp_evt_batch* batch)
+{
+	batch->m_inspector = this;
+	batch->m_max_evts = max_evts;
+	batch->m_nevts = 0;
+	batch->m_evt = NULL;
+	batch->m_res = SCAP_TIMEOUT;
+
+	if(max_evts == 0)
+	{
+		return SCAP_TIMEOUT;
+	}
+
+	//
+	// The first event is read, and parsed, here, so that the caller knows
+	// whether there's something to iterate
+	//
+	batch->advance(true);
+
+	if(batch->m_evt == NULL)
+	{
+		return batch->m_res;
+	}
+
+	return SCAP_SUCCESS;
+}
+
+sinsp_evt_batch::sinsp_evt_batch():
+	m_inspector(NULL),
+	m_max_evts(0),
+	m_nevts(0),
+	m_evt(NULL),
+	m_res(SCAP_SUCCESS)
+{
+}
+
+//
+// Move to the next event of the batch, or set m_evt to NULL if the batch is
+// over. The batch ends with the events that were read from libscap, unless
+// there are meta events that still need to be delivered. Only the first
+// event of a batch can start a new read.
+//
+void sinsp_evt_batch::advance(bool first)
+{
+	m_evt = NULL;
+
+	while(m_nevts < m_max_evts)
+	{
+		sinsp_evt* evt = NULL;
+		int32_t res;
+
+		if(!first &&
+			m_inspector->m_batch_pos == m_inspector->m_batch_size &&
+			m_inspector->m_metaevt == NULL)
+		{
+			break;
+		}
+
+		first = false;
+		res = m_inspector->next(&evt);
+
+		if(res == SCAP_SUCCESS)
+		{
+			m_nevts++;
+			m_evt = evt;
+			m_res = SCAP_SUCCESS;
+			return;
+		}
+		else if(res == SCAP_TIMEOUT)
+		{
+			//
+			// Events dropped by the capture filter are still delivered, so
+			// that the consumer can run its timeout logic
+			//
+			if(evt != NULL)
+			{
+				m_evt = evt;
+				m_res = SCAP_SUCCESS;
+				return;
+			}
+		}
+		else
+		{
+			m_res = res;
+			return;
+		}
+	}
+}
+
 uint64_t sinsp::get_num_events()
 {
 	ASSERT(m_h);
@@ -1230,16 +1410,20 @@ sinsp_threadinfo* sinsp::get_thread(int64_t tid, bool query_os_if_not_found, boo
 
 		for(it = pttable->begin(); it != pttable->end(); ++it)
 		{
-			if(it->second.m_pid == tid)
+			if((it->second.m_flags & PPM_CL_CLONE_THREAD) &&
+				it->second.m_pid == tid &&
+				it->second.m_tid != tid &&
+				it->second.m_nchilds_pid == -1)
 			{
 				newti.m_nchilds++;
+				it->second.m_nchilds_pid = tid;
 			}
 		}
 
 		//
 		// Done. Add the new thread to the list.
 		//
-		m_thread_manager->add_thread(newti, false);
+		m_thread_manager->add_thread(std::move(newti), false);
 		sinsp_proc = find_thread(tid, lookup_only);
 	}
 
@@ -1253,7 +1437,12 @@ sinsp_threadinfo* sinsp::get_thread(int64_t tid)
 
 void sinsp::add_thread(const sinsp_threadinfo& ptinfo)
 {
-	m_thread_manager->add_thread((sinsp_threadinfo&)ptinfo, false);
+	m_thread_manager->add_thread(ptinfo, false);
+}
+
+void sinsp::add_thread(sinsp_threadinfo&& ptinfo)
+{
+	m_thread_manager->add_thread(std::move(ptinfo), false);
 }
 
 void sinsp::remove_thread(int64_t tid, bool force)
@@ -1273,6 +1462,13 @@ void sinsp::set_snaplen(uint32_t snaplen)
 		return;
 	}
 
+	//
+	// Setting the snaplen flushes the ring buffers, which invalidates
+	// the events we still have in the batch
+	//
+	m_batch_size = 0;
+	m_batch_pos = 0;
+
 	if(scap_set_snaplen(m_h, snaplen) != SCAP_SUCCESS)
 	{
 		//
@@ -1358,6 +1554,42 @@ const string sinsp::get_filter()
 	return m_filterstring;
 }
 
+void sinsp::set_eventmask_from_filter()
+{
+	sinsp_evttype_set evttypes;
+
+	if(m_filter == NULL || !m_filter->get_evttypes(&evttypes))
+	{
+		return;
+	}
+
+	uint8_t events[PPM_EVENT_MAX];
+
+	for(uint32_t j = 0; j < PPM_EVENT_MAX; j++)
+	{
+		//
+		// The parsers need both the enter and the exit event of a syscall,
+		// and the thread and fd tables need the events that change them
+		// even when the filter drops them
+		//
+		events[j] = evttypes[j] ||
+			evttypes[j ^ PPME_DIRECTION_FLAG] ||
+			(g_infotables.m_event_info[j].flags & (EF_CREATES_FD | EF_DESTROYS_FD | EF_MODIFIES_STATE));
+	}
+
+	//
+	// Setting the mask flushes the ring buffers, which invalidates
+	// the events we still have in the batch
+	//
+	m_batch_size = 0;
+	m_batch_pos = 0;
+
+	if(scap_set_eventmask_all(m_h, events) != SCAP_SUCCESS)
+	{
+		throw sinsp_exception(scap_getlasterr(m_h));
+	}
+}
+
 void sinsp::add_evttype_filter(string &name,
 			       list<uint32_t> &evttypes,
 			       sinsp_filter *filter)
@@ -1468,6 +1700,10 @@ sinsp_stats sinsp::get_stats()
 		m_thread_manager->update_statistics();
 	}
 
+#ifdef HAS_FILTERING
+	m_field_cache.get_stats(&m_stats.m_n_field_cache_hits, &m_stats.m_n_field_cache_misses);
+#endif
+
 	//
 	// Return the result
 	//
@@ -1590,6 +1826,12 @@ sinsp_parser* sinsp::get_parser()
 }
 
 bool sinsp::setup_cycle_writer(string base_file_name, int rollover_mb, int duration_seconds, int file_limit, unsigned long event_limit, bool compress)
+{
+	return setup_cycle_writer(base_file_name, rollover_mb, duration_seconds, file_limit, event_limit,
+		compress? SCAP_COMPRESSION_GZIP : SCAP_COMPRESSION_NONE);
+}
+
+bool sinsp::setup_cycle_writer(string base_file_name, int rollover_mb, int duration_seconds, int file_limit, unsigned long event_limit, compression_mode compress)
 {
 	m_compress = compress;
 
@@ -1598,7 +1840,7 @@ bool sinsp::setup_cycle_writer(string base_file_name, int rollover_mb, int durat
 		m_write_cycling = true;
 	}
 
-	return m_cycle_writer->setup(base_file_name, rollover_mb, duration_seconds, file_limit, event_limit, &m_dumper);
+	return m_cycle_writer->setup(base_file_name, rollover_mb, duration_seconds, file_limit, event_limit, &m_dump_writer);
 }
 
 double sinsp::get_read_progress()
@@ -1620,6 +1862,133 @@ double sinsp::get_read_progress()
 	return (double)fpos * 100 / m_filesize;
 }
 
+void sinsp::seek_to_time(uint64_t ts, bool replay_state)
+{
+	seek(ts, true, replay_state);
+}
+
+void sinsp::seek_to_evtnum(uint64_t evtnum, bool replay_state)
+{
+	seek(evtnum, false, replay_state);
+}
+
+void sinsp::seek(uint64_t target, bool by_time, bool replay_state)
+{
+	uint64_t chunk_evtnum;
+	int32_t res;
+
+	if(m_h == NULL || m_islive)
+	{
+		throw sinsp_exception("seeking is only supported on trace files");
+	}
+
+	//
+	// Find the chunk to start parsing from. Event numbers start from 1,
+	// while libscap counts the events that come before.
+	//
+	if(replay_state)
+	{
+		res = scap_seek_to_evtnum(m_h, 0, &chunk_evtnum);
+	}
+	else if(by_time)
+	{
+		res = scap_seek_to_time(m_h, target, &chunk_evtnum);
+	}
+	else
+	{
+		res = scap_seek_to_evtnum(m_h, (target == 0)? 0 : target - 1, &chunk_evtnum);
+	}
+
+	if(res == SCAP_EOF)
+	{
+		throw sinsp_exception("seek target is past the end of the file");
+	}
+	else if(res != SCAP_SUCCESS)
+	{
+		throw sinsp_exception(scap_getlasterr(m_h));
+	}
+
+	//
+	// Go back to the thread table saved at the beginning of the file. The
+	// containers and the users are not rebuilt from the events and are kept.
+	//
+	m_thread_manager->clear();
+	import_thread_table();
+
+	m_tid_to_remove = -1;
+	m_fds_to_remove->clear();
+	m_metaevt = NULL;
+	m_skipped_evt = NULL;
+	m_meta_evt_pending = false;
+	m_batch_size = 0;
+	m_batch_pos = 0;
+	m_nevts = chunk_evtnum;
+
+	for(auto it = m_partial_tracers_list.begin(); it != m_partial_tracers_list.end(); ++it)
+	{
+		m_partial_tracers_pool->push(*it);
+	}
+	m_partial_tracers_list.clear();
+
+	//
+	// Run the events that come before the target through next(), so that
+	// they update the state but are not returned. The next event is peeked
+	// from the batch, which next() will then consume.
+	//
+	while(true)
+	{
+		sinsp_evt* evt;
+
+		if(m_batch_pos == m_batch_size)
+		{
+			m_batch_pos = 0;
+
+			res = scap_next_batch(m_h,
+				SCAP_NEXT_BATCH_SIZE,
+				&m_batch_evts[0],
+				&m_batch_cpuids[0],
+				&m_batch_dump_flags[0],
+				&m_batch_size);
+
+			if(res != SCAP_SUCCESS)
+			{
+				m_batch_size = 0;
+
+				if(res == SCAP_EOF)
+				{
+					break;
+				}
+
+				throw sinsp_exception(scap_getlasterr(m_h));
+			}
+		}
+
+		if(m_metaevt == NULL)
+		{
+			if(by_time && m_batch_evts[m_batch_pos]->ts >= target)
+			{
+				break;
+			}
+
+			if(!by_time && m_nevts + 1 >= target)
+			{
+				break;
+			}
+		}
+
+		res = next(&evt);
+
+		if(res == SCAP_EOF)
+		{
+			break;
+		}
+		else if(res != SCAP_SUCCESS && res != SCAP_TIMEOUT)
+		{
+			throw sinsp_exception(m_lasterr);
+		}
+	}
+}
+
 bool sinsp::remove_inactive_threads()
 {
 	return m_thread_manager->remove_inactive_threads();
@@ -1643,6 +2012,38 @@ void sinsp::init_mesos_client(string* api_server, bool verbose)
 		}
 
 		bool is_live = !m_mesos_api_server.empty();
+#ifdef HAS_CAPTURE
+		if(is_live)
+		{
+			if(m_mesos_state)
+			{
+				return;
+			}
+
+			string mesos_api_server = m_mesos_api_server;
+			vector<string> marathon_api_server = m_marathon_api_server;
+			bool verbose_json = m_verbose_json;
+			sinsp_metadata_thread::mesos_factory_t factory = [mesos_api_server, marathon_api_server, verbose_json]()
+			{
+				return new mesos(mesos_api_server, mesos::default_state_api,
+								marathon_api_server,
+								mesos::default_groups_api,
+								mesos::default_apps_api,
+								marathon_api_server.empty(), // leader auto-follow if no uri
+								mesos::default_timeout_ms,
+								true,
+								verbose_json);
+			};
+
+			if(m_metadata_thread == NULL)
+			{
+				m_metadata_thread = new sinsp_metadata_thread();
+			}
+			m_metadata_thread->set_mesos_client(factory(), factory);
+			m_mesos_state = m_metadata_thread->get_mesos_state();
+			return;
+		}
+#endif // HAS_CAPTURE
 		m_mesos_client = new mesos(m_mesos_api_server, mesos::default_state_api,
 									m_marathon_api_server,
 									mesos::default_groups_api,
@@ -1725,6 +2126,38 @@ void sinsp::init_k8s_client(string* api_server, string* ssl_cert, bool verbose)
 		}
 #endif // HAS_CAPTURE
 		bool is_live = !m_k8s_api_server->empty();
+#ifdef HAS_CAPTURE
+		if(is_live)
+		{
+			if(m_k8s_state)
+			{
+				return;
+			}
+
+			//
+			// The factory keeps the credentials, so that the background
+			// thread can reconnect with them
+			//
+			string k8s_api_server = *m_k8s_api_server;
+			sinsp_metadata_thread::k8s_factory_t factory = [k8s_api_server, k8s_ssl, k8s_bt]()
+			{
+				return new k8s(k8s_api_server,
+					true, // watch
+					false, // don't run watch in thread
+					true, // capture
+					k8s_ssl,
+					k8s_bt);
+			};
+
+			if(m_metadata_thread == NULL)
+			{
+				m_metadata_thread = new sinsp_metadata_thread();
+			}
+			m_metadata_thread->set_k8s_client(factory(), factory);
+			m_k8s_state = m_metadata_thread->get_k8s_state();
+			return;
+		}
+#endif // HAS_CAPTURE
 		m_k8s_client = new k8s(*m_k8s_api_server,
 			is_live ? true : false, // watch
 			false, // don't run watch in thread
@@ -1744,92 +2177,72 @@ ssl_err:
 #endif // HAS_CAPTURE
 }
 
-void sinsp::update_kubernetes_state()
+const k8s_state_t* sinsp::get_k8s_state() const
 {
-	ASSERT(m_k8s_client);
-	if(m_lastevent_ts > m_k8s_last_watch_time_ns + ONE_SECOND_IN_NS)
+	if(m_k8s_state)
 	{
-		m_k8s_last_watch_time_ns = m_lastevent_ts;
-
-		if(m_parser && m_k8s_client->is_alive())
-		{
-			uint64_t delta = sinsp_utils::get_current_time_ns();
-
-			m_k8s_client->watch();
-			m_parser->schedule_k8s_events(&m_meta_evt);
-
-			delta = sinsp_utils::get_current_time_ns() - delta;
-
-			g_logger.format(sinsp_logger::SEV_DEBUG, "Updating Kubernetes state took %" PRIu64 " ms", delta / 1000000LL);
-		}
-		else
-		{
-			g_logger.format(sinsp_logger::SEV_WARNING, "Kubernetes connection not active anymore, retrying");
-			delete m_k8s_client;
-			m_k8s_client = NULL;
-			init_k8s_client(m_k8s_api_server, m_k8s_api_cert, m_verbose_json);
-		}
+		return m_k8s_state.get();
+	}
+	else if(m_k8s_client)
+	{
+		return &m_k8s_client->get_state();
 	}
+	return NULL;
 }
 
-bool sinsp::get_mesos_data()
+const mesos_state_t* sinsp::get_mesos_state() const
 {
-	bool ret = false;
-#ifdef HAS_CAPTURE
-	try
+	if(m_mesos_state)
 	{
-		static time_t last_mesos_refresh = 0;
-		ASSERT(m_mesos_client);
-		ASSERT(m_mesos_client->is_alive());
-
-		time_t now; time(&now);
-		if(last_mesos_refresh)
-		{
-			g_logger.log("Collecting Mesos data ...", sinsp_logger::SEV_DEBUG);
-			ret = m_mesos_client->collect_data();
-		}
-		if(difftime(now, last_mesos_refresh) > 10)
-		{
-			g_logger.log("Requesting Mesos data ...", sinsp_logger::SEV_DEBUG);
-			m_mesos_client->send_data_request(false);
-			last_mesos_refresh = now;
-		}
+		return m_mesos_state.get();
 	}
-	catch(std::exception& ex)
+	else if(m_mesos_client)
 	{
-		g_logger.log(std::string("Mesos exception: ") + ex.what(), sinsp_logger::SEV_ERROR);
-		delete m_mesos_client;
-		m_mesos_client = NULL;
-		init_mesos_client(0, m_verbose_json);
+		return &m_mesos_client->get_state();
 	}
-#endif // HAS_CAPTURE
-	return ret;
+	return NULL;
 }
 
-void sinsp::update_mesos_state()
+void sinsp::update_metadata_state()
 {
-	ASSERT(m_mesos_client);
-	if(m_lastevent_ts > m_mesos_last_watch_time_ns + ONE_SECOND_IN_NS)
+#ifdef HAS_CAPTURE
+	ASSERT(m_metadata_thread);
+
+	//
+	// Pick up the state that the metadata thread published last. The
+	// states we drop are freed by the thread.
+	//
+	uint64_t generation = m_metadata_thread->get_generation();
+	if(generation != m_metadata_generation)
 	{
-		m_mesos_last_watch_time_ns = m_lastevent_ts;
-		if(m_mesos_client->is_alive())
+		m_metadata_generation = generation;
+		m_k8s_state = m_metadata_thread->get_k8s_state();
+		m_mesos_state = m_metadata_thread->get_mesos_state();
+		m_metadata_events_pending = true;
+	}
+
+	//
+	// Only one group of meta events can be in flight, so the Kubernetes and
+	// Mesos events go in separate batches
+	//
+	if(m_metadata_events_pending && m_parser && m_meta_event_callback == NULL)
+	{
+		deque<string> events;
+
+		if(m_metadata_thread->get_k8s_capture_events(&events))
 		{
-			uint64_t delta = sinsp_utils::get_current_time_ns();
-			if(m_parser && get_mesos_data())
-			{
-				m_parser->schedule_mesos_events(&m_meta_evt);
-				delta = sinsp_utils::get_current_time_ns() - delta;
-				g_logger.format(sinsp_logger::SEV_DEBUG, "Updating Mesos state took %" PRIu64 " ms", delta / 1000000LL);
-			}
+			m_parser->schedule_k8s_events(&m_meta_evt, &events);
+		}
+		else if(m_metadata_thread->get_mesos_capture_events(&events))
+		{
+			m_parser->schedule_mesos_events(&m_meta_evt, &events);
 		}
 		else
 		{
-			g_logger.format(sinsp_logger::SEV_ERROR, "Mesos connection not active anymore, retrying ...");
-			delete m_mesos_client;
-			m_mesos_client = NULL;
-			init_mesos_client(0, m_verbose_json);
+			m_metadata_events_pending = false;
 		}
 	}
+#endif // HAS_CAPTURE
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -1837,70 +2250,53 @@ void sinsp::update_mesos_state()
 ///////////////////////////////////////////////////////////////////////////////
 bool sinsp_thread_manager::remove_inactive_threads()
 {
-	bool res = false;
+	uint64_t now = m_inspector->m_lastevent_ts;
 
 	if(m_last_flush_time_ns == 0)
 	{
 		//
-		// Set the first table scan for 30 seconds in, so that we can spot bugs in the logic without having
-		// to wait for tens of minutes
+		// Schedule the first check of the threads that are already in the
+		// table for 30 seconds in, so that we can spot bugs in the logic
+		// without having to wait for tens of minutes
 		//
-		if(m_inspector->m_inactive_thread_scan_time_ns > 30 * ONE_SECOND_IN_NS)
+		uint64_t first_check_ns = m_inspector->m_inactive_thread_scan_time_ns;
+
+		if(first_check_ns > 30 * ONE_SECOND_IN_NS)
 		{
-			m_last_flush_time_ns =
-				(m_inspector->m_lastevent_ts - m_inspector->m_inactive_thread_scan_time_ns + 30 * ONE_SECOND_IN_NS);
+			first_check_ns = 30 * ONE_SECOND_IN_NS;
 		}
-		else
+
+		m_last_flush_time_ns = now;
+
+		for(threadinfo_map_iterator_t it = m_threadtable.begin(); it != m_threadtable.end(); ++it)
 		{
-			m_last_flush_time_ns =
-				(m_inspector->m_lastevent_ts - m_inspector->m_inactive_thread_scan_time_ns);
+			schedule_expiry_check(&(it->second), now + first_check_ns);
 		}
 	}
 
-	if(m_inspector->m_lastevent_ts >
-		m_last_flush_time_ns + m_inspector->m_inactive_thread_scan_time_ns)
-	{
-		res = true;
-
-		m_last_flush_time_ns = m_inspector->m_lastevent_ts;
-
-		g_logger.format(sinsp_logger::SEV_INFO, "Flushing thread table");
-
-		//
-		// Go through the table and remove dead entries.
-		//
-		for(threadinfo_map_iterator_t it = m_threadtable.begin(); it != m_threadtable.end();)
+	//
+	// Check the threads that are due. There's a limit for each call, so
+	// that a lot of threads due at the same time don't stall the capture.
+	//
+	uint32_t nchecked = m_expiry_wheel.expire(now, THREAD_EXPIRY_CHECKS_PER_BATCH,
+		[this](int64_t tid, uint64_t due_ts)
 		{
-			bool closed = (it->second.m_flags & PPM_CL_CLOSED) != 0;
+			check_inactive_thread(tid, due_ts);
+		});
 
-			if(closed ||
-				((m_inspector->m_lastevent_ts > it->second.m_lastaccess_ts + m_inspector->m_thread_timeout_ns) &&
-					!scap_is_thread_alive(m_inspector->m_h, it->second.m_pid, it->first, it->second.m_comm.c_str()))
-					)
-			{
-				//
-				// Reset the cache
-				//
-				m_last_tid = 0;
-				m_last_tinfo = NULL;
-
-#ifdef GATHER_INTERNAL_STATS
-				m_removed_threads->increment();
-#endif
-				remove_thread(it++, closed);
-			}
-			else
-			{
-				++it;
-			}
-		}
+	if(nchecked != 0)
+	{
+		m_last_flush_time_ns = now;
+	}
 
-		//
-		// Rebalance the thread table dependency tree, so we free up threads that
-		// exited but that are stuck because of reference counting.
-		//
-		recreate_child_dependencies();
+	//
+	// Give back the memory that a burst of stored enter events left unused
+	//
+	if(now > m_last_arena_trim_ns + SP_EVT_ARENA_TRIM_INTERVAL_S * ONE_SECOND_IN_NS)
+	{
+		m_evt_arena.trim(SP_EVT_ARENA_RESERVE_SLABS);
+		m_last_arena_trim_ns = now;
 	}
 
-	return res;
+	return nchecked != 0;
 }
@@ -57,11 +57,14 @@ along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <map>
 #include <queue>
 #include <vector>
 #include <set>
+#include <bitset>
 #include <list>
+#include <memory>
 
 using namespace std;
 
@@ -70,9 +73,12 @@ using namespace std;
 #include "logger.h"
 #include "event.h"
 #include "filter.h"
+#include "fieldcache.h"
+#include "dumpwriter.h"
 #include "dumper.h"
 #include "stats.h"
 #include "ifinfo.h"
+#include "istring.h"
 #include "container.h"
 #include "viewinfo.h"
 #include "utils.h"
@@ -96,7 +102,11 @@ typedef enum sinsp_pd_callback_type
 }sinsp_pd_callback_type;
 
 #include "tuples.h"
+#include "fdmap.h"
 #include "fdinfo.h"
+#include "tidmap.h"
+#include "evtarena.h"
+#include "timingwheel.h"
 #include "threadinfo.h"
 #include "ifinfo.h"
 #include "eventformatter.h"
@@ -108,8 +118,11 @@ class sinsp_filter;
 class cycle_writer;
 class sinsp_protodecoder;
 class k8s;
+class k8s_state_t;
 class sinsp_partial_tracer;
 class mesos;
+class mesos_state_t;
+class sinsp_metadata_thread;
 
 vector<string> sinsp_split(const string &s, char delim);
 
@@ -185,6 +198,109 @@ struct sinsp_capture_interrupt_exception : sinsp_exception
 */
 #define DEFAULT_OUTPUT_STR "*%evt.num %evt.time %evt.cpu %proc.name (%thread.tid) %evt.dir %evt.type %evt.args"
 
+class sinsp;
+
+/*!
+  \brief A batch of events returned by \ref sinsp::next_batch().
+
+  The events of a batch are read from libscap at once, but the state engine
+  runs on each of them only when the iteration gets to it, so every event
+  sees exactly the state that \ref sinsp::next() would have exposed. The
+  events are iterated with a range for:
+
+  \code
+  for(sinsp_evt* evt : batch)
+  {
+  	...
+  }
+  \endcode
+
+  The events that the capture filter dropped, which \ref sinsp::next()
+  returns with SCAP_TIMEOUT, are part of the batch too, so that the consumer
+  can run its timeout logic. \ref sinsp_evt::is_filtered_out() tells them
+  apart. Every event is valid only until the iteration moves to the next one.
+  Leaving the iteration early is fine: the remaining events are returned by
+  the next call to \ref sinsp::next() or \ref sinsp::next_batch().
+*/
+class SINSP_PUBLIC sinsp_evt_batch
+{
+public:
+	class iterator
+	{
+	public:
+		iterator(sinsp_evt_batch* batch):
+			m_batch(batch)
+		{
+		}
+
+		sinsp_evt* operator*() const
+		{
+			return m_batch->m_evt;
+		}
+
+		iterator& operator++()
+		{
+			m_batch->advance(false);
+			return *this;
+		}
+
+		bool operator!=(const iterator& other) const
+		{
+			return at_end() != other.at_end();
+		}
+
+	private:
+		bool at_end() const
+		{
+			return m_batch == NULL || m_batch->m_evt == NULL;
+		}
+
+		sinsp_evt_batch* m_batch;
+	};
+
+	sinsp_evt_batch();
+
+	iterator begin()
+	{
+		return iterator(this);
+	}
+
+	iterator end()
+	{
+		return iterator(NULL);
+	}
+
+	/*!
+	  \brief Return the number of events of the batch that have been iterated
+	   so far, not counting the ones that the capture filter dropped.
+	*/
+	uint32_t get_nevts() const
+	{
+		return m_nevts;
+	}
+
+	/*!
+	  \brief Return SCAP_SUCCESS, or SCAP_EOF or SCAP_FAILURE if the capture
+	   ended or failed while the batch was iterated. The events before the end
+	   or the failure are in the batch.
+	*/
+	int32_t get_result() const
+	{
+		return m_res;
+	}
+
+private:
+	void advance(bool first);
+
+	sinsp* m_inspector;
+	uint32_t m_max_evts;
+	uint32_t m_nevts;
+	sinsp_evt* m_evt; // NULL when the iteration is over
+	int32_t m_res;
+
+	friend class sinsp;
+};
+
 //
 // Internal stuff for meta event management
 //
@@ -224,11 +340,13 @@ public:
 
 	  \param timeout_ms the optional read timeout, i.e. the time after which a
 	  call to \ref next() returns even if no events are available.
+	  \param wait_params the optional policy used to wait for data when the
+	  driver buffers are empty. NULL selects the default policy.
 
 	  @throws a sinsp_exception containing the error string is thrown in case
 	   of failure.
 	*/
-	void open(uint32_t timeout_ms = SCAP_TIMEOUT_MS);
+	void open(uint32_t timeout_ms = SCAP_TIMEOUT_MS, const scap_wait_params* wait_params = NULL);
 
 	/*!
 	  \brief Start an event capture from a trace file.
@@ -262,6 +380,24 @@ public:
 	*/
 	int32_t next(OUT sinsp_evt** evt);
 
+	/*!
+	  \brief Get a batch of events from the active capture.
+
+	  \param max_evts the maximum number of events, not counting the ones that
+	   the capture filter dropped, that the batch can contain.
+	  \param batch the batch to fill. Its previous events are dropped.
+
+	  \return SCAP_SUCCESS if the batch contains at least one event.
+	   SCAP_TIMEOUT, SCAP_EOF and SCAP_FAILURE have the same meaning as for
+	   \ref next(), and the batch is empty.
+
+	  \note: a batch never goes past the events that were read from libscap
+	   with a single call, so it can contain less than max_evts events even if
+	   more data is available. The state engine runs on each event while the
+	   batch is iterated, see \ref sinsp_evt_batch.
+	*/
+	int32_t next_batch(uint32_t max_evts, OUT sinsp_evt_batch* batch);
+
 	/*!
 	  \brief Get the number of events that have been captured and processed
 	   since the call to \ref open()
@@ -307,6 +443,37 @@ public:
 	*/
 	void set_import_users(bool import_users);
 
+	/*!
+	  \brief Determine if the fds of the processes that exist when a live
+	  capture starts are read from /proc on startup or when they're first used.
+
+	  \param lazy if true, only the processes and threads are read on startup,
+	  and each fd is read from /proc the first time an event refers to it.
+	  This makes the startup faster on machines with many open fds. Since the
+	  direction of a connection is guessed from the server ports seen so far,
+	  it can be wrong for connections read before their server socket. When
+	  the process table is filtered in the trace files, the fds that haven't
+	  been read are not matched against the filter.
+
+	  \note default behavior is lazy=false. Must be called before open().
+	*/
+	void set_lazy_fd_import(bool lazy);
+
+	/*!
+	  \brief Choose how trace files are read.
+
+	  \param readahead if true, compressed files are decompressed by a
+	  background thread while the events are processed.
+
+	  \param mmap if true, uncompressed files are mapped in memory and their
+	  events are returned without being copied. The file must not be
+	  truncated while it's being read.
+
+	  \note default behavior is readahead=false and mmap=false, which reads
+	  the file from the capture thread. Must be called before open().
+	*/
+	void set_offline_read_options(bool readahead, bool mmap);
+
 	/*!
 	  \brief temporarily pauses event capture.
 
@@ -350,6 +517,30 @@ public:
 	*/
 	const string get_filter();
 
+	/*!
+	  \brief Restrict the events that the driver captures to the ones that
+	   the filter set with \ref set_filter() can accept. The events that
+	   change the state of the library are captured anyway. Nothing is done if
+	   the filter can accept any event type.
+
+	  \note This function can only be called for live captures, after
+	   \ref open() and \ref set_filter(). The event mask of the driver is
+	   shared by all the captures that run on the machine.
+
+	  @throws a sinsp_exception containing the error string is thrown in case
+	   the driver rejects the mask.
+	*/
+	void set_eventmask_from_filter();
+
+	/*!
+	  \brief Return the cache of the field values of the current event, which
+	   is shared by the filters, the formatters and the chisels.
+	*/
+	sinsp_field_cache* get_field_cache()
+	{
+		return &m_field_cache;
+	}
+
 	void add_evttype_filter(std::string &name,
 				list<uint32_t> &evttypes,
 				sinsp_filter* filter);
@@ -400,6 +591,13 @@ public:
 	*/
 	void autodump_start(const string& dump_filename, bool compress);
 
+	/*!
+	  \brief Like \ref autodump_start(), with a choice of the tracefile
+	   format. SCAP_COMPRESSION_CHUNKED produces files that can be read
+	   back with \ref seek_to_time() and \ref seek_to_evtnum().
+	*/
+	void autodump_start(const string& dump_filename, compression_mode compress);
+
  	/*!
 	  \brief Cycles the file pointer to a new capture file
 	*/
@@ -413,6 +611,31 @@ public:
 	*/
 	void autodump_stop();
 
+	/*!
+	  \brief Set how the files written by \ref autodump_start() and by the
+	   cycle writer are compressed.
+
+	  \param compression_level the zlib compression level, from 1 (fastest)
+	   to 9 (smallest). 0 means the zlib default.
+
+	  \param async if true, the events are handed to a background thread
+	   that compresses and writes them, so that the capture doesn't wait for
+	   the disk, for the compression or for the process table to be read when
+	   the cycle writer moves to a new file.
+
+	  \note the compression level is used for the next file that is opened.
+	   async takes effect on the next \ref autodump_start() after
+	   \ref autodump_stop().
+	*/
+	void set_dump_options(int32_t compression_level, bool async);
+
+	/*!
+	  \brief Fill the given structure with the counters of the current event
+	   dump, including the state of the queue toward the writer thread when
+	   the dump is asynchronous.
+	*/
+	void get_dump_stats(sinsp_dump_stats* stats);
+
 	/*!
 	  \brief Populate the given vector with the full list of filter check fields
 	   that this version of the library supports.
@@ -670,11 +893,57 @@ public:
 	*/
 	double get_read_progress();
 
+	/*!
+	  \brief When reading events from a trace file, move to the first event
+	   with a timestamp equal or greater than ts, which will be the next one
+	   returned by next(). Only works on files written in the chunked format
+	   (SCAP_COMPRESSION_CHUNKED), where this doesn't require decompressing
+	   the events that come before ts.
+
+	  \param ts the timestamp to seek to, in nanoseconds.
+
+	  \param replay_state the thread and fd tables are reset to the snapshot
+	   saved at the beginning of the file. If replay_state is false, only the
+	   events of the chunk that contains ts are parsed on top of it, which is
+	   fast but leaves out the threads and fds created in the skipped part of
+	   the file. If replay_state is true, all the events before ts are parsed,
+	   which gives the same state as reading the file sequentially.
+
+	  @throws a sinsp_exception containing the error string is thrown in case
+	   of failure, or if there is no event after ts.
+	*/
+	void seek_to_time(uint64_t ts, bool replay_state = false);
+
+	/*!
+	  \brief Like \ref seek_to_time(), but the target is the number of the
+	   event in the file, starting from 1, as returned by sinsp_evt::get_num()
+	   when reading the file sequentially.
+	*/
+	void seek_to_evtnum(uint64_t evtnum, bool replay_state = false);
+
+	/*!
+	  \brief Connect to the Kubernetes API server, or get ready to replay the
+	   Kubernetes events of a trace file if api_server is empty. The state of
+	   a live connection is refreshed by a background thread.
+	*/
 	void init_k8s_client(string* api_server, string* ssl_cert, bool verbose = false);
+
+	/*!
+	  \brief Return the client that replays the Kubernetes events of a trace
+	   file. Live clients belong to the background thread and are not
+	   returned.
+	*/
 	k8s* get_k8s_client() const { return m_k8s_client; }
 
+	/*!
+	  \brief Return the Kubernetes state as of the last batch of events, or
+	   NULL if there is no Kubernetes client.
+	*/
+	const k8s_state_t* get_k8s_state() const;
+
 	void init_mesos_client(string* api_server, bool verbose = false);
 	mesos* get_mesos_client() const { return m_mesos_client; }
+	const mesos_state_t* get_mesos_state() const;
 
 	//
 	// Misc internal stuff
@@ -707,6 +976,7 @@ public:
 	sinsp_parser* get_parser();
 
 	bool setup_cycle_writer(string base_file_name, int rollover_mb, int duration_seconds, int file_limit, unsigned long event_limit, bool compress);
+	bool setup_cycle_writer(string base_file_name, int rollover_mb, int duration_seconds, int file_limit, unsigned long event_limit, compression_mode compress);
 	void import_ipv4_interface(const sinsp_ipv4_ifinfo& ifinfo);
 	void add_meta_event(sinsp_evt *metaevt);
 	void add_meta_event_and_repeat(sinsp_evt *metaevt);
@@ -729,48 +999,51 @@ private:
 	void import_ifaddr_list();
 	void import_user_list();
 	void add_protodecoders();
+	void seek(uint64_t target, bool by_time, bool replay_state);
 
 	void add_thread(const sinsp_threadinfo& ptinfo);
+	void add_thread(sinsp_threadinfo&& ptinfo);
 	void remove_thread(int64_t tid, bool force);
 	//
 	// Note: lookup_only should be used when the query for the thread is made
 	//       not as a consequence of an event for that thread arriving, but
 	//       just for lookup reason. In that case, m_lastaccess_ts is not updated
-	//       and m_last_tinfo is not set.
+	//       and the thread is not added to the lookaside cache.
 	//
 	inline sinsp_threadinfo* find_thread(int64_t tid, bool lookup_only)
 	{
-		threadinfo_map_iterator_t it;
+		sinsp_thread_manager::lookaside_entry* le =
+			&m_thread_manager->m_lookaside[tid & (THREAD_LOOKASIDE_SIZE - 1)];
 
 		//
 		// Try looking up in our simple cache
 		//
-		if(m_thread_manager->m_last_tinfo && tid == m_thread_manager->m_last_tid)
+		if(le->m_tinfo && tid == le->m_tid)
 		{
 	#ifdef GATHER_INTERNAL_STATS
 			m_thread_manager->m_cached_lookups->increment();
 	#endif
-			m_thread_manager->m_last_tinfo->m_lastaccess_ts = m_lastevent_ts;
-			return m_thread_manager->m_last_tinfo;
+			le->m_tinfo->m_lastaccess_ts = m_lastevent_ts;
+			return le->m_tinfo;
 		}
 
 		//
 		// Caching failed, do a real lookup
 		//
-		it = m_thread_manager->m_threadtable.find(tid);
+		sinsp_threadinfo* tinfo = m_thread_manager->m_threadtable.get(tid);
 
-		if(it != m_thread_manager->m_threadtable.end())
+		if(tinfo != NULL)
 		{
 	#ifdef GATHER_INTERNAL_STATS
 			m_thread_manager->m_non_cached_lookups->increment();
 	#endif
 			if(!lookup_only)
 			{
-				m_thread_manager->m_last_tid = tid;
-				m_thread_manager->m_last_tinfo = &(it->second);
-				m_thread_manager->m_last_tinfo->m_lastaccess_ts = m_lastevent_ts;
+				le->m_tid = tid;
+				le->m_tinfo = tinfo;
+				tinfo->m_lastaccess_ts = m_lastevent_ts;
 			}
-			return &(it->second);
+			return tinfo;
 		}
 		else
 		{
@@ -783,9 +1056,7 @@ private:
 	// this is here for testing purposes only
 	sinsp_threadinfo* find_thread_test(int64_t tid, bool lookup_only);
 	bool remove_inactive_threads();
-	void update_kubernetes_state();
-	void update_mesos_state();
-	bool get_mesos_data();
+	void update_metadata_state();
 
 	static int64_t get_file_size(const std::string& fname, char *error);
 	static std::string get_error_desc(const std::string& msg = "");
@@ -800,9 +1071,20 @@ private:
 	bool m_hostname_and_port_resolution_enabled;
 	char m_output_time_flag;
 	uint32_t m_max_evt_output_len;
-	bool m_compress;
+	compression_mode m_compress;
+	int32_t m_dump_compression_level;
+	bool m_dump_async;
 	sinsp_evt m_evt;
 	string m_lasterr;
+	//
+	// Events read from libscap with the last scap_next_batch() call and
+	// not yet returned by next()
+	//
+	vector<scap_evt*> m_batch_evts;
+	vector<uint16_t> m_batch_cpuids;
+	vector<uint32_t> m_batch_dump_flags;
+	uint32_t m_batch_size;
+	uint32_t m_batch_pos;
 	int64_t m_tid_to_remove;
 	int64_t m_tid_of_fd_to_remove;
 	vector<int64_t>* m_fds_to_remove;
@@ -810,7 +1092,7 @@ private:
 	// the parsing engine
 	sinsp_parser* m_parser;
 	// the statistics analysis engine
-	scap_dumper_t* m_dumper;
+	sinsp_dump_writer* m_dump_writer;
 	bool m_filter_proc_table_when_saving;
 	const scap_machine_info* m_machine_info;
 	uint32_t m_num_cpus;
@@ -828,16 +1110,26 @@ private:
 	//
 	string* m_k8s_api_server;
 	string* m_k8s_api_cert;
-	k8s* m_k8s_client;
-	uint64_t m_k8s_last_watch_time_ns;
+	k8s* m_k8s_client; // Only when replaying a trace file
+	std::shared_ptr<const k8s_state_t> m_k8s_state; // Only when live
 
 	//
 	// Mesos/Marathon
 	//
 	string m_mesos_api_server;
 	vector<string> m_marathon_api_server;
-	mesos* m_mesos_client;
-	uint64_t m_mesos_last_watch_time_ns;
+	mesos* m_mesos_client; // Only when replaying a trace file
+	std::shared_ptr<const mesos_state_t> m_mesos_state; // Only when live
+
+	//
+	// Refreshes the live Kubernetes and Mesos state. m_metadata_generation
+	// is the generation of the thread that was last picked up, and
+	// m_metadata_events_pending tells if the thread may still have capture
+	// events to add to the event stream.
+	//
+	sinsp_metadata_thread* m_metadata_thread;
+	uint64_t m_metadata_generation;
+	bool m_metadata_events_pending;
 
 	//
 	// True if sysdig is ran with -v.
@@ -856,6 +1148,7 @@ private:
 	sinsp_filter* m_filter;
 	sinsp_evttype_filter *m_evttype_filter;
 	string m_filterstring;
+	sinsp_field_cache m_field_cache;
 
 #endif
 
@@ -903,6 +1196,17 @@ private:
 	unordered_map<uint32_t, scap_userinfo*> m_userlist;
 	unordered_map<uint32_t, scap_groupinfo*> m_grouplist;
 
+	//
+	// true if the fds of the processes found in /proc are read when used
+	//
+	bool m_lazy_fd_import;
+
+	//
+	// How trace files are read, see set_offline_read_options()
+	//
+	bool m_offline_readahead;
+	bool m_offline_mmap;
+
 	//
 	// The cycle-writer for files
 	//
@@ -960,6 +1264,8 @@ private:
 	friend class sinsp_thread_manager;
 	friend class sinsp_container_manager;
 	friend class sinsp_dumper;
+	friend class sinsp_dump_writer;
+	friend class sinsp_evt_batch;
 	friend class sinsp_analyzer_fd_listener;
 	friend class sinsp_chisel;
 	friend class sinsp_tracerparser;
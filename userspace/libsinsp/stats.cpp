@@ -36,10 +36,15 @@ void sinsp_stats::clear()
 	m_n_fds = 0;
 	m_n_added_fds = 0;
 	m_n_removed_fds = 0;
+	m_n_lazy_fd_imports = 0;
 	m_n_stored_evts = 0;
 	m_n_store_drops = 0;
 	m_n_retrieved_evts = 0;
 	m_n_retrieve_drops = 0;
+	m_n_evt_arena_bytes = 0;
+	m_n_evt_arena_used_bytes = 0;
+	m_n_field_cache_hits = 0;
+	m_n_field_cache_misses = 0;
 	m_metrics_registry.clear_all_metrics();
 }
 
@@ -59,10 +64,18 @@ void sinsp_stats::emit(FILE* f)
 	fprintf(f, "n. fds: %" PRIu64 "\n", m_n_fds);
 	fprintf(f, "added fds: %" PRIu64 "\n", m_n_added_fds);
 	fprintf(f, "removed fds: %" PRIu64 "\n", m_n_removed_fds);
+	fprintf(f, "fds imported lazily: %" PRIu64 "\n", m_n_lazy_fd_imports);
 	fprintf(f, "stored evts: %" PRIu64 "\n", m_n_stored_evts);
 	fprintf(f, "store drops: %" PRIu64 "\n", m_n_store_drops);
 	fprintf(f, "retrieved evts: %" PRIu64 "\n", m_n_retrieved_evts);
 	fprintf(f, "retrieve drops: %" PRIu64 "\n", m_n_retrieve_drops);
+	fprintf(f, "stored evts memory: %" PRIu64 " bytes (%" PRIu64 " in use)\n",
+		m_n_evt_arena_bytes,
+		m_n_evt_arena_used_bytes);
+	fprintf(f, "field extractions: %" PRIu64 " (%" PRIu64 " cached %" PRIu64 " noncached)\n",
+		m_n_field_cache_hits + m_n_field_cache_misses,
+		m_n_field_cache_hits,
+		m_n_field_cache_misses);
 
 	for(internal_metrics::registry::metric_map_iterator_t it = m_metrics_registry.get_metrics().begin(); it != m_metrics_registry.get_metrics().end(); it++)
 	{
@@ -48,10 +48,15 @@ public:
 	uint64_t m_n_fds;
 	uint64_t m_n_added_fds;
 	uint64_t m_n_removed_fds;
+	uint64_t m_n_lazy_fd_imports;
 	uint64_t m_n_stored_evts;
 	uint64_t m_n_store_drops;
 	uint64_t m_n_retrieved_evts;
 	uint64_t m_n_retrieve_drops;
+	uint64_t m_n_evt_arena_bytes;
+	uint64_t m_n_evt_arena_used_bytes;
+	uint64_t m_n_field_cache_hits;
+	uint64_t m_n_field_cache_misses;
 
 private:
 	internal_metrics::registry m_metrics_registry;
@@ -0,0 +1,252 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "sinsp.h"
+#include "sinsp_int.h"
+#include "stringmatcher.h"
+
+sinsp_string_matcher::sinsp_string_matcher()
+{
+	m_npatterns = 0;
+	m_nclasses = 1;
+	memset(m_classes, 0, sizeof(m_classes));
+}
+
+void sinsp_string_matcher::add_exact(const char* str, uint32_t len)
+{
+	add_pattern(&m_exacts, str, len);
+}
+
+void sinsp_string_matcher::add_prefix(const char* str, uint32_t len)
+{
+	add_pattern(&m_prefixes, str, len);
+}
+
+void sinsp_string_matcher::add_substring(const char* str, uint32_t len)
+{
+	add_pattern(&m_substrings, str, len);
+}
+
+void sinsp_string_matcher::add_pattern(vector<string>* patterns, const char* str, uint32_t len)
+{
+	//
+	// The strings are compared up to their terminator, like strcmp() and
+	// strstr() do, so a pattern ends at its first NUL
+	//
+	patterns->push_back(string(str, strnlen(str, len)));
+	m_npatterns++;
+}
+
+uint32_t sinsp_string_matcher::add_state(vector<int32_t>* table, vector<uint8_t>* flags)
+{
+	table->resize(table->size() + m_nclasses, 0);
+	flags->push_back(0);
+	return (uint32_t)flags->size() - 1;
+}
+
+void sinsp_string_matcher::build_trie(const vector<string>& patterns, uint8_t flag, OUT vector<int32_t>* table, OUT vector<uint8_t>* flags)
+{
+	if(flags->empty())
+	{
+		add_state(table, flags);
+	}
+
+	for(const string& pattern : patterns)
+	{
+		uint32_t state = 0;
+
+		for(uint8_t c : pattern)
+		{
+			uint32_t idx = state * m_nclasses + m_classes[c];
+
+			if((*table)[idx] == 0)
+			{
+				uint32_t next = add_state(table, flags);
+				(*table)[idx] = next;
+			}
+
+			state = (*table)[idx];
+		}
+
+		(*flags)[state] |= flag;
+	}
+}
+
+void sinsp_string_matcher::build()
+{
+	const vector<string>* all[] = {&m_exacts, &m_prefixes, &m_substrings};
+
+	//
+	// Every byte that appears in a pattern gets its own class, all the other
+	// ones are class 0
+	//
+	memset(m_classes, 0, sizeof(m_classes));
+	m_nclasses = 1;
+
+	for(auto patterns : all)
+	{
+		for(const string& pattern : *patterns)
+		{
+			for(uint8_t c : pattern)
+			{
+				if(m_classes[c] == 0)
+				{
+					m_classes[c] = (uint8_t)m_nclasses++;
+				}
+			}
+		}
+	}
+
+	m_anchored.clear();
+	m_anchored_flags.clear();
+	m_scan.clear();
+	m_scan_flags.clear();
+
+	if(!m_exacts.empty() || !m_prefixes.empty())
+	{
+		build_trie(m_exacts, SF_EXACT, &m_anchored, &m_anchored_flags);
+		build_trie(m_prefixes, SF_PREFIX, &m_anchored, &m_anchored_flags);
+		finish_table(&m_anchored, m_anchored_flags);
+	}
+
+	if(m_substrings.empty())
+	{
+		return;
+	}
+
+	build_trie(m_substrings, SF_PREFIX, &m_scan, &m_scan_flags);
+
+	//
+	// Resolve the failure transitions breadth first, so that the state that a
+	// state fails to is complete when the state is reached. A state matches
+	// if the state it fails to does, and a missing transition is the one of
+	// the state it fails to.
+	//
+	vector<uint32_t> fail(m_scan_flags.size(), 0);
+	queue<uint32_t> states;
+
+	for(uint32_t c = 0; c < m_nclasses; c++)
+	{
+		if(m_scan[c] != 0)
+		{
+			states.push(m_scan[c]);
+		}
+	}
+
+	while(!states.empty())
+	{
+		uint32_t state = states.front();
+		states.pop();
+
+		m_scan_flags[state] |= m_scan_flags[fail[state]];
+
+		for(uint32_t c = 0; c < m_nclasses; c++)
+		{
+			int32_t* next = &m_scan[state * m_nclasses + c];
+			int32_t fail_next = m_scan[fail[state] * m_nclasses + c];
+
+			if(*next != 0)
+			{
+				fail[*next] = fail_next;
+				states.push(*next);
+			}
+			else
+			{
+				*next = fail_next;
+			}
+		}
+	}
+
+	finish_table(&m_scan, m_scan_flags);
+}
+
+//
+// Turn the transitions into the offsets of the rows of their target states,
+// and into FINISHED for the states where a prefix or a substring ends, so
+// that match() needs a single load per byte
+//
+void sinsp_string_matcher::finish_table(vector<int32_t>* table, const vector<uint8_t>& flags)
+{
+	for(auto& next : *table)
+	{
+		if(flags[next] & SF_PREFIX)
+		{
+			next = FINISHED;
+		}
+		else
+		{
+			next *= m_nclasses;
+		}
+	}
+}
+
+bool sinsp_string_matcher::match(const char* str) const
+{
+	const uint8_t* p;
+	int32_t row;
+
+	if(!m_anchored_flags.empty())
+	{
+		//
+		// The empty prefix is at the start of every string
+		//
+		if(m_anchored_flags[0] & SF_PREFIX)
+		{
+			return true;
+		}
+
+		for(p = (const uint8_t*)str, row = 0; *p != 0; p++)
+		{
+			row = m_anchored[row + m_classes[*p]];
+
+			if(row <= 0)
+			{
+				break;
+			}
+		}
+
+		if(row == FINISHED ||
+			(*p == 0 && (m_anchored_flags[row / m_nclasses] & SF_EXACT)))
+		{
+			return true;
+		}
+	}
+
+	if(!m_scan_flags.empty())
+	{
+		//
+		// The empty substring is in every string
+		//
+		if(m_scan_flags[0] & SF_PREFIX)
+		{
+			return true;
+		}
+
+		for(p = (const uint8_t*)str, row = 0; *p != 0; p++)
+		{
+			row = m_scan[row + m_classes[*p]];
+
+			if(row < 0)
+			{
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
@@ -0,0 +1,107 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+/*!
+  \brief Matches a string against many patterns at once.
+
+  The patterns can be whole strings, prefixes or substrings, and a string
+  matches if it's equal to one of the whole strings, starts with one of the
+  prefixes or contains one of the substrings. The whole strings and the
+  prefixes are kept in a trie that is walked from the start of the string,
+  the substrings in an Aho-Corasick automaton that scans it once, so the cost
+  of a match depends on the length of the string and not on the number of
+  patterns.
+
+  The bytes that don't appear in any pattern share a single column of the
+  transition tables, which keeps them small for the usual path and command
+  line alphabets.
+*/
+class SINSP_PUBLIC sinsp_string_matcher
+{
+public:
+	sinsp_string_matcher();
+
+	void add_exact(const char* str, uint32_t len);
+	void add_prefix(const char* str, uint32_t len);
+	void add_substring(const char* str, uint32_t len);
+
+	/*!
+	  \brief Build the transition tables. Must be called after adding the
+	   patterns and before the first \ref match().
+	*/
+	void build();
+
+	/*!
+	  \brief Return true if the given NUL-terminated string matches any of
+	   the patterns.
+	*/
+	bool match(const char* str) const;
+
+	/*!
+	  \brief Return the number of patterns added to the matcher.
+	*/
+	uint32_t get_npatterns() const
+	{
+		return m_npatterns;
+	}
+
+private:
+	//
+	// Flags of the states of the tables
+	//
+	enum state_flags
+	{
+		SF_EXACT = 1,	// A whole string ends here
+		SF_PREFIX = 2,	// A prefix or a substring ends here
+	};
+
+	//
+	// Transition to a state where a prefix or a substring ends
+	//
+	static const int32_t FINISHED = -1;
+
+	uint32_t add_state(vector<int32_t>* table, vector<uint8_t>* flags);
+	void add_pattern(vector<string>* patterns, const char* str, uint32_t len);
+	void build_trie(const vector<string>& patterns, uint8_t flag, OUT vector<int32_t>* table, OUT vector<uint8_t>* flags);
+	void finish_table(vector<int32_t>* table, const vector<uint8_t>& flags);
+
+	vector<string> m_exacts;
+	vector<string> m_prefixes;
+	vector<string> m_substrings;
+	uint32_t m_npatterns;
+
+	uint8_t m_classes[256];
+	uint32_t m_nclasses;
+
+	//
+	// Trie of the whole strings and of the prefixes. A 0 transition means
+	// that no pattern continues with that byte. The transitions are the
+	// offsets of the rows of the states.
+	//
+	vector<int32_t> m_anchored;
+	vector<uint8_t> m_anchored_flags;
+
+	//
+	// Aho-Corasick automaton of the substrings, with the failure transitions
+	// resolved, so that every byte is a single lookup
+	//
+	vector<int32_t> m_scan;
+	vector<uint8_t> m_scan_flags;
+};
@@ -528,6 +528,12 @@ void sinsp_table::process_proctable(sinsp_evt* evt)
 		tevt.m_tinfo = &it->second;
 		tscapevt.tid = tevt.m_tinfo->m_tid;
 
+		//
+		// tevt is reused for every thread, so the cached field values of the
+		// previous thread must not be picked up
+		//
+		m_inspector->get_field_cache()->invalidate();
+
 		if(m_filter)
 		{
 			if(!m_filter->run(&tevt))
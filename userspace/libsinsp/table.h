@@ -230,6 +230,10 @@ public:
 	sinsp_table(sinsp* inspector, tabletype type, uint64_t refresh_interval_ns, bool print_to_stdout);
 	~sinsp_table();
 	void configure(vector<sinsp_view_column_info>* entries, const string& filter, bool use_defaults, uint32_t view_depth);
+	//
+	// Like chisels, tables are fed by the capture loop, which reads the
+	// events in batches with sinsp::next_batch() (see csysdig.cpp)
+	//
 	void process_event(sinsp_evt* evt);
 	void flush(sinsp_evt* evt);
 	void filter_sample();
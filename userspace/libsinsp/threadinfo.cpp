@@ -85,12 +85,30 @@ void sinsp_threadinfo::init()
 	m_ainfo = NULL;
 	m_program_hash = 0;
 	m_lastevent_data = NULL;
+	m_expiry_check_ts = 0;
+	m_nchilds_pid = -1;
 }
 
-sinsp_threadinfo::~sinsp_threadinfo()
+sinsp_threadinfo::sinsp_threadinfo(const sinsp_threadinfo& other) :
+	m_fdtable(other.m_inspector)
 {
-	uint32_t j;
+	m_inspector = other.m_inspector;
+	m_tracer_parser = NULL;
+	m_lastevent_data = NULL;
+	*this = other;
+}
 
+sinsp_threadinfo::sinsp_threadinfo(sinsp_threadinfo&& other) :
+	m_fdtable(other.m_inspector)
+{
+	m_inspector = other.m_inspector;
+	m_tracer_parser = NULL;
+	m_lastevent_data = NULL;
+	*this = std::move(other);
+}
+
+sinsp_threadinfo::~sinsp_threadinfo()
+{
 	if((m_inspector != NULL) &&
 		(m_inspector->m_thread_manager != NULL) &&
 		(m_inspector->m_thread_manager->m_listener != NULL))
@@ -98,6 +116,167 @@ sinsp_threadinfo::~sinsp_threadinfo()
 		m_inspector->m_thread_manager->m_listener->on_thread_destroyed(this);
 	}
 
+	free_owned_state();
+}
+
+sinsp_threadinfo& sinsp_threadinfo::operator=(const sinsp_threadinfo& other)
+{
+	uint32_t j;
+
+	if(this == &other)
+	{
+		return *this;
+	}
+
+	free_owned_state();
+
+	m_tid = other.m_tid;
+	m_pid = other.m_pid;
+	m_ptid = other.m_ptid;
+	m_sid = other.m_sid;
+	m_comm = other.m_comm;
+	m_exe = other.m_exe;
+	m_args = other.m_args;
+	m_env = other.m_env;
+	m_cgroups = other.m_cgroups;
+	m_container_id = other.m_container_id;
+	m_flags = other.m_flags;
+	m_fdlimit = other.m_fdlimit;
+	m_uid = other.m_uid;
+	m_gid = other.m_gid;
+	m_nchilds = other.m_nchilds;
+	m_vmsize_kb = other.m_vmsize_kb;
+	m_vmrss_kb = other.m_vmrss_kb;
+	m_vmswap_kb = other.m_vmswap_kb;
+	m_pfmajor = other.m_pfmajor;
+	m_pfminor = other.m_pfminor;
+	m_vtid = other.m_vtid;
+	m_vpid = other.m_vpid;
+	m_root = other.m_root;
+	m_lastevent_fd = other.m_lastevent_fd;
+	m_lastevent_ts = other.m_lastevent_ts;
+	m_prevevent_ts = other.m_prevevent_ts;
+	m_lastaccess_ts = other.m_lastaccess_ts;
+	m_clone_ts = other.m_clone_ts;
+	m_ainfo = other.m_ainfo;
+#ifdef HAS_FILTERING
+	m_last_latency_entertime = other.m_last_latency_entertime;
+	m_latency = other.m_latency;
+#endif
+	m_inspector = other.m_inspector;
+	m_fdtable = other.m_fdtable;
+	m_fdtable.reset_cache();
+	m_cwd = other.m_cwd;
+	m_main_thread = other.m_main_thread;
+	m_lastevent_type = other.m_lastevent_type;
+	m_lastevent_cpuid = other.m_lastevent_cpuid;
+	m_lastevent_category = other.m_lastevent_category;
+	m_program_hash = other.m_program_hash;
+
+	//
+	// The copy is not in the expiry wheel and doesn't count as a child of
+	// its main thread until it's added to the table
+	//
+	m_expiry_check_ts = 0;
+	m_nchilds_pid = -1;
+
+	//
+	// Clone what the source owns. The tracer parser only holds the state of
+	// a partially parsed tracer, the copy gets a new one when it needs it.
+	//
+	if(other.m_lastevent_data != NULL)
+	{
+		uint32_t len = sinsp_evt_arena::get_buf_size(other.m_lastevent_data);
+
+		m_lastevent_data = m_inspector->m_thread_manager->m_evt_arena.reserve(len);
+		memcpy(m_lastevent_data, other.m_lastevent_data, len);
+	}
+
+	if(m_inspector != NULL && !other.m_private_state.empty())
+	{
+		vector<uint32_t>* sizes = &m_inspector->m_thread_privatestate_manager.m_memory_sizes;
+
+		for(j = 0; j < other.m_private_state.size() && j < sizes->size(); j++)
+		{
+			void* newbuf = malloc(sizes->at(j));
+			memcpy(newbuf, other.m_private_state[j], sizes->at(j));
+			m_private_state.push_back(newbuf);
+		}
+	}
+
+	return *this;
+}
+
+sinsp_threadinfo& sinsp_threadinfo::operator=(sinsp_threadinfo&& other)
+{
+	if(this == &other)
+	{
+		return *this;
+	}
+
+	free_owned_state();
+
+	m_tid = other.m_tid;
+	m_pid = other.m_pid;
+	m_ptid = other.m_ptid;
+	m_sid = other.m_sid;
+	m_comm = std::move(other.m_comm);
+	m_exe = std::move(other.m_exe);
+	m_args = std::move(other.m_args);
+	m_env = std::move(other.m_env);
+	m_cgroups = std::move(other.m_cgroups);
+	m_container_id = std::move(other.m_container_id);
+	m_flags = other.m_flags;
+	m_fdlimit = other.m_fdlimit;
+	m_uid = other.m_uid;
+	m_gid = other.m_gid;
+	m_nchilds = other.m_nchilds;
+	m_vmsize_kb = other.m_vmsize_kb;
+	m_vmrss_kb = other.m_vmrss_kb;
+	m_vmswap_kb = other.m_vmswap_kb;
+	m_pfmajor = other.m_pfmajor;
+	m_pfminor = other.m_pfminor;
+	m_vtid = other.m_vtid;
+	m_vpid = other.m_vpid;
+	m_root = std::move(other.m_root);
+	m_lastevent_fd = other.m_lastevent_fd;
+	m_lastevent_ts = other.m_lastevent_ts;
+	m_prevevent_ts = other.m_prevevent_ts;
+	m_lastaccess_ts = other.m_lastaccess_ts;
+	m_clone_ts = other.m_clone_ts;
+	m_tracer_parser = other.m_tracer_parser;
+	m_ainfo = other.m_ainfo;
+#ifdef HAS_FILTERING
+	m_last_latency_entertime = other.m_last_latency_entertime;
+	m_latency = other.m_latency;
+#endif
+	m_inspector = other.m_inspector;
+	m_fdtable = std::move(other.m_fdtable);
+	m_cwd = std::move(other.m_cwd);
+	m_main_thread = other.m_main_thread;
+	m_lastevent_data = other.m_lastevent_data;
+	m_private_state = std::move(other.m_private_state);
+	m_expiry_check_ts = other.m_expiry_check_ts;
+	m_nchilds_pid = other.m_nchilds_pid;
+	m_lastevent_type = other.m_lastevent_type;
+	m_lastevent_cpuid = other.m_lastevent_cpuid;
+	m_lastevent_category = other.m_lastevent_category;
+	m_program_hash = other.m_program_hash;
+
+	//
+	// The source must not free what this threadinfo now owns
+	//
+	other.m_tracer_parser = NULL;
+	other.m_lastevent_data = NULL;
+	other.m_private_state.clear();
+
+	return *this;
+}
+
+void sinsp_threadinfo::free_owned_state()
+{
+	uint32_t j;
+
 	for(j = 0; j < m_private_state.size(); j++)
 	{
 		free(m_private_state[j]);
@@ -106,45 +285,56 @@ sinsp_threadinfo::~sinsp_threadinfo()
 	m_private_state.clear();
 	if(m_lastevent_data)
 	{
-		free(m_lastevent_data);
+		m_inspector->m_thread_manager->m_evt_arena.release(m_lastevent_data);
+		m_lastevent_data = NULL;
 	}
 
 	if(m_tracer_parser)
 	{
 		delete m_tracer_parser;
+		m_tracer_parser = NULL;
 	}
 }
 
 void sinsp_threadinfo::fix_sockets_coming_from_proc()
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator it;
+	fdinfo_map_iterator_t it;
 
 	for(it = m_fdtable.m_table.begin(); it != m_fdtable.m_table.end(); it++)
 	{
-		if(it->second.m_type == SCAP_FD_IPV4_SOCK)
+		fix_socket_coming_from_proc(&(it->second));
+	}
+}
+
+//
+// /proc doesn't tell which end of a connection is the server: use the server
+// ports seen so far to decide it.
+//
+void sinsp_threadinfo::fix_socket_coming_from_proc(sinsp_fdinfo_t* fdinfo)
+{
+	if(fdinfo->m_type == SCAP_FD_IPV4_SOCK)
+	{
+		if(m_inspector->m_thread_manager->m_server_ports.find(fdinfo->m_sockinfo.m_ipv4info.m_fields.m_sport) !=
+			m_inspector->m_thread_manager->m_server_ports.end())
 		{
-			if(m_inspector->m_thread_manager->m_server_ports.find(it->second.m_sockinfo.m_ipv4info.m_fields.m_sport) !=
-				m_inspector->m_thread_manager->m_server_ports.end())
-			{
-				uint32_t tip;
-				uint16_t tport;
+			uint32_t tip;
+			uint16_t tport;
 
-				tip = it->second.m_sockinfo.m_ipv4info.m_fields.m_sip;
-				tport = it->second.m_sockinfo.m_ipv4info.m_fields.m_sport;
+			tip = fdinfo->m_sockinfo.m_ipv4info.m_fields.m_sip;
+			tport = fdinfo->m_sockinfo.m_ipv4info.m_fields.m_sport;
 
-				it->second.m_sockinfo.m_ipv4info.m_fields.m_sip = it->second.m_sockinfo.m_ipv4info.m_fields.m_dip;
-				it->second.m_sockinfo.m_ipv4info.m_fields.m_dip = tip;
-				it->second.m_sockinfo.m_ipv4info.m_fields.m_sport = it->second.m_sockinfo.m_ipv4info.m_fields.m_dport;
-				it->second.m_sockinfo.m_ipv4info.m_fields.m_dport = tport;
+			fdinfo->m_sockinfo.m_ipv4info.m_fields.m_sip = fdinfo->m_sockinfo.m_ipv4info.m_fields.m_dip;
+			fdinfo->m_sockinfo.m_ipv4info.m_fields.m_dip = tip;
+			fdinfo->m_sockinfo.m_ipv4info.m_fields.m_sport = fdinfo->m_sockinfo.m_ipv4info.m_fields.m_dport;
+			fdinfo->m_sockinfo.m_ipv4info.m_fields.m_dport = tport;
 
-				it->second.m_name = ipv4tuple_to_string(&it->second.m_sockinfo.m_ipv4info, m_inspector->m_hostname_and_port_resolution_enabled);
+			fdinfo->m_name = ipv4tuple_to_string(&fdinfo->m_sockinfo.m_ipv4info, m_inspector->m_hostname_and_port_resolution_enabled);
 
-				it->second.set_role_server();
-			}
-			else
-			{
-				it->second.set_role_client();
-			}
+			fdinfo->set_role_server();
+		}
+		else
+		{
+			fdinfo->set_role_client();
 		}
 	}
 }
@@ -335,6 +525,16 @@ void sinsp_threadinfo::init(scap_threadinfo* pi)
 	set_cgroups(pi->cgroups, pi->cgroups_len);
 	m_root = pi->root;
 	ASSERT(m_inspector);
+
+	//
+	// With lazy fd import, scap didn't read the fds of the process: they
+	// will be read from /proc when they are first looked up
+	//
+	if(m_inspector->m_lazy_fd_import && m_inspector->m_islive && m_tid == m_pid)
+	{
+		m_fdtable.m_lazy_pid = m_pid;
+	}
+
 	m_inspector->m_container_manager.resolve_container(this, m_inspector->m_islive);
 	//
 	// Prepare for filtering
@@ -370,6 +570,12 @@ void sinsp_threadinfo::init(scap_threadinfo* pi)
 			int64_t tlefd = tevt.m_tinfo->m_lastevent_fd;
 			tevt.m_tinfo->m_lastevent_fd = fdi->fd;
 
+			//
+			// tevt and tfdinfo are reused for every fd, so the cached field
+			// values of the previous fd must not be picked up
+			//
+			m_inspector->get_field_cache()->invalidate();
+
 			if(m_inspector->m_filter->run(&tevt))
 			{
 				match = true;
@@ -407,6 +613,34 @@ string sinsp_threadinfo::get_exe()
 	return m_exe;
 }
 
+vector<string> sinsp_threadinfo::get_args() const
+{
+	return vector<string>(m_args.begin(), m_args.end());
+}
+
+vector<pair<string, string>> sinsp_threadinfo::get_cgroups() const
+{
+	vector<pair<string, string>> res;
+
+	res.reserve(m_cgroups.size());
+	for(const auto& cg : m_cgroups)
+	{
+		res.emplace_back(cg.first.str(), cg.second.str());
+	}
+
+	return res;
+}
+
+string sinsp_threadinfo::get_root() const
+{
+	return m_root;
+}
+
+string sinsp_threadinfo::get_container_id() const
+{
+	return m_container_id;
+}
+
 void sinsp_threadinfo::set_args(const char* args, size_t len)
 {
 	m_args.clear();
@@ -529,7 +763,7 @@ void sinsp_threadinfo::remove_fd(int64_t fd)
 
 bool sinsp_threadinfo::is_bound_to_port(uint16_t number)
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator it;
+	fdinfo_map_iterator_t it;
 
 	sinsp_fdtable* fdt = get_fd_table();
 
@@ -556,7 +790,7 @@ bool sinsp_threadinfo::is_bound_to_port(uint16_t number)
 
 bool sinsp_threadinfo::uses_client_port(uint16_t number)
 {
-	unordered_map<int64_t, sinsp_fdinfo_t>::iterator it;
+	fdinfo_map_iterator_t it;
 
 	sinsp_fdtable* fdt = get_fd_table();
 
@@ -621,12 +855,14 @@ void sinsp_threadinfo::set_cwd(const char* cwd, uint32_t cwdlen)
 			cwd,
 			cwdlen);
 
-		tinfo->m_cwd = tpath;
+		string newcwd = tpath;
 
-		if(tinfo->m_cwd[tinfo->m_cwd.size() - 1] != '/')
+		if(newcwd[newcwd.size() - 1] != '/')
 		{
-			tinfo->m_cwd += '/';
+			newcwd += '/';
 		}
+
+		tinfo->m_cwd = newcwd;
 	}
 	else
 	{
@@ -640,6 +876,11 @@ void sinsp_threadinfo::allocate_private_state()
 
 	if(m_inspector != NULL)
 	{
+		for(j = 0; j < m_private_state.size(); j++)
+		{
+			free(m_private_state[j]);
+		}
+
 		m_private_state.clear();
 
 		vector<uint32_t>* sizes = &m_inspector->m_thread_privatestate_manager.m_memory_sizes;
@@ -768,7 +1009,8 @@ sinsp_threadinfo* sinsp_threadinfo::get_main_thread()
 ///////////////////////////////////////////////////////////////////////////////
 // sinsp_thread_manager implementation
 ///////////////////////////////////////////////////////////////////////////////
-sinsp_thread_manager::sinsp_thread_manager(sinsp* inspector)
+sinsp_thread_manager::sinsp_thread_manager(sinsp* inspector):
+	m_expiry_wheel(THREAD_EXPIRY_WHEEL_SLOT_NS, THREAD_EXPIRY_WHEEL_NSLOTS)
 {
 	m_inspector = inspector;
 	m_listener = NULL;
@@ -778,9 +1020,11 @@ sinsp_thread_manager::sinsp_thread_manager(sinsp* inspector)
 void sinsp_thread_manager::clear()
 {
 	m_threadtable.clear();
-	m_last_tid = 0;
-	m_last_tinfo = NULL;
+	reset_lookaside();
+	m_expiry_wheel.clear();
+	m_container_nthreads.clear();
 	m_last_flush_time_ns = 0;
+	m_last_arena_trim_ns = 0;
 	m_n_drops = 0;
 
 #ifdef GATHER_INTERNAL_STATS
@@ -789,9 +1033,22 @@ void sinsp_thread_manager::clear()
 	m_non_cached_lookups = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("thread_non_cached_lookups","Non cached thread lookups"));
 	m_added_threads = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("thread_added","Number of added threads"));
 	m_removed_threads = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("thread_removed","Removed threads"));
+	m_thread_pool_used = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("thread_pool_used","Thread entries in use"));
+	m_thread_pool_capacity = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("thread_pool_capacity","Thread entries allocated"));
+	m_fd_pool_used = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("fd_pool_used","FD entries in use"));
+	m_fd_pool_capacity = &m_inspector->m_stats.get_metrics_registry().register_counter(internal_metrics::metric_name("fd_pool_capacity","FD entries allocated"));
 #endif
 }
 
+void sinsp_thread_manager::reset_lookaside()
+{
+	for(uint32_t j = 0; j < THREAD_LOOKASIDE_SIZE; j++)
+	{
+		m_lookaside[j].m_tid = 0;
+		m_lookaside[j].m_tinfo = NULL;
+	}
+}
+
 void sinsp_thread_manager::set_listener(sinsp_threadtable_listener* listener)
 {
 	m_listener = listener;
@@ -799,7 +1056,7 @@ void sinsp_thread_manager::set_listener(sinsp_threadtable_listener* listener)
 
 void sinsp_thread_manager::increment_mainthread_childcount(sinsp_threadinfo* threadinfo)
 {
-	if(threadinfo->m_flags & PPM_CL_CLONE_THREAD)
+	if((threadinfo->m_flags & PPM_CL_CLONE_THREAD) && threadinfo->m_nchilds_pid == -1)
 	{
 		//
 		// Increment the refcount of the main thread so it won't
@@ -811,6 +1068,7 @@ void sinsp_thread_manager::increment_mainthread_childcount(sinsp_threadinfo* thr
 		if(main_thread)
 		{
 			++main_thread->m_nchilds;
+			threadinfo->m_nchilds_pid = threadinfo->m_pid;
 		}
 		else
 		{
@@ -819,14 +1077,105 @@ void sinsp_thread_manager::increment_mainthread_childcount(sinsp_threadinfo* thr
 	}
 }
 
-void sinsp_thread_manager::add_thread(sinsp_threadinfo& threadinfo, bool from_scap_proctable)
+//
+// Release the reference that the thread holds on its main thread. The thread
+// remembers which main thread it counted in, because execve clears its flags
+// and can change its pid, and a thread whose main thread was missing at its
+// creation holds no reference. This keeps m_nchilds exact without scanning
+// the table.
+//
+void sinsp_thread_manager::decrement_mainthread_childcount(sinsp_threadinfo* threadinfo)
+{
+	if(threadinfo->m_nchilds_pid == -1)
+	{
+		return;
+	}
+
+	sinsp_threadinfo* main_thread = m_inspector->get_thread(threadinfo->m_nchilds_pid, false, true);
+	if(main_thread != NULL && main_thread->m_nchilds > 0)
+	{
+		--main_thread->m_nchilds;
+	}
+	else
+	{
+		ASSERT(false);
+	}
+
+	threadinfo->m_nchilds_pid = -1;
+}
+
+void sinsp_thread_manager::add_container_ref(const sinsp_istring& container_id)
+{
+	if(!container_id.empty())
+	{
+		m_container_nthreads[container_id.get_id()]++;
+	}
+}
+
+void sinsp_thread_manager::release_container_ref(const sinsp_istring& container_id)
+{
+	if(container_id.empty())
+	{
+		return;
+	}
+
+	unordered_map<uintptr_t, uint32_t>::iterator it = m_container_nthreads.find(container_id.get_id());
+	if(it == m_container_nthreads.end())
+	{
+		ASSERT(false);
+		return;
+	}
+
+	if(--it->second == 0)
+	{
+		m_container_nthreads.erase(it);
+	}
+}
+
+void sinsp_thread_manager::set_container_id(sinsp_threadinfo* tinfo, const string& container_id)
+{
+	//
+	// Threads that aren't in the table yet are counted when they are added
+	//
+	bool in_table = (m_threadtable.get(tinfo->m_tid) == tinfo);
+
+	if(in_table)
+	{
+		release_container_ref(tinfo->m_container_id);
+	}
+
+	tinfo->m_container_id = container_id;
+
+	if(in_table)
+	{
+		add_container_ref(tinfo->m_container_id);
+	}
+}
+
+uint32_t sinsp_thread_manager::get_container_thread_count(const string& container_id) const
+{
+	//
+	// If no thread holds the id, interning it here makes a new entry that
+	// can't be in the table
+	//
+	sinsp_istring id(container_id);
+
+	unordered_map<uintptr_t, uint32_t>::const_iterator it = m_container_nthreads.find(id.get_id());
+	return (it != m_container_nthreads.end())? it->second : 0;
+}
+
+void sinsp_thread_manager::add_thread(const sinsp_threadinfo& threadinfo, bool from_scap_proctable)
+{
+	sinsp_threadinfo newentry(threadinfo);
+	add_thread(std::move(newentry), from_scap_proctable);
+}
+
+void sinsp_thread_manager::add_thread(sinsp_threadinfo&& threadinfo, bool from_scap_proctable)
 {
 #ifdef GATHER_INTERNAL_STATS
 	m_added_threads->increment();
 #endif
 
-	m_last_tinfo = NULL;
-
 	if (m_threadtable.size() >= m_inspector->m_max_thread_table_size
 #if defined(HAS_CAPTURE)
 		&& threadinfo.m_pid != m_inspector->m_sysdig_pid
@@ -842,11 +1191,43 @@ void sinsp_thread_manager::add_thread(sinsp_threadinfo& threadinfo, bool from_sc
 		increment_mainthread_childcount(&threadinfo);
 	}
 
+	//
+	// A thread whose exit was missed is replaced when its tid is reused,
+	// release its reference to its main thread first
+	//
+	sinsp_threadinfo* oldentry = m_threadtable.get(threadinfo.m_tid);
+	uint64_t old_nchilds = 0;
+
+	if(oldentry != NULL)
+	{
+		decrement_mainthread_childcount(oldentry);
+		release_container_ref(oldentry->m_container_id);
+		old_nchilds = oldentry->m_nchilds;
+	}
+
 	threadinfo.compute_program_hash();
 
-	sinsp_threadinfo& newentry = (m_threadtable[threadinfo.m_tid] = threadinfo);
+	//
+	// The entries of the table don't move, so the pointers in the lookaside
+	// cache stay valid
+	//
+	sinsp_threadinfo& newentry = *m_threadtable.insert(threadinfo.m_tid, std::move(threadinfo));
 
 	newentry.allocate_private_state();
+	add_container_ref(newentry.m_container_id);
+
+	newentry.m_expiry_check_ts = 0;
+	schedule_expiry_check(&newentry,
+		m_inspector->m_lastevent_ts + m_inspector->m_inactive_thread_scan_time_ns);
+
+	//
+	// The threads of a replaced main thread still count in the new entry,
+	// which doesn't know about them
+	//
+	if(old_nchilds != 0)
+	{
+		recreate_child_dependencies();
+	}
 
 	if(m_listener)
 	{
@@ -882,34 +1263,15 @@ void sinsp_thread_manager::remove_thread(threadinfo_map_iterator_t it, bool forc
 		// Decrement the refcount of the main thread/program because
 		// this reference is gone
 		//
-		if(it->second.m_flags & PPM_CL_CLONE_THREAD)
-		{
-			ASSERT(it->second.m_pid != it->second.m_tid);
-			sinsp_threadinfo* main_thread = m_inspector->get_thread(it->second.m_pid, false, true);
-			if(main_thread)
-			{
-				if(main_thread->m_nchilds > 0)
-				{
-					--main_thread->m_nchilds;
-				}
-				else
-				{
-					ASSERT(false);
-				}
-			}
-			else
-			{
-				ASSERT(false);
-			}
-		}
+		decrement_mainthread_childcount(&(it->second));
 
 		//
 		// If this is the main thread of a process, erase all the FDs that the process owns
 		//
 		if(it->second.m_pid == it->second.m_tid)
 		{
-			unordered_map<int64_t, sinsp_fdinfo_t>* fdtable = &(it->second.get_fd_table()->m_table);
-			unordered_map<int64_t, sinsp_fdinfo_t>::iterator fdit;
+			fdinfo_map_t* fdtable = &(it->second.get_fd_table()->m_table);
+			fdinfo_map_iterator_t fdit;
 
 			erase_fd_params eparams;
 			eparams.m_remove_from_table = false;
@@ -933,15 +1295,19 @@ void sinsp_thread_manager::remove_thread(threadinfo_map_iterator_t it, bool forc
 		}
 
 		//
-		// Reset the cache
+		// Remove the thread from the cache
 		//
-		m_last_tid = 0;
-		m_last_tinfo = NULL;
+		lookaside_entry* le = &m_lookaside[it->first & (THREAD_LOOKASIDE_SIZE - 1)];
+		if(le->m_tid == it->first)
+		{
+			le->m_tinfo = NULL;
+		}
 
 #ifdef GATHER_INTERNAL_STATS
 		m_removed_threads->increment();
 #endif
 
+		release_container_ref(it->second.m_container_id);
 		m_threadtable.erase(it);
 
 		//
@@ -955,6 +1321,88 @@ void sinsp_thread_manager::remove_thread(threadinfo_map_iterator_t it, bool forc
 			recreate_child_dependencies();
 		}
 	}
+	else if(it->second.m_flags & PPM_CL_CLOSED)
+	{
+		//
+		// The process exited, but its threads still refer to it. Check it
+		// again after a scan period, and remove it then.
+		//
+		schedule_expiry_check(&(it->second),
+			m_inspector->m_lastevent_ts + m_inspector->m_inactive_thread_scan_time_ns);
+	}
+}
+
+void sinsp_thread_manager::schedule_expiry_check(sinsp_threadinfo* tinfo, uint64_t ts)
+{
+	//
+	// Until the capture starts, the threads are scheduled by the first
+	// remove_inactive_threads()
+	//
+	if(m_last_flush_time_ns == 0)
+	{
+		return;
+	}
+
+	tinfo->m_expiry_check_ts = ts;
+	m_expiry_wheel.insert(tinfo->m_tid, ts);
+}
+
+//
+// Called by the expiry wheel when a thread is due. This is what the old full
+// table scan did for every thread.
+//
+void sinsp_thread_manager::check_inactive_thread(int64_t tid, uint64_t due_ts)
+{
+	threadinfo_map_iterator_t it = m_threadtable.find(tid);
+
+	//
+	// The thread is gone, or this is an entry left behind by rescheduling
+	// or by a previous thread with the same tid
+	//
+	if(it == m_threadtable.end() || it->second.m_expiry_check_ts != due_ts)
+	{
+		return;
+	}
+
+	sinsp_threadinfo* tinfo = &(it->second);
+	uint64_t now = m_inspector->m_lastevent_ts;
+	bool closed = (tinfo->m_flags & PPM_CL_CLOSED) != 0;
+
+	tinfo->m_expiry_check_ts = 0;
+
+	if(closed ||
+		((now > tinfo->m_lastaccess_ts + m_inspector->m_thread_timeout_ns) &&
+			!scap_is_thread_alive(m_inspector->m_h, tinfo->m_pid, tid, tinfo->m_comm.c_str()))
+			)
+	{
+		remove_thread(it, closed);
+
+		//
+		// A dead main thread is kept while its threads refer to it. Check it
+		// again after a scan period, when they may be gone.
+		//
+		it = m_threadtable.find(tid);
+		if(it != m_threadtable.end() && it->second.m_expiry_check_ts == 0)
+		{
+			schedule_expiry_check(&(it->second), now + m_inspector->m_inactive_thread_scan_time_ns);
+		}
+
+		return;
+	}
+
+	//
+	// The thread can't time out before m_thread_timeout_ns after its last
+	// access. Threads that have timed out but are still alive are checked
+	// again after a scan period.
+	//
+	uint64_t next_ts = tinfo->m_lastaccess_ts + m_inspector->m_thread_timeout_ns;
+
+	if(next_ts < now + m_inspector->m_inactive_thread_scan_time_ns)
+	{
+		next_ts = now + m_inspector->m_inactive_thread_scan_time_ns;
+	}
+
+	schedule_expiry_check(tinfo, next_ts);
 }
 
 void sinsp_thread_manager::fix_sockets_coming_from_proc()
@@ -992,12 +1440,12 @@ void sinsp_thread_manager::reset_child_dependencies()
 {
 	threadinfo_map_iterator_t it;
 
-	m_last_tinfo = NULL;
-	m_last_tid = 0;
+	reset_lookaside();
 
 	for(it = m_threadtable.begin(); it != m_threadtable.end(); ++it)
 	{
 		it->second.m_nchilds = 0;
+		it->second.m_nchilds_pid = -1;
 		clear_thread_pointers(it);
 	}
 }
@@ -1028,5 +1476,13 @@ void sinsp_thread_manager::update_statistics()
 	{
 		m_inspector->m_stats.m_n_fds += it->second.get_fd_table()->size();
 	}
+
+	m_thread_pool_used->set(m_threadtable.get_pool().get_used());
+	m_thread_pool_capacity->set(m_threadtable.get_pool().get_capacity());
+	m_fd_pool_used->set(m_fdinfo_pool.get_used());
+	m_fd_pool_capacity->set(m_fdinfo_pool.get_capacity());
+
+	m_inspector->m_stats.m_n_evt_arena_bytes = m_evt_arena.get_size();
+	m_inspector->m_stats.m_n_evt_arena_used_bytes = m_evt_arena.get_used();
 #endif
 }
@@ -57,7 +57,17 @@ class SINSP_PUBLIC sinsp_threadinfo
 public:
 	sinsp_threadinfo();
 	sinsp_threadinfo(sinsp *inspector);
+	//
+	// A threadinfo owns its pending enter event, its tracer parser and its
+	// private state. Moving hands them over; copying clones the enter event
+	// and the private state, while the copy starts without a tracer parser
+	// (it's created again on the next tracer event).
+	//
+	sinsp_threadinfo(const sinsp_threadinfo& other);
+	sinsp_threadinfo(sinsp_threadinfo&& other);
 	~sinsp_threadinfo();
+	sinsp_threadinfo& operator=(const sinsp_threadinfo& other);
+	sinsp_threadinfo& operator=(sinsp_threadinfo&& other);
 
 	/*!
 	  \brief Return the name of the process containing this thread, e.g. "top".
@@ -74,6 +84,29 @@ public:
 	*/
 	string get_cwd();
 
+	/*!
+	  \brief Return the command line arguments of the process containing this
+	  thread, as strings. m_args keeps them interned.
+	*/
+	vector<string> get_args() const;
+
+	/*!
+	  \brief Return the subsystem-cgroup pairs of this thread, as strings.
+	  m_cgroups keeps them interned.
+	*/
+	vector<pair<string, string>> get_cgroups() const;
+
+	/*!
+	  \brief Return the root directory of the process containing this thread.
+	*/
+	string get_root() const;
+
+	/*!
+	  \brief Return the id of the container this thread runs in, empty for the
+	  host.
+	*/
+	string get_container_id() const;
+
 	/*!
 	  \brief Return the values of all environment variables for the process
 	  containing this thread.
@@ -205,12 +238,12 @@ public:
 	int64_t m_pid; ///< The id of the process containing this thread. In single thread threads, this is equal to tid.
 	int64_t m_ptid; ///< The id of the process that started this thread.
 	int64_t m_sid; ///< The session id of the process containing this thread.
-	string m_comm; ///< Command name (e.g. "top")
-	string m_exe; ///< argv[0] (e.g. "sshd: user@pts/4")
-	vector<string> m_args; ///< Command line arguments (e.g. "-d1")
+	sinsp_istring m_comm; ///< Command name (e.g. "top")
+	sinsp_istring m_exe; ///< argv[0] (e.g. "sshd: user@pts/4")
+	vector<sinsp_istring> m_args; ///< Command line arguments (e.g. "-d1")
 	vector<string> m_env; ///< Environment variables
-	vector<pair<string, string>> m_cgroups; ///< subsystem-cgroup pairs
-	string m_container_id; ///< heuristic-based container id
+	vector<pair<sinsp_istring, sinsp_istring>> m_cgroups; ///< subsystem-cgroup pairs
+	sinsp_istring m_container_id; ///< heuristic-based container id
 	uint32_t m_flags; ///< The thread flags. See the PPM_CL_* declarations in ppm_events_public.h.
 	int64_t m_fdlimit;  ///< The maximum number of FDs this thread can open
 	uint32_t m_uid; ///< user id
@@ -223,7 +256,7 @@ public:
 	uint64_t m_pfminor; ///< number of minor page faults since start.
 	int64_t m_vtid;  ///< The virtual id of this thread.
 	int64_t m_vpid; ///< The virtual id of the process containing this thread. In single thread threads, this is equal to vtid.
-	string m_root;
+	sinsp_istring m_root;
 
 	//
 	// State for multi-event processing
@@ -256,9 +289,11 @@ public:
 
 VISIBILITY_PRIVATE
 	void init();
+	void free_owned_state();
 	// return true if, based on the current inspector filter, this thread should be kept
 	void init(scap_threadinfo* pi);
 	void fix_sockets_coming_from_proc();
+	void fix_socket_coming_from_proc(sinsp_fdinfo_t* fdinfo);
 	sinsp_fdinfo_t* add_fd(int64_t fd, sinsp_fdinfo_t *fdinfo);
 	void add_fd_from_scap(scap_fdinfo *fdinfo, OUT sinsp_fdinfo_t *res);
 	void remove_fd(int64_t fd);
@@ -311,10 +346,12 @@ VISIBILITY_PRIVATE
 	// parent thread info
 	//
 	sinsp_fdtable m_fdtable; // The fd table of this thread
-	string m_cwd; // current working directory
+	sinsp_istring m_cwd; // current working directory
 	sinsp_threadinfo* m_main_thread;
 	uint8_t* m_lastevent_data; // Used by some event parsers to store the last enter event
 	vector<void*> m_private_state;
+	uint64_t m_expiry_check_ts; // When the thread is due in the expiry wheel of the thread manager, 0 if it's not there
+	int64_t m_nchilds_pid; // The main thread whose m_nchilds counts this thread, -1 if none
 
 	uint16_t m_lastevent_type;
 	uint16_t m_lastevent_cpuid;
@@ -326,6 +363,7 @@ VISIBILITY_PRIVATE
 	friend class sinsp_analyzer;
 	friend class sinsp_analyzer_parsers;
 	friend class sinsp_evt;
+	friend class sinsp_fdtable;
 	friend class sinsp_thread_manager;
 	friend class sinsp_transaction_table;
 	friend class thread_analyzer_info;
@@ -335,7 +373,7 @@ VISIBILITY_PRIVATE
 
 /*@}*/
 
-typedef unordered_map<int64_t, sinsp_threadinfo> threadinfo_map_t;
+typedef sinsp_tid_map<sinsp_threadinfo> threadinfo_map_t;
 typedef threadinfo_map_t::iterator threadinfo_map_iterator_t;
 
 
@@ -375,9 +413,16 @@ public:
 	void clear();
 
 	void set_listener(sinsp_threadtable_listener* listener);
-	void add_thread(sinsp_threadinfo& threadinfo, bool from_scap_proctable);
+	// Copies or moves threadinfo into the table
+	void add_thread(const sinsp_threadinfo& threadinfo, bool from_scap_proctable);
+	void add_thread(sinsp_threadinfo&& threadinfo, bool from_scap_proctable);
 	void remove_thread(int64_t tid, bool force);
-	// Returns true if the table is actually scanned
+	// Sets the container of a thread, keeping the container thread counts
+	// right if the thread is in the table
+	void set_container_id(sinsp_threadinfo* tinfo, const string& container_id);
+	// Number of threads in the table that belong to the container
+	uint32_t get_container_thread_count(const string& container_id) const;
+	// Returns true if some threads were checked
 	// NOTE: this is implemented in sinsp.cpp so we can inline it from there
 	inline bool remove_inactive_threads();
 	void fix_sockets_coming_from_proc();
@@ -397,18 +442,63 @@ public:
 		return &m_threadtable;
 	}
 
+	const fdinfo_pool_t* get_fdinfo_pool() const
+	{
+		return &m_fdinfo_pool;
+	}
+
+	sinsp_evt_arena* get_evt_arena()
+	{
+		return &m_evt_arena;
+	}
+
 	set<uint16_t> m_server_ports;
 
 private:
 	void remove_thread(threadinfo_map_iterator_t it, bool force);
+	void schedule_expiry_check(sinsp_threadinfo* tinfo, uint64_t ts);
+	void check_inactive_thread(int64_t tid, uint64_t due_ts);
 	void increment_mainthread_childcount(sinsp_threadinfo* threadinfo);
+	void decrement_mainthread_childcount(sinsp_threadinfo* threadinfo);
+	void add_container_ref(const sinsp_istring& container_id);
+	void release_container_ref(const sinsp_istring& container_id);
 	inline void clear_thread_pointers(threadinfo_map_iterator_t it);
+	void reset_lookaside();
+
+	//
+	// Cache of the last looked up threads, indexed by tid. Events from
+	// different CPUs interleave, so a single entry would keep missing.
+	//
+	struct lookaside_entry
+	{
+		int64_t m_tid;
+		sinsp_threadinfo* m_tinfo;
+	};
 
 	sinsp* m_inspector;
+	//
+	// The entries of all the fd tables and the stored enter events of all
+	// the threads. They must outlive the threads, so they come before the
+	// thread table.
+	//
+	fdinfo_pool_t m_fdinfo_pool;
+	sinsp_evt_arena m_evt_arena;
 	threadinfo_map_t m_threadtable;
-	int64_t m_last_tid;
-	sinsp_threadinfo* m_last_tinfo;
+	lookaside_entry m_lookaside[THREAD_LOOKASIDE_SIZE];
+	//
+	// The threads by the time they must be checked for inactivity. Each
+	// thread has one entry, at its m_expiry_check_ts; the entries left
+	// behind by rescheduling are skipped.
+	//
+	sinsp_timing_wheel<int64_t> m_expiry_wheel;
+	//
+	// Number of threads in the table for each container, by the id of the
+	// interned container id. The threads hold their ids, so the ids in
+	// here stay in the pool.
+	//
+	unordered_map<uintptr_t, uint32_t> m_container_nthreads;
 	uint64_t m_last_flush_time_ns;
+	uint64_t m_last_arena_trim_ns;
 	uint32_t m_n_drops;
 	uint32_t m_n_proc_lookups;
 
@@ -419,9 +509,14 @@ private:
 	INTERNAL_COUNTER(m_non_cached_lookups);
 	INTERNAL_COUNTER(m_added_threads);
 	INTERNAL_COUNTER(m_removed_threads);
+	INTERNAL_COUNTER(m_thread_pool_used);
+	INTERNAL_COUNTER(m_thread_pool_capacity);
+	INTERNAL_COUNTER(m_fd_pool_used);
+	INTERNAL_COUNTER(m_fd_pool_capacity);
 
 	friend class sinsp_parser;
 	friend class sinsp_analyzer;
 	friend class sinsp;
 	friend class sinsp_threadinfo;
+	friend class sinsp_fdtable;
 };
@@ -0,0 +1,423 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <new>
+#include <utility>
+#include "objpool.h"
+
+///////////////////////////////////////////////////////////////////////////////
+// A hash table keyed by thread ID, used for the thread table.
+//
+// The slots are an open-addressing array with linear probing. Each slot holds
+// the key and a pointer to the entry, so a lookup walks contiguous memory and
+// only touches the entry it returns. The entries are allocated from a
+// sinsp_obj_pool and never move: pointers to them stay valid until they are erased, like with
+// unordered_map.
+//
+// Erasing leaves a tombstone in the slot, so erasing while iterating is safe.
+// The table is only rehashed by insert().
+///////////////////////////////////////////////////////////////////////////////
+template<typename T, uint32_t SLAB_SIZE = 256>
+class sinsp_tid_map
+{
+public:
+	typedef std::pair<const int64_t, T> value_type;
+
+private:
+	struct slot
+	{
+		int64_t m_key;
+		value_type* m_entry; // NULL if empty, tombstone() if erased
+	};
+
+public:
+	class iterator
+	{
+	public:
+		iterator():
+			m_map(NULL),
+			m_pos(0)
+		{
+		}
+
+		value_type& operator*() const
+		{
+			return *m_map->m_slots[m_pos].m_entry;
+		}
+
+		value_type* operator->() const
+		{
+			return m_map->m_slots[m_pos].m_entry;
+		}
+
+		iterator& operator++()
+		{
+			m_pos = m_map->next_live(m_pos + 1);
+			return *this;
+		}
+
+		iterator operator++(int)
+		{
+			iterator res = *this;
+			++(*this);
+			return res;
+		}
+
+		bool operator==(const iterator& other) const
+		{
+			return m_pos == other.m_pos && m_map == other.m_map;
+		}
+
+		bool operator!=(const iterator& other) const
+		{
+			return !(*this == other);
+		}
+
+	private:
+		iterator(sinsp_tid_map* map, size_t pos):
+			m_map(map),
+			m_pos(pos)
+		{
+		}
+
+		//
+		// The position rather than a slot pointer, so that an iterator doesn't
+		// dangle if the table is rehashed
+		//
+		sinsp_tid_map* m_map;
+		size_t m_pos;
+
+		friend class sinsp_tid_map;
+	};
+
+	sinsp_tid_map():
+		m_slots(NULL),
+		m_capacity(0),
+		m_shift(64),
+		m_size(0),
+		m_tombstones(0)
+	{
+	}
+
+	~sinsp_tid_map()
+	{
+		clear();
+	}
+
+	sinsp_tid_map(const sinsp_tid_map&) = delete;
+	sinsp_tid_map& operator=(const sinsp_tid_map&) = delete;
+
+	size_t size() const
+	{
+		return m_size;
+	}
+
+	bool empty() const
+	{
+		return m_size == 0;
+	}
+
+	iterator begin()
+	{
+		return iterator(this, next_live(0));
+	}
+
+	iterator end()
+	{
+		return iterator(this, m_capacity);
+	}
+
+	//
+	// Return a pointer to the value of key, or NULL if it's not in the table
+	//
+	inline T* get(int64_t key)
+	{
+		if(m_size == 0)
+		{
+			return NULL;
+		}
+
+		size_t mask = m_capacity - 1;
+		size_t j = hash(key);
+
+		while(true)
+		{
+			slot* s = &m_slots[j];
+
+			if(s->m_entry == NULL)
+			{
+				return NULL;
+			}
+
+			if(s->m_key == key && s->m_entry != tombstone())
+			{
+				return &s->m_entry->second;
+			}
+
+			j = (j + 1) & mask;
+		}
+	}
+
+	iterator find(int64_t key)
+	{
+		size_t pos = find_slot(key);
+		return iterator(this, pos);
+	}
+
+	//
+	// Set the value of key to a copy of value, adding it if it's not in the
+	// table. Return the value in the table.
+	//
+	T* insert(int64_t key, const T& value)
+	{
+		size_t pos = find_slot(key);
+		if(pos != m_capacity)
+		{
+			m_slots[pos].m_entry->second = value;
+			return &m_slots[pos].m_entry->second;
+		}
+
+		size_t j = reserve_slot(key);
+		return fill_slot(j, m_pool.create(key, value));
+	}
+
+	//
+	// Like insert(), but move value into the table
+	//
+	T* insert(int64_t key, T&& value)
+	{
+		size_t pos = find_slot(key);
+		if(pos != m_capacity)
+		{
+			m_slots[pos].m_entry->second = std::move(value);
+			return &m_slots[pos].m_entry->second;
+		}
+
+		size_t j = reserve_slot(key);
+		return fill_slot(j, m_pool.create(key, std::move(value)));
+	}
+
+	void erase(iterator it)
+	{
+		size_t mask = m_capacity - 1;
+		size_t j = it.m_pos;
+		slot* s = &m_slots[j];
+
+		m_pool.destroy(s->m_entry);
+
+		s->m_entry = tombstone();
+		m_size--;
+		m_tombstones++;
+
+		//
+		// If the slot is the last one of its probe sequence, the tombstones
+		// before it aren't needed anymore
+		//
+		if(m_slots[(j + 1) & mask].m_entry == NULL)
+		{
+			while(m_slots[j].m_entry == tombstone())
+			{
+				m_slots[j].m_entry = NULL;
+				m_tombstones--;
+				j = (j - 1) & mask;
+			}
+		}
+	}
+
+	void erase(int64_t key)
+	{
+		iterator it = find(key);
+		if(it != end())
+		{
+			erase(it);
+		}
+	}
+
+	void clear()
+	{
+		for(size_t j = 0; j < m_capacity; j++)
+		{
+			if(m_slots[j].m_entry != NULL && m_slots[j].m_entry != tombstone())
+			{
+				m_pool.destroy(m_slots[j].m_entry);
+			}
+		}
+
+		m_pool.clear();
+		free(m_slots);
+
+		m_slots = NULL;
+		m_capacity = 0;
+		m_shift = 64;
+		m_size = 0;
+		m_tombstones = 0;
+	}
+
+	const sinsp_obj_pool<value_type, SLAB_SIZE>& get_pool() const
+	{
+		return m_pool;
+	}
+
+private:
+	static value_type* tombstone()
+	{
+		return (value_type*)1;
+	}
+
+	//
+	// Return the slot where a key that is not in the table goes, growing the
+	// table if needed
+	//
+	size_t reserve_slot(int64_t key)
+	{
+		if((m_size + m_tombstones + 1) * 4 > m_capacity * 3)
+		{
+			//
+			// Keep the load, tombstones included, under 3/4. The table grows
+			// when the entries would take more than half of it, otherwise
+			// rehashing just drops the tombstones.
+			//
+			size_t capacity = (m_capacity == 0)? 64 : m_capacity;
+			while((m_size + 1) * 2 > capacity)
+			{
+				capacity *= 2;
+			}
+
+			rehash(capacity);
+		}
+
+		size_t mask = m_capacity - 1;
+		size_t j = hash(key);
+		while(m_slots[j].m_entry != NULL && m_slots[j].m_entry != tombstone())
+		{
+			j = (j + 1) & mask;
+		}
+
+		return j;
+	}
+
+	T* fill_slot(size_t j, value_type* entry)
+	{
+		if(m_slots[j].m_entry == tombstone())
+		{
+			m_tombstones--;
+		}
+
+		m_slots[j].m_key = entry->first;
+		m_slots[j].m_entry = entry;
+		m_size++;
+
+		return &entry->second;
+	}
+
+	//
+	// Fibonacci hashing, so that consecutive tids spread over the table
+	//
+	inline size_t hash(int64_t key) const
+	{
+		return (size_t)(((uint64_t)key * 0x9E3779B97F4A7C15ULL) >> m_shift);
+	}
+
+	size_t find_slot(int64_t key)
+	{
+		if(m_size == 0)
+		{
+			return m_capacity;
+		}
+
+		size_t mask = m_capacity - 1;
+		size_t j = hash(key);
+
+		while(m_slots[j].m_entry != NULL)
+		{
+			if(m_slots[j].m_key == key && m_slots[j].m_entry != tombstone())
+			{
+				return j;
+			}
+
+			j = (j + 1) & mask;
+		}
+
+		return m_capacity;
+	}
+
+	size_t next_live(size_t pos) const
+	{
+		while(pos < m_capacity &&
+			(m_slots[pos].m_entry == NULL || m_slots[pos].m_entry == tombstone()))
+		{
+			pos++;
+		}
+
+		return pos;
+	}
+
+	void rehash(size_t capacity)
+	{
+		slot* old_slots = m_slots;
+		size_t old_capacity = m_capacity;
+		uint32_t shift = 64;
+
+		for(size_t c = capacity; c > 1; c >>= 1)
+		{
+			shift--;
+		}
+
+		m_slots = (slot*)calloc(capacity, sizeof(slot));
+		if(m_slots == NULL)
+		{
+			m_slots = old_slots;
+			throw std::bad_alloc();
+		}
+
+		m_capacity = capacity;
+		m_shift = shift;
+		m_tombstones = 0;
+
+		size_t mask = m_capacity - 1;
+
+		for(size_t k = 0; k < old_capacity; k++)
+		{
+			if(old_slots[k].m_entry == NULL || old_slots[k].m_entry == tombstone())
+			{
+				continue;
+			}
+
+			size_t j = hash(old_slots[k].m_key);
+			while(m_slots[j].m_entry != NULL)
+			{
+				j = (j + 1) & mask;
+			}
+
+			m_slots[j] = old_slots[k];
+		}
+
+		free(old_slots);
+	}
+
+	slot* m_slots;
+	size_t m_capacity; // Always 0 or a power of 2
+	uint32_t m_shift;
+	size_t m_size;
+	size_t m_tombstones;
+	sinsp_obj_pool<value_type, SLAB_SIZE> m_pool;
+};
@@ -0,0 +1,168 @@
+/*
+Copyright (C) 2013-2014 Draios inc.
+
+This file is part of sysdig.
+
+sysdig is free software; you can redistribute it and/or modify
+it under the terms of the GNU General Public License version 2 as
+published by the Free Software Foundation.
+
+sysdig is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with sysdig.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+///////////////////////////////////////////////////////////////////////////////
+// A hashed timing wheel, used to expire table entries without scanning the
+// tables.
+//
+// Each key is stored with the time it's due at, in the slot that covers that
+// time. The slots are SLOT_NS nanoseconds wide and the wheel wraps around, so
+// a slot can also hold keys that are due a few rotations later; those stay in
+// the slot until their rotation comes. A slot is expired once the time has
+// gone past its end, so the keys are expired with the granularity of a slot.
+//
+// expire() takes a limit on the number of keys that it returns, and picks up
+// where it left at the next call. A lot of keys due at the same time are
+// spread over several calls instead of being expired at once.
+///////////////////////////////////////////////////////////////////////////////
+template<typename K>
+class sinsp_timing_wheel
+{
+private:
+	struct entry
+	{
+		K m_key;
+		uint64_t m_due_ts;
+	};
+
+public:
+	sinsp_timing_wheel(uint64_t slot_ns, uint32_t nslots):
+		m_slots(nslots),
+		m_slot_ns(slot_ns),
+		m_cur_ts(0),
+		m_cur_pos(0),
+		m_size(0)
+	{
+	}
+
+	void insert(const K& key, uint64_t due_ts)
+	{
+		entry e;
+		e.m_key = key;
+		e.m_due_ts = due_ts;
+
+		if(m_cur_ts == 0)
+		{
+			m_cur_ts = due_ts - (due_ts % m_slot_ns);
+		}
+
+		//
+		// Keys that are already due go in the slot that is being expired
+		//
+		if(due_ts < m_cur_ts + m_slot_ns)
+		{
+			m_slots[slot_index(m_cur_ts)].push_back(e);
+		}
+		else
+		{
+			m_slots[slot_index(due_ts)].push_back(e);
+		}
+
+		m_size++;
+	}
+
+	//
+	// Call fn(key, due_ts) for the keys that are due at now, up to max_keys
+	// of them. fn can insert keys. Returns the number of keys expired.
+	//
+	template<typename F>
+	uint32_t expire(uint64_t now, uint32_t max_keys, F fn)
+	{
+		uint32_t nexpired = 0;
+		uint32_t nslots = 0;
+
+		while(m_cur_ts != 0 && m_cur_ts + m_slot_ns <= now)
+		{
+			std::vector<entry>& slot = m_slots[slot_index(m_cur_ts)];
+
+			while(m_cur_pos < slot.size())
+			{
+				if(slot[m_cur_pos].m_due_ts >= m_cur_ts + m_slot_ns)
+				{
+					//
+					// Due in a later rotation
+					//
+					m_cur_pos++;
+					continue;
+				}
+
+				if(nexpired == max_keys)
+				{
+					return nexpired;
+				}
+
+				entry e = slot[m_cur_pos];
+				slot[m_cur_pos] = slot.back();
+				slot.pop_back();
+				m_size--;
+				nexpired++;
+
+				fn(e.m_key, e.m_due_ts);
+			}
+
+			m_cur_ts += m_slot_ns;
+			m_cur_pos = 0;
+
+			//
+			// Don't spin through more than a rotation of slots when the time
+			// jumps ahead. The next calls will continue from here.
+			//
+			if(++nslots == m_slots.size())
+			{
+				break;
+			}
+		}
+
+		return nexpired;
+	}
+
+	void clear()
+	{
+		for(size_t j = 0; j < m_slots.size(); j++)
+		{
+			m_slots[j].clear();
+		}
+
+		m_cur_ts = 0;
+		m_cur_pos = 0;
+		m_size = 0;
+	}
+
+	size_t size() const
+	{
+		return m_size;
+	}
+
+private:
+	inline size_t slot_index(uint64_t ts) const
+	{
+		return (size_t)((ts / m_slot_ns) % m_slots.size());
+	}
+
+	std::vector<std::vector<entry>> m_slots;
+	uint64_t m_slot_ns;
+	uint64_t m_cur_ts; // Start of the slot being expired, 0 until the first key arrives
+	size_t m_cur_pos; // Position in the slot being expired
+	size_t m_size;
+};
@@ -181,10 +181,11 @@ captureinfo do_inspect(sinsp* inspector,
 {
 	captureinfo retval;
 	int32_t res;
-	sinsp_evt* ev;
+	sinsp_evt* ev = NULL;
+	sinsp_evt_batch batch;
 
 	//
-	// Loop through the events
+	// Loop through the events, one batch at a time
 	//
 	while(1)
 	{
@@ -197,13 +198,49 @@ captureinfo do_inspect(sinsp* inspector,
 			break;
 		}
 
-		res = inspector->next(&ev);
+		//
+		// Never go past the event count specified with -n
+		//
+		uint64_t max_evts = cnt - retval.m_nevts;
+		if(max_evts > UINT32_MAX)
+		{
+			max_evts = UINT32_MAX;
+		}
+
+		res = inspector->next_batch((uint32_t)max_evts, &batch);
+
+		if(res == SCAP_SUCCESS)
+		{
+			for(sinsp_evt* bev : batch)
+			{
+				if(bev->is_filtered_out())
+				{
+					continue;
+				}
+
+				ev = bev;
+
+				if(ui->process_event(ev, res) == true)
+				{
+					return retval;
+				}
+
+				retval.m_nevts++;
+
+				if(g_terminate)
+				{
+					break;
+				}
+			}
+
+			res = batch.get_result();
+		}
 
-		if(res == SCAP_TIMEOUT)
+		if(res == SCAP_SUCCESS || res == SCAP_TIMEOUT)
 		{
 			continue;
 		}
-		else if(res != SCAP_EOF && res != SCAP_SUCCESS)
+		else if(res != SCAP_EOF)
 		{
 			//
 			// Event read error.
@@ -221,6 +258,9 @@ captureinfo do_inspect(sinsp* inspector,
 			}
 		}
 
+		//
+		// The UI keeps running after the end of a trace file
+		//
 		if(ui->process_event(ev, res) == true)
 		{
 			return retval;
@@ -67,6 +67,11 @@ static void usage()
 " -A, --print-ascii  Only print the text portion of data buffers, and echo\n"
 "                    end-of-lines. This is useful to only display human-readable\n"
 "                    data.\n"
+" --async-write      Used with -w, writes the files from a background thread, so\n"
+"                    that the capture doesn't wait for the disk, for the\n"
+"                    compression or for the process table to be read at every\n"
+"                    new file. -v reports how often the capture had to wait for\n"
+"                    the writer.\n"
 " -b, --print-base64 Print data buffers in base64. This is useful for encoding\n"
 "                    binary data that needs to be used over media designed to\n"
 "                    handle textual data (i.e., terminal or json).\n"
@@ -86,6 +91,10 @@ static void usage()
 "                    starting at 0 and continuing upward. The units of file_size\n"
 "                    are millions of bytes (10^6, not 2^20). Use the -W flag to\n"
 "                    determine how many files will be saved to disk.\n"
+" --compression-level=<level>\n"
+"                    Used with -z or --seekable, sets the zlib compression level,\n"
+"                    from 1 (fastest) to 9 (smallest). The default is 0, which\n"
+"                    picks the zlib default.\n"
 " -d, --displayflt   Make the given filter a display one\n"
 "                    Setting this option causes the events to be filtered\n"
 "                    after being parsed by the state system. Events are\n"
@@ -93,6 +102,12 @@ static void usage()
 "                    efficient, but can cause state (e.g. FD names) to be lost.\n"
 " -D, --debug        Capture events about sysdig itself and print additional\n"
 "                    logging on standard error.\n"
+" --driver-filter    Used with a live capture and a filter, makes the driver\n"
+"                    capture only the event types that the filter can accept,\n"
+"                    plus the ones that sysdig needs to keep track of processes\n"
+"                    and files. This lowers the capture overhead with selective\n"
+"                    filters. The driver settings are shared by all the sysdig\n"
+"                    instances running on the machine.\n"
 " -E, --exclude-users\n"
 "                    Don't create the user/group tables by querying the OS when\n"
 "                    sysdig starts. This also means that no user or group info\n"
@@ -106,6 +121,12 @@ static void usage()
 "                    parameter each.\n"
 "                    Used alongside -W flags creates a ring buffer of file containing\n"
 "                    num_events each.\n"
+" --explain-filter   Print the order in which the checks of the filter are\n"
+"                    evaluated, with the estimated cost of each one and how\n"
+"                    often it's expected to be true, and exit.\n"
+" --fast-read        Used with -r, decompresses the file in a background thread,\n"
+"                    or maps it in memory if it isn't compressed. The file must\n"
+"                    not be truncated while it's being read.\n"
 " -F, --fatfile      Enable fatfile mode\n"
 "                    when writing in fatfile mode, the output file will contain\n"
 "                    events that will be invisible when reading the file, but\n"
@@ -155,6 +176,10 @@ static void usage()
 "                    Note that the format of this command-line option prohibits use of files whose names contain\n"
 "                    ':' or '#' characters in the file name.\n"
 "                    Option can also be provided via the environment variable SYSDIG_K8S_API_CERT.\n"
+" --lazy-fds         Don't read the file descriptors of all the processes at\n"
+"                    startup. Each one is read from /proc the first time an\n"
+"                    event uses it, which makes startup faster on machines with\n"
+"                    many open files or connections.\n"
 " -L, --list-events  List the events that the engine supports\n"
 " -l, --list         List the fields that can be used for filtering and output\n"
 "                    formatting. Use -lv to get additional information for each\n"
@@ -183,6 +208,9 @@ static void usage()
 "                    Read the events from <readfile>.\n"
 " -S, --summary      print the event summary (i.e. the list of the top events)\n"
 "                    when the capture ends.\n"
+" --seekable         Used with -w, writes compressed tracefiles made of independent\n"
+"                    chunks followed by an index, so that they can be seeked\n"
+"                    quickly by time or event number when they are read back.\n"
 " -s <len>, --snaplen=<len>\n"
 "                    Capture the first <len> bytes of each I/O buffer.\n"
 "                    By default, the first 80 bytes are captured. Use this\n"
@@ -213,6 +241,12 @@ static void usage()
 "                    -v will also make sysdig print some summary information at\n"
 "                    the end of the capture.\n"
 " --version          Print version number.\n"
+" --wait-policy=<policy>\n"
+"                    How a live capture waits for events when the driver buffers\n"
+"                    are empty. fixed (the default) sleeps up to 30ms, busy never\n"
+"                    sleeps, backoff sleeps longer and longer while there are no\n"
+"                    events, and watermark waits until a buffer holds 20000 bytes\n"
+"                    or data has been waiting for 30ms.\n"
 " -w <writefile>, --write=<writefile>\n"
 "                    Write the captured events to <writefile>.\n"
 " -W <num>, --limit <num>\n"
@@ -505,6 +539,161 @@ void handle_end_of_file(bool print_progress, sinsp_evt_formatter* formatter = NU
 	}
 }
 
+//
+// State shared by do_inspect() and the per-event callback
+//
+struct inspect_context
+{
+	sinsp* m_inspector;
+	bool m_quiet;
+	bool m_json;
+	bool m_print_progress;
+	sinsp_filter* m_display_filter;
+	vector<summary_table_entry>* m_summary_table;
+	sinsp_evt_formatter* m_formatter;
+	bool m_do_flush;
+	int m_duration_to_tot;
+	int m_duration_start;
+	string m_line;
+	double m_last_printed_progress_pct;
+};
+
+//
+// True when the user stopped the capture, or when the time given with -M is
+// over. Checked before every event, like when events were read one at a time.
+//
+static bool capture_over(inspect_context* ctx)
+{
+	if(ctx->m_duration_to_tot > 0)
+	{
+		int duration_tot = ((double)clock()) / CLOCKS_PER_SEC - ctx->m_duration_start;
+		if(duration_tot >= ctx->m_duration_to_tot)
+		{
+			return true;
+		}
+	}
+
+	return g_terminate;
+}
+
+//
+// Process a single event of a batch
+//
+static void process_evt(sinsp_evt* ev, inspect_context* ctx)
+{
+	if(ev->is_filtered_out())
+	{
+		//
+		// The event has been dropped by the filtering system.
+		// Give the chisels a chance to run their timeout logic.
+		//
+		chisels_do_timeout(ev);
+		return;
+	}
+
+	if(ctx->m_print_progress)
+	{
+		if(ev->get_num() % 10000 == 0)
+		{
+			double progress_pct = ctx->m_inspector->get_read_progress();
+
+			if(progress_pct - ctx->m_last_printed_progress_pct > 0.1)
+			{
+				fprintf(stderr, "%.2lf\n", progress_pct);
+				fflush(stderr);
+				ctx->m_last_printed_progress_pct = progress_pct;
+			}
+		}
+	}
+
+	//
+	// If there are chisels to run, run them
+	//
+#ifdef HAS_CHISELS
+	if(!g_chisels.empty())
+	{
+		for(vector<sinsp_chisel*>::iterator it = g_chisels.begin(); it != g_chisels.end(); ++it)
+		{
+			if((*it)->run(ev) == false)
+			{
+				continue;
+			}
+		}
+	}
+	else
+#endif
+	{
+		//
+		// If we're supposed to summarize, increase the count for this event
+		//
+		if(ctx->m_summary_table != NULL)
+		{
+			uint16_t etype = ev->get_type();
+
+			if(etype == PPME_GENERIC_E)
+			{
+				sinsp_evt_param *parinfo = ev->get_param(0);
+				uint16_t id = *(int16_t *)parinfo->m_val;
+				((*ctx->m_summary_table)[PPM_EVENT_MAX + id * 2]).m_ncalls++;
+			}
+			else if(etype == PPME_GENERIC_X)
+			{
+				sinsp_evt_param *parinfo = ev->get_param(0);
+				uint16_t id = *(int16_t *)parinfo->m_val;
+				((*ctx->m_summary_table)[PPM_EVENT_MAX + id * 2 + 1]).m_ncalls++;
+			}
+			else
+			{
+				((*ctx->m_summary_table)[etype]).m_ncalls++;
+			}
+		}
+
+		//
+		// When the quiet flag is specified, we don't do any kind of processing other
+		// than counting the events.
+		//
+		if(ctx->m_quiet)
+		{
+			return;
+		}
+
+		if(!ctx->m_inspector->is_debug_enabled() &&
+			ev->get_category() & EC_INTERNAL)
+		{
+			return;
+		}
+
+		if(ctx->m_formatter->tostring(ev, &ctx->m_line))
+		{
+			//
+			// Output the line
+			//
+			if(ctx->m_display_filter)
+			{
+				if(!ctx->m_display_filter->run(ev))
+				{
+					return;
+				}
+			}
+
+			//
+			// The output is flushed once per batch, or once per line with
+			// --unbuffered
+			//
+			cout << ctx->m_line;
+			if(!ctx->m_json)
+			{
+				cout << '\n';
+			}
+
+			if(ctx->m_do_flush)
+			{
+				cout << flush;
+			}
+		}
+	}
+}
+
 //
 // Event processing loop
 //
@@ -521,53 +710,74 @@ captureinfo do_inspect(sinsp* inspector,
 {
 	captureinfo retval;
 	int32_t res;
-	sinsp_evt* ev;
-	string line;
-	double last_printed_progress_pct = 0;
-	int duration_start = 0;
+	sinsp_evt_batch batch;
+	inspect_context ctx;
 
 	if(json)
 	{
 		do_flush = true;
 	}
 
+	ctx.m_inspector = inspector;
+	ctx.m_quiet = quiet;
+	ctx.m_json = json;
+	ctx.m_print_progress = print_progress;
+	ctx.m_display_filter = display_filter;
+	ctx.m_summary_table = summary_table;
+	ctx.m_formatter = formatter;
+	ctx.m_do_flush = do_flush;
+	ctx.m_duration_to_tot = duration_to_tot;
+	ctx.m_last_printed_progress_pct = 0;
+
 	//
-	// Loop through the events
+	// Loop through the events, one batch at a time
 	//
-	duration_start = ((double)clock()) / CLOCKS_PER_SEC;
+	ctx.m_duration_start = ((double)clock()) / CLOCKS_PER_SEC;
 	while(1)
 	{
-		if(duration_to_tot > 0)
-		{
-			int duration_tot = ((double)clock()) / CLOCKS_PER_SEC - duration_start;
-			if(duration_tot >= duration_to_tot)
-			{
-				handle_end_of_file(print_progress, formatter);
-				break;
-			}
-		}
-		if(retval.m_nevts == cnt || g_terminate)
+		if(retval.m_nevts == cnt || capture_over(&ctx))
 		{
 			//
-			// End of capture, either because the user stopped it, or because
-			// we reached the event count specified with -n.
+			// End of capture, either because the user stopped it, because the
+			// time given with -M is over, or because we reached the event
+			// count specified with -n.
 			//
 			handle_end_of_file(print_progress, formatter);
 			break;
 		}
-		res = inspector->next(&ev);
 
-		if(res == SCAP_TIMEOUT)
+		//
+		// Never go past the event count specified with -n
+		//
+		uint64_t max_evts = cnt - retval.m_nevts;
+		if(max_evts > UINT32_MAX)
+		{
+			max_evts = UINT32_MAX;
+		}
+
+		res = inspector->next_batch((uint32_t)max_evts, &batch);
+
+		if(res == SCAP_SUCCESS)
 		{
-			if(ev != NULL && ev->is_filtered_out())
+			for(sinsp_evt* ev : batch)
 			{
+				process_evt(ev, &ctx);
+
 				//
-				// The event has been dropped by the filtering system.
-				// Give the chisels a chance to run their timeout logic.
+				// Stop the batch here if the capture is over
 				//
-				chisels_do_timeout(ev);
+				if(capture_over(&ctx))
+				{
+					break;
+				}
 			}
 
+			retval.m_nevts += batch.get_nevts();
+			res = batch.get_result();
+		}
+
+		if(res == SCAP_TIMEOUT)
+		{
 			continue;
 		}
 		else if(res == SCAP_EOF)
@@ -586,105 +796,7 @@ captureinfo do_inspect(sinsp* inspector,
 			throw sinsp_exception(inspector->getlasterr().c_str());
 		}
 
-		retval.m_nevts++;
-
-		if(print_progress)
-		{
-			if(ev->get_num() % 10000 == 0)
-			{
-				double progress_pct = inspector->get_read_progress();
-
-				if(progress_pct - last_printed_progress_pct > 0.1)
-				{
-					fprintf(stderr, "%.2lf\n", progress_pct);
-					fflush(stderr);
-					last_printed_progress_pct = progress_pct;
-				}
-			}
-		}
-
-		//
-		// If there are chisels to run, run them
-		//
-#ifdef HAS_CHISELS
-		if(!g_chisels.empty())
-		{
-			for(vector<sinsp_chisel*>::iterator it = g_chisels.begin(); it != g_chisels.end(); ++it)
-			{
-				if((*it)->run(ev) == false)
-				{
-					continue;
-				}
-			}
-		}
-		else
-#endif
-		{
-			//
-			// If we're supposed to summarize, increase the count for this event
-			//
-			if(summary_table != NULL)
-			{
-				uint16_t etype = ev->get_type();
-
-				if(etype == PPME_GENERIC_E)
-				{
-					sinsp_evt_param *parinfo = ev->get_param(0);
-					uint16_t id = *(int16_t *)parinfo->m_val;
-					((*summary_table)[PPM_EVENT_MAX + id * 2]).m_ncalls++;
-				}
-				else if(etype == PPME_GENERIC_X)
-				{
-					sinsp_evt_param *parinfo = ev->get_param(0);
-					uint16_t id = *(int16_t *)parinfo->m_val;
-					((*summary_table)[PPM_EVENT_MAX + id * 2 + 1]).m_ncalls++;
-				}
-				else
-				{
-					((*summary_table)[etype]).m_ncalls++;
-				}
-			}
-
-			//
-			// When the quiet flag is specified, we don't do any kind of processing other
-			// than counting the events.
-			//
-			if(quiet)
-			{
-				continue;
-			}
-
-			if(!inspector->is_debug_enabled() &&
-				ev->get_category() & EC_INTERNAL)
-			{
-				continue;
-			}
-
-			if(formatter->tostring(ev, &line))
-			{
-				//
-				// Output the line
-				//
-				if(display_filter)
-				{
-					if(!display_filter->run(ev))
-					{
-						continue;
-					}
-				}
-
-				cout << line;
-				if(!json)
-				{
-					cout << endl;
-				}
-			}
-		}
-
-		if(do_flush)
-		{
-			cout << flush;
-		}
+		cout << flush;
 	}
 
 	return retval;
@@ -707,7 +819,10 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 	bool list_flds = false;
 	bool list_flds_markdown = false;
 	bool print_progress = false;
-	bool compress = false;
+	compression_mode compress = SCAP_COMPRESSION_NONE;
+	int32_t compression_level = 0;
+	bool async_write = false;
+	scap_wait_params wait_params;
 	sinsp_evt::param_fmt event_buffer_format = sinsp_evt::PF_NORMAL;
 	sinsp_filter* display_filter = NULL;
 	double duration = 1;
@@ -721,6 +836,8 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 	bool jflag = false;
 	bool unbuf_flag = false;
 	bool filter_proclist_flag = false;
+	bool explain_filter_flag = false;
+	bool driver_filter_flag = false;
 	string cname;
 	vector<summary_table_entry>* summary_table = NULL;
 	string* k8s_api = 0;
@@ -737,6 +854,7 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 	static struct option long_options[] =
 	{
 		{"print-ascii", no_argument, 0, 'A' },
+		{"async-write", no_argument, 0, 0 },
 		{"print-base64", no_argument, 0, 'b' },
 #ifdef HAS_CHISELS
 		{"chisel", required_argument, 0, 'c' },
@@ -746,6 +864,8 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 		{"debug", no_argument, 0, 'D'},
 		{"exclude-users", no_argument, 0, 'E' },
 		{"event-limit", required_argument, 0, 'e'},
+		{"explain-filter", no_argument, 0, 0 },
+		{"driver-filter", no_argument, 0, 0 },
 		{"fatfile", no_argument, 0, 'F'},
 		{"filter-proclist", no_argument, 0, 0 },
 		{"seconds", required_argument, 0, 'G' },
@@ -757,6 +877,8 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 		{"json", no_argument, 0, 'j' },
 		{"k8s-api", required_argument, 0, 'k'},
 		{"k8s-api-cert", required_argument, 0, 'K' },
+		{"fast-read", no_argument, 0, 0 },
+		{"lazy-fds", no_argument, 0, 0 },
 		{"list", no_argument, 0, 'l' },
 		{"list-events", no_argument, 0, 'L' },
 		{"list-markdown", no_argument, 0, 0 },
@@ -766,6 +888,8 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 		{"print", required_argument, 0, 'p' },
 		{"quiet", no_argument, 0, 'q' },
 		{"readfile", required_argument, 0, 'r' },
+		{"seekable", no_argument, 0, 0 },
+		{"compression-level", required_argument, 0, 0 },
 		{"snaplen", required_argument, 0, 's' },
 		{"summary", no_argument, 0, 'S' },
 		{"timetype", required_argument, 0, 't' },
@@ -773,6 +897,7 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 		{"unbuffered", no_argument, 0, 0 },
 		{"verbose", no_argument, 0, 'v' },
 		{"version", no_argument, 0, 0 },
+		{"wait-policy", required_argument, 0, 0 },
 		{"writefile", required_argument, 0, 'w' },
 		{"limit", required_argument, 0, 'W' },
 		{"print-hex", no_argument, 0, 'x'},
@@ -783,6 +908,8 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 
 	output_format = "*%evt.num %evt.outputtime %evt.cpu %proc.name (%thread.tid) %evt.dir %evt.type %evt.info";
 
+	memset(&wait_params, 0, sizeof(wait_params));
+
 	try
 	{
 		inspector = new sinsp();
@@ -1121,7 +1248,7 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 				event_buffer_format = sinsp_evt::PF_HEXASCII;
 				break;
 			case 'z':
-				compress = true;
+				compress = SCAP_COMPRESSION_GZIP;
 				break;
             // getopt_long : '?' for an ambiguous match or an extraneous parameter 
 			case '?':
@@ -1149,6 +1276,75 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 				filter_proclist_flag = true;
 			}
 
+			if(string(long_options[long_index].name) == "explain-filter")
+			{
+				explain_filter_flag = true;
+			}
+
+			if(string(long_options[long_index].name) == "driver-filter")
+			{
+				driver_filter_flag = true;
+			}
+
+			if(string(long_options[long_index].name) == "fast-read")
+			{
+				inspector->set_offline_read_options(true, true);
+			}
+
+			if(string(long_options[long_index].name) == "lazy-fds")
+			{
+				inspector->set_lazy_fd_import(true);
+			}
+
+			if(string(long_options[long_index].name) == "seekable")
+			{
+				compress = SCAP_COMPRESSION_CHUNKED;
+			}
+
+			if(string(long_options[long_index].name) == "async-write")
+			{
+				async_write = true;
+			}
+
+			if(string(long_options[long_index].name) == "compression-level")
+			{
+				compression_level = sinsp_numparser::parsed32(optarg);
+				if(compression_level < 0 || compression_level > 9)
+				{
+					fprintf(stderr, "invalid compression level %s, must be between 0 and 9\n", optarg);
+					delete inspector;
+					return sysdig_init_res(EXIT_FAILURE);
+				}
+			}
+
+			if(string(long_options[long_index].name) == "wait-policy")
+			{
+				string policy = optarg;
+
+				if(policy == "fixed")
+				{
+					wait_params.policy = SCAP_WAIT_FIXED;
+				}
+				else if(policy == "busy")
+				{
+					wait_params.policy = SCAP_WAIT_BUSY_POLL;
+				}
+				else if(policy == "backoff")
+				{
+					wait_params.policy = SCAP_WAIT_BACKOFF;
+				}
+				else if(policy == "watermark")
+				{
+					wait_params.policy = SCAP_WAIT_WATERMARK;
+				}
+				else
+				{
+					fprintf(stderr, "invalid wait policy %s, must be fixed, busy, backoff or watermark\n", optarg);
+					delete inspector;
+					return sysdig_init_res(EXIT_FAILURE);
+				}
+			}
+
 			if(string(long_options[long_index].name) == "list-markdown")
 			{
 				list_flds = true;
@@ -1225,6 +1421,18 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 				}
 			}
 
+			if(explain_filter_flag)
+			{
+				sinsp_filter_compiler compiler(inspector, filter);
+				sinsp_filter* explained_filter = compiler.compile();
+
+				printf("%s", explained_filter->explain().c_str());
+				delete explained_filter;
+
+				res.m_res = EXIT_SUCCESS;
+				goto exit;
+			}
+
 			if(is_filter_display)
 			{
 				sinsp_filter_compiler compiler(inspector, filter);
@@ -1236,6 +1444,12 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 			goto exit;
 #endif
 		}
+		else if(explain_filter_flag)
+		{
+			fprintf(stderr, "you must specify a filter if you use --explain-filter.\n");
+			res.m_res = EXIT_FAILURE;
+			goto exit;
+		}
 
 		if(signal(SIGINT, signal_callback) == SIG_ERR)
 		{
@@ -1333,7 +1547,7 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 
 				try
 				{
-					inspector->open("");
+					inspector->open(SCAP_TIMEOUT_MS, &wait_params);
 				}
 				catch(sinsp_exception e)
 				{
@@ -1353,7 +1567,7 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 						fprintf(stderr, "Unable to load the driver\n");
 					}
 
-					inspector->open("");
+					inspector->open(SCAP_TIMEOUT_MS, &wait_params);
 				}
 #else
 				//
@@ -1367,6 +1581,17 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 				// Enable gathering the CPU from the kernel module
 				//
 				inspector->set_get_procs_cpu_from_driver(true);
+
+#ifdef HAS_FILTERING
+				//
+				// Let the driver drop the events that the filter would drop
+				// anyway
+				//
+				if(driver_filter_flag)
+				{
+					inspector->set_eventmask_from_filter();
+				}
+#endif
 			}
 
 			//
@@ -1389,6 +1614,7 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 
 			if(outfile != "")
 			{
+				inspector->set_dump_options(compression_level, async_write);
 				inspector->setup_cycle_writer(outfile, rollover_mb, duration_seconds, file_limit, event_limit, compress);
 				inspector->autodump_next_file();
 			}
@@ -1477,6 +1703,26 @@ sysdig_init_res sysdig_init(int argc, char **argv)
 					cstats.n_evts,
 					cstats.n_drops);
 
+				fprintf(stderr, "Reader Waits:%" PRIu64 ", Wait Time:%.3lf ms, Max Wait:%.3lf ms, Drops During Waits:%" PRIu64 "\n",
+					cstats.n_waits,
+					(double)cstats.wait_ns / 1000000,
+					(double)cstats.max_wait_ns / 1000000,
+					cstats.n_drops_during_wait);
+
+				if(outfile != "")
+				{
+					sinsp_dump_stats dstats;
+					inspector->get_dump_stats(&dstats);
+
+					fprintf(stderr, "Dumped Events:%" PRIu64 ", Files:%" PRIu64 ", Max Queue Depth:%" PRIu64 "/%" PRIu64 " bytes, Queue Stalls:%" PRIu64 ", Stall Time:%.3lf ms\n",
+						dstats.m_n_evts,
+						dstats.m_n_files,
+						dstats.m_max_queue_depth,
+						dstats.m_queue_size,
+						dstats.m_n_stalls,
+						(double)dstats.m_stall_ns / 1000000);
+				}
+
 				fprintf(stderr, "Elapsed time: %.3lf, Captured Events: %" PRIu64 ", %.2lf eps\n",
 					duration,
 					cinfo.m_nevts,